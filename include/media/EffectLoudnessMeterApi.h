@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EFFECTLOUDNESSMETERAPI_H_
+#define ANDROID_EFFECTLOUDNESSMETERAPI_H_
+
+#include <stdint.h>
+#include <hardware/audio_effect.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/////////////////////////////////////////////////
+//      Loudness meter effect
+/////////////////////////////////////////////////
+
+// The loudness meter measures the loudness of the stream it is inserted on as specified by
+// ITU-R BS.1770 (K-weighting, 400 ms momentary and 3 s short-term windows, gated integrated
+// loudness). It does not modify the audio.
+
+#ifndef OPENSL_ES_H_
+static const effect_uuid_t SL_IID_LOUDNESSMETER_ = { 0x8616f54b, 0xd0fb, 0x43cb, 0xaf35,
+        { 0xe2, 0xd5, 0xaa, 0x9e, 0x80, 0x6f } };
+const effect_uuid_t * const SL_IID_LOUDNESSMETER = &SL_IID_LOUDNESSMETER_;
+#endif //OPENSL_ES_H_
+
+// All loudness values are in hundredths of LU relative to full scale (LUFS * 100), and
+// LOUDNESS_METER_SILENCE_CLUFS until the measurement window is filled or when everything was
+// gated out. The peak is the sample peak in mB relative to full scale.
+#define LOUDNESS_METER_SILENCE_CLUFS      -9600
+
+// enumerated parameters for the loudness meter effect, all of them are read only
+typedef enum
+{
+    LOUDNESS_METER_PARAM_MOMENTARY,       // loudness of the last 400 ms, int32_t
+    LOUDNESS_METER_PARAM_SHORT_TERM,      // loudness of the last 3 s, int32_t
+    LOUDNESS_METER_PARAM_INTEGRATED,      // gated loudness since the last reset, int32_t
+    LOUDNESS_METER_PARAM_PEAK,            // sample peak since the last reset, int32_t
+    LOUDNESS_METER_PARAM_MEASUREMENTS,    // all of the above, loudness_meter_measurements_t
+} t_loudness_meter_params;
+
+typedef struct loudness_meter_measurements_s {
+    int32_t momentaryClufs;
+    int32_t shortTermClufs;
+    int32_t integratedClufs;
+    int32_t peakMb;
+    uint32_t durationMs;    // duration of the audio measured since the last reset
+} loudness_meter_measurements_t;
+
+#if __cplusplus
+}  // extern "C"
+#endif
+
+#endif /*ANDROID_EFFECTLOUDNESSMETERAPI_H_*/
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EFFECTVISUALIZERAPI_H_
+#define ANDROID_EFFECTVISUALIZERAPI_H_
+
+#include <stdint.h>
+#include <audio_effects/effect_visualizer.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/////////////////////////////////////////////////
+//      Visualizer spectrum and measurement batch extensions
+/////////////////////////////////////////////////
+
+// Parameters and commands understood by the platform visualizer in addition to those of
+// effect_visualizer.h. They are numbered well above the standard ones so that both sets can
+// grow independently.
+
+// Spectrum size in samples: 0 (spectrum disabled, the default) or a power of 2 in the range
+// [VISUALIZER_CAPTURE_SIZE_MIN, VISUALIZER_CAPTURE_SIZE_MAX].
+// The effect only keeps the history needed for spectra while the size is not 0.
+#define VISUALIZER_PARAM_SPECTRUM_SIZE    0x100
+// Window applied before the FFT, one of VISUALIZER_WINDOW_xxx.
+#define VISUALIZER_PARAM_SPECTRUM_WINDOW  0x101
+
+#define VISUALIZER_WINDOW_RECTANGULAR     0
+#define VISUALIZER_WINDOW_HANN            1    // default
+#define VISUALIZER_WINDOW_HAMMING         2
+#define VISUALIZER_WINDOW_BLACKMAN        3
+
+// Returns the magnitude spectrum of the last spectrum size mono samples as played, latency
+// compensated like VISUALIZER_CMD_CAPTURE.
+// The reply is VISUALIZER_SPECTRUM_BINS(size) floats, from DC to the Nyquist frequency, scaled
+// so that a full scale sine wave at the center of a bin has a magnitude of 1.0.
+#define VISUALIZER_CMD_SPECTRUM           (EFFECT_CMD_FIRST_PROPRIETARY + 0x100)
+#define VISUALIZER_SPECTRUM_BINS(size)    ((size) / 2 + 1)
+
+// Returns the peak and RMS of each buffer processed since the previous
+// VISUALIZER_CMD_MEASURE_BATCH, oldest first, as an array of visualizer_measurement_t.
+// MEASUREMENT_MODE_PEAK_RMS must be set. *replySize is the size of the reply buffer on input,
+// and the size of the measurements returned on output; when more measurements are pending than
+// fit in the reply buffer, or than the effect keeps, the oldest ones are dropped.
+#define VISUALIZER_CMD_MEASURE_BATCH      (EFFECT_CMD_FIRST_PROPRIETARY + 0x101)
+
+// maximum number of measurements returned by one VISUALIZER_CMD_MEASURE_BATCH
+#define VISUALIZER_MEASURE_BATCH_MAX      64
+
+typedef struct visualizer_measurement_s {
+    int32_t peakMb;         // peak of the buffer in mB, -9600 for silence
+    int32_t rmsMb;          // RMS of the buffer in mB, -9600 for silence
+    uint32_t frameCount;    // number of frames in the buffer
+} visualizer_measurement_t;
+
+#if __cplusplus
+}  // extern "C"
+#endif
+
+#endif /*ANDROID_EFFECTVISUALIZERAPI_H_*/
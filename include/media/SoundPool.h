@@ -33,6 +33,7 @@ static const int IDLE_PRIORITY = -1;
 class SoundEvent;
 class SoundPoolThread;
 class SoundPool;
+class SampleData;
 
 // for queued events
 class SoundPoolEvent {
@@ -75,6 +76,7 @@ public:
 private:
     void init();
 
+    sp<SampleData>      mSampleData;    // decoded PCM, possibly shared with other samples
     size_t              mSize;
     volatile int32_t    mRefCount;
     uint16_t            mSampleID;
@@ -169,6 +171,7 @@ class SoundPool {
 public:
     SoundPool(int maxChannels, const audio_attributes_t* pAttributes);
     ~SoundPool();
+    // Samples are decoded in the background, in decreasing order of priority.
     int load(const char* url, int priority);
     int load(int fd, int64_t offset, int64_t length, int priority);
     bool unload(int sampleID);
@@ -198,7 +201,7 @@ public:
 private:
     SoundPool() {} // no default constructor
     bool startThreads();
-    void doLoad(sp<Sample>& sample);
+    void doLoad(sp<Sample>& sample, int priority);
     sp<Sample> findSample(int sampleID) { return mSamples.valueFor(sampleID); }
     SoundChannel* findChannel (int channelID);
     SoundChannel* findNextChannel (int channelID);
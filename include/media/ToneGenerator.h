@@ -163,6 +163,7 @@ public:
     int getSessionId() { return (mpAudioTrack == 0) ? 0 : mpAudioTrack->getSessionId(); }
 
 private:
+    friend class ToneGeneratorTest; // checks the WaveGenerator output against sin()
 
     enum tone_state {
         TONE_IDLE,  // ToneGenerator is being initialized or initialization failed
@@ -280,7 +281,10 @@ private:
     void clearWaveGens();
     tone_type getToneForRegion(tone_type toneType);
 
-    // WaveGenerator generates a single sine wave
+    // WaveGenerator generates a single sine wave.
+    // The samples are read from a sine table shared by all generators, with a phase accumulator
+    // per generator, so that the cost per sample does not depend on a recurrence on the previous
+    // samples and the frequency is exact to within a few micro hertz.
     class WaveGenerator {
     public:
         enum gen_command {
@@ -298,13 +302,21 @@ private:
 
     private:
         static const short GEN_AMP = 32000;  // amplitude of generator
-        static const short S_Q14 = 14;  // shift for Q14
         static const short S_Q15 = 15;  // shift for Q15
 
-        short mA1_Q14;  // Q14 coefficient
-        // delay line of full amplitude generator
-        short mS1, mS2;  // delay line S2 oldest
-        short mS2_0;  // saved value for reinitialisation
+        // One period of GEN_AMP * sin() in SINE_TABLE_SIZE points, plus a guard point for the
+        // linear interpolation. The generated samples are within 4 LSB of the exact sine.
+        static const int SINE_TABLE_BITS = 10;
+        static const int SINE_TABLE_SIZE = 1 << SINE_TABLE_BITS;
+        static short sSineTable[SINE_TABLE_SIZE + 1];
+        static pthread_once_t sSineTableOnce;
+        static void initSineTable();
+
+        // returns the sample at this phase, in Q32 fractions of a period
+        static inline int sineAt(uint32_t phase);
+
+        uint32_t mPhase;  // phase of the last sample generated, Q32 fraction of a period
+        uint32_t mPhaseIncrement;  // frequency / samplingRate in Q32
         short mAmplitude_Q15;  // Q15 amplitude
     };
 
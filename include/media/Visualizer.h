@@ -19,6 +19,7 @@
 
 #include <media/AudioEffect.h>
 #include <audio_effects/effect_visualizer.h>
+#include <media/EffectVisualizerApi.h>
 #include <utils/Thread.h>
 
 /**
@@ -34,12 +35,15 @@
  * Two types of representation of audio content can be captured:
  * - Waveform data: consecutive 8-bit (unsigned) mono samples by using the getWaveForm() method
  * - Frequency data: 8-bit magnitude FFT by using the getFft() method
+ * - Spectrum data: float magnitudes computed by the effect by using the getSpectrum() method
  *
  * The length of the capture can be retrieved or specified by calling respectively
  * getCaptureSize() and setCaptureSize() methods. Note that the size of the FFT
  * is half of the specified capture size but both sides of the spectrum are returned yielding in a
  * number of bytes equal to the capture size. The capture size must be a power of 2 in the range
  * returned by getMinCaptureSize() and getMaxCaptureSize().
+ * Spectra are computed by the effect from 16-bit audio, independently of the capture. Their size
+ * and window are set with setSpectrumSize() and setSpectrumWindow().
  * In addition to the polling capture mode, a callback mode is also available by installing a
  * callback function by use of the setCaptureCallBack() method. The rate at which the callback
  * is called as well as the type of data returned is specified.
@@ -122,6 +126,20 @@ public:
     // return a set of int32_t measurements
     status_t getIntMeasurements(uint32_t type, uint32_t number, int32_t *measurements);
 
+    // return the peak and RMS of each buffer processed since the previous call, oldest first.
+    // count is the capacity of measurements on input, and the number of measurements returned
+    // on output. Requires MEASUREMENT_MODE_PEAK_RMS.
+    status_t getMeasurementBatch(visualizer_measurement_t *measurements, uint32_t *count);
+
+    // set the spectrum size: 0 to disable spectra, or a power of two in the range
+    // [VISUALIZER_CAPTURE_SIZE_MIN, VISUALIZER_CAPTURE_SIZE_MAX]
+    status_t setSpectrumSize(uint32_t size);
+    uint32_t getSpectrumSize() { return mSpectrumSize; }
+
+    // set the window applied before computing spectra, one of VISUALIZER_WINDOW_xxx
+    status_t setSpectrumWindow(uint32_t window);
+    uint32_t getSpectrumWindow() { return mSpectrumWindow; }
+
     // return a capture in PCM 8 bit unsigned format. The size of the capture is equal to
     // getCaptureSize()
     status_t getWaveForm(uint8_t *waveform);
@@ -131,6 +149,11 @@ public:
     // are returned
     status_t getFft(uint8_t *fft);
 
+    // return the magnitude spectrum computed by the effect, VISUALIZER_SPECTRUM_BINS(
+    // getSpectrumSize()) floats from DC to the Nyquist frequency. A full scale sine wave has a
+    // magnitude of 1.0.
+    status_t getSpectrum(float *magnitudes);
+
 protected:
     // from IEffectClient
     virtual void controlStatusChanged(bool controlGranted);
@@ -156,6 +179,7 @@ private:
     };
 
     status_t doFft(uint8_t *fft, uint8_t *waveform);
+    status_t setSpectrumParameter(uint32_t param, uint32_t value);
     void periodicCapture();
     uint32_t initCaptureSize();
 
@@ -165,6 +189,8 @@ private:
     uint32_t mSampleRate;
     uint32_t mScalingMode;
     uint32_t mMeasurementMode;
+    uint32_t mSpectrumSize;
+    uint32_t mSpectrumWindow;
     capture_cbk_t mCaptureCallBack;
     void *mCaptureCbkUser;
     sp<CaptureThread> mCaptureThread;
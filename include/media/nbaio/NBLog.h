@@ -40,8 +40,14 @@ enum Event {
     EVENT_RESERVED,
     EVENT_STRING,               // ASCII string, not NUL-terminated
     EVENT_TIMESTAMP,            // clock_gettime(CLOCK_MONOTONIC)
+    EVENT_BINARY,               // format id, CLOCK_MONOTONIC nanoseconds, raw arguments
 };
 
+// limits of the format table used by binary records
+static const size_t kMaxFormats = 16;       // format strings per shared memory region
+static const size_t kMaxFormatLength = 64;  // including the terminating NUL
+static const size_t kMaxFormatArgs = 7;     // arguments per format string
+
 // ---------------------------------------------------------------------------
 
 // representation of a single log entry in private memory
@@ -50,7 +56,8 @@ struct Entry {
         : mEvent(event), mLength(length), mData(data) { }
     /*virtual*/ ~Entry() { }
 
-    int     readAt(size_t offset) const;
+    // serializes the entry in its shared memory representation, returns number of bytes
+    size_t  copyTo(uint8_t *buffer) const;
 
 private:
     friend class Writer;
@@ -69,13 +76,27 @@ private:
 //  byte[2+mLength-1]   mData[mLength-1]
 //  byte[2+mLength]     duplicate copy of mLength to permit reverse scan
 //  byte[3+mLength]     start of next log entry
+//
+// mData of an EVENT_BINARY entry
+//  byte[0]             format id, index in Shared::mFormats
+//  byte[1..8]          int64_t CLOCK_MONOTONIC time in nanoseconds
+//  byte[9]...          arguments packed as described by Format::mSignature
+
+// format string of binary records, located in shared memory
+struct Format {
+    char    mSignature[kMaxFormatArgs + 1]; // one character per argument, NUL-terminated:
+                                            // 'i' int32_t, 'I' int64_t, 'd' double
+    char    mFormat[kMaxFormatLength];      // printf format, NUL-terminated
+};
 
 // located in shared memory
 struct Shared {
-    Shared() : mRear(0) { }
+    Shared() : mRear(0), mFormatCount(0) { }
     /*virtual*/ ~Shared() { }
 
     volatile int32_t mRear;     // index one byte past the end of most recent Entry
+    volatile int32_t mFormatCount; // number of claimed entries in mFormats, may exceed kMaxFormats
+    Format  mFormats[kMaxFormats]; // format strings referenced by EVENT_BINARY entries
     char    mBuffer[0];         // circular buffer for entries
 };
 
@@ -109,8 +130,10 @@ private:
 
 // ---------------------------------------------------------------------------
 
-// Writer is thread-safe with respect to Reader, but not with respect to multiple threads
-// calling Writer methods.  If you need multi-thread safety for writing, use LockedWriter.
+// NBLog is single-producer: each thread that logs has its own Writer and shared memory,
+// as allocated by AudioFlinger::newWriter_l(), and the media.log service dumps each of them.
+// Writer is thread-safe with respect to Reader, and never waits for it or for other threads,
+// but is not thread-safe with respect to other Writers on the same shared memory.
 class Writer : public RefBase {
 public:
     Writer();                   // dummy nop implementation without shared memory
@@ -128,6 +151,16 @@ public:
     virtual void    logTimestamp();
     virtual void    logTimestamp(const struct timespec& ts);
 
+    // Binary records defer formatting to the Reader: only the format id, a timestamp and the
+    // raw arguments are logged, which is much cheaper than logf() on time-critical threads.
+    // registerFormat() is called once per format string, e.g. at thread start, and returns
+    // the id to pass to logb(), or a negative errno if the format table is full or the format
+    // is not supported.  Supported conversions are integer (including 'h', 'l', 'll', 'z',
+    // 'j' and 't' length modifiers), floating point and '%%'; '%s', '%p', '%n' and '*' are not.
+    virtual int     registerFormat(const char *fmt);
+    virtual void    logb(int formatId, ...);
+    virtual void    logvb(int formatId, va_list ap);
+
     virtual bool    isEnabled() const;
 
     // return value for all of these is the previous isEnabled()
@@ -150,7 +183,8 @@ private:
 
 // ---------------------------------------------------------------------------
 
-// Similar to Writer, but safe for multiple threads to call concurrently
+// Similar to Writer, but safe for multiple concurrent threads to call the same Writer.
+// Not for time-critical threads, which should have their own Writer.
 class LockedWriter : public Writer {
 public:
     LockedWriter();
@@ -161,6 +195,9 @@ public:
     virtual void    logvf(const char *fmt, va_list ap);
     virtual void    logTimestamp();
     virtual void    logTimestamp(const struct timespec& ts);
+    virtual int     registerFormat(const char *fmt);
+    virtual void    logb(int formatId, ...);
+    virtual void    logvb(int formatId, va_list ap);
 
     virtual bool    isEnabled() const;
     virtual bool    setEnabled(bool enabled);
@@ -193,6 +230,7 @@ private:
     int     mIndent;            // indentation level
 
     void    dumpLine(const String8& timestamp, String8& body);
+    void    dumpBinary(String8& body, const uint8_t *data, size_t length);
 
     static const size_t kSquashTimestamp = 5; // squash this many or more adjacent timestamps
 };
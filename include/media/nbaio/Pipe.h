@@ -56,12 +56,21 @@ public:
     virtual ssize_t write(const void *buffer, size_t count);
     //virtual ssize_t writeVia(writeVia_t via, size_t total, void *user, size_t block);
 
+    // FIXME assumes 64 byte cache lines; used to keep the writer and reader indices apart.
+    static const size_t kCacheLineSize = 64;
+
 private:
     const size_t    mMaxFrames;     // always a power of 2
     void * const    mBuffer;
-    volatile int32_t mRear;         // written by android_atomic_release_store
     volatile int32_t mReaders;      // number of PipeReader clients currently attached to this Pipe
     const bool      mFreeBufferInDestructor;
+
+    // mRear is stored by the writer on every write() and loaded by every reader, so it is kept on
+    // its own cache line, away from the base class counters that write() also updates and from
+    // whatever is allocated after the Pipe. The readers keep their own copies of the fields above.
+    char            mPadBeforeRear[kCacheLineSize];
+    volatile int32_t mRear;         // written by android_atomic_release_store
+    char            mPadAfterRear[kCacheLineSize - sizeof(int32_t)];
 };
 
 }   // namespace android
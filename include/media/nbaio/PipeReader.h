@@ -47,17 +47,48 @@ public:
 
     virtual ssize_t read(void *buffer, size_t count, int64_t readPTS);
 
+    // Passes the unread frames to via() directly from the pipe buffer, without an intermediate
+    // copy. As with read(), an overrun during via() is silently ignored but caught at next read.
+    virtual ssize_t readVia(readVia_t via, size_t total, void *user,
+                            int64_t readPTS, size_t block = 0);
+
     // NBAIO_Source end
 
+    // A contiguous run of frames in the pipe buffer.
+    struct Region {
+        const void *mData;
+        size_t      mFrameCount;
+    };
+
+    // Zero-copy read: describes up to 'count' unread frames as at most two contiguous regions of
+    // the pipe buffer, in order, without consuming them. The second region is empty unless the
+    // frames wrap around the end of the buffer.
+    // Returns the total number of frames in the regions, or a negative status as for
+    // availableToRead(), in which case both regions are empty.
+    // The regions stay valid until the writer overwrites them, that is until it gets more than
+    // roundup(maxFrames) frames ahead of them; as with read(), such an overrun is silently
+    // ignored until the next call, so the caller should not hold on to the regions.
+    ssize_t peek(Region regions[2], size_t count);
+
+    // Consumes 'count' frames, at most the number of frames returned by the last peek() and not
+    // yet consumed. A larger count is a caller bug and is fatal, as it would skip unread frames.
+    void advance(size_t count);
+
 #if 0   // until necessary
     Pipe& pipe() const { return mPipe; }
 #endif
 
 private:
     Pipe&       mPipe;
+    const size_t mMaxFrames;    // copy of mPipe.mMaxFrames, so read() doesn't touch the Pipe
+    const void * const mBuffer; // copy of mPipe.mBuffer
     int32_t     mFront;         // follows behind mPipe.mRear
+    size_t      mPeeked;        // frames returned by the last peek() and not yet advance()d
     size_t      mFramesOverrun;
     size_t      mOverruns;
+    // readers normally run on different threads, so keep mFront off a cache line shared with
+    // whatever is allocated after this PipeReader
+    char        mPadAfterFront[Pipe::kCacheLineSize];
 };
 
 }   // namespace android
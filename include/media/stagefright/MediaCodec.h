@@ -50,6 +50,21 @@ struct MediaCodec : public AHandler {
         CB_OUTPUT_AVAILABLE = 2,
         CB_ERROR = 3,
         CB_OUTPUT_FORMAT_CHANGED = 4,
+        // Sent instead of CB_INPUT_AVAILABLE and CB_OUTPUT_AVAILABLE when the callback was set
+        // with coalesceBuffers, for all the buffers that became available while the codec
+        // looper was busy: "count" buffers, in "indices" as int32_t and in "buffers" as
+        // BufferDescriptor.
+        CB_INPUT_BUFFERS_AVAILABLE = 5,
+        CB_OUTPUT_BUFFERS_AVAILABLE = 6,
+    };
+
+    // An input buffer to queue or an output buffer that was dequeued, for the batched calls.
+    struct BufferDescriptor {
+        size_t mIndex;
+        size_t mOffset;
+        size_t mSize;
+        int64_t mPresentationTimeUs;
+        uint32_t mFlags;
     };
 
     struct BatteryNotifier;
@@ -66,7 +81,7 @@ struct MediaCodec : public AHandler {
             const sp<ICrypto> &crypto,
             uint32_t flags);
 
-    status_t setCallback(const sp<AMessage> &callback);
+    status_t setCallback(const sp<AMessage> &callback, bool coalesceBuffers = false);
 
     status_t createInputSurface(sp<IGraphicBufferProducer>* bufferProducer);
 
@@ -120,6 +135,26 @@ struct MediaCodec : public AHandler {
     status_t renderOutputBufferAndRelease(size_t index);
     status_t releaseOutputBuffer(size_t index);
 
+    // Batched variants of the calls above, which take a single round trip to the codec looper
+    // for all the buffers. queueInputBuffers() and releaseOutputBuffers() stop at the first
+    // buffer that fails and return its error, *count is the number of buffers that were
+    // processed before it, and *errorDetailMsg describes a decryption error of that buffer.
+    // The dequeue calls wait up to timeoutUs for the first buffer, and then return all the
+    // available buffers, at most maxCount.
+    status_t queueInputBuffers(
+            const BufferDescriptor *buffers, size_t numBuffers, size_t *count,
+            AString *errorDetailMsg = NULL);
+
+    status_t dequeueInputBuffers(
+            size_t *indices, size_t maxCount, size_t *count, int64_t timeoutUs = 0ll);
+
+    status_t dequeueOutputBuffers(
+            BufferDescriptor *buffers, size_t maxCount, size_t *count,
+            int64_t timeoutUs = 0ll);
+
+    status_t releaseOutputBuffers(
+            const size_t *indices, size_t numIndices, bool render, size_t *count);
+
     status_t signalEndOfInputStream();
 
     status_t getOutputFormat(sp<AMessage> *format) const;
@@ -191,6 +226,11 @@ private:
         kWhatGetName                        = 'getN',
         kWhatSetParameters                  = 'setP',
         kWhatSetCallback                    = 'setC',
+        kWhatQueueInputBuffers              = 'qInB',
+        kWhatDequeueInputBuffers            = 'dInB',
+        kWhatDequeueOutputBuffers           = 'dOuB',
+        kWhatReleaseOutputBuffers           = 'rOuB',
+        kWhatPostCoalescedCallbacks         = 'pCoC',
     };
 
     enum {
@@ -206,6 +246,8 @@ private:
         kFlagGatherCodecSpecificData    = 512,
         kFlagIsAsync                    = 1024,
         kFlagIsComponentAllocated       = 2048,
+        kFlagCoalesceCallbacks          = 4096,
+        kFlagCoalescedCallbacksPending  = 8192,
     };
 
     struct BufferInfo {
@@ -254,6 +296,12 @@ private:
     int32_t mDequeueOutputTimeoutGeneration;
     uint32_t mDequeueOutputReplyID;
 
+    // caller arrays of the pending batched dequeue requests, NULL for the single ones
+    size_t *mDequeueInputBatch;
+    size_t mDequeueInputBatchSize;
+    BufferDescriptor *mDequeueOutputBatch;
+    size_t mDequeueOutputBatchSize;
+
     sp<ICrypto> mCrypto;
 
     List<sp<ABuffer> > mCSD;
@@ -297,6 +345,9 @@ private:
 
     void onInputBufferAvailable();
     void onOutputBufferAvailable();
+    void describeOutputBuffer(size_t index, BufferDescriptor *desc);
+    void postInputBuffersAvailable();
+    void postOutputBuffersAvailable();
     void onError(status_t err, int32_t actionCode, const char *detail = NULL);
     void onOutputFormatChanged();
 
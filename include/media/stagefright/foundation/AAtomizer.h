@@ -18,30 +18,55 @@
 
 #define A_ATOMIZER_H_
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/AString.h>
-#include <utils/List.h>
-#include <utils/Vector.h>
 #include <utils/threads.h>
 
 namespace android {
 
+// Interns strings: equal strings are atomized to the same pointer, which stays valid for the
+// life of the process. Atoms are never removed, so only bounded sets of names should be
+// atomized.
 struct AAtomizer {
     static const char *Atomize(const char *name);
 
+    // Same, with the hash and the length of the name as returned by Hash().
+    static const char *Atomize(const char *name, size_t length, uint32_t hash);
+
+    // Returns the atom equal to the name if there is one, or NULL. Never adds an atom, so
+    // it is safe to call with untrusted names.
+    static const char *Lookup(const char *name, size_t length, uint32_t hash);
+
+    // Hash of a string, also returns its length if |length| is not NULL.
+    static uint32_t Hash(const char *s, size_t *length = NULL);
+
 private:
+    struct Atom {
+        Atom *mNext;
+        uint32_t mHash;
+        AString mName;
+    };
+
+    enum {
+        kNumBuckets = 128,
+    };
+
     static AAtomizer gAtomizer;
 
+    // Each bucket is a list of atoms linked by mNext. Atoms are only ever added at the head
+    // of a list under mLock, and published with a release store, so lookups need no lock.
     Mutex mLock;
-    Vector<List<AString> > mAtoms;
+    atomic_uintptr_t mBuckets[kNumBuckets];
 
     AAtomizer();
 
-    const char *atomize(const char *name);
+    const char *atomize(const char *name, size_t length, uint32_t hash);
 
-    static uint32_t Hash(const char *s);
+    static const Atom *Find(
+            uintptr_t head, const char *name, size_t length, uint32_t hash);
 
     DISALLOW_EVIL_CONSTRUCTORS(AAtomizer);
 };
@@ -25,6 +25,7 @@
 #include <utils/List.h>
 #include <utils/RefBase.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -58,9 +59,11 @@ protected:
 
 private:
     friend struct ALooperRoster;
+    friend struct ALooperTest;
 
     struct Event {
         int64_t mWhenUs;
+        uint64_t mSequence;     // orders the events due at the same time by posting order
         sp<AMessage> mMessage;
     };
 
@@ -69,15 +72,22 @@ private:
 
     AString mName;
 
-    List<Event> mEventQueue;
+    // binary min-heap of the pending events on (mWhenUs, mSequence), the next one is first
+    Vector<Event> mEventQueue;
+    uint64_t mNextSequence;
 
     struct LooperThread;
     sp<LooperThread> mThread;
     bool mRunningLocally;
 
     void post(const sp<AMessage> &msg, int64_t delayUs);
+    // posts the message for delivery at whenUs, in GetNowUs() time
+    void postAt(const sp<AMessage> &msg, int64_t whenUs);
     bool loop();
 
+    void pushEvent_l(const Event &event);
+    void popEvent_l(Event *event);
+
     DISALLOW_EVIL_CONSTRUCTORS(ALooper);
 };
 
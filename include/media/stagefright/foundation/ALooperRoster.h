@@ -48,14 +48,30 @@ private:
         wp<AHandler> mHandler;
     };
 
-    Mutex mLock;
-    KeyedVector<ALooper::handler_id, HandlerInfo> mHandlers;
-    ALooper::handler_id mNextHandlerID;
+    // The handlers are spread over shards by their id, each with its own lock, so that loopers
+    // posting and delivering messages to different handlers rarely contend.
+    enum {
+        kNumShards = 16,
+    };
+
+    struct Shard {
+        Mutex mLock;
+        KeyedVector<ALooper::handler_id, HandlerInfo> mHandlers;
+    };
+
+    Shard mShards[kNumShards];
+    volatile int32_t mNextHandlerID;
+
+    Mutex mLock;    // protects the replies
     uint32_t mNextReplyID;
     Condition mRepliesCondition;
 
     KeyedVector<uint32_t, sp<AMessage> > mReplies;
 
+    Shard &shardFor(ALooper::handler_id handlerID) {
+        return mShards[(uint32_t)handlerID % kNumShards];
+    }
+
     DISALLOW_EVIL_CONSTRUCTORS(ALooperRoster);
 };
 
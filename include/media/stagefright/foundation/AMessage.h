@@ -43,6 +43,8 @@ struct AMessage : public RefBase {
 
     void clear();
 
+    // Item names are copied, unless the name is an atom already; code that sets the same
+    // fixed keys at a high rate can AAtomizer::Atomize() them once to share them instead.
     void setInt32(const char *name, int32_t value);
     void setInt64(const char *name, int64_t value);
     void setSize(const char *name, size_t value);
@@ -138,8 +140,11 @@ private:
         } u;
         const char *mName;
         size_t      mNameLength;
+        uint32_t    mNameHash;      // AAtomizer::Hash() of the name
+        bool        mNameIsAtom;    // the name is shared from AAtomizer, else it is owned
         Type mType;
-        void setName(const char *name, size_t len);
+        void setName(const char *name, size_t len, uint32_t hash);
+        void freeName();
     };
 
     enum {
@@ -155,7 +160,7 @@ private:
     void setObjectInternal(
             const char *name, const sp<RefBase> &obj, Type type);
 
-    size_t findItemIndex(const char *name, size_t len) const;
+    size_t findItemIndex(const char *name, size_t len, uint32_t hash) const;
 
     DISALLOW_EVIL_CONSTRUCTORS(AMessage);
 };
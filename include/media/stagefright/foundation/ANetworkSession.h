@@ -20,6 +20,7 @@
 
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/KeyedVector.h>
+#include <utils/SortedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Thread.h>
 
@@ -31,6 +32,8 @@ struct AMessage;
 
 // Helper class to manage a number of live sockets (datagram and stream-based)
 // on a single thread. Clients are notified about activity through AMessages.
+// The sockets are watched with an edge-triggered epoll set, so the cost of a
+// wakeup depends on the number of ready sockets only.
 struct ANetworkSession : public RefBase {
     ANetworkSession();
 
@@ -103,9 +106,20 @@ private:
     int32_t mNextSessionID;
 
     int mPipeFd[2];
+    int mEpollFd;
 
     KeyedVector<int32_t, sp<Session> > mSessions;
 
+    // sessions whose output queue was empty when a request was queued, the
+    // thread writes to them since no EPOLLOUT edge is due for their sockets
+    Vector<int32_t> mSessionsToWrite;
+
+    // UDP sessions whose last read or write failed and is retried, the
+    // thread retries them on its next loop since their sockets may not
+    // report another edge
+    SortedVector<int32_t> mSessionsToRetryRead;
+    SortedVector<int32_t> mSessionsToRetryWrite;
+
     enum Mode {
         kModeCreateUDPSession,
         kModeCreateTCPDatagramSessionPassive,
@@ -125,6 +139,11 @@ private:
     void threadLoop();
     void interrupt();
 
+    status_t addSession_l(const sp<Session> &session);
+    void acceptClients_l(const sp<Session> &session);
+    void readMore_l(const sp<Session> &session);
+    void writeMore_l(const sp<Session> &session);
+
     static status_t MakeSocketNonBlocking(int s);
 
     DISALLOW_EVIL_CONSTRUCTORS(ANetworkSession);
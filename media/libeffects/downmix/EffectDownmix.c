@@ -22,12 +22,12 @@
 #include <string.h>
 #include <stdbool.h>
 #include "EffectDownmix.h"
+#include "EffectDownmixOps.h"
 
 // Do not submit with DOWNMIX_TEST_CHANNEL_INDEX defined, strictly for testing
 //#define DOWNMIX_TEST_CHANNEL_INDEX 0
-// Do not submit with DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER defined, strictly for testing
-//#define DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER 0
 
+#define UNITY_IN_Q19_12 4096 // 0dB = 1.0 * 2^12 = 4096
 #define MINUS_3_DB_IN_Q19_12 2896 // -3dB = 0.707 * 2^12 = 2896
 
 // subset of possible audio_channel_mask_t values, and AUDIO_CHANNEL_OUT_* renamed to CHANNEL_MASK_*
@@ -259,7 +259,6 @@ static int Downmix_Process(effect_handle_t self,
         audio_buffer_t *inBuffer, audio_buffer_t *outBuffer) {
 
     downmix_object_t *pDownmixer;
-    int16_t *pSrc, *pDst;
     downmix_module_t *pDwmModule = (downmix_module_t *)self;
 
     if (pDwmModule == NULL) {
@@ -282,18 +281,29 @@ static int Downmix_Process(effect_handle_t self,
         return -ENODATA;
     }
 
-    pSrc = inBuffer->s16;
-    pDst = outBuffer->s16;
     size_t numFrames = outBuffer->frameCount;
 
     const bool accumulate =
             (pDwmModule->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE);
+    const bool isFloat = (pDwmModule->config.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT);
     const uint32_t downmixInputChannelMask = pDwmModule->config.inputCfg.channels;
 
     switch(pDownmixer->type) {
 
       case DOWNMIX_TYPE_STRIP:
-          if (accumulate) {
+          if (isFloat) {
+              float *pSrc = inBuffer->f32;
+              float *pDst = outBuffer->f32;
+              while (numFrames) {
+                  pDst[0] = accumulate ? pDst[0] + pSrc[0] : pSrc[0];
+                  pDst[1] = accumulate ? pDst[1] + pSrc[1] : pSrc[1];
+                  pSrc += pDownmixer->input_channel_count;
+                  pDst += 2;
+                  numFrames--;
+              }
+          } else if (accumulate) {
+              int16_t *pSrc = inBuffer->s16;
+              int16_t *pDst = outBuffer->s16;
               while (numFrames) {
                   pDst[0] = clamp16(pDst[0] + pSrc[0]);
                   pDst[1] = clamp16(pDst[1] + pSrc[1]);
@@ -302,6 +312,8 @@ static int Downmix_Process(effect_handle_t self,
                   numFrames--;
               }
           } else {
+              int16_t *pSrc = inBuffer->s16;
+              int16_t *pDst = outBuffer->s16;
               while (numFrames) {
                   pDst[0] = pSrc[0];
                   pDst[1] = pSrc[1];
@@ -313,35 +325,15 @@ static int Downmix_Process(effect_handle_t self,
           break;
 
       case DOWNMIX_TYPE_FOLD:
-#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
-          // bypass the optimized downmix routines for the common formats
-          if (!Downmix_foldGeneric(
-                  downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-              ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported", downmixInputChannelMask);
-              return -EINVAL;
-          }
-          break;
-#endif
-        // optimize for the common formats
-        switch((downmix_input_channel_mask_t)downmixInputChannelMask) {
-        case CHANNEL_MASK_QUAD_BACK:
-        case CHANNEL_MASK_QUAD_SIDE:
-            Downmix_foldFromQuad(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_5POINT1_BACK:
-        case CHANNEL_MASK_5POINT1_SIDE:
-            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_7POINT1:
-            Downmix_foldFrom7Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        default:
-            if (!Downmix_foldGeneric(
-                    downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-                ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported", downmixInputChannelMask);
-                return -EINVAL;
-            }
-            break;
+        // the fold matrix was computed for the input channel mask by Downmix_Configure()
+        if (!pDownmixer->fold_supported) {
+            ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported", downmixInputChannelMask);
+            return -EINVAL;
+        }
+        if (isFloat) {
+            Downmix_foldFloat(pDownmixer, inBuffer->f32, outBuffer->f32, numFrames, accumulate);
+        } else {
+            Downmix_fold16(pDownmixer, inBuffer->s16, outBuffer->s16, numFrames, accumulate);
         }
         break;
 
@@ -609,8 +601,9 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
     // Check configuration compatibility with build options, and effect capabilities
     if (pConfig->inputCfg.samplingRate != pConfig->outputCfg.samplingRate
         || pConfig->outputCfg.channels != DOWNMIX_OUTPUT_CHANNELS
-        || pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
-        || pConfig->outputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+        || (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
+                && pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT)
+        || pConfig->outputCfg.format != pConfig->inputCfg.format) {
         ALOGE("Downmix_Configure error: invalid config");
         return -EINVAL;
     }
@@ -632,6 +625,9 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
         pDownmixer->input_channel_count =
                 audio_channel_count_from_out_mask(pConfig->inputCfg.channels);
     }
+    // an unsupported mask is only an error if the effect is used to fold
+    pDownmixer->fold_supported =
+            Downmix_computeFoldMatrix(pConfig->inputCfg.channels, pDownmixer);
 
     Downmix_Reset(pDownmixer, init);
 
@@ -768,123 +764,246 @@ int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t *
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFromQuad()
+ * Downmix_computeFoldMatrix()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a quad signal to stereo
+ * compute the fold matrix used to downmix to stereo a multichannel signal whose format is:
+ *  - has FL/FR
+ *  - if using AUDIO_CHANNEL_OUT_SIDE*, it contains both left and right
+ *  - if using AUDIO_CHANNEL_OUT_BACK*, it contains both left and right
+ *  - doesn't use any of the AUDIO_CHANNEL_OUT_TOP* channels
+ *  - doesn't use any of the AUDIO_CHANNEL_OUT_FRONT_*_OF_CENTER channels
+ * Front, side and back channels are mixed to their side, front center, back center and LFE
+ * are mixed to both sides at -3dB, and the result is attenuated by 6dB.
  *
  * Inputs:
- *  pSrc       quad audio samples to downmix
- *  numFrames  the number of quad frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
+ *  mask       the channel mask of the signal to downmix
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
+ *  pDownmixer fold_rows_q19_12 and fold_rows_float updated with the left and right gain of
+ *               each input channel, in the order of the channel mask bits:
+ *               FL FR FC LFE BL BR BC SL SR
+ *
+ * Returns: false if multichannel format is not supported
  *
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is RL
-    // sample at index 3 is RR
-    if (accumulate) {
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16(pDst[0] + ((pSrc[0] + pSrc[2]) >> 1));
-            // FR + RR
-            pDst[1] = clamp16(pDst[1] + ((pSrc[1] + pSrc[3]) >> 1));
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
-        }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16((pSrc[0] + pSrc[2]) >> 1);
-            // FR + RR
-            pDst[1] = clamp16((pSrc[1] + pSrc[3]) >> 1);
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
+bool Downmix_computeFoldMatrix(uint32_t mask, downmix_object_t *pDownmixer) {
+    // check against unsupported channels
+    if (mask & kUnsupported) {
+        ALOGE("Unsupported channels (top or front left/right of center)");
+        return false;
+    }
+    // verify has FL/FR
+    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
+        ALOGE("Front channels must be present");
+        return false;
+    }
+    // verify uses SIDE as a pair (ok if not using SIDE at all)
+    if ((mask & kSides) != 0 && (mask & kSides) != kSides) {
+        ALOGE("Side channels must be used as a pair");
+        return false;
+    }
+    // verify uses BACK as a pair (ok if not using BACK at all)
+    if ((mask & kBacks) != 0 && (mask & kBacks) != kBacks) {
+        ALOGE("Back channels must be used as a pair");
+        return false;
+    }
+
+    // the rows are zero beyond the channel count, as the SIMD kernels rely on it
+    int16_t (*rows)[DOWNMIX_FOLD_MAX_CHANNELS] = pDownmixer->fold_rows_q19_12;
+    memset(rows, 0, sizeof(pDownmixer->fold_rows_q19_12));
+    int numChan = 0;
+    while (mask != 0) {
+        const uint32_t channel = mask & -mask;
+        mask &= ~channel;
+        switch (channel) {
+        case AUDIO_CHANNEL_OUT_FRONT_LEFT:
+        case AUDIO_CHANNEL_OUT_BACK_LEFT:
+        case AUDIO_CHANNEL_OUT_SIDE_LEFT:
+            rows[0][numChan] = UNITY_IN_Q19_12;
+            break;
+        case AUDIO_CHANNEL_OUT_FRONT_RIGHT:
+        case AUDIO_CHANNEL_OUT_BACK_RIGHT:
+        case AUDIO_CHANNEL_OUT_SIDE_RIGHT:
+            rows[1][numChan] = UNITY_IN_Q19_12;
+            break;
+        case AUDIO_CHANNEL_OUT_FRONT_CENTER:
+        case AUDIO_CHANNEL_OUT_LOW_FREQUENCY:
+        case AUDIO_CHANNEL_OUT_BACK_CENTER:
+            rows[0][numChan] = MINUS_3_DB_IN_Q19_12;
+            rows[1][numChan] = MINUS_3_DB_IN_Q19_12;
+            break;
+        default:
+            ALOGE("Unknown channel 0x%" PRIx32, channel);
+            return false;
         }
+        numChan++;
+    }
+    // the fixed point kernels scale the sum by 2^-13: 2^-12 for the Q19.12 gains and -6dB
+    for (int i = 0; i < DOWNMIX_FOLD_MAX_CHANNELS; i++) {
+        pDownmixer->fold_rows_float[0][i] = rows[0][i] * (1.0f / (1 << 13));
+        pDownmixer->fold_rows_float[1][i] = rows[1][i] * (1.0f / (1 << 13));
     }
+    return true;
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom5Point1()
+ * Fold kernels
  *----------------------------------------------------------------------------
- * Purpose:
- * downmix a 5.1 signal to stereo
- *
- * Inputs:
- *  pSrc       5.1 audio samples to downmix
- *  numFrames  the number of 5.1 frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
- *
- * Outputs:
- *  pDst       downmixed stereo audio samples
+ * The fold is a matrix multiply of each numChan input frame by the 2 x numChan fold matrix.
+ * Frames are processed DOWNMIX_BLOCK_FRAMES at a time: with NEON or SSE2 by the kernels of
+ * EffectDownmixOps.h for up to DOWNMIX_SIMD_CHANNELS channels, otherwise with fixed trip
+ * count loops that the compiler can unroll once inlined with a constant numChan.
+ * All outputs of a block are computed before any is stored, which keeps in-place
+ * processing (pSrc == pDst) safe.
  *
+ * The 16 bit kernels compute the same result as the former per channel mask routines:
+ * the sum is in Q19.12, and each output sample is clamped after the optional accumulation.
+ * The float kernels don't clamp.
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
+
+#define DOWNMIX_BLOCK_FRAMES 4
+
+static inline __attribute__((always_inline)) void Downmix_foldFrames16(
+        const int16_t *pSrc, int16_t *pDst, const downmix_object_t *pDownmixer,
+        const int numFrames, const int numChan, const bool accumulate) {
+    const int16_t *coefsL = pDownmixer->fold_rows_q19_12[0];
+    const int16_t *coefsR = pDownmixer->fold_rows_q19_12[1];
+    int32_t lt[DOWNMIX_BLOCK_FRAMES], rt[DOWNMIX_BLOCK_FRAMES]; // samples in Q19.12 format
+    for (int f = 0; f < numFrames; f++) {
+        lt[f] = 0;
+        rt[f] = 0;
+        for (int c = 0; c < numChan; c++) {
+            lt[f] += pSrc[f * numChan + c] * coefsL[c];
+            rt[f] += pSrc[f * numChan + c] * coefsR[c];
+        }
+    }
+    for (int f = 0; f < numFrames; f++) {
+        if (accumulate) {
+            pDst[2 * f] = clamp16(pDst[2 * f] + (lt[f] >> 13));
+            pDst[2 * f + 1] = clamp16(pDst[2 * f + 1] + (rt[f] >> 13));
+        } else {
+            pDst[2 * f] = clamp16(lt[f] >> 13);
+            pDst[2 * f + 1] = clamp16(rt[f] >> 13);
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) void Downmix_foldFramesFloat(
+        const float *pSrc, float *pDst, const downmix_object_t *pDownmixer,
+        const int numFrames, const int numChan, const bool accumulate) {
+    const float *coefsL = pDownmixer->fold_rows_float[0];
+    const float *coefsR = pDownmixer->fold_rows_float[1];
+    float lt[DOWNMIX_BLOCK_FRAMES], rt[DOWNMIX_BLOCK_FRAMES];
+    for (int f = 0; f < numFrames; f++) {
+        lt[f] = 0;
+        rt[f] = 0;
+        for (int c = 0; c < numChan; c++) {
+            lt[f] += pSrc[f * numChan + c] * coefsL[c];
+            rt[f] += pSrc[f * numChan + c] * coefsR[c];
         }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
+    }
+    for (int f = 0; f < numFrames; f++) {
+        if (accumulate) {
+            pDst[2 * f] += lt[f];
+            pDst[2 * f + 1] += rt[f];
+        } else {
+            pDst[2 * f] = lt[f];
+            pDst[2 * f + 1] = rt[f];
         }
     }
 }
 
+// Returns whether a SIMD block can be processed: its last frame is loaded as a full vector.
+static inline bool Downmix_canFoldBlockSimd(size_t numFrames, int numChan) {
+    return DOWNMIX_USE_SIMD && numChan <= DOWNMIX_SIMD_CHANNELS
+            && numFrames >= DOWNMIX_BLOCK_FRAMES
+            && (numFrames - (DOWNMIX_BLOCK_FRAMES - 1)) * numChan >= DOWNMIX_SIMD_CHANNELS;
+}
+
+static inline __attribute__((always_inline)) void Downmix_foldKernel16(
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, const downmix_object_t *pDownmixer,
+        const int numChan, const bool accumulate) {
+#if DOWNMIX_USE_SIMD
+    for (; Downmix_canFoldBlockSimd(numFrames, numChan); numFrames -= DOWNMIX_BLOCK_FRAMES) {
+        Downmix_foldBlock16(pSrc, pDst, numChan, pDownmixer->fold_rows_q19_12[0],
+                pDownmixer->fold_rows_q19_12[1], accumulate);
+        pSrc += DOWNMIX_BLOCK_FRAMES * numChan;
+        pDst += DOWNMIX_BLOCK_FRAMES * 2;
+    }
+#endif
+    for (; numFrames >= DOWNMIX_BLOCK_FRAMES; numFrames -= DOWNMIX_BLOCK_FRAMES) {
+        Downmix_foldFrames16(pSrc, pDst, pDownmixer, DOWNMIX_BLOCK_FRAMES, numChan, accumulate);
+        pSrc += DOWNMIX_BLOCK_FRAMES * numChan;
+        pDst += DOWNMIX_BLOCK_FRAMES * 2;
+    }
+    for (; numFrames > 0; numFrames--) {
+        Downmix_foldFrames16(pSrc, pDst, pDownmixer, 1, numChan, accumulate);
+        pSrc += numChan;
+        pDst += 2;
+    }
+}
+
+static inline __attribute__((always_inline)) void Downmix_foldKernelFloat(
+        const float *pSrc, float *pDst, size_t numFrames, const downmix_object_t *pDownmixer,
+        const int numChan, const bool accumulate) {
+#if DOWNMIX_USE_SIMD
+    for (; Downmix_canFoldBlockSimd(numFrames, numChan); numFrames -= DOWNMIX_BLOCK_FRAMES) {
+        Downmix_foldBlockFloat(pSrc, pDst, numChan, pDownmixer->fold_rows_float[0],
+                pDownmixer->fold_rows_float[1], accumulate);
+        pSrc += DOWNMIX_BLOCK_FRAMES * numChan;
+        pDst += DOWNMIX_BLOCK_FRAMES * 2;
+    }
+#endif
+    for (; numFrames >= DOWNMIX_BLOCK_FRAMES; numFrames -= DOWNMIX_BLOCK_FRAMES) {
+        Downmix_foldFramesFloat(pSrc, pDst, pDownmixer, DOWNMIX_BLOCK_FRAMES, numChan,
+                accumulate);
+        pSrc += DOWNMIX_BLOCK_FRAMES * numChan;
+        pDst += DOWNMIX_BLOCK_FRAMES * 2;
+    }
+    for (; numFrames > 0; numFrames--) {
+        Downmix_foldFramesFloat(pSrc, pDst, pDownmixer, 1, numChan, accumulate);
+        pSrc += numChan;
+        pDst += 2;
+    }
+}
+
+// Instantiates a kernel for the channel counts of the common channel masks (quad, 5.1, 7.1),
+// falling back to a runtime channel count for the others.
+#define DOWNMIX_FOLD_DISPATCH(kernel, pSrc, pDst, numFrames, pDownmixer, accumulate)   \
+    switch ((pDownmixer)->input_channel_count) {                                        \
+    case 4:                                                                             \
+        if (accumulate) { kernel(pSrc, pDst, numFrames, pDownmixer, 4, true); }         \
+        else { kernel(pSrc, pDst, numFrames, pDownmixer, 4, false); }                   \
+        break;                                                                          \
+    case 6:                                                                             \
+        if (accumulate) { kernel(pSrc, pDst, numFrames, pDownmixer, 6, true); }         \
+        else { kernel(pSrc, pDst, numFrames, pDownmixer, 6, false); }                   \
+        break;                                                                          \
+    case 8:                                                                             \
+        if (accumulate) { kernel(pSrc, pDst, numFrames, pDownmixer, 8, true); }         \
+        else { kernel(pSrc, pDst, numFrames, pDownmixer, 8, false); }                   \
+        break;                                                                          \
+    default:                                                                            \
+        kernel(pSrc, pDst, numFrames, pDownmixer, (pDownmixer)->input_channel_count,    \
+                accumulate);                                                            \
+        break;                                                                          \
+    }
+
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom7Point1()
+ * Downmix_fold16()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a 7.1 signal to stereo
+ * downmix a 16 bit multichannel signal to stereo using the fold matrix of pDownmixer
  *
  * Inputs:
- *  pSrc       7.1 audio samples to downmix
- *  numFrames  the number of 7.1 frames to downmix
+ *  pDownmixer downmix context, with a fold matrix computed by Downmix_computeFoldMatrix()
+ *  pSrc       multichannel audio samples to downmix
+ *  numFrames  the number of multichannel frames to downmix
  *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
  *               or overwrite pDst (when false)
  *
@@ -893,69 +1012,21 @@ void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool
  *
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // sample at index 6 is SL
-    // sample at index 7 is SR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            //accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
-    }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
-        }
-    }
+void Downmix_fold16(const downmix_object_t *pDownmixer,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, bool accumulate) {
+    DOWNMIX_FOLD_DISPATCH(Downmix_foldKernel16, pSrc, pDst, numFrames, pDownmixer, accumulate);
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldGeneric()
+ * Downmix_foldFloat()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix to stereo a multichannel signal whose format is:
- *  - has FL/FR
- *  - if using AUDIO_CHANNEL_OUT_SIDE*, it contains both left and right
- *  - if using AUDIO_CHANNEL_OUT_BACK*, it contains both left and right
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_TOP* channels
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_FRONT_*_OF_CENTER channels
- * Only handles channel masks not enumerated in downmix_input_channel_mask_t
+ * downmix a float multichannel signal to stereo using the fold matrix of pDownmixer
  *
  * Inputs:
- *  mask       the channel mask of pSrc
- *  pSrc       multichannel audio buffer to downmix
+ *  pDownmixer downmix context, with a fold matrix computed by Downmix_computeFoldMatrix()
+ *  pSrc       multichannel audio samples to downmix
  *  numFrames  the number of multichannel frames to downmix
  *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
  *               or overwrite pDst (when false)
@@ -963,119 +1034,9 @@ void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool
  * Outputs:
  *  pDst       downmixed stereo audio samples
  *
- * Returns: false if multichannel format is not supported
- *
  *----------------------------------------------------------------------------
  */
-bool Downmix_foldGeneric(
-        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    // check against unsupported channels
-    if (mask & kUnsupported) {
-        ALOGE("Unsupported channels (top or front left/right of center)");
-        return false;
-    }
-    // verify has FL/FR
-    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
-        ALOGE("Front channels must be present");
-        return false;
-    }
-    // verify uses SIDE as a pair (ok if not using SIDE at all)
-    bool hasSides = false;
-    if ((mask & kSides) != 0) {
-        if ((mask & kSides) != kSides) {
-            ALOGE("Side channels must be used as a pair");
-            return false;
-        }
-        hasSides = true;
-    }
-    // verify uses BACK as a pair (ok if not using BACK at all)
-    bool hasBacks = false;
-    if ((mask & kBacks) != 0) {
-        if ((mask & kBacks) != kBacks) {
-            ALOGE("Back channels must be used as a pair");
-            return false;
-        }
-        hasBacks = true;
-    }
-
-    const int numChan = audio_channel_count_from_out_mask(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    int32_t lt, rt, centersLfeContrib; // samples in Q19.12 format
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
-            }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
-        }
-    } else {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
-            }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
-        }
-    }
-    return true;
+void Downmix_foldFloat(const downmix_object_t *pDownmixer,
+        const float *pSrc, float *pDst, size_t numFrames, bool accumulate) {
+    DOWNMIX_FOLD_DISPATCH(Downmix_foldKernelFloat, pSrc, pDst, numFrames, pDownmixer, accumulate);
 }
@@ -27,6 +27,8 @@
 */
 
 #define DOWNMIX_OUTPUT_CHANNELS AUDIO_CHANNEL_OUT_STEREO
+// maximum number of channels of a foldable input: FL FR FC LFE BL BR BC SL SR
+#define DOWNMIX_FOLD_MAX_CHANNELS 9
 
 typedef enum {
     DOWNMIX_STATE_UNINITIALIZED,
@@ -40,6 +42,11 @@ typedef struct {
     downmix_type_t type;
     bool apply_volume_correction;
     uint8_t input_channel_count;
+    bool fold_supported;        // whether the input channel mask can be folded
+    // fold matrix for the input channel mask: left and right gain rows, zero beyond the
+    // input channel count
+    int16_t fold_rows_q19_12[2][DOWNMIX_FOLD_MAX_CHANNELS];
+    float fold_rows_float[2][DOWNMIX_FOLD_MAX_CHANNELS];
 } downmix_object_t;
 
 
@@ -96,10 +103,10 @@ int Downmix_Reset(downmix_object_t *pDownmixer, bool init);
 int Downmix_setParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t size, void *pValue);
 int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t *pSize, void *pValue);
 
-void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-bool Downmix_foldGeneric(
-        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
+bool Downmix_computeFoldMatrix(uint32_t mask, downmix_object_t *pDownmixer);
+void Downmix_fold16(const downmix_object_t *pDownmixer,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, bool accumulate);
+void Downmix_foldFloat(const downmix_object_t *pDownmixer,
+        const float *pSrc, float *pDst, size_t numFrames, bool accumulate);
 
 #endif /*ANDROID_EFFECTDOWNMIX_H_*/
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EFFECTDOWNMIX_OPS_H_
+#define ANDROID_EFFECTDOWNMIX_OPS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define DOWNMIX_USE_NEON 1
+#include <arm_neon.h>
+#else
+#define DOWNMIX_USE_NEON 0
+#endif
+
+#if !DOWNMIX_USE_NEON && defined(__SSE2__)
+#define DOWNMIX_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define DOWNMIX_USE_SSE2 0
+#endif
+
+#define DOWNMIX_USE_SIMD (DOWNMIX_USE_NEON || DOWNMIX_USE_SSE2)
+
+/* SIMD fold kernels.
+ *
+ * Each call folds a block of 4 frames of up to DOWNMIX_SIMD_CHANNELS interleaved channels
+ * to stereo.  Every frame is loaded as a full vector of DOWNMIX_SIMD_CHANNELS samples and
+ * multiplied by the left and right rows of the fold matrix, which are zero beyond numChan,
+ * so the block reads 3 * numChan + DOWNMIX_SIMD_CHANNELS samples from pSrc.
+ * All samples are loaded before pDst is stored, so that in-place processing is safe.
+ *
+ * The 16 bit kernels are bit-exact with Downmix_foldFrames16(): the products and sums are
+ * exact in 32 bits, and the saturating narrow is clamp16().
+ * The float kernels sum in a different order than Downmix_foldFramesFloat().
+ */
+
+#define DOWNMIX_SIMD_CHANNELS 8
+
+#if DOWNMIX_USE_NEON
+
+// returns { sum(v[0]), sum(v[1]), sum(v[2]), sum(v[3]) }
+static inline int32x4_t Downmix_sum4_neon(const int32x4_t v[4]) {
+    const int32x2_t s0 = vadd_s32(vget_low_s32(v[0]), vget_high_s32(v[0]));
+    const int32x2_t s1 = vadd_s32(vget_low_s32(v[1]), vget_high_s32(v[1]));
+    const int32x2_t s2 = vadd_s32(vget_low_s32(v[2]), vget_high_s32(v[2]));
+    const int32x2_t s3 = vadd_s32(vget_low_s32(v[3]), vget_high_s32(v[3]));
+    return vcombine_s32(vpadd_s32(s0, s1), vpadd_s32(s2, s3));
+}
+
+static inline float32x4_t Downmix_sum4f_neon(const float32x4_t v[4]) {
+    const float32x2_t s0 = vadd_f32(vget_low_f32(v[0]), vget_high_f32(v[0]));
+    const float32x2_t s1 = vadd_f32(vget_low_f32(v[1]), vget_high_f32(v[1]));
+    const float32x2_t s2 = vadd_f32(vget_low_f32(v[2]), vget_high_f32(v[2]));
+    const float32x2_t s3 = vadd_f32(vget_low_f32(v[3]), vget_high_f32(v[3]));
+    return vcombine_f32(vpadd_f32(s0, s1), vpadd_f32(s2, s3));
+}
+
+static inline void Downmix_foldBlock16(const int16_t *pSrc, int16_t *pDst, int numChan,
+        const int16_t *coefsL, const int16_t *coefsR, bool accumulate) {
+    const int16x8_t cl = vld1q_s16(coefsL);
+    const int16x8_t cr = vld1q_s16(coefsR);
+    int32x4_t l[4], r[4];
+    for (int f = 0; f < 4; f++) {
+        const int16x8_t in = vld1q_s16(pSrc + f * numChan);
+        l[f] = vmlal_s16(vmull_s16(vget_low_s16(in), vget_low_s16(cl)),
+                vget_high_s16(in), vget_high_s16(cl));
+        r[f] = vmlal_s16(vmull_s16(vget_low_s16(in), vget_low_s16(cr)),
+                vget_high_s16(in), vget_high_s16(cr));
+    }
+    int32x4x2_t lr = vzipq_s32(vshrq_n_s32(Downmix_sum4_neon(l), 13),
+            vshrq_n_s32(Downmix_sum4_neon(r), 13));
+    if (accumulate) {
+        const int16x8_t dst = vld1q_s16(pDst);
+        lr.val[0] = vaddw_s16(lr.val[0], vget_low_s16(dst));
+        lr.val[1] = vaddw_s16(lr.val[1], vget_high_s16(dst));
+    }
+    vst1q_s16(pDst, vcombine_s16(vqmovn_s32(lr.val[0]), vqmovn_s32(lr.val[1])));
+}
+
+static inline void Downmix_foldBlockFloat(const float *pSrc, float *pDst, int numChan,
+        const float *coefsL, const float *coefsR, bool accumulate) {
+    const float32x4_t cl0 = vld1q_f32(coefsL);
+    const float32x4_t cl1 = vld1q_f32(coefsL + 4);
+    const float32x4_t cr0 = vld1q_f32(coefsR);
+    const float32x4_t cr1 = vld1q_f32(coefsR + 4);
+    float32x4_t l[4], r[4];
+    for (int f = 0; f < 4; f++) {
+        const float32x4_t in0 = vld1q_f32(pSrc + f * numChan);
+        const float32x4_t in1 = vld1q_f32(pSrc + f * numChan + 4);
+        l[f] = vmlaq_f32(vmulq_f32(in0, cl0), in1, cl1);
+        r[f] = vmlaq_f32(vmulq_f32(in0, cr0), in1, cr1);
+    }
+    float32x4x2_t lr = vzipq_f32(Downmix_sum4f_neon(l), Downmix_sum4f_neon(r));
+    if (accumulate) {
+        lr.val[0] = vaddq_f32(lr.val[0], vld1q_f32(pDst));
+        lr.val[1] = vaddq_f32(lr.val[1], vld1q_f32(pDst + 4));
+    }
+    vst1q_f32(pDst, lr.val[0]);
+    vst1q_f32(pDst + 4, lr.val[1]);
+}
+
+#endif // DOWNMIX_USE_NEON
+
+#if DOWNMIX_USE_SSE2
+
+// returns { sum(v[0]), sum(v[1]), sum(v[2]), sum(v[3]) }
+static inline __m128i Downmix_sum4_sse2(const __m128i v[4]) {
+    const __m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(v[0], v[1]),
+            _mm_unpackhi_epi32(v[0], v[1]));
+    const __m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(v[2], v[3]),
+            _mm_unpackhi_epi32(v[2], v[3]));
+    return _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+}
+
+static inline __m128 Downmix_sum4f_sse2(const __m128 v[4]) {
+    const __m128 s01 = _mm_add_ps(_mm_unpacklo_ps(v[0], v[1]), _mm_unpackhi_ps(v[0], v[1]));
+    const __m128 s23 = _mm_add_ps(_mm_unpacklo_ps(v[2], v[3]), _mm_unpackhi_ps(v[2], v[3]));
+    return _mm_add_ps(_mm_movelh_ps(s01, s23), _mm_movehl_ps(s23, s01));
+}
+
+static inline void Downmix_foldBlock16(const int16_t *pSrc, int16_t *pDst, int numChan,
+        const int16_t *coefsL, const int16_t *coefsR, bool accumulate) {
+    const __m128i cl = _mm_loadu_si128((const __m128i *) coefsL);
+    const __m128i cr = _mm_loadu_si128((const __m128i *) coefsR);
+    __m128i l[4], r[4];
+    for (int f = 0; f < 4; f++) {
+        const __m128i in = _mm_loadu_si128((const __m128i *) (pSrc + f * numChan));
+        l[f] = _mm_madd_epi16(in, cl);
+        r[f] = _mm_madd_epi16(in, cr);
+    }
+    const __m128i lt = _mm_srai_epi32(Downmix_sum4_sse2(l), 13);
+    const __m128i rt = _mm_srai_epi32(Downmix_sum4_sse2(r), 13);
+    __m128i lo = _mm_unpacklo_epi32(lt, rt);
+    __m128i hi = _mm_unpackhi_epi32(lt, rt);
+    if (accumulate) {
+        const __m128i dst = _mm_loadu_si128((const __m128i *) pDst);
+        lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(dst, dst), 16));
+        hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(dst, dst), 16));
+    }
+    _mm_storeu_si128((__m128i *) pDst, _mm_packs_epi32(lo, hi));
+}
+
+static inline void Downmix_foldBlockFloat(const float *pSrc, float *pDst, int numChan,
+        const float *coefsL, const float *coefsR, bool accumulate) {
+    const __m128 cl0 = _mm_loadu_ps(coefsL);
+    const __m128 cl1 = _mm_loadu_ps(coefsL + 4);
+    const __m128 cr0 = _mm_loadu_ps(coefsR);
+    const __m128 cr1 = _mm_loadu_ps(coefsR + 4);
+    __m128 l[4], r[4];
+    for (int f = 0; f < 4; f++) {
+        const __m128 in0 = _mm_loadu_ps(pSrc + f * numChan);
+        const __m128 in1 = _mm_loadu_ps(pSrc + f * numChan + 4);
+        l[f] = _mm_add_ps(_mm_mul_ps(in0, cl0), _mm_mul_ps(in1, cl1));
+        r[f] = _mm_add_ps(_mm_mul_ps(in0, cr0), _mm_mul_ps(in1, cr1));
+    }
+    const __m128 lt = Downmix_sum4f_sse2(l);
+    const __m128 rt = Downmix_sum4f_sse2(r);
+    __m128 lo = _mm_unpacklo_ps(lt, rt);
+    __m128 hi = _mm_unpackhi_ps(lt, rt);
+    if (accumulate) {
+        lo = _mm_add_ps(lo, _mm_loadu_ps(pDst));
+        hi = _mm_add_ps(hi, _mm_loadu_ps(pDst + 4));
+    }
+    _mm_storeu_ps(pDst, lo);
+    _mm_storeu_ps(pDst + 4, hi);
+}
+
+#endif // DOWNMIX_USE_SSE2
+
+#endif /*ANDROID_EFFECTDOWNMIX_OPS_H_*/
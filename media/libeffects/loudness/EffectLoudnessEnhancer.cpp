@@ -107,7 +107,8 @@ int LE_setConfig(LoudnessEnhancerContext *pContext, effect_config_t *pConfig)
     if (pConfig->inputCfg.channels != AUDIO_CHANNEL_OUT_STEREO) return -EINVAL;
     if (pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_WRITE &&
             pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_ACCUMULATE) return -EINVAL;
-    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT) return -EINVAL;
+    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+            pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT) return -EINVAL;
 
     pContext->mConfig = *pConfig;
 
@@ -283,22 +284,45 @@ int LE_process(
     uint16_t inIdx;
     float inputAmp = pow(10, pContext->mTargetGainmB/2000.0f);
     float leftSample, rightSample;
-    for (inIdx = 0 ; inIdx < inBuffer->frameCount ; inIdx++) {
-        // makeup gain is applied on the input of the compressor
-        leftSample  = inputAmp * (float)inBuffer->s16[2*inIdx];
-        rightSample = inputAmp * (float)inBuffer->s16[2*inIdx +1];
-        pContext->mCompressor->Compress(&leftSample, &rightSample);
-        inBuffer->s16[2*inIdx]    = (int16_t) leftSample;
-        inBuffer->s16[2*inIdx +1] = (int16_t) rightSample;
-    }
+    if (pContext->mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+        // the compressor operates on 16 bit sample values
+        const float inputScale = inputAmp * 32768.0f;
+        for (inIdx = 0 ; inIdx < inBuffer->frameCount ; inIdx++) {
+            leftSample  = inputScale * inBuffer->f32[2*inIdx];
+            rightSample = inputScale * inBuffer->f32[2*inIdx +1];
+            pContext->mCompressor->Compress(&leftSample, &rightSample);
+            inBuffer->f32[2*inIdx]    = leftSample * (1.0f / 32768.0f);
+            inBuffer->f32[2*inIdx +1] = rightSample * (1.0f / 32768.0f);
+        }
+
+        if (inBuffer->raw != outBuffer->raw) {
+            if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
+                for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
+                    outBuffer->f32[i] += inBuffer->f32[i];
+                }
+            } else {
+                memcpy(outBuffer->raw, inBuffer->raw, outBuffer->frameCount * 2 * sizeof(float));
+            }
+        }
+    } else {
+        for (inIdx = 0 ; inIdx < inBuffer->frameCount ; inIdx++) {
+            // makeup gain is applied on the input of the compressor
+            leftSample  = inputAmp * (float)inBuffer->s16[2*inIdx];
+            rightSample = inputAmp * (float)inBuffer->s16[2*inIdx +1];
+            pContext->mCompressor->Compress(&leftSample, &rightSample);
+            inBuffer->s16[2*inIdx]    = (int16_t) leftSample;
+            inBuffer->s16[2*inIdx +1] = (int16_t) rightSample;
+        }
 
-    if (inBuffer->raw != outBuffer->raw) {
-        if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
-            for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
-                outBuffer->s16[i] = clamp16(outBuffer->s16[i] + inBuffer->s16[i]);
+        if (inBuffer->raw != outBuffer->raw) {
+            if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
+                for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
+                    outBuffer->s16[i] = clamp16(outBuffer->s16[i] + inBuffer->s16[i]);
+                }
+            } else {
+                memcpy(outBuffer->raw, inBuffer->raw,
+                        outBuffer->frameCount * 2 * sizeof(int16_t));
             }
-        } else {
-            memcpy(outBuffer->raw, inBuffer->raw, outBuffer->frameCount * 2 * sizeof(int16_t));
         }
     }
     if (pContext->mState != LOUDNESS_ENHANCER_STATE_ACTIVE) {
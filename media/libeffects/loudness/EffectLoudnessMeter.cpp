@@ -0,0 +1,540 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EffectLM"
+//#define LOG_NDEBUG 0
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <math.h>
+#include <media/EffectLoudnessMeterApi.h>
+#include "dsp/core/loudness_meter.h"
+
+extern "C" {
+
+// effect_handle_t interface implementation for LM effect
+extern const struct effect_interface_s gLMInterface;
+
+// AOSP Loudness Meter UUID: 9a162b50-8593-4284-b86f-683940d44a2c
+const effect_descriptor_t gLMDescriptor = {
+        {0x8616f54b, 0xd0fb, 0x43cb, 0xaf35, {0xe2, 0xd5, 0xaa, 0x9e, 0x80, 0x6f}}, // type
+        {0x9a162b50, 0x8593, 0x4284, 0xb86f, {0x68, 0x39, 0x40, 0xd4, 0x4a, 0x2c}}, // uuid
+        EFFECT_CONTROL_API_VERSION,
+        (EFFECT_FLAG_TYPE_INSERT | EFFECT_FLAG_INSERT_LAST),
+        0, // TODO
+        1,
+        "Loudness Meter",
+        "The Android Open Source Project",
+};
+
+enum lm_state_e {
+    LOUDNESS_METER_STATE_UNINITIALIZED,
+    LOUDNESS_METER_STATE_INITIALIZED,
+    LOUDNESS_METER_STATE_ACTIVE,
+};
+
+struct LoudnessMeterContext {
+    const struct effect_interface_s *mItfe;
+    effect_config_t mConfig;
+    uint8_t mState;
+    le_fx::LoudnessMeter* mMeter;
+    // The measurements are published by LM_process() and read by LM_command(), which can
+    // run on another thread, through a sequence lock: mSnapshotSeq is odd while
+    // mSnapshot is being written.
+    volatile int32_t mSnapshotSeq;
+    loudness_meter_measurements_t mSnapshot;
+    int64_t mSnapshotSteps;     // mMeter->step_count() when the loudness was last computed
+};
+
+//
+//--- Local functions (not directly used by effect interface)
+//
+
+static inline int16_t clamp16(int32_t sample)
+{
+    if ((sample>>15) ^ (sample>>31))
+        sample = 0x7FFF ^ (sample>>31);
+    return sample;
+}
+
+// Converts a loudness in LUFS to hundredths of LU.
+static inline int32_t LM_toClufs(float lufs)
+{
+    if (!(lufs > LOUDNESS_METER_SILENCE_CLUFS / 100.0f)) {
+        return LOUDNESS_METER_SILENCE_CLUFS;
+    }
+    return (int32_t)lroundf(lufs * 100.0f);
+}
+
+// Converts a linear amplitude to mB.
+static inline int32_t LM_toMb(float amplitude)
+{
+    if (!(amplitude > 0.0f)) {
+        return LOUDNESS_METER_SILENCE_CLUFS;
+    }
+    return (int32_t)lroundf(2000.0f * log10f(amplitude));
+}
+
+// Publishes the measurements of the meter for LM_getMeasurements(). The loudness values are
+// only computed again if requested, as they only change at the end of a 100 ms step.
+void LM_publishMeasurements(LoudnessMeterContext *pContext, bool loudness)
+{
+    const le_fx::LoudnessMeter *meter = pContext->mMeter;
+    loudness_meter_measurements_t *pMeas = &pContext->mSnapshot;
+
+    android_atomic_inc(&pContext->mSnapshotSeq);
+    if (loudness) {
+        pMeas->momentaryClufs = LM_toClufs(meter->MomentaryLoudness());
+        pMeas->shortTermClufs = LM_toClufs(meter->ShortTermLoudness());
+        pMeas->integratedClufs = LM_toClufs(meter->IntegratedLoudness());
+        pContext->mSnapshotSteps = meter->step_count();
+    }
+    pMeas->peakMb = LM_toMb(meter->peak());
+    pMeas->durationMs = (uint32_t)(meter->frame_count() * 1000
+            / pContext->mConfig.inputCfg.samplingRate);
+    android_atomic_inc(&pContext->mSnapshotSeq);
+}
+
+// Reads the last measurements published, without touching the meter, so it can be called
+// while LM_process() runs.
+void LM_getMeasurements(LoudnessMeterContext *pContext, loudness_meter_measurements_t *pMeas)
+{
+    for (;;) {
+        const int32_t seq = android_atomic_acquire_load(&pContext->mSnapshotSeq);
+        if ((seq & 1) == 0) {
+            *pMeas = pContext->mSnapshot;
+            android_memory_barrier();
+            if (android_atomic_acquire_load(&pContext->mSnapshotSeq) == seq) {
+                return;
+            }
+        }
+        sched_yield();
+    }
+}
+
+void LM_reset(LoudnessMeterContext *pContext)
+{
+    ALOGV("  > LM_reset(%p)", pContext);
+
+    if (pContext->mMeter != NULL) {
+        pContext->mMeter->Initialize(pContext->mConfig.inputCfg.samplingRate);
+        LM_publishMeasurements(pContext, true /*loudness*/);
+    } else {
+        ALOGE("LM_reset(%p): null meter", pContext);
+    }
+}
+
+//----------------------------------------------------------------------------
+// LM_setConfig()
+//----------------------------------------------------------------------------
+// Purpose: Set input and output audio configuration.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  pConfig:    pointer to effect_config_t structure holding input and output
+//      configuration parameters
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+int LM_setConfig(LoudnessMeterContext *pContext, effect_config_t *pConfig)
+{
+    ALOGV("LM_setConfig(%p)", pContext);
+
+    if (pConfig->inputCfg.samplingRate != pConfig->outputCfg.samplingRate) return -EINVAL;
+    if (pConfig->inputCfg.samplingRate == 0) return -EINVAL;
+    if (pConfig->inputCfg.channels != pConfig->outputCfg.channels) return -EINVAL;
+    if (pConfig->inputCfg.format != pConfig->outputCfg.format) return -EINVAL;
+    if (pConfig->inputCfg.channels != AUDIO_CHANNEL_OUT_STEREO) return -EINVAL;
+    if (pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_WRITE &&
+            pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_ACCUMULATE) return -EINVAL;
+    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+            pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT) return -EINVAL;
+
+    pContext->mConfig = *pConfig;
+
+    LM_reset(pContext);
+
+    return 0;
+}
+
+
+//----------------------------------------------------------------------------
+// LM_getConfig()
+//----------------------------------------------------------------------------
+// Purpose: Get input and output audio configuration.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  pConfig:    pointer to effect_config_t structure holding input and output
+//      configuration parameters
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+void LM_getConfig(LoudnessMeterContext *pContext, effect_config_t *pConfig)
+{
+    *pConfig = pContext->mConfig;
+}
+
+
+//----------------------------------------------------------------------------
+// LM_init()
+//----------------------------------------------------------------------------
+// Purpose: Initialize engine with default configuration.
+//
+// Inputs:
+//  pContext:   effect engine context
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+int LM_init(LoudnessMeterContext *pContext)
+{
+    ALOGV("LM_init(%p)", pContext);
+
+    pContext->mConfig.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    pContext->mConfig.inputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+    pContext->mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    pContext->mConfig.inputCfg.samplingRate = 44100;
+    pContext->mConfig.inputCfg.bufferProvider.getBuffer = NULL;
+    pContext->mConfig.inputCfg.bufferProvider.releaseBuffer = NULL;
+    pContext->mConfig.inputCfg.bufferProvider.cookie = NULL;
+    pContext->mConfig.inputCfg.mask = EFFECT_CONFIG_ALL;
+    pContext->mConfig.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_ACCUMULATE;
+    pContext->mConfig.outputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+    pContext->mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    pContext->mConfig.outputCfg.samplingRate = 44100;
+    pContext->mConfig.outputCfg.bufferProvider.getBuffer = NULL;
+    pContext->mConfig.outputCfg.bufferProvider.releaseBuffer = NULL;
+    pContext->mConfig.outputCfg.bufferProvider.cookie = NULL;
+    pContext->mConfig.outputCfg.mask = EFFECT_CONFIG_ALL;
+
+    if (pContext->mMeter == NULL) {
+        pContext->mMeter = new le_fx::LoudnessMeter();
+    }
+
+    LM_setConfig(pContext, &pContext->mConfig);
+
+    return 0;
+}
+
+//
+//--- Effect Library Interface Implementation
+//
+
+int LMLib_Create(const effect_uuid_t *uuid,
+                         int32_t sessionId,
+                         int32_t ioId,
+                         effect_handle_t *pHandle) {
+    ALOGV("LMLib_Create()");
+    int ret;
+
+    if (pHandle == NULL || uuid == NULL) {
+        return -EINVAL;
+    }
+
+    if (memcmp(uuid, &gLMDescriptor.uuid, sizeof(effect_uuid_t)) != 0) {
+        return -EINVAL;
+    }
+
+    LoudnessMeterContext *pContext = new LoudnessMeterContext;
+
+    pContext->mItfe = &gLMInterface;
+    pContext->mState = LOUDNESS_METER_STATE_UNINITIALIZED;
+
+    pContext->mMeter = NULL;
+    pContext->mSnapshotSeq = 0;
+    memset(&pContext->mSnapshot, 0, sizeof(pContext->mSnapshot));
+    pContext->mSnapshotSteps = 0;
+    ret = LM_init(pContext);
+    if (ret < 0) {
+        ALOGW("LMLib_Create() init failed");
+        delete pContext;
+        return ret;
+    }
+
+    *pHandle = (effect_handle_t)pContext;
+
+    pContext->mState = LOUDNESS_METER_STATE_INITIALIZED;
+
+    ALOGV("  LMLib_Create context is %p", pContext);
+
+    return 0;
+
+}
+
+int LMLib_Release(effect_handle_t handle) {
+    LoudnessMeterContext * pContext = (LoudnessMeterContext *)handle;
+
+    ALOGV("LMLib_Release %p", handle);
+    if (pContext == NULL) {
+        return -EINVAL;
+    }
+    pContext->mState = LOUDNESS_METER_STATE_UNINITIALIZED;
+    if (pContext->mMeter != NULL) {
+        delete pContext->mMeter;
+        pContext->mMeter = NULL;
+    }
+    delete pContext;
+
+    return 0;
+}
+
+int LMLib_GetDescriptor(const effect_uuid_t *uuid,
+                                effect_descriptor_t *pDescriptor) {
+
+    if (pDescriptor == NULL || uuid == NULL){
+        ALOGV("LMLib_GetDescriptor() called with NULL pointer");
+        return -EINVAL;
+    }
+
+    if (memcmp(uuid, &gLMDescriptor.uuid, sizeof(effect_uuid_t)) == 0) {
+        *pDescriptor = gLMDescriptor;
+        return 0;
+    }
+
+    return  -EINVAL;
+} /* end LMLib_GetDescriptor */
+
+//
+//--- Effect Control Interface Implementation
+//
+int LM_process(
+        effect_handle_t self, audio_buffer_t *inBuffer, audio_buffer_t *outBuffer)
+{
+    LoudnessMeterContext * pContext = (LoudnessMeterContext *)self;
+
+    if (pContext == NULL) {
+        return -EINVAL;
+    }
+
+    if (inBuffer == NULL || inBuffer->raw == NULL ||
+        outBuffer == NULL || outBuffer->raw == NULL ||
+        inBuffer->frameCount != outBuffer->frameCount ||
+        inBuffer->frameCount == 0) {
+        return -EINVAL;
+    }
+
+    // the audio is measured as is and passed through
+    if (pContext->mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+        pContext->mMeter->Process(inBuffer->f32, inBuffer->frameCount);
+
+        if (inBuffer->raw != outBuffer->raw) {
+            if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
+                for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
+                    outBuffer->f32[i] += inBuffer->f32[i];
+                }
+            } else {
+                memcpy(outBuffer->raw, inBuffer->raw, outBuffer->frameCount * 2 * sizeof(float));
+            }
+        }
+    } else {
+        pContext->mMeter->Process(inBuffer->s16, inBuffer->frameCount);
+
+        if (inBuffer->raw != outBuffer->raw) {
+            if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
+                for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
+                    outBuffer->s16[i] = clamp16(outBuffer->s16[i] + inBuffer->s16[i]);
+                }
+            } else {
+                memcpy(outBuffer->raw, inBuffer->raw,
+                        outBuffer->frameCount * 2 * sizeof(int16_t));
+            }
+        }
+    }
+    LM_publishMeasurements(pContext,
+            pContext->mMeter->step_count() != pContext->mSnapshotSteps /*loudness*/);
+
+    if (pContext->mState != LOUDNESS_METER_STATE_ACTIVE) {
+        return -ENODATA;
+    }
+    return 0;
+}
+
+int LM_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
+        void *pCmdData, uint32_t *replySize, void *pReplyData) {
+
+    LoudnessMeterContext * pContext = (LoudnessMeterContext *)self;
+
+    if (pContext == NULL || pContext->mState == LOUDNESS_METER_STATE_UNINITIALIZED) {
+        return -EINVAL;
+    }
+
+//    ALOGV("LM_command command %d cmdSize %d",cmdCode, cmdSize);
+    switch (cmdCode) {
+    case EFFECT_CMD_INIT:
+        if (pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        *(int *) pReplyData = LM_init(pContext);
+        break;
+    case EFFECT_CMD_SET_CONFIG:
+        if (pCmdData == NULL || cmdSize != sizeof(effect_config_t)
+                || pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        *(int *) pReplyData = LM_setConfig(pContext,
+                (effect_config_t *) pCmdData);
+        break;
+    case EFFECT_CMD_GET_CONFIG:
+        if (pReplyData == NULL ||
+            *replySize != sizeof(effect_config_t)) {
+            return -EINVAL;
+        }
+        LM_getConfig(pContext, (effect_config_t *)pReplyData);
+        break;
+    case EFFECT_CMD_RESET:
+        LM_reset(pContext);
+        break;
+    case EFFECT_CMD_ENABLE:
+        if (pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        if (pContext->mState != LOUDNESS_METER_STATE_INITIALIZED) {
+            return -ENOSYS;
+        }
+        pContext->mState = LOUDNESS_METER_STATE_ACTIVE;
+        ALOGV("EFFECT_CMD_ENABLE() OK");
+        *(int *)pReplyData = 0;
+        break;
+    case EFFECT_CMD_DISABLE:
+        if (pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        if (pContext->mState != LOUDNESS_METER_STATE_ACTIVE) {
+            return -ENOSYS;
+        }
+        pContext->mState = LOUDNESS_METER_STATE_INITIALIZED;
+        ALOGV("EFFECT_CMD_DISABLE() OK");
+        *(int *)pReplyData = 0;
+        break;
+    case EFFECT_CMD_GET_PARAM: {
+        if (pCmdData == NULL ||
+            cmdSize != (int)(sizeof(effect_param_t) + sizeof(uint32_t)) ||
+            pReplyData == NULL ||
+            *replySize < (int)(sizeof(effect_param_t) + sizeof(uint32_t) + sizeof(uint32_t))) {
+            return -EINVAL;
+        }
+        const uint32_t replyCapacity = *replySize;
+        memcpy(pReplyData, pCmdData, sizeof(effect_param_t) + sizeof(uint32_t));
+        effect_param_t *p = (effect_param_t *)pReplyData;
+        p->status = 0;
+        *replySize = sizeof(effect_param_t) + sizeof(uint32_t);
+        if (p->psize != sizeof(uint32_t)) {
+            p->status = -EINVAL;
+            break;
+        }
+        loudness_meter_measurements_t meas;
+        LM_getMeasurements(pContext, &meas);
+        int32_t value = 0;
+        switch (*(uint32_t *)p->data) {
+        case LOUDNESS_METER_PARAM_MOMENTARY:
+            value = meas.momentaryClufs;
+            break;
+        case LOUDNESS_METER_PARAM_SHORT_TERM:
+            value = meas.shortTermClufs;
+            break;
+        case LOUDNESS_METER_PARAM_INTEGRATED:
+            value = meas.integratedClufs;
+            break;
+        case LOUDNESS_METER_PARAM_PEAK:
+            value = meas.peakMb;
+            break;
+        case LOUDNESS_METER_PARAM_MEASUREMENTS:
+            if (replyCapacity < sizeof(effect_param_t) + sizeof(uint32_t) + sizeof(meas)) {
+                p->status = -EINVAL;
+                break;
+            }
+            memcpy((uint32_t *)p->data + 1, &meas, sizeof(meas));
+            p->vsize = sizeof(meas);
+            *replySize += sizeof(meas);
+            break;
+        default:
+            p->status = -EINVAL;
+            break;
+        }
+        if (p->status == 0 && *(uint32_t *)p->data != LOUDNESS_METER_PARAM_MEASUREMENTS) {
+            ALOGV("get param %u = %d", *(uint32_t *)p->data, value);
+            *((int32_t *)p->data + 1) = value;
+            p->vsize = sizeof(int32_t);
+            *replySize += sizeof(int32_t);
+        }
+        } break;
+    case EFFECT_CMD_SET_PARAM:
+        // all parameters are read only
+        if (pReplyData == NULL || *replySize != sizeof(int32_t)) {
+            return -EINVAL;
+        }
+        *(int32_t *)pReplyData = -EINVAL;
+        break;
+    case EFFECT_CMD_SET_DEVICE:
+    case EFFECT_CMD_SET_VOLUME:
+    case EFFECT_CMD_SET_AUDIO_MODE:
+        break;
+
+    default:
+        ALOGW("LM_command invalid command %d",cmdCode);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/* Effect Control Interface Implementation: get_descriptor */
+int LM_getDescriptor(effect_handle_t   self,
+                                    effect_descriptor_t *pDescriptor)
+{
+    LoudnessMeterContext * pContext = (LoudnessMeterContext *) self;
+
+    if (pContext == NULL || pDescriptor == NULL) {
+        ALOGV("LM_getDescriptor() invalid param");
+        return -EINVAL;
+    }
+
+    *pDescriptor = gLMDescriptor;
+
+    return 0;
+}   /* end LM_getDescriptor */
+
+// effect_handle_t interface implementation for LM effect
+const struct effect_interface_s gLMInterface = {
+        LM_process,
+        LM_command,
+        LM_getDescriptor,
+        NULL,
+};
+
+// This is the only symbol that needs to be exported
+__attribute__ ((visibility ("default")))
+audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM = {
+    .tag = AUDIO_EFFECT_LIBRARY_TAG,
+    .version = EFFECT_LIBRARY_API_VERSION,
+    .name = "Loudness Meter Library",
+    .implementor = "The Android Open Source Project",
+    .create_effect = LMLib_Create,
+    .release_effect = LMLib_Release,
+    .get_descriptor = LMLib_GetDescriptor,
+};
+
+}; // extern "C"
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LE_FX_ENGINE_DSP_CORE_LOUDNESS_METER_INL_H_
+#define LE_FX_ENGINE_DSP_CORE_LOUDNESS_METER_INL_H_
+
+
+namespace le_fx {
+
+
+inline float LoudnessMeter::peak() const {
+  return peak_;
+}
+
+
+inline int64 LoudnessMeter::frame_count() const {
+  return step_count_ * step_frames_ + step_frame_count_;
+}
+
+
+inline int64 LoudnessMeter::step_count() const {
+  return step_count_;
+}
+
+}  // namespace le_fx
+
+
+#endif  // LE_FX_ENGINE_DSP_CORE_LOUDNESS_METER_INL_H_
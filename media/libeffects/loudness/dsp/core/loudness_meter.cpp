@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LE_FX_USE_NEON
+#endif
+
+#include "common/core/math.h"
+#include "common/core/types.h"
+#include "dsp/core/loudness_meter.h"
+
+//#define LOG_NDEBUG 0
+#include <cutils/log.h>
+
+
+namespace le_fx {
+
+// Definitions for static const class members declared in loudness_meter.h.
+const float LoudnessMeter::kSilence = -HUGE_VALF;
+const float LoudnessMeter::kAbsoluteGate = -70.0f;
+const float LoudnessMeter::kRelativeGate = -10.0f;
+const float LoudnessMeter::kHistogramMin = -70.0f;
+const float LoudnessMeter::kHistogramMax = 10.0f;
+const float LoudnessMeter::kHistogramStep =
+    (LoudnessMeter::kHistogramMax - LoudnessMeter::kHistogramMin) /
+    LoudnessMeter::kHistogramBins;
+
+namespace {
+
+// Loudness of a K-weighted mean square summed over the channels.
+inline double Loudness(double mean_square) {
+  return -0.691 + 10.0 * std::log10(mean_square);
+}
+
+inline float ToFloat(float sample, float scale) {
+  return sample * scale;
+}
+
+inline float ToFloat(int16 sample, float scale) {
+  return static_cast<float>(sample) * scale;
+}
+
+#ifdef LE_FX_USE_NEON
+inline float32x2_t LoadFrame(const float *data, float32x2_t scale) {
+  return vmul_f32(vld1_f32(data), scale);
+}
+
+inline float32x2_t LoadFrame(const int16 *data, float32x2_t scale) {
+  const int32x2_t frame = { data[0], data[1] };
+  return vmul_f32(vcvt_f32_s32(frame), scale);
+}
+#endif
+
+}  // namespace
+
+LoudnessMeter::LoudnessMeter() {
+  Initialize(48000.0f);
+}
+
+bool LoudnessMeter::Initialize(float sampling_rate) {
+  if (!(sampling_rate > 0.0f)) {
+    return false;
+  }
+  // The filters of BS.1770 are specified at 48 kHz; they are redesigned here
+  // for the actual rate from their analog prototypes.
+  double f0 = 1681.974450955533;
+  double gain_db = 3.999843853973347;
+  double q = 0.7071752369554196;
+  double k = std::tan(M_PI * f0 / sampling_rate);
+  const double vh = std::pow(10.0, gain_db / 20.0);
+  const double vb = std::pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  shelf_.b0 = (vh + vb * k / q + k * k) / a0;
+  shelf_.b1 = 2.0 * (k * k - vh) / a0;
+  shelf_.b2 = (vh - vb * k / q + k * k) / a0;
+  shelf_.a1 = -2.0 * (k * k - 1.0) / a0;
+  shelf_.a2 = -(1.0 - k / q + k * k) / a0;
+
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = std::tan(M_PI * f0 / sampling_rate);
+  a0 = 1.0 + k / q + k * k;
+  high_pass_.b0 = 1.0f;
+  high_pass_.b1 = -2.0f;
+  high_pass_.b2 = 1.0f;
+  high_pass_.a1 = -2.0 * (k * k - 1.0) / a0;
+  high_pass_.a2 = -(1.0 - k / q + k * k) / a0;
+
+  step_frames_ = static_cast<int>(sampling_rate * kStepMs / 1000 + 0.5f);
+  Reset();
+  return true;
+}
+
+void LoudnessMeter::Reset() {
+  memset(shelf_state_, 0, sizeof(shelf_state_));
+  memset(high_pass_state_, 0, sizeof(high_pass_state_));
+  step_frame_count_ = 0;
+  step_sum_ = 0.0;
+  memset(steps_, 0, sizeof(steps_));
+  step_index_ = 0;
+  step_count_ = 0;
+  peak_ = 0.0f;
+  memset(histogram_sum_, 0, sizeof(histogram_sum_));
+  memset(histogram_count_, 0, sizeof(histogram_count_));
+}
+
+void LoudnessMeter::Process(const float *data, int frame_count) {
+  while (frame_count > 0) {
+    const int frames = ProcessStep(data, frame_count, 1.0f);
+    data += 2 * frames;
+    frame_count -= frames;
+  }
+}
+
+void LoudnessMeter::Process(const int16 *data, int frame_count) {
+  while (frame_count > 0) {
+    const int frames = ProcessStep(data, frame_count, 1.0f / 32768.0f);
+    data += 2 * frames;
+    frame_count -= frames;
+  }
+}
+
+template <typename T>
+int LoudnessMeter::ProcessStep(const T *data, int frame_count, float scale) {
+  const int frames = min(frame_count, step_frames_ - step_frame_count_);
+#ifdef LE_FX_USE_NEON
+  // both channels are filtered together, one per lane
+  const float32x2_t scale2 = vdup_n_f32(scale);
+  float32x2_t s0 = { shelf_state_[0][0], shelf_state_[1][0] };
+  float32x2_t s1 = { shelf_state_[0][1], shelf_state_[1][1] };
+  float32x2_t h0 = { high_pass_state_[0][0], high_pass_state_[1][0] };
+  float32x2_t h1 = { high_pass_state_[0][1], high_pass_state_[1][1] };
+  float32x2_t sum = vdup_n_f32(0.0f);
+  float32x2_t peak = vdup_n_f32(0.0f);
+  for (int i = 0; i < frames; ++i) {
+    const float32x2_t x = LoadFrame(data + 2 * i, scale2);
+    peak = vmax_f32(peak, vabs_f32(x));
+    const float32x2_t y = vmla_n_f32(s0, x, shelf_.b0);
+    s0 = vmla_n_f32(vmla_n_f32(s1, x, shelf_.b1), y, shelf_.a1);
+    s1 = vmla_n_f32(vmul_n_f32(x, shelf_.b2), y, shelf_.a2);
+    const float32x2_t z = vmla_n_f32(h0, y, high_pass_.b0);
+    h0 = vmla_n_f32(vmla_n_f32(h1, y, high_pass_.b1), z, high_pass_.a1);
+    h1 = vmla_n_f32(vmul_n_f32(y, high_pass_.b2), z, high_pass_.a2);
+    sum = vmla_f32(sum, z, z);
+  }
+  shelf_state_[0][0] = vget_lane_f32(s0, 0);
+  shelf_state_[1][0] = vget_lane_f32(s0, 1);
+  shelf_state_[0][1] = vget_lane_f32(s1, 0);
+  shelf_state_[1][1] = vget_lane_f32(s1, 1);
+  high_pass_state_[0][0] = vget_lane_f32(h0, 0);
+  high_pass_state_[1][0] = vget_lane_f32(h0, 1);
+  high_pass_state_[0][1] = vget_lane_f32(h1, 0);
+  high_pass_state_[1][1] = vget_lane_f32(h1, 1);
+  step_sum_ += static_cast<double>(vget_lane_f32(sum, 0)) + vget_lane_f32(sum, 1);
+  peak_ = max(peak_, max(vget_lane_f32(peak, 0), vget_lane_f32(peak, 1)));
+#else
+  for (int c = 0; c < 2; ++c) {
+    float s0 = shelf_state_[c][0];
+    float s1 = shelf_state_[c][1];
+    float h0 = high_pass_state_[c][0];
+    float h1 = high_pass_state_[c][1];
+    float sum = 0.0f;
+    float peak = 0.0f;
+    for (int i = 0; i < frames; ++i) {
+      const float x = ToFloat(data[2 * i + c], scale);
+      peak = max(peak, std::fabs(x));
+      const float y = shelf_.b0 * x + s0;
+      s0 = shelf_.b1 * x + shelf_.a1 * y + s1;
+      s1 = shelf_.b2 * x + shelf_.a2 * y;
+      const float z = high_pass_.b0 * y + h0;
+      h0 = high_pass_.b1 * y + high_pass_.a1 * z + h1;
+      h1 = high_pass_.b2 * y + high_pass_.a2 * z;
+      sum += z * z;
+    }
+    shelf_state_[c][0] = s0;
+    shelf_state_[c][1] = s1;
+    high_pass_state_[c][0] = h0;
+    high_pass_state_[c][1] = h1;
+    step_sum_ += sum;
+    peak_ = max(peak_, peak);
+  }
+#endif
+  step_frame_count_ += frames;
+  if (step_frame_count_ == step_frames_) {
+    EndStep();
+  }
+  return frames;
+}
+
+void LoudnessMeter::EndStep() {
+  steps_[step_index_] = step_sum_ / step_frames_;
+  step_index_ = (step_index_ + 1) % kShortTermSteps;
+  ++step_count_;
+  step_sum_ = 0.0;
+  step_frame_count_ = 0;
+
+  // a new gating block ends with every step, they overlap by 75%
+  const double block = MeanSquare(kMomentarySteps);
+  if (block > 0.0 && Loudness(block) > kAbsoluteGate) {
+    const int index = HistogramIndex(Loudness(block));
+    histogram_sum_[index] += block;
+    ++histogram_count_[index];
+  }
+}
+
+double LoudnessMeter::MeanSquare(int steps) const {
+  if (step_count_ < steps) {
+    return -1.0;
+  }
+  double sum = 0.0;
+  for (int i = 1; i <= steps; ++i) {
+    sum += steps_[(step_index_ + kShortTermSteps - i) % kShortTermSteps];
+  }
+  return sum / steps;
+}
+
+int LoudnessMeter::HistogramIndex(double loudness) {
+  const int index =
+      static_cast<int>((loudness - kHistogramMin) / kHistogramStep);
+  return max(0, min(index, kHistogramBins - 1));
+}
+
+float LoudnessMeter::MomentaryLoudness() const {
+  const double mean_square = MeanSquare(kMomentarySteps);
+  return mean_square > 0.0 ? Loudness(mean_square) : kSilence;
+}
+
+float LoudnessMeter::ShortTermLoudness() const {
+  const double mean_square = MeanSquare(kShortTermSteps);
+  return mean_square > 0.0 ? Loudness(mean_square) : kSilence;
+}
+
+float LoudnessMeter::IntegratedLoudness() const {
+  // the relative gate is 10 LU below the loudness of the blocks above the
+  // absolute gate
+  double sum = 0.0;
+  uint64 count = 0;
+  for (int i = 0; i < kHistogramBins; ++i) {
+    sum += histogram_sum_[i];
+    count += histogram_count_[i];
+  }
+  if (count == 0) {
+    return kSilence;
+  }
+  // blocks are gated with the resolution of the histogram
+  const int first = HistogramIndex(Loudness(sum / count) + kRelativeGate);
+  sum = 0.0;
+  count = 0;
+  for (int i = first; i < kHistogramBins; ++i) {
+    sum += histogram_sum_[i];
+    count += histogram_count_[i];
+  }
+  return count != 0 ? Loudness(sum / count) : kSilence;
+}
+
+}  // namespace le_fx
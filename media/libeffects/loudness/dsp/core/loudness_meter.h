@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef LE_FX_ENGINE_DSP_CORE_LOUDNESS_METER_H_
+#define LE_FX_ENGINE_DSP_CORE_LOUDNESS_METER_H_
+
+#include "common/core/types.h"
+#include "common/core/math.h"
+
+
+namespace le_fx {
+
+// A streaming stereo loudness meter as specified by ITU-R BS.1770. The input is
+// K-weighted and its mean square is accumulated over 100 ms steps, from which
+// the momentary (400 ms) and short-term (3 s) loudness are derived. The 400 ms
+// gating blocks are kept in a histogram, so the gated integrated loudness
+// needs constant memory however long the stream is.
+//
+// Process() only filters and accumulates; the loudness is computed when it is
+// read, so the per-block cost is the filter and a few operations per 100 ms.
+class LoudnessMeter {
+ public:
+  LoudnessMeter();
+
+  // Initializes the meter for a sampling rate and clears all measurements.
+  bool Initialize(float sampling_rate);
+
+  // Clears all measurements, keeping the sampling rate.
+  void Reset();
+
+  // Measures interleaved stereo samples, full scale is 1.0f.
+  void Process(const float *data, int frame_count);
+
+  // Same for 16 bit samples.
+  void Process(const int16 *data, int frame_count);
+
+  // Loudness values in LUFS, or kSilence when there is not enough audio yet
+  // or all of it is below the absolute gate.
+  float MomentaryLoudness() const;
+  float ShortTermLoudness() const;
+  float IntegratedLoudness() const;
+
+  // Sample peak since the last reset, in linear full scale units.
+  float peak() const;
+
+  // Number of frames measured since the last reset.
+  int64 frame_count() const;
+
+  // Number of 100 ms steps completed since the last reset; the loudness values
+  // only change when it does.
+  int64 step_count() const;
+
+  static const float kSilence;
+
+ private:
+  // Second order section in transposed direct form II, with -a1 and -a2.
+  struct Biquad {
+    float b0, b1, b2, a1, a2;
+  };
+
+  // Filters and accumulates at most the rest of the current 100 ms step, the
+  // samples are converted to float by scaling them with |scale|.
+  template <typename T>
+  int ProcessStep(const T *data, int frame_count, float scale);
+
+  // Ends the current 100 ms step.
+  void EndStep();
+
+  // Mean square of the last |steps| steps, or a negative value if fewer steps
+  // were measured.
+  double MeanSquare(int steps) const;
+
+  static int HistogramIndex(double loudness);
+
+  // Duration of a step, and number of steps in the momentary and short-term
+  // windows; the momentary window is also the gating block.
+  static const int kStepMs = 100;
+  static const int kMomentarySteps = 4;
+  static const int kShortTermSteps = 30;
+  // Gating thresholds
+  static const float kAbsoluteGate;
+  static const float kRelativeGate;
+  // The histogram of gating blocks spans kHistogramMin to kHistogramMax LUFS in
+  // kHistogramStep LU bins; louder blocks go in the last bin.
+  static const float kHistogramMin;
+  static const float kHistogramMax;
+  static const float kHistogramStep;
+  static const int kHistogramBins = 800;
+
+  // K-weighting: a high shelf and a high-pass filter
+  Biquad shelf_;
+  Biquad high_pass_;
+  // filter states, index 0 is left and 1 is right
+  float shelf_state_[2][2];
+  float high_pass_state_[2][2];
+
+  int step_frames_;
+  // frames and sum of squares of the current step
+  int step_frame_count_;
+  double step_sum_;
+  // mean square of the last kShortTermSteps steps, a ring buffer
+  double steps_[kShortTermSteps];
+  int step_index_;
+  int64 step_count_;
+  float peak_;
+  // sum of the mean squares and count of the gating blocks above the absolute
+  // gate, per bin
+  double histogram_sum_[kHistogramBins];
+  uint32 histogram_count_[kHistogramBins];
+
+  LE_FX_DISALLOW_COPY_AND_ASSIGN(LoudnessMeter);
+};
+
+}  // namespace le_fx
+
+#include "dsp/core/loudness_meter-inl.h"
+
+#endif  // LE_FX_ENGINE_DSP_CORE_LOUDNESS_METER_H_
@@ -0,0 +1,31 @@
+# Build the unit tests.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := loudness_meter_tests
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	loudness_meter_tests.cpp \
+	../EffectLoudnessMeter.cpp \
+	../dsp/core/loudness_meter.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libstlport
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main
+
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-effects) \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	frameworks/av/media/libeffects/loudness
+
+include $(BUILD_EXECUTABLE)
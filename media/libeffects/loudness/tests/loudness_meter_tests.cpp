@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "loudness_meter_tests"
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <vector>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+#include <media/EffectLoudnessMeterApi.h>
+
+extern "C" audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM;
+
+// implementation uuid of the loudness meter, see EffectLoudnessMeter.cpp
+static const effect_uuid_t kLoudnessMeterUuid =
+        {0x9a162b50, 0x8593, 0x4284, 0xb86f, {0x68, 0x39, 0x40, 0xd4, 0x4a, 0x2c}};
+
+static const uint32_t kSamplingRate = 48000;
+static const size_t kFrameCount = 960;  // 20 ms
+
+// loudness is checked to 0.1 LU, the peak to 0.05 dB
+static const int32_t kLoudnessTolerance = 10;
+static const int32_t kPeakTolerance = 5;
+
+class LoudnessMeterTest : public ::testing::Test {
+public:
+    LoudnessMeterTest() : mHandle(NULL), mPhase(0) {
+    }
+
+    virtual void SetUp() {
+        ASSERT_EQ(0, AUDIO_EFFECT_LIBRARY_INFO_SYM.create_effect(
+                &kLoudnessMeterUuid, 0 /*sessionId*/, 0 /*ioId*/, &mHandle));
+
+        effect_config_t config;
+        memset(&config, 0, sizeof(config));
+        config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+        config.inputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+        config.inputCfg.format = AUDIO_FORMAT_PCM_FLOAT;
+        config.inputCfg.samplingRate = kSamplingRate;
+        config.inputCfg.mask = EFFECT_CONFIG_ALL;
+        config.outputCfg = config.inputCfg;
+        config.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
+        int reply = -1;
+        uint32_t replySize = sizeof(reply);
+        ASSERT_EQ(0, (*mHandle)->command(mHandle, EFFECT_CMD_SET_CONFIG,
+                sizeof(config), &config, &replySize, &reply));
+        ASSERT_EQ(0, reply);
+
+        replySize = sizeof(reply);
+        ASSERT_EQ(0, (*mHandle)->command(mHandle, EFFECT_CMD_ENABLE,
+                0, NULL, &replySize, &reply));
+        ASSERT_EQ(0, reply);
+    }
+
+    virtual void TearDown() {
+        if (mHandle != NULL) {
+            AUDIO_EFFECT_LIBRARY_INFO_SYM.release_effect(mHandle);
+        }
+    }
+
+    // Processes a stereo 997 Hz sine with the same level on both channels, at level dBFS;
+    // a level of -INFINITY processes silence.
+    void process(float level, float seconds) {
+        const float amplitude = powf(10.0f, level / 20.0f);
+        const double phaseIncrement = 2 * M_PI * 997 / kSamplingRate;
+        std::vector<float> buffer(kFrameCount * 2);
+        size_t frames = (size_t)(seconds * kSamplingRate);
+        while (frames > 0) {
+            const size_t count = frames < kFrameCount ? frames : kFrameCount;
+            for (size_t i = 0; i < count; i++) {
+                mPhase += phaseIncrement;
+                buffer[2 * i] = buffer[2 * i + 1] = amplitude * sin(mPhase);
+            }
+            audio_buffer_t in;
+            in.frameCount = count;
+            in.f32 = &buffer[0];
+            audio_buffer_t out = in;
+            ASSERT_EQ(0, (*mHandle)->process(mHandle, &in, &out));
+            frames -= count;
+        }
+    }
+
+    void getMeasurements(loudness_meter_measurements_t *meas) {
+        uint32_t cmd[(sizeof(effect_param_t) + sizeof(uint32_t)) / sizeof(uint32_t)];
+        effect_param_t *param = (effect_param_t *)cmd;
+        param->psize = sizeof(uint32_t);
+        param->vsize = sizeof(*meas);
+        *(uint32_t *)param->data = LOUDNESS_METER_PARAM_MEASUREMENTS;
+
+        uint32_t reply[(sizeof(effect_param_t) + sizeof(uint32_t) + sizeof(*meas))
+                / sizeof(uint32_t)];
+        uint32_t replySize = sizeof(reply);
+        ASSERT_EQ(0, (*mHandle)->command(mHandle, EFFECT_CMD_GET_PARAM,
+                sizeof(cmd), cmd, &replySize, reply));
+        effect_param_t *result = (effect_param_t *)reply;
+        ASSERT_EQ(0, result->status);
+        ASSERT_EQ(sizeof(*meas), result->vsize);
+        memcpy(meas, (uint32_t *)result->data + 1, sizeof(*meas));
+    }
+
+protected:
+    effect_handle_t mHandle;
+    double mPhase;
+};
+
+// BS.1770 calibration: a 997 Hz sine at -20 dBFS on both channels reads -20 LUFS.
+TEST_F(LoudnessMeterTest, SineCalibration) {
+    process(-20.0f, 10.0f);
+
+    loudness_meter_measurements_t meas;
+    getMeasurements(&meas);
+    EXPECT_NEAR(-2000, meas.momentaryClufs, kLoudnessTolerance);
+    EXPECT_NEAR(-2000, meas.shortTermClufs, kLoudnessTolerance);
+    EXPECT_NEAR(-2000, meas.integratedClufs, kLoudnessTolerance);
+    EXPECT_NEAR(-2000, meas.peakMb, kPeakTolerance);
+    EXPECT_EQ(10000u, meas.durationMs);
+}
+
+// Silence is below the absolute gate: it empties the momentary and short-term windows but
+// leaves the integrated loudness unchanged.
+TEST_F(LoudnessMeterTest, SilenceIsGated) {
+    loudness_meter_measurements_t meas;
+    process(-INFINITY, 5.0f);
+    getMeasurements(&meas);
+    EXPECT_EQ(LOUDNESS_METER_SILENCE_CLUFS, meas.momentaryClufs);
+    EXPECT_EQ(LOUDNESS_METER_SILENCE_CLUFS, meas.integratedClufs);
+
+    process(-20.0f, 10.0f);
+    process(-INFINITY, 10.0f);
+    getMeasurements(&meas);
+    EXPECT_EQ(LOUDNESS_METER_SILENCE_CLUFS, meas.momentaryClufs);
+    EXPECT_EQ(LOUDNESS_METER_SILENCE_CLUFS, meas.shortTermClufs);
+    // the overlapping blocks across the end of the tone are partly silent but pass the
+    // gates, and lower the integrated loudness by about 0.1 LU
+    EXPECT_NEAR(-2000, meas.integratedClufs, 2 * kLoudnessTolerance);
+    EXPECT_EQ(25000u, meas.durationMs);
+}
+
+// Blocks more than 10 LU below the ungated loudness are excluded by the relative gate;
+// without it, equal parts at -20 and -40 LUFS would integrate to -22.97 LUFS.
+TEST_F(LoudnessMeterTest, RelativeGate) {
+    process(-20.0f, 10.0f);
+    process(-40.0f, 10.0f);
+
+    loudness_meter_measurements_t meas;
+    getMeasurements(&meas);
+    EXPECT_NEAR(-4000, meas.momentaryClufs, kLoudnessTolerance);
+    EXPECT_NEAR(-2000, meas.integratedClufs, kLoudnessTolerance);
+}
+
+// The measurements can be read while the audio is processed on another thread.
+struct ReaderArgs {
+    LoudnessMeterTest *test;
+    volatile bool done;
+    bool consistent;
+};
+
+TEST_F(LoudnessMeterTest, ConcurrentRead) {
+    struct Reader {
+        static void *run(void *arg) {
+            ReaderArgs *args = (ReaderArgs *)arg;
+            uint32_t lastDurationMs = 0;
+            while (!args->done) {
+                loudness_meter_measurements_t meas;
+                args->test->getMeasurements(&meas);
+                // durations only grow, and the level never exceeds what is played
+                if (meas.durationMs < lastDurationMs
+                        || meas.momentaryClufs > -2000 + kLoudnessTolerance
+                        || meas.peakMb > -2000 + kPeakTolerance) {
+                    args->consistent = false;
+                }
+                lastDurationMs = meas.durationMs;
+            }
+            return NULL;
+        }
+    };
+    ReaderArgs args = { this, false, true };
+    pthread_t reader;
+    ASSERT_EQ(0, pthread_create(&reader, NULL, Reader::run, &args));
+    process(-20.0f, 20.0f);
+    args.done = true;
+    pthread_join(reader, NULL);
+    EXPECT_TRUE(args.consistent);
+}
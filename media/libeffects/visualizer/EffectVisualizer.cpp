@@ -25,6 +25,7 @@
 #include <time.h>
 #include <math.h>
 #include <audio_effects/effect_visualizer.h>
+#include <media/EffectVisualizerApi.h>
 
 
 extern "C" {
@@ -68,6 +69,28 @@ struct BufferStats {
     float mRmsSquared; // the average square of the samples in a buffer
 };
 
+struct BatchedStats {
+    uint16_t mPeakU16;
+    float mRmsSquared;
+    uint32_t mFrameCount;
+};
+
+// State for VISUALIZER_CMD_SPECTRUM, only allocated while the spectrum size is not 0.
+// The tables are built when the size or window is set, so a spectrum request only runs
+// the FFT.
+struct SpectrumContext {
+    // mono 16 bit samples as played, indexed like mCaptureBuf
+    int16_t mHistory[CAPTURE_BUF_SIZE];
+    uint32_t mLastSpectrumIdx;
+    float mWindow[VISUALIZER_CAPTURE_SIZE_MAX];
+    // cos and sin of 2*pi*k/size for k < size/2
+    float mCos[VISUALIZER_CAPTURE_SIZE_MAX / 2];
+    float mSin[VISUALIZER_CAPTURE_SIZE_MAX / 2];
+    float mScale;   // from 16 bit FFT magnitude to full scale sine = 1.0
+    float mRe[VISUALIZER_CAPTURE_SIZE_MAX / 2];
+    float mIm[VISUALIZER_CAPTURE_SIZE_MAX / 2];
+};
+
 struct VisualizerContext {
     const struct effect_interface_s *mItfe;
     effect_config_t mConfig;
@@ -85,6 +108,14 @@ struct VisualizerContext {
     uint8_t mMeasurementWindowSizeInBuffers;
     uint8_t mMeasurementBufferIdx;
     BufferStats mPastMeasurements[MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS];
+    // measurements not yet returned by VISUALIZER_CMD_MEASURE_BATCH
+    uint32_t mBatchIdx;
+    uint32_t mBatchCount;
+    BatchedStats mBatch[VISUALIZER_MEASURE_BATCH_MAX];
+    // for spectra
+    uint32_t mSpectrumSize;
+    uint32_t mSpectrumWindow;
+    SpectrumContext *mSpectrum;
 };
 
 //
@@ -115,6 +146,189 @@ void Visualizer_reset(VisualizerContext *pContext)
     pContext->mBufferUpdateTime.tv_sec = 0;
     pContext->mLatency = 0;
     memset(pContext->mCaptureBuf, 0x80, CAPTURE_BUF_SIZE);
+    pContext->mBatchIdx = 0;
+    pContext->mBatchCount = 0;
+    if (pContext->mSpectrum != NULL) {
+        memset(pContext->mSpectrum->mHistory, 0, sizeof(pContext->mSpectrum->mHistory));
+        pContext->mSpectrum->mLastSpectrumIdx = 0;
+    }
+}
+
+// Converts a level in 16 bit sample values to mB, with -96dB for silence.
+static int32_t Visualizer_levelToMb(float level)
+{
+    if (level < 0.000016f) {
+        return -9600; //-96dB
+    }
+    return (int32_t) (2000 * log10(level / 32767.0f));
+}
+
+// Returns the index in the capture buffer of the first of the size samples to return for a
+// capture, taking into account the latency not yet elapsed since the last buffer update.
+// A negative index is relative to the end of the capture buffer.
+static int32_t Visualizer_getCapturePoint(VisualizerContext *pContext, uint32_t size,
+        uint32_t deltaMs)
+{
+    int32_t latencyMs = pContext->mLatency;
+    latencyMs -= deltaMs;
+    if (latencyMs < 0) {
+        latencyMs = 0;
+    }
+    const uint32_t deltaSmpl = pContext->mConfig.inputCfg.samplingRate * latencyMs / 1000;
+    return pContext->mCaptureIdx - size - deltaSmpl;
+}
+
+//----------------------------------------------------------------------------
+// Visualizer_setSpectrum()
+//----------------------------------------------------------------------------
+// Purpose: Set the size and window of the spectra, and build the FFT tables.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  size:       spectrum size in samples, 0 to disable spectra
+//  window:     one of VISUALIZER_WINDOW_xxx
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+int Visualizer_setSpectrum(VisualizerContext *pContext, uint32_t size, uint32_t window)
+{
+    if (size != 0 && (size < VISUALIZER_CAPTURE_SIZE_MIN || size > VISUALIZER_CAPTURE_SIZE_MAX ||
+            (size & (size - 1)) != 0)) {
+        return -EINVAL;
+    }
+    if (window > VISUALIZER_WINDOW_BLACKMAN) {
+        return -EINVAL;
+    }
+    pContext->mSpectrumSize = size;
+    pContext->mSpectrumWindow = window;
+    if (size == 0) {
+        delete pContext->mSpectrum;
+        pContext->mSpectrum = NULL;
+        return 0;
+    }
+
+    SpectrumContext *pSpectrum = pContext->mSpectrum;
+    if (pSpectrum == NULL) {
+        pSpectrum = new (std::nothrow) SpectrumContext;
+        if (pSpectrum == NULL) {
+            pContext->mSpectrumSize = 0;
+            return -ENOMEM;
+        }
+        memset(pSpectrum->mHistory, 0, sizeof(pSpectrum->mHistory));
+        pSpectrum->mLastSpectrumIdx = 0;
+        pContext->mSpectrum = pSpectrum;
+    }
+
+    float sum = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        const double x = 2 * M_PI * i / size;
+        float w;
+        switch (window) {
+        case VISUALIZER_WINDOW_HANN:
+            w = 0.5 - 0.5 * cos(x);
+            break;
+        case VISUALIZER_WINDOW_HAMMING:
+            w = 0.54 - 0.46 * cos(x);
+            break;
+        case VISUALIZER_WINDOW_BLACKMAN:
+            w = 0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x);
+            break;
+        default:
+            w = 1.0f;
+            break;
+        }
+        pSpectrum->mWindow[i] = w;
+        sum += w;
+    }
+    // a sine of amplitude A in the center of a bin has a magnitude of A * sum / 2
+    pSpectrum->mScale = 2.0f / (sum * 32768.0f);
+    for (uint32_t k = 0; k < size / 2; k++) {
+        const double x = 2 * M_PI * k / size;
+        pSpectrum->mCos[k] = cos(x);
+        pSpectrum->mSin[k] = sin(x);
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// Visualizer_computeSpectrum()
+//----------------------------------------------------------------------------
+// Purpose: Compute the magnitude spectrum of the mSpectrumSize samples of the history
+//  starting at capturePoint.
+//
+// Inputs:
+//  pContext:       effect engine context
+//  capturePoint:   index of the first sample, see Visualizer_getCapturePoint()
+//
+// Outputs:
+//  pMagnitudes:    VISUALIZER_SPECTRUM_BINS(mSpectrumSize) magnitudes
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_computeSpectrum(VisualizerContext *pContext, int32_t capturePoint,
+        float *pMagnitudes)
+{
+    SpectrumContext *pSpectrum = pContext->mSpectrum;
+    const uint32_t size = pContext->mSpectrumSize;
+    // the real input of size samples is transformed as n complex samples: even samples in
+    // the real parts and odd samples in the imaginary parts.
+    const uint32_t n = size / 2;
+    float *re = pSpectrum->mRe;
+    float *im = pSpectrum->mIm;
+    const float *cosTab = pSpectrum->mCos;
+    const float *sinTab = pSpectrum->mSin;
+
+    // window, and store in bit reversed order
+    uint32_t idx = capturePoint < 0 ? capturePoint + CAPTURE_BUF_SIZE : capturePoint;
+    for (uint32_t i = 0, j = 0; i < n; i++) {
+        re[j] = pSpectrum->mHistory[idx] * pSpectrum->mWindow[2 * i];
+        idx = (idx + 1) & (CAPTURE_BUF_SIZE - 1);
+        im[j] = pSpectrum->mHistory[idx] * pSpectrum->mWindow[2 * i + 1];
+        idx = (idx + 1) & (CAPTURE_BUF_SIZE - 1);
+        // next j in bit reversed order
+        uint32_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+    }
+
+    // radix 2 decimation in time FFT of n points, twiddles exp(-2*pi*i*k/len)
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        const uint32_t half = len >> 1;
+        const uint32_t stride = size / len;
+        for (uint32_t i = 0; i < n; i += len) {
+            for (uint32_t k = 0; k < half; k++) {
+                const float wr = cosTab[k * stride];
+                const float wi = sinTab[k * stride];
+                float *pRe = re + i + k;
+                float *pIm = im + i + k;
+                const float tr = wr * pRe[half] + wi * pIm[half];
+                const float ti = wr * pIm[half] - wi * pRe[half];
+                pRe[half] = pRe[0] - tr;
+                pIm[half] = pIm[0] - ti;
+                pRe[0] += tr;
+                pIm[0] += ti;
+            }
+        }
+    }
+
+    // split the n complex bins Z into the n + 1 bins X of the real input:
+    // X[k] = (Z[k] + conj(Z[n-k])) / 2 - i * exp(-2*pi*i*k/size) * (Z[k] - conj(Z[n-k])) / 2
+    const float scale = pSpectrum->mScale;
+    pMagnitudes[0] = fabsf(re[0] + im[0]) * scale * 0.5f;
+    pMagnitudes[n] = fabsf(re[0] - im[0]) * scale * 0.5f;
+    for (uint32_t k = 1; k < n; k++) {
+        const float er = (re[k] + re[n - k]) * 0.5f;
+        const float ei = (im[k] - im[n - k]) * 0.5f;
+        const float or_ = (im[k] + im[n - k]) * 0.5f;
+        const float oi = (re[n - k] - re[k]) * 0.5f;
+        const float xr = er + cosTab[k] * or_ + sinTab[k] * oi;
+        const float xi = ei + cosTab[k] * oi - sinTab[k] * or_;
+        pMagnitudes[k] = sqrtf(xr * xr + xi * xi) * scale;
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -141,7 +355,8 @@ int Visualizer_setConfig(VisualizerContext *pContext, effect_config_t *pConfig)
     if (pConfig->inputCfg.channels != AUDIO_CHANNEL_OUT_STEREO) return -EINVAL;
     if (pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_WRITE &&
             pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_ACCUMULATE) return -EINVAL;
-    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT) return -EINVAL;
+    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+            pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT) return -EINVAL;
 
     pContext->mConfig = *pConfig;
 
@@ -218,6 +433,9 @@ int Visualizer_init(VisualizerContext *pContext)
         pContext->mPastMeasurements[i].mRmsSquared = 0;
     }
 
+    // spectrum initialization
+    Visualizer_setSpectrum(pContext, 0, VISUALIZER_WINDOW_HANN);
+
     Visualizer_setConfig(pContext, &pContext->mConfig);
 
     return 0;
@@ -246,6 +464,7 @@ int VisualizerLib_Create(const effect_uuid_t *uuid,
 
     pContext->mItfe = &gVisualizerInterface;
     pContext->mState = VISUALIZER_STATE_UNINITIALIZED;
+    pContext->mSpectrum = NULL;
 
     ret = Visualizer_init(pContext);
     if (ret < 0) {
@@ -272,6 +491,7 @@ int VisualizerLib_Release(effect_handle_t handle) {
         return -EINVAL;
     }
     pContext->mState = VISUALIZER_STATE_UNINITIALIZED;
+    delete pContext->mSpectrum;
     delete pContext;
 
     return 0;
@@ -304,6 +524,24 @@ static inline int16_t clamp16(int32_t sample)
     return sample;
 }
 
+// Returns input sample idx as a 16 bit value; measurements and captures are always
+// done on 16 bit samples whatever the configured format.
+static inline int32_t Visualizer_inSample(bool isFloat, const audio_buffer_t *inBuffer,
+        uint32_t idx)
+{
+    if (!isFloat) {
+        return inBuffer->s16[idx];
+    }
+    float f = inBuffer->f32[idx] * 32768.0f;
+    if (!(f < 32767.0f)) {
+        return 32767;   // also catches NaN
+    }
+    if (f <= -32768.0f) {
+        return -32768;
+    }
+    return (int32_t)f;
+}
+
 int Visualizer_process(
         effect_handle_t self,audio_buffer_t *inBuffer, audio_buffer_t *outBuffer)
 {
@@ -320,6 +558,8 @@ int Visualizer_process(
         return -EINVAL;
     }
 
+    const bool isFloat = pContext->mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT;
+
     // perform measurements if needed
     if (pContext->mMeasurementMode & MEASUREMENT_MODE_PEAK_RMS) {
         // find the peak and RMS squared for the new buffer
@@ -327,24 +567,34 @@ int Visualizer_process(
         int16_t maxSample = 0;
         float rmsSqAcc = 0;
         for (inIdx = 0 ; inIdx < inBuffer->frameCount * pContext->mChannelCount ; inIdx++) {
-            if (inBuffer->s16[inIdx] > maxSample) {
-                maxSample = inBuffer->s16[inIdx];
-            } else if (-inBuffer->s16[inIdx] > maxSample) {
-                maxSample = -inBuffer->s16[inIdx];
+            const int32_t smp = Visualizer_inSample(isFloat, inBuffer, inIdx);
+            if (smp > maxSample) {
+                maxSample = smp;
+            } else if (-smp > maxSample) {
+                maxSample = -smp;
             }
-            rmsSqAcc += (inBuffer->s16[inIdx] * inBuffer->s16[inIdx]);
+            rmsSqAcc += (smp * smp);
         }
         // store the measurement
+        const float rmsSquared = rmsSqAcc / (inBuffer->frameCount * pContext->mChannelCount);
         pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mPeakU16 = (uint16_t)maxSample;
-        pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mRmsSquared =
-                rmsSqAcc / (inBuffer->frameCount * pContext->mChannelCount);
+        pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mRmsSquared = rmsSquared;
         pContext->mPastMeasurements[pContext->mMeasurementBufferIdx].mIsValid = true;
         if (++pContext->mMeasurementBufferIdx >= pContext->mMeasurementWindowSizeInBuffers) {
             pContext->mMeasurementBufferIdx = 0;
         }
+        // and queue it for the next batch, the conversion to mB is left to the reader
+        BatchedStats *pStats = &pContext->mBatch[pContext->mBatchIdx];
+        pStats->mPeakU16 = (uint16_t)maxSample;
+        pStats->mRmsSquared = rmsSquared;
+        pStats->mFrameCount = inBuffer->frameCount;
+        pContext->mBatchIdx = (pContext->mBatchIdx + 1) % VISUALIZER_MEASURE_BATCH_MAX;
+        if (pContext->mBatchCount < VISUALIZER_MEASURE_BATCH_MAX) {
+            pContext->mBatchCount++;
+        }
     }
 
-    // all code below assumes stereo 16 bit PCM output and input
+    // all code below assumes stereo output and input
     int32_t shift;
 
     if (pContext->mScalingMode == VISUALIZER_SCALING_MODE_NORMALIZED) {
@@ -353,7 +603,7 @@ int Visualizer_process(
         shift = 32;
         int len = inBuffer->frameCount * 2;
         for (int i = 0; i < len; i++) {
-            int32_t smp = inBuffer->s16[i];
+            int32_t smp = Visualizer_inSample(isFloat, inBuffer, i);
             if (smp < 0) smp = -smp - 1; // take care to keep the max negative in range
             int32_t clz = __builtin_clz(smp);
             if (shift > clz) shift = clz;
@@ -375,6 +625,8 @@ int Visualizer_process(
     uint32_t captIdx;
     uint32_t inIdx;
     uint8_t *buf = pContext->mCaptureBuf;
+    // the spectrum history is not scaled, so that spectra are comparable over time
+    int16_t *history = pContext->mSpectrum != NULL ? pContext->mSpectrum->mHistory : NULL;
     for (inIdx = 0, captIdx = pContext->mCaptureIdx;
          inIdx < inBuffer->frameCount;
          inIdx++, captIdx++) {
@@ -382,7 +634,11 @@ int Visualizer_process(
             // wrap around
             captIdx = 0;
         }
-        int32_t smp = inBuffer->s16[2 * inIdx] + inBuffer->s16[2 * inIdx + 1];
+        int32_t smp = Visualizer_inSample(isFloat, inBuffer, 2 * inIdx) +
+                Visualizer_inSample(isFloat, inBuffer, 2 * inIdx + 1);
+        if (history != NULL) {
+            history[captIdx] = smp >> 1;
+        }
         smp = smp >> shift;
         buf[captIdx] = ((uint8_t)smp)^0x80;
     }
@@ -397,11 +653,18 @@ int Visualizer_process(
 
     if (inBuffer->raw != outBuffer->raw) {
         if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
-            for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
-                outBuffer->s16[i] = clamp16(outBuffer->s16[i] + inBuffer->s16[i]);
+            if (isFloat) {
+                for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
+                    outBuffer->f32[i] += inBuffer->f32[i];
+                }
+            } else {
+                for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
+                    outBuffer->s16[i] = clamp16(outBuffer->s16[i] + inBuffer->s16[i]);
+                }
             }
         } else {
-            memcpy(outBuffer->raw, inBuffer->raw, outBuffer->frameCount * 2 * sizeof(int16_t));
+            memcpy(outBuffer->raw, inBuffer->raw, outBuffer->frameCount * 2 *
+                    (isFloat ? sizeof(float) : sizeof(int16_t)));
         }
     }
     if (pContext->mState != VISUALIZER_STATE_ACTIVE) {
@@ -503,6 +766,18 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
             p->vsize = sizeof(uint32_t);
             *replySize += sizeof(uint32_t);
             break;
+        case VISUALIZER_PARAM_SPECTRUM_SIZE:
+            ALOGV("get mSpectrumSize = %" PRIu32, pContext->mSpectrumSize);
+            *((uint32_t *)p->data + 1) = pContext->mSpectrumSize;
+            p->vsize = sizeof(uint32_t);
+            *replySize += sizeof(uint32_t);
+            break;
+        case VISUALIZER_PARAM_SPECTRUM_WINDOW:
+            ALOGV("get mSpectrumWindow = %" PRIu32, pContext->mSpectrumWindow);
+            *((uint32_t *)p->data + 1) = pContext->mSpectrumWindow;
+            p->vsize = sizeof(uint32_t);
+            *replySize += sizeof(uint32_t);
+            break;
         default:
             p->status = -EINVAL;
         }
@@ -536,6 +811,16 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
             pContext->mMeasurementMode = *((uint32_t *)p->data + 1);
             ALOGV("set mMeasurementMode = %" PRIu32, pContext->mMeasurementMode);
             break;
+        case VISUALIZER_PARAM_SPECTRUM_SIZE:
+            *(int32_t *)pReplyData = Visualizer_setSpectrum(pContext,
+                    *((uint32_t *)p->data + 1), pContext->mSpectrumWindow);
+            ALOGV("set mSpectrumSize = %" PRIu32, pContext->mSpectrumSize);
+            break;
+        case VISUALIZER_PARAM_SPECTRUM_WINDOW:
+            *(int32_t *)pReplyData = Visualizer_setSpectrum(pContext,
+                    pContext->mSpectrumSize, *((uint32_t *)p->data + 1));
+            ALOGV("set mSpectrumWindow = %" PRIu32, pContext->mSpectrumWindow);
+            break;
         default:
             *(int32_t *)pReplyData = -EINVAL;
         }
@@ -565,14 +850,8 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
                     pContext->mBufferUpdateTime.tv_sec = 0;
                     memset(pReplyData, 0x80, captureSize);
             } else {
-                int32_t latencyMs = pContext->mLatency;
-                latencyMs -= deltaMs;
-                if (latencyMs < 0) {
-                    latencyMs = 0;
-                }
-                const uint32_t deltaSmpl =
-                    pContext->mConfig.inputCfg.samplingRate * latencyMs / 1000;
-                int32_t capturePoint = pContext->mCaptureIdx - captureSize - deltaSmpl;
+                int32_t capturePoint =
+                        Visualizer_getCapturePoint(pContext, captureSize, deltaMs);
 
                 if (capturePoint < 0) {
                     uint32_t size = -capturePoint;
@@ -630,22 +909,70 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         float rms = nbValidMeasurements == 0 ? 0.0f : sqrtf(sumRmsSquared / nbValidMeasurements);
         int32_t* pIntReplyData = (int32_t*)pReplyData;
         // convert from I16 sample values to mB and write results
-        if (rms < 0.000016f) {
-            pIntReplyData[MEASUREMENT_IDX_RMS] = -9600; //-96dB
-        } else {
-            pIntReplyData[MEASUREMENT_IDX_RMS] = (int32_t) (2000 * log10(rms / 32767.0f));
-        }
-        if (peakU16 == 0) {
-            pIntReplyData[MEASUREMENT_IDX_PEAK] = -9600; //-96dB
-        } else {
-            pIntReplyData[MEASUREMENT_IDX_PEAK] = (int32_t) (2000 * log10(peakU16 / 32767.0f));
-        }
+        pIntReplyData[MEASUREMENT_IDX_RMS] = Visualizer_levelToMb(rms);
+        pIntReplyData[MEASUREMENT_IDX_PEAK] = Visualizer_levelToMb(peakU16);
         ALOGV("VISUALIZER_CMD_MEASURE peak=%" PRIu16 " (%" PRId32 "mB), rms=%.1f (%" PRId32 "mB)",
                 peakU16, pIntReplyData[MEASUREMENT_IDX_PEAK],
                 rms, pIntReplyData[MEASUREMENT_IDX_RMS]);
         }
         break;
 
+    case VISUALIZER_CMD_SPECTRUM: {
+        const uint32_t spectrumSize = pContext->mSpectrumSize;
+        const uint32_t bins = VISUALIZER_SPECTRUM_BINS(spectrumSize);
+        if (spectrumSize == 0 || pReplyData == NULL || *replySize != bins * sizeof(float)) {
+            ALOGV("VISUALIZER_CMD_SPECTRUM() error *replySize %" PRIu32 " spectrumSize %" PRIu32,
+                    *replySize, spectrumSize);
+            return -EINVAL;
+        }
+        SpectrumContext *pSpectrum = pContext->mSpectrum;
+        if (pContext->mState == VISUALIZER_STATE_ACTIVE) {
+            const uint32_t deltaMs = Visualizer_getDeltaTimeMsFromUpdatedTime(pContext);
+
+            // same idle detection as VISUALIZER_CMD_CAPTURE, the capture buffer and the
+            // spectrum history are updated together
+            if ((pSpectrum->mLastSpectrumIdx == pContext->mCaptureIdx) &&
+                    (pContext->mBufferUpdateTime.tv_sec != 0) &&
+                    (deltaMs > MAX_STALL_TIME_MS)) {
+                ALOGV("spectrum going to idle");
+                memset(pReplyData, 0, *replySize);
+            } else {
+                Visualizer_computeSpectrum(pContext,
+                        Visualizer_getCapturePoint(pContext, spectrumSize, deltaMs),
+                        (float *)pReplyData);
+            }
+            pSpectrum->mLastSpectrumIdx = pContext->mCaptureIdx;
+        } else {
+            memset(pReplyData, 0, *replySize);
+        }
+        } break;
+
+    case VISUALIZER_CMD_MEASURE_BATCH: {
+        if (pReplyData == NULL || replySize == NULL ||
+                !(pContext->mMeasurementMode & MEASUREMENT_MODE_PEAK_RMS)) {
+            return -EINVAL;
+        }
+        uint32_t count = *replySize / sizeof(visualizer_measurement_t);
+        if (count > pContext->mBatchCount) {
+            count = pContext->mBatchCount;
+        }
+        // skip the oldest measurements that do not fit
+        uint32_t idx = (pContext->mBatchIdx + VISUALIZER_MEASURE_BATCH_MAX - count) %
+                VISUALIZER_MEASURE_BATCH_MAX;
+        visualizer_measurement_t *pMeasurements = (visualizer_measurement_t *)pReplyData;
+        for (uint32_t i = 0; i < count; i++) {
+            const BatchedStats *pStats = &pContext->mBatch[idx];
+            pMeasurements[i].peakMb = Visualizer_levelToMb(pStats->mPeakU16);
+            pMeasurements[i].rmsMb = Visualizer_levelToMb(sqrtf(pStats->mRmsSquared));
+            pMeasurements[i].frameCount = pStats->mFrameCount;
+            idx = (idx + 1) % VISUALIZER_MEASURE_BATCH_MAX;
+        }
+        ALOGV("VISUALIZER_CMD_MEASURE_BATCH returned %" PRIu32 " of %" PRIu32 " measurements",
+                count, pContext->mBatchCount);
+        pContext->mBatchCount = 0;
+        *replySize = count * sizeof(visualizer_measurement_t);
+        } break;
+
     default:
         ALOGW("Visualizer_command invalid command %" PRIu32, cmdCode);
         return -EINVAL;
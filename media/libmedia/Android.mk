@@ -97,3 +97,5 @@ LOCAL_MODULE := libinstantssq
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_STATIC_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
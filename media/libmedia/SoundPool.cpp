@@ -18,6 +18,7 @@
 #define LOG_TAG "SoundPool"
 
 #include <inttypes.h>
+#include <sys/stat.h>
 
 #include <utils/Log.h>
 
@@ -203,32 +204,32 @@ SoundChannel* SoundPool::findNextChannel(int channelID)
     return NULL;
 }
 
-int SoundPool::load(const char* path, int priority __unused)
+int SoundPool::load(const char* path, int priority)
 {
     ALOGV("load: path=%s, priority=%d", path, priority);
     Mutex::Autolock lock(&mLock);
     sp<Sample> sample = new Sample(++mNextSampleID, path);
     mSamples.add(sample->sampleID(), sample);
-    doLoad(sample);
+    doLoad(sample, priority);
     return sample->sampleID();
 }
 
-int SoundPool::load(int fd, int64_t offset, int64_t length, int priority __unused)
+int SoundPool::load(int fd, int64_t offset, int64_t length, int priority)
 {
     ALOGV("load: fd=%d, offset=%" PRId64 ", length=%" PRId64 ", priority=%d",
             fd, offset, length, priority);
     Mutex::Autolock lock(&mLock);
     sp<Sample> sample = new Sample(++mNextSampleID, fd, offset, length);
     mSamples.add(sample->sampleID(), sample);
-    doLoad(sample);
+    doLoad(sample, priority);
     return sample->sampleID();
 }
 
-void SoundPool::doLoad(sp<Sample>& sample)
+void SoundPool::doLoad(sp<Sample>& sample, int priority)
 {
     ALOGV("doLoad: loading sample sampleID=%d", sample->sampleID());
     sample->startLoad();
-    mDecodeThread->loadSample(sample->sampleID());
+    mDecodeThread->loadSample(sample->sampleID(), priority);
 }
 
 bool SoundPool::unload(int sampleID)
@@ -256,6 +257,10 @@ int SoundPool::play(int sampleID, float leftVolume, float rightVolume,
     sample = findSample(sampleID);
     if ((sample == 0) || (sample->state() != Sample::READY)) {
         ALOGW("  sample %d not READY", sampleID);
+        // the application needs this sample now, decode it before those only preloaded
+        if (sample != 0 && sample->state() == Sample::LOADING) {
+            mDecodeThread->prioritizeSample(sampleID);
+        }
         return 0;
     }
 
@@ -450,6 +455,162 @@ void SoundPool::dump()
 }
 
 
+// Decoded PCM of a sample. The samples loaded from the same region of the same file, by this
+// or any other SoundPool of the process, share one SampleData, see SampleCache.
+class SampleData : public RefBase {
+public:
+    SampleData() : mStatus(NO_INIT), mSize(0), mSampleRate(0), mNumChannels(0),
+            mFormat(AUDIO_FORMAT_INVALID), mDev(0), mIno(0), mFileSize(0), mMtime(0),
+            mOffset(0), mLength(0) {}
+
+    status_t decode(const char* url);
+    status_t decode(int fd, int64_t offset, int64_t length);
+
+    status_t            mStatus;    // NO_INIT until decoded, guarded by SampleCache::sLock
+    sp<MemoryHeapBase>  mHeap;
+    sp<IMemory>         mData;
+    size_t              mSize;
+    uint32_t            mSampleRate;
+    int                 mNumChannels;
+    audio_format_t      mFormat;
+
+    // key in SampleCache
+    dev_t               mDev;
+    ino_t               mIno;
+    off_t               mFileSize;
+    time_t              mMtime;
+    int64_t             mOffset;
+    int64_t             mLength;
+
+private:
+    status_t check(status_t status);
+};
+
+status_t SampleData::decode(const char* url)
+{
+    mHeap = new MemoryHeapBase(kDefaultHeapSize);
+    return check(MediaPlayer::decode(
+            NULL /* httpService */,
+            url,
+            &mSampleRate,
+            &mNumChannels,
+            &mFormat,
+            mHeap,
+            &mSize));
+}
+
+status_t SampleData::decode(int fd, int64_t offset, int64_t length)
+{
+    mHeap = new MemoryHeapBase(kDefaultHeapSize);
+    return check(MediaPlayer::decode(fd, offset, length, &mSampleRate, &mNumChannels, &mFormat,
+            mHeap, &mSize));
+}
+
+status_t SampleData::check(status_t status)
+{
+    if (status != NO_ERROR) {
+        goto error;
+    }
+    ALOGV("pointer = %p, size = %zu, sampleRate = %u, numChannels = %d",
+          mHeap->getBase(), mSize, mSampleRate, mNumChannels);
+
+    if (mSampleRate > kMaxSampleRate) {
+       ALOGE("Sample rate (%u) out of range", mSampleRate);
+       status = BAD_VALUE;
+       goto error;
+    }
+
+    if ((mNumChannels < 1) || (mNumChannels > 2)) {
+        ALOGE("Sample channel count (%d) out of range", mNumChannels);
+        status = BAD_VALUE;
+        goto error;
+    }
+
+    mData = new MemoryBase(mHeap, 0, mSize);
+    return NO_ERROR;
+
+error:
+    mHeap.clear();
+    return status;
+}
+
+// Process-wide cache of the decoded samples which are still loaded in a SoundPool.
+// The cache only holds weak references, so the PCM is freed when the last sample using it is
+// unloaded. A sample which is being decoded is in the cache too, so that the same file region
+// requested concurrently by another worker or SoundPool is decoded only once.
+class SampleCache {
+public:
+    // Returns the decoded data of this file region, decoding it if it is not cached.
+    static sp<SampleData> acquire(int fd, int64_t offset, int64_t length, status_t* status);
+
+private:
+    static Mutex                    sLock;
+    static Condition                sCondition;     // signaled when a sample is decoded
+    static Vector< wp<SampleData> > sEntries;
+};
+
+Mutex SampleCache::sLock;
+Condition SampleCache::sCondition;
+Vector< wp<SampleData> > SampleCache::sEntries;
+
+sp<SampleData> SampleCache::acquire(int fd, int64_t offset, int64_t length, status_t* status)
+{
+    sp<SampleData> data = new SampleData();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // not a file we can identify, don't share it
+        *status = data->decode(fd, offset, length);
+        return data;
+    }
+    data->mDev = st.st_dev;
+    data->mIno = st.st_ino;
+    data->mFileSize = st.st_size;
+    data->mMtime = st.st_mtime;
+    data->mOffset = offset;
+    data->mLength = length;
+
+    {
+        Mutex::Autolock lock(sLock);
+        for (size_t i = 0; i < sEntries.size(); ) {
+            sp<SampleData> entry = sEntries[i].promote();
+            if (entry == 0) {
+                sEntries.removeAt(i);
+                continue;
+            }
+            if (entry->mDev == data->mDev && entry->mIno == data->mIno &&
+                    entry->mFileSize == data->mFileSize && entry->mMtime == data->mMtime &&
+                    entry->mOffset == offset && entry->mLength == length) {
+                ALOGV("sample already decoded, or being decoded");
+                while (entry->mStatus == NO_INIT) {
+                    sCondition.wait(sLock);
+                }
+                *status = entry->mStatus;
+                return entry;
+            }
+            i++;
+        }
+        sEntries.add(data);
+    }
+
+    status_t decodeStatus = data->decode(fd, offset, length);
+
+    Mutex::Autolock lock(sLock);
+    data->mStatus = decodeStatus;
+    if (decodeStatus != NO_ERROR) {
+        // don't cache failures, a later load may succeed
+        for (size_t i = 0; i < sEntries.size(); i++) {
+            if (sEntries[i].unsafe_get() == data.get()) {
+                sEntries.removeAt(i);
+                break;
+            }
+        }
+    }
+    sCondition.broadcast();
+    *status = decodeStatus;
+    return data;
+}
+
+
 Sample::Sample(int sampleID, const char* url)
 {
     init();
@@ -493,58 +654,32 @@ Sample::~Sample()
 
 status_t Sample::doLoad()
 {
-    uint32_t sampleRate;
-    int numChannels;
-    audio_format_t format;
     status_t status;
-    mHeap = new MemoryHeapBase(kDefaultHeapSize);
 
     ALOGV("Start decode");
     if (mUrl) {
-        status = MediaPlayer::decode(
-                NULL /* httpService */,
-                mUrl,
-                &sampleRate,
-                &numChannels,
-                &format,
-                mHeap,
-                &mSize);
+        mSampleData = new SampleData();
+        status = mSampleData->decode(mUrl);
     } else {
-        status = MediaPlayer::decode(mFd, mOffset, mLength, &sampleRate, &numChannels, &format,
-                                     mHeap, &mSize);
+        mSampleData = SampleCache::acquire(mFd, mOffset, mLength, &status);
         ALOGV("close(%d)", mFd);
         ::close(mFd);
         mFd = -1;
     }
     if (status != NO_ERROR) {
         ALOGE("Unable to load sample: %s", mUrl);
-        goto error;
-    }
-    ALOGV("pointer = %p, size = %zu, sampleRate = %u, numChannels = %d",
-          mHeap->getBase(), mSize, sampleRate, numChannels);
-
-    if (sampleRate > kMaxSampleRate) {
-       ALOGE("Sample rate (%u) out of range", sampleRate);
-       status = BAD_VALUE;
-       goto error;
-    }
-
-    if ((numChannels < 1) || (numChannels > 2)) {
-        ALOGE("Sample channel count (%d) out of range", numChannels);
-        status = BAD_VALUE;
-        goto error;
+        mSampleData.clear();
+        return status;
     }
 
-    mData = new MemoryBase(mHeap, 0, mSize);
-    mSampleRate = sampleRate;
-    mNumChannels = numChannels;
-    mFormat = format;
+    mHeap = mSampleData->mHeap;
+    mData = mSampleData->mData;
+    mSize = mSampleData->mSize;
+    mSampleRate = mSampleData->mSampleRate;
+    mNumChannels = mSampleData->mNumChannels;
+    mFormat = mSampleData->mFormat;
     mState = READY;
     return NO_ERROR;
-
-error:
-    mHeap.clear();
-    return status;
 }
 
 
@@ -18,52 +18,74 @@
 #define LOG_TAG "SoundPoolThread"
 #include "utils/Log.h"
 
+#include <unistd.h>
+
 #include "SoundPoolThread.h"
 
 namespace android {
 
+void SoundPoolThread::insert_l(const SoundPoolMsg& msg) {
+    size_t i = mMsgQueue.size();
+    while (i > 0 && mMsgQueue[i - 1].mPriority < msg.mPriority) {
+        --i;
+    }
+    mMsgQueue.insertAt(msg, i);
+}
+
 void SoundPoolThread::write(SoundPoolMsg msg) {
     Mutex::Autolock lock(&mLock);
-    while (mMsgQueue.size() >= maxMessages) {
-        mCondition.wait(mLock);
-    }
 
     // if thread is quitting, don't add to queue
     if (mRunning) {
-        mMsgQueue.push(msg);
+        insert_l(msg);
+        // start another worker if the idle ones can't take all the pending requests
+        if (mMsgQueue.size() > mIdleThreads && mThreads < mMaxThreads) {
+            if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
+                mThreads++;
+            } else {
+                ALOGW_IF(mThreads == 0, "unable to start a decode thread");
+            }
+        }
         mCondition.signal();
     }
 }
 
 const SoundPoolMsg SoundPoolThread::read() {
     Mutex::Autolock lock(&mLock);
-    while (mMsgQueue.size() == 0) {
+    mIdleThreads++;
+    while (mRunning && mMsgQueue.size() == 0) {
         mCondition.wait(mLock);
     }
+    mIdleThreads--;
+    if (!mRunning) {
+        return SoundPoolMsg(SoundPoolMsg::KILL, 0);
+    }
     SoundPoolMsg msg = mMsgQueue[0];
     mMsgQueue.removeAt(0);
-    mCondition.signal();
     return msg;
 }
 
 void SoundPoolThread::quit() {
     Mutex::Autolock lock(&mLock);
-    if (mRunning) {
-        mRunning = false;
-        mMsgQueue.clear();
-        mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
-        mCondition.signal();
+    mRunning = false;
+    mMsgQueue.clear();
+    mCondition.broadcast();
+    while (mThreads > 0) {
         mCondition.wait(mLock);
     }
     ALOGV("return from quit");
 }
 
 SoundPoolThread::SoundPoolThread(SoundPool* soundPool) :
-    mSoundPool(soundPool)
+    mSoundPool(soundPool),
+    mRunning(true),
+    mMaxThreads(maxThreads),
+    mThreads(0),
+    mIdleThreads(0)
 {
-    mMsgQueue.setCapacity(maxMessages);
-    if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
-        mRunning = true;
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpus >= 1 && (size_t) cpus < mMaxThreads) {
+        mMaxThreads = cpus;
     }
 }
 
@@ -84,9 +106,13 @@ int SoundPoolThread::run() {
         SoundPoolMsg msg = read();
         ALOGV("Got message m=%d, mData=%d", msg.mMessageType, msg.mData);
         switch (msg.mMessageType) {
-        case SoundPoolMsg::KILL:
+        case SoundPoolMsg::KILL: {
             ALOGV("goodbye");
+            Mutex::Autolock lock(&mLock);
+            mThreads--;
+            mCondition.broadcast();
             return NO_ERROR;
+        }
         case SoundPoolMsg::LOAD_SAMPLE:
             doLoadSample(msg.mData);
             break;
@@ -98,12 +124,32 @@ int SoundPoolThread::run() {
     }
 }
 
-void SoundPoolThread::loadSample(int sampleID) {
-    write(SoundPoolMsg(SoundPoolMsg::LOAD_SAMPLE, sampleID));
+void SoundPoolThread::loadSample(int sampleID, int priority) {
+    write(SoundPoolMsg(SoundPoolMsg::LOAD_SAMPLE, sampleID, priority));
+}
+
+void SoundPoolThread::prioritizeSample(int sampleID) {
+    Mutex::Autolock lock(&mLock);
+    for (size_t i = 0; i < mMsgQueue.size(); i++) {
+        SoundPoolMsg msg = mMsgQueue[i];
+        if (msg.mMessageType == SoundPoolMsg::LOAD_SAMPLE && msg.mData == sampleID) {
+            if (msg.mPriority != urgentPriority) {
+                mMsgQueue.removeAt(i);
+                msg.mPriority = urgentPriority;
+                insert_l(msg);
+            }
+            break;
+        }
+    }
 }
 
 void SoundPoolThread::doLoadSample(int sampleID) {
-    sp <Sample> sample = mSoundPool->findSample(sampleID);
+    sp <Sample> sample;
+    {
+        // other workers may be loading, and the application adding, samples concurrently
+        Mutex::Autolock lock(&mSoundPool->mLock);
+        sample = mSoundPool->findSample(sampleID);
+    }
     status_t status = -1;
     if (sample != 0) {
         status = sample->doLoad();
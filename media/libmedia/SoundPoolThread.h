@@ -17,6 +17,8 @@
 #ifndef SOUNDPOOLTHREAD_H_
 #define SOUNDPOOLTHREAD_H_
 
+#include <limits.h>
+
 #include <utils/threads.h>
 #include <utils/Vector.h>
 #include <media/AudioTrack.h>
@@ -28,37 +30,49 @@ namespace android {
 class SoundPoolMsg {
 public:
     enum MessageType { INVALID, KILL, LOAD_SAMPLE };
-    SoundPoolMsg() : mMessageType(INVALID), mData(0) {}
-    SoundPoolMsg(MessageType MessageType, int data) :
-        mMessageType(MessageType), mData(data) {}
+    SoundPoolMsg() : mMessageType(INVALID), mData(0), mPriority(0) {}
+    SoundPoolMsg(MessageType MessageType, int data, int priority = 0) :
+        mMessageType(MessageType), mData(data), mPriority(priority) {}
     uint16_t         mMessageType;
     uint16_t         mData;
+    int              mPriority;
 };
 
 /*
- * This class handles background requests from the SoundPool
+ * This class handles background requests from the SoundPool.
+ * Samples are decoded by a pool of up to maxThreads worker threads, which are started on demand.
+ * Pending requests are served in decreasing order of priority, and in order of arrival for
+ * requests of the same priority.
  */
 class SoundPoolThread {
 public:
     SoundPoolThread(SoundPool* SoundPool);
     ~SoundPoolThread();
-    void loadSample(int sampleID);
+    void loadSample(int sampleID, int priority = 0);
+    // moves a pending load ahead of all other requests, for a sample that play() is waiting for
+    void prioritizeSample(int sampleID);
     void quit();
     void write(SoundPoolMsg msg);
 
 private:
-    static const size_t maxMessages = 5;
+    static const size_t maxThreads = 4;
+    // priority of the samples requested by play() while loading
+    static const int urgentPriority = INT_MAX;
 
     static int beginThread(void* arg);
     int run();
     void doLoadSample(int sampleID);
     const SoundPoolMsg read();
+    void insert_l(const SoundPoolMsg& msg);
 
     Mutex                   mLock;
     Condition               mCondition;
-    Vector<SoundPoolMsg>    mMsgQueue;
+    Vector<SoundPoolMsg>    mMsgQueue;      // ordered by decreasing priority
     SoundPool*              mSoundPool;
     bool                    mRunning;
+    size_t                  mMaxThreads;    // maxThreads, or fewer on devices with fewer cores
+    size_t                  mThreads;       // worker threads started and not yet exited
+    size_t                  mIdleThreads;   // worker threads waiting for a request
 };
 
 } // end namespace android
@@ -1502,27 +1502,18 @@ ToneGenerator::tone_type ToneGenerator::getToneForRegion(tone_type toneType) {
 ////////////////////////////////////////////////////////////////////////////////
 ToneGenerator::WaveGenerator::WaveGenerator(unsigned short samplingRate,
         unsigned short frequency, float volume) {
-    double d0;
-    double F_div_Fs;  // frequency / samplingRate
+    pthread_once(&sSineTableOnce, initSineTable);
 
-    F_div_Fs = frequency / (double)samplingRate;
-    d0 = - (float)GEN_AMP * sin(2 * M_PI * F_div_Fs);
-    mS2_0 = (short)d0;
-    mS1 = 0;
-    mS2 = mS2_0;
+    mPhase = 0;
+    mPhaseIncrement = (uint32_t)(frequency * 4294967296.0 / samplingRate);
 
     mAmplitude_Q15 = (short)(32767. * 32767. * volume / GEN_AMP);
     // take some margin for amplitude fluctuation
     if (mAmplitude_Q15 > 32500)
         mAmplitude_Q15 = 32500;
 
-    d0 = 32768.0 * cos(2 * M_PI * F_div_Fs);  // Q14*2*cos()
-    if (d0 > 32767)
-        d0 = 32767;
-    mA1_Q14 = (short) d0;
-
-    ALOGV("WaveGenerator init, mA1_Q14: %d, mS2_0: %d, mAmplitude_Q15: %d",
-            mA1_Q14, mS2_0, mAmplitude_Q15);
+    ALOGV("WaveGenerator init, mPhaseIncrement: %u, mAmplitude_Q15: %d",
+            mPhaseIncrement, mAmplitude_Q15);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1559,19 +1550,16 @@ ToneGenerator::WaveGenerator::~WaveGenerator() {
 ////////////////////////////////////////////////////////////////////////////////
 void ToneGenerator::WaveGenerator::getSamples(short *outBuffer,
         unsigned int count, unsigned int command) {
-    long lS1, lS2;
-    long lA1, lAmplitude;
-    long Sample;  // current sample
+    uint32_t lPhase;
+    const uint32_t lPhaseIncrement = mPhaseIncrement;
+    long lAmplitude;
 
     // init local
     if (command == WAVEGEN_START) {
-        lS1 = (long)0;
-        lS2 = (long)mS2_0;
+        lPhase = 0;
     } else {
-        lS1 = (long)mS1;
-        lS2 = (long)mS2;
+        lPhase = mPhase;
     }
-    lA1 = (long)mA1_Q14;
     lAmplitude = (long)mAmplitude_Q15;
 
     if (command == WAVEGEN_STOP) {
@@ -1582,29 +1570,42 @@ void ToneGenerator::WaveGenerator::getSamples(short *outBuffer,
         long dec = lAmplitude/count;
         // loop generation
         while (count--) {
-            Sample = ((lA1 * lS1) >> S_Q14) - lS2;
-            // shift delay
-            lS2 = lS1;
-            lS1 = Sample;
-            Sample = ((lAmplitude>>16) * Sample) >> S_Q15;
+            lPhase += lPhaseIncrement;
+            long Sample = ((lAmplitude>>16) * sineAt(lPhase)) >> S_Q15;
             *(outBuffer++) += (short)Sample;  // put result in buffer
             lAmplitude -= dec;
         }
     } else {
         // loop generation
         while (count--) {
-            Sample = ((lA1 * lS1) >> S_Q14) - lS2;
-            // shift delay
-            lS2 = lS1;
-            lS1 = Sample;
-            Sample = (lAmplitude * Sample) >> S_Q15;
+            lPhase += lPhaseIncrement;
+            long Sample = (lAmplitude * sineAt(lPhase)) >> S_Q15;
             *(outBuffer++) += (short)Sample;  // put result in buffer
         }
     }
 
     // save status
-    mS1 = (short)lS1;
-    mS2 = (short)lS2;
+    mPhase = lPhase;
+}
+
+//---------------------------------- private methods ---------------------------
+
+short ToneGenerator::WaveGenerator::sSineTable[SINE_TABLE_SIZE + 1];
+pthread_once_t ToneGenerator::WaveGenerator::sSineTableOnce = PTHREAD_ONCE_INIT;
+
+void ToneGenerator::WaveGenerator::initSineTable() {
+    for (int i = 0; i <= SINE_TABLE_SIZE; i++) {
+        sSineTable[i] = (short)floor(GEN_AMP * sin(2 * M_PI * i / SINE_TABLE_SIZE) + 0.5);
+    }
+}
+
+inline int ToneGenerator::WaveGenerator::sineAt(uint32_t phase) {
+    // the top SINE_TABLE_BITS of the phase select the table entry,
+    // and the next 15 bits interpolate linearly to the following entry
+    const uint32_t index = phase >> (32 - SINE_TABLE_BITS);
+    const int frac = (phase >> (32 - SINE_TABLE_BITS - 15)) & 0x7FFF;
+    const int s0 = sSineTable[index];
+    return s0 + (((sSineTable[index + 1] - s0) * frac + (1 << 14)) >> 15);
 }
 
 }  // end namespace android
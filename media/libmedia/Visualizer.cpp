@@ -44,6 +44,8 @@ Visualizer::Visualizer (int32_t priority,
         mSampleRate(44100000),
         mScalingMode(VISUALIZER_SCALING_MODE_NORMALIZED),
         mMeasurementMode(MEASUREMENT_MODE_NONE),
+        mSpectrumSize(0),
+        mSpectrumWindow(VISUALIZER_WINDOW_HANN),
         mCaptureCallBack(NULL),
         mCaptureCbkUser(NULL)
 {
@@ -259,6 +261,76 @@ status_t Visualizer::getIntMeasurements(uint32_t type, uint32_t number, int32_t
     return status;
 }
 
+status_t Visualizer::getMeasurementBatch(visualizer_measurement_t *measurements,
+        uint32_t *count) {
+    if (measurements == NULL || count == NULL) {
+        return BAD_VALUE;
+    }
+    if (!(mMeasurementMode & MEASUREMENT_MODE_PEAK_RMS)) {
+        ALOGE("Cannot retrieve measurement batch, MEASUREMENT_MODE_PEAK_RMS not set");
+        return INVALID_OPERATION;
+    }
+    if (!mEnabled) {
+        ALOGV("getMeasurementBatch() disabled");
+        return INVALID_OPERATION;
+    }
+    uint32_t replySize = *count * sizeof(visualizer_measurement_t);
+    status_t status = command(VISUALIZER_CMD_MEASURE_BATCH, 0, NULL, &replySize, measurements);
+    ALOGV("getMeasurementBatch() command returned %d", status);
+    *count = status == NO_ERROR ? replySize / sizeof(visualizer_measurement_t) : 0;
+    return status;
+}
+
+status_t Visualizer::setSpectrumSize(uint32_t size)
+{
+    if (size != 0 && (size > VISUALIZER_CAPTURE_SIZE_MAX ||
+            size < VISUALIZER_CAPTURE_SIZE_MIN ||
+            popcount(size) != 1)) {
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock _l(mCaptureLock);
+    status_t status = setSpectrumParameter(VISUALIZER_PARAM_SPECTRUM_SIZE, size);
+    if (status == NO_ERROR) {
+        mSpectrumSize = size;
+    }
+    return status;
+}
+
+status_t Visualizer::setSpectrumWindow(uint32_t window)
+{
+    if (window > VISUALIZER_WINDOW_BLACKMAN) {
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock _l(mCaptureLock);
+    status_t status = setSpectrumParameter(VISUALIZER_PARAM_SPECTRUM_WINDOW, window);
+    if (status == NO_ERROR) {
+        mSpectrumWindow = window;
+    }
+    return status;
+}
+
+status_t Visualizer::setSpectrumParameter(uint32_t param, uint32_t value)
+{
+    uint32_t buf32[sizeof(effect_param_t) / sizeof(uint32_t) + 2];
+    effect_param_t *p = (effect_param_t *)buf32;
+
+    p->psize = sizeof(uint32_t);
+    p->vsize = sizeof(uint32_t);
+    *(int32_t *)p->data = param;
+    *((int32_t *)p->data + 1)= value;
+    status_t status = setParameter(p);
+
+    ALOGV("setSpectrumParameter param %d value %d status %d p->status %d",
+            param, value, status, p->status);
+
+    if (status == NO_ERROR) {
+        status = p->status;
+    }
+    return status;
+}
+
 status_t Visualizer::getWaveForm(uint8_t *waveform)
 {
     if (waveform == NULL) {
@@ -333,6 +405,30 @@ status_t Visualizer::doFft(uint8_t *fft, uint8_t *waveform)
     return NO_ERROR;
 }
 
+status_t Visualizer::getSpectrum(float *magnitudes)
+{
+    if (magnitudes == NULL) {
+        return BAD_VALUE;
+    }
+    if (mSpectrumSize == 0) {
+        return NO_INIT;
+    }
+
+    uint32_t replySize = VISUALIZER_SPECTRUM_BINS(mSpectrumSize) * sizeof(float);
+    status_t status = NO_ERROR;
+    if (mEnabled) {
+        status = command(VISUALIZER_CMD_SPECTRUM, 0, NULL, &replySize, magnitudes);
+        ALOGV("getSpectrum() command returned %d", status);
+        if ((status == NO_ERROR) && (replySize == 0)) {
+            status = NOT_ENOUGH_DATA;
+        }
+    } else {
+        ALOGV("getSpectrum() disabled");
+        memset(magnitudes, 0, replySize);
+    }
+    return status;
+}
+
 void Visualizer::periodicCapture()
 {
     Mutex::Autolock _l(mCaptureLock);
@@ -403,6 +499,9 @@ void Visualizer::controlStatusChanged(bool controlGranted) {
         setScalingMode(mScalingMode);
         ALOGV("    capture size reset to %d", mCaptureSize);
         setCaptureSize(mCaptureSize);
+        ALOGV("    spectrum size reset to %d window %d", mSpectrumSize, mSpectrumWindow);
+        setSpectrumWindow(mSpectrumWindow);
+        setSpectrumSize(mSpectrumSize);
     }
     AudioEffect::controlStatusChanged(controlGranted);
 }
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ToneGenerator_test"
+
+#include <math.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include <media/ToneGenerator.h>
+
+namespace android {
+
+class ToneGeneratorTest : public ::testing::Test {
+protected:
+    typedef ToneGenerator::WaveGenerator WaveGenerator;
+
+    static const float kVolume;
+
+    // the Q15 amplitude WaveGenerator derives from kVolume, applied to the
+    // 32000 peak of its sine table
+    static double amplitude() {
+        return (short)(32767. * 32767. * kVolume / 32000.) * 32000. / 32768.;
+    }
+
+    // Returns the largest difference between the generated samples and the
+    // exact sine. The first sample is one phase step after phase 0.
+    static double maxError(unsigned short samplingRate, unsigned short frequency,
+            const short *samples, size_t count) {
+        const double a = amplitude();
+        double maxError = 0;
+        for (size_t i = 0; i < count; ++i) {
+            double exact = a * sin(2 * M_PI * frequency * (i + 1.0) / samplingRate);
+            maxError = fmax(maxError, fabs(samples[i] - exact));
+        }
+        return maxError;
+    }
+};
+
+const float ToneGeneratorTest::kVolume = 0.9f;
+
+static const unsigned short kSamplingRates[] = { 8000, 16000, 44100, 48000 };
+// DTMF rows and columns, and call progress tones
+static const unsigned short kFrequencies[] = {
+    350, 425, 440, 480, 620, 697, 770, 852, 941, 950, 1209, 1336, 1400, 1477, 1633, 1800,
+};
+
+// One second of each tone stays within 4 LSB of the exact sine, so the phase accumulator
+// does not drift and the table interpolation error stays bounded.
+TEST_F(ToneGeneratorTest, SineWithinTableError) {
+    for (size_t i = 0; i < sizeof(kSamplingRates) / sizeof(kSamplingRates[0]); ++i) {
+        const unsigned short samplingRate = kSamplingRates[i];
+        short *samples = new short[samplingRate];
+        for (size_t j = 0; j < sizeof(kFrequencies) / sizeof(kFrequencies[0]); ++j) {
+            const unsigned short frequency = kFrequencies[j];
+            memset(samples, 0, samplingRate * sizeof(short));
+            WaveGenerator generator(samplingRate, frequency, kVolume);
+            generator.getSamples(samples, samplingRate, WaveGenerator::WAVEGEN_START);
+            EXPECT_LE(maxError(samplingRate, frequency, samples, samplingRate), 4.0)
+                    << frequency << " Hz at " << samplingRate << " Hz";
+        }
+        delete[] samples;
+    }
+}
+
+// Generating in blocks continues the phase, and the generated samples are accumulated
+// into the output.
+TEST_F(ToneGeneratorTest, BlocksAccumulateAndContinue) {
+    static const unsigned short kSamplingRate = 48000;
+    static const size_t kBlock = 160;
+    static const size_t kCount = 48 * kBlock;
+    short whole[kCount];
+    short blocks[kCount];
+    memset(whole, 0, sizeof(whole));
+    memset(blocks, 0, sizeof(blocks));
+
+    WaveGenerator low(kSamplingRate, 697, 0.5f);
+    WaveGenerator high(kSamplingRate, 1209, 0.5f);
+    low.getSamples(whole, kCount, WaveGenerator::WAVEGEN_START);
+    high.getSamples(whole, kCount, WaveGenerator::WAVEGEN_START);
+
+    WaveGenerator lowBlocks(kSamplingRate, 697, 0.5f);
+    WaveGenerator highBlocks(kSamplingRate, 1209, 0.5f);
+    for (size_t i = 0; i < kCount; i += kBlock) {
+        const unsigned int command = i == 0 ? WaveGenerator::WAVEGEN_START
+                : WaveGenerator::WAVEGEN_CONT;
+        lowBlocks.getSamples(&blocks[i], kBlock, command);
+        highBlocks.getSamples(&blocks[i], kBlock, command);
+    }
+
+    EXPECT_EQ(0, memcmp(whole, blocks, sizeof(whole)));
+}
+
+} // namespace android
@@ -36,3 +36,5 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_STATIC_LIBRARIES += libinstantssq
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
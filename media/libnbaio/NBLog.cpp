@@ -17,6 +17,7 @@
 #define LOG_TAG "NBLog"
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -30,19 +31,82 @@
 
 namespace android {
 
-int NBLog::Entry::readAt(size_t offset) const
+size_t NBLog::Entry::copyTo(uint8_t *buffer) const
 {
-    // FIXME This is too slow, despite the name it is used during writing
-    if (offset == 0)
-        return mEvent;
-    else if (offset == 1)
-        return mLength;
-    else if (offset < (size_t) (mLength + 2))
-        return ((char *) mData)[offset - 2];
-    else if (offset == (size_t) (mLength + 2))
-        return mLength;
-    else
-        return 0;
+    buffer[0] = mEvent;
+    buffer[1] = mLength;
+    memcpy(&buffer[2], mData, mLength);
+    buffer[mLength + 2] = mLength;
+    return mLength + 3;
+}
+
+// ---------------------------------------------------------------------------
+
+// Parses one printf conversion specification of a binary record format, starting after the '%'.
+// On success returns a pointer past the conversion character and sets the argument type
+// ('i' int32_t, 'I' int64_t or 'd' double), the conversion character and the extent of the
+// flags, width and precision. Returns NULL for unsupported conversions.
+static const char *parseConversion(const char *p, char *type, char *conversion,
+        size_t *flagsLength)
+{
+    const char *start = p;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) {
+        ++p;
+    }
+    while (*p >= '0' && *p <= '9') {
+        ++p;
+    }
+    if (*p == '.') {
+        ++p;
+        while (*p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+    *flagsLength = p - start;
+    size_t size = sizeof(int);
+    switch (*p) {
+    case 'h':
+        p += p[1] == 'h' ? 2 : 1;   // promoted to int
+        break;
+    case 'l':
+        if (p[1] == 'l') {
+            size = sizeof(long long);
+            p += 2;
+        } else {
+            size = sizeof(long);
+            ++p;
+        }
+        break;
+    case 'z':
+        size = sizeof(size_t);
+        ++p;
+        break;
+    case 'j':
+        size = sizeof(intmax_t);
+        ++p;
+        break;
+    case 't':
+        size = sizeof(ptrdiff_t);
+        ++p;
+        break;
+    default:
+        break;
+    }
+    switch (*p) {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+        *type = size == sizeof(int64_t) ? 'I' : 'i';
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        if (size != sizeof(int)) {
+            return NULL;    // no 'L' or similar
+        }
+        *type = 'd';
+        break;
+    default:
+        return NULL;        // '%s', '%p', '%n', '*', ... are not supported
+    }
+    *conversion = *p;
+    return p + 1;
 }
 
 // ---------------------------------------------------------------------------
@@ -147,6 +211,103 @@ void NBLog::Writer::logTimestamp(const struct timespec& ts)
     log(EVENT_TIMESTAMP, &ts, sizeof(struct timespec));
 }
 
+int NBLog::Writer::registerFormat(const char *fmt)
+{
+    if (mShared == NULL) {
+        return -ENODEV;
+    }
+    if (fmt == NULL || strlen(fmt) >= kMaxFormatLength) {
+        return -EINVAL;
+    }
+    Format format;
+    memset(&format, 0, sizeof(format));
+    size_t args = 0;
+    for (const char *p = fmt; *p != '\0'; ) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (*p == '%') {
+            ++p;
+            continue;
+        }
+        char conversion;
+        size_t flagsLength;
+        if (args >= kMaxFormatArgs ||
+                (p = parseConversion(p, &format.mSignature[args], &conversion, &flagsLength))
+                        == NULL) {
+            return -EINVAL;
+        }
+        ++args;
+    }
+    strcpy(format.mFormat, fmt);
+
+    // reuse an identical format registered earlier, possibly by a previous Writer
+    int32_t count = android_atomic_acquire_load(&mShared->mFormatCount);
+    for (int32_t i = 0; i < count && i < (int32_t) kMaxFormats; ++i) {
+        if (memcmp(&mShared->mFormats[i], &format, sizeof(format)) == 0) {
+            return i;
+        }
+    }
+    int32_t id = android_atomic_inc(&mShared->mFormatCount);
+    if (id >= (int32_t) kMaxFormats) {
+        return -ENOSPC;
+    }
+    // the format is published to the Reader by the release store of the first entry using it
+    memcpy(&mShared->mFormats[id], &format, sizeof(format));
+    return id;
+}
+
+void NBLog::Writer::logb(int formatId, ...)
+{
+    if (!mEnabled) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, formatId);
+    Writer::logvb(formatId, ap);
+    va_end(ap);
+}
+
+void NBLog::Writer::logvb(int formatId, va_list ap)
+{
+    if (!mEnabled || formatId < 0 || formatId >= (int) kMaxFormats) {
+        return;
+    }
+    // id + timestamp + at most kMaxFormatArgs 8 byte arguments, well below 255 bytes
+    uint8_t buffer[1 + sizeof(int64_t) * (kMaxFormatArgs + 1)];
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+        return;
+    }
+    int64_t ns = (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    buffer[0] = formatId;
+    memcpy(&buffer[1], &ns, sizeof(ns));
+    size_t length = 1 + sizeof(ns);
+    const char *signature = mShared->mFormats[formatId].mSignature;
+    for (size_t i = 0; i < kMaxFormatArgs && signature[i] != '\0'; ++i) {
+        switch (signature[i]) {
+        case 'i': {
+            int32_t value = va_arg(ap, int);
+            memcpy(&buffer[length], &value, sizeof(value));
+            length += sizeof(value);
+            } break;
+        case 'I': {
+            int64_t value = va_arg(ap, long long);
+            memcpy(&buffer[length], &value, sizeof(value));
+            length += sizeof(value);
+            } break;
+        case 'd': {
+            double value = va_arg(ap, double);
+            memcpy(&buffer[length], &value, sizeof(value));
+            length += sizeof(value);
+            } break;
+        default:
+            return;
+        }
+    }
+    log(EVENT_BINARY, buffer, length);
+}
+
 void NBLog::Writer::log(Event event, const void *data, size_t length)
 {
     if (!mEnabled) {
@@ -158,6 +319,7 @@ void NBLog::Writer::log(Event event, const void *data, size_t length)
     switch (event) {
     case EVENT_STRING:
     case EVENT_TIMESTAMP:
+    case EVENT_BINARY:
         break;
     case EVENT_RESERVED:
     default:
@@ -177,25 +339,19 @@ void NBLog::Writer::log(const NBLog::Entry *entry, bool trusted)
         return;
     }
     size_t rear = mRear & (mSize - 1);
-    size_t written = mSize - rear;      // written = number of bytes that have been written so far
-    size_t need = entry->mLength + 3;   // mEvent, mLength, data[length], mLength
-                                        // need = number of bytes remaining to write
-    if (written > need) {
-        written = need;
-    }
-    size_t i;
-    // FIXME optimize this using memcpy for the data part of the Entry.
-    // The Entry could have a method copyTo(ptr, offset, size) to optimize the copy.
-    for (i = 0; i < written; ++i) {
-        mShared->mBuffer[rear + i] = entry->readAt(i);
-    }
-    if (rear + written == mSize && (need -= written) > 0)  {
-        for (i = 0; i < need; ++i) {
-            mShared->mBuffer[i] = entry->readAt(written + i);
-        }
-        written += need;
+    const size_t need = entry->mLength + 3;     // mEvent, mLength, data[length], mLength
+    if (rear + need <= mSize) {
+        entry->copyTo((uint8_t *) &mShared->mBuffer[rear]);
+    } else {
+        // the entry wraps around the end of the circular buffer
+        uint8_t serialized[255 + 3];
+        entry->copyTo(serialized);
+        size_t written = mSize - rear;  // number of bytes that fit before the wraparound point
+        memcpy(&mShared->mBuffer[rear], serialized, written);
+        memcpy(mShared->mBuffer, &serialized[written], need - written);
     }
-    android_atomic_release_store(mRear += written, &mShared->mRear);
+    // publish the entry to the Reader
+    android_atomic_release_store(mRear += need, &mShared->mRear);
 }
 
 bool NBLog::Writer::isEnabled() const
@@ -258,6 +414,27 @@ void NBLog::LockedWriter::logTimestamp(const struct timespec& ts)
     Writer::logTimestamp(ts);
 }
 
+int NBLog::LockedWriter::registerFormat(const char *fmt)
+{
+    Mutex::Autolock _l(mLock);
+    return Writer::registerFormat(fmt);
+}
+
+void NBLog::LockedWriter::logb(int formatId, ...)
+{
+    Mutex::Autolock _l(mLock);
+    va_list ap;
+    va_start(ap, formatId);
+    Writer::logvb(formatId, ap);
+    va_end(ap);
+}
+
+void NBLog::LockedWriter::logvb(int formatId, va_list ap)
+{
+    Mutex::Autolock _l(mLock);
+    Writer::logvb(formatId, ap);
+}
+
 bool NBLog::LockedWriter::isEnabled() const
 {
     Mutex::Autolock _l(mLock);
@@ -335,6 +512,16 @@ void NBLog::Reader::dump(int fd, size_t indent)
             if (ts.tv_sec > maxSec) {
                 maxSec = ts.tv_sec;
             }
+        } else if (event == EVENT_BINARY) {
+            if (length < 1 + sizeof(int64_t)) {
+                // corrupt
+                break;
+            }
+            int64_t ns;
+            memcpy(&ns, &copy[i - length], sizeof(ns));
+            if (ns / 1000000000 > maxSec) {
+                maxSec = ns / 1000000000;
+            }
         }
         i -= length + 3;
     }
@@ -416,6 +603,19 @@ void NBLog::Reader::dump(int fd, size_t indent)
                     (int) (ts.tv_nsec / 1000000));
             deferredTimestamp = true;
             } break;
+        case EVENT_BINARY: {
+            // already checked that length >= 1 + sizeof(int64_t)
+            int64_t ns;
+            memcpy(&ns, &copy[i + 3], sizeof(ns));
+            if (deferredTimestamp) {
+                dumpLine(timestamp, body);
+                deferredTimestamp = false;
+            }
+            timestamp.clear();
+            timestamp.appendFormat("[%d.%03d]", (int) (ns / 1000000000),
+                    (int) (ns % 1000000000 / 1000000));
+            dumpBinary(body, (const uint8_t *) data, length);
+            } break;
         case EVENT_RESERVED:
         default:
             body.appendFormat("warning: unknown event %d", event);
@@ -445,6 +645,84 @@ void NBLog::Reader::dumpLine(const String8& timestamp, String8& body)
     body.clear();
 }
 
+void NBLog::Reader::dumpBinary(String8& body, const uint8_t *data, size_t length)
+{
+    const size_t id = data[0];
+    if (id >= kMaxFormats) {
+        body.appendFormat("warning: unknown format %zu", id);
+        return;
+    }
+    // copy the format as the writer process could be modifying the shared memory
+    Format format;
+    memcpy(&format, &mShared->mFormats[id], sizeof(format));
+    format.mSignature[kMaxFormatArgs] = '\0';
+    format.mFormat[kMaxFormatLength - 1] = '\0';
+    size_t offset = 1 + sizeof(int64_t);
+    size_t arg = 0;
+    for (const char *p = format.mFormat; *p != '\0'; ) {
+        const char *percent = strchr(p, '%');
+        if (percent == NULL) {
+            body.append(p);
+            break;
+        }
+        body.append(p, percent - p);
+        p = percent + 1;
+        if (*p == '%') {
+            body.append("%");
+            ++p;
+            continue;
+        }
+        char type, conversion;
+        size_t flagsLength;
+        const char *next = parseConversion(p, &type, &conversion, &flagsLength);
+        if (next == NULL || type != format.mSignature[arg]) {
+            body.append("<corrupt format>");
+            return;
+        }
+        // rebuild the conversion with length modifiers matching the logged argument type
+        String8 spec("%");
+        spec.append(p, flagsLength);
+        if (type == 'I') {
+            spec.append("ll");
+        }
+        spec.append(&conversion, 1);
+        p = next;
+        ++arg;
+        switch (type) {
+        case 'i': {
+            int32_t value;
+            if (offset + sizeof(value) > length) {
+                body.append("<truncated>");
+                return;
+            }
+            memcpy(&value, &data[offset], sizeof(value));
+            offset += sizeof(value);
+            body.appendFormat(spec.string(), (int) value);
+            } break;
+        case 'I': {
+            int64_t value;
+            if (offset + sizeof(value) > length) {
+                body.append("<truncated>");
+                return;
+            }
+            memcpy(&value, &data[offset], sizeof(value));
+            offset += sizeof(value);
+            body.appendFormat(spec.string(), (long long) value);
+            } break;
+        case 'd': {
+            double value;
+            if (offset + sizeof(value) > length) {
+                body.append("<truncated>");
+                return;
+            }
+            memcpy(&value, &data[offset], sizeof(value));
+            offset += sizeof(value);
+            body.appendFormat(spec.string(), value);
+            } break;
+        }
+    }
+}
+
 bool NBLog::Reader::isIMemory(const sp<IMemory>& iMemory) const
 {
     return iMemory != 0 && mIMemory != 0 && iMemory->pointer() == mIMemory->pointer();
@@ -29,9 +29,9 @@ Pipe::Pipe(size_t maxFrames, const NBAIO_Format& format, void *buffer) :
         NBAIO_Sink(format),
         mMaxFrames(roundup(maxFrames)),
         mBuffer(buffer == NULL ? malloc(mMaxFrames * Format_frameSize(format)) : buffer),
-        mRear(0),
         mReaders(0),
-        mFreeBufferInDestructor(buffer == NULL)
+        mFreeBufferInDestructor(buffer == NULL),
+        mRear(0)
 {
 }
 
@@ -26,8 +26,11 @@ namespace android {
 PipeReader::PipeReader(Pipe& pipe) :
         NBAIO_Source(pipe.mFormat),
         mPipe(pipe),
+        mMaxFrames(pipe.mMaxFrames),
+        mBuffer(pipe.mBuffer),
         // any data already in the pipe is not visible to this PipeReader
         mFront(android_atomic_acquire_load(&pipe.mRear)),
+        mPeeked(0),
         mFramesOverrun(0),
         mOverruns(0)
 {
@@ -48,10 +51,10 @@ ssize_t PipeReader::availableToRead()
     int32_t rear = android_atomic_acquire_load(&mPipe.mRear);
     // read() is not multi-thread safe w.r.t. itself, so no mutex or atomic op needed to read mFront
     size_t avail = rear - mFront;
-    if (CC_UNLIKELY(avail > mPipe.mMaxFrames)) {
+    if (CC_UNLIKELY(avail > mMaxFrames)) {
         // Discard 1/16 of the most recent data in pipe to avoid another overrun immediately
         int32_t oldFront = mFront;
-        mFront = rear - mPipe.mMaxFrames + (mPipe.mMaxFrames >> 4);
+        mFront = rear - mMaxFrames + (mMaxFrames >> 4);
         mFramesOverrun += (size_t) (mFront - oldFront);
         ++mOverruns;
         return OVERRUN;
@@ -61,6 +64,7 @@ ssize_t PipeReader::availableToRead()
 
 ssize_t PipeReader::read(void *buffer, size_t count, int64_t readPTS __unused)
 {
+    mPeeked = 0;
     ssize_t avail = availableToRead();
     if (CC_UNLIKELY(avail <= 0)) {
         return avail;
@@ -70,20 +74,20 @@ ssize_t PipeReader::read(void *buffer, size_t count, int64_t readPTS __unused)
     if (CC_LIKELY(count > (size_t) avail)) {
         count = avail;
     }
-    size_t front = mFront & (mPipe.mMaxFrames - 1);
-    size_t red = mPipe.mMaxFrames - front;
+    size_t front = mFront & (mMaxFrames - 1);
+    size_t red = mMaxFrames - front;
     if (CC_LIKELY(red > count)) {
         red = count;
     }
     // In particular, an overrun during the memcpy will result in reading corrupt data
-    memcpy(buffer, (char *) mPipe.mBuffer + (front * mFrameSize), red * mFrameSize);
+    memcpy(buffer, (const char *) mBuffer + (front * mFrameSize), red * mFrameSize);
     // We could re-read the rear pointer here to detect the corruption, but why bother?
-    if (CC_UNLIKELY(front + red == mPipe.mMaxFrames)) {
+    if (CC_UNLIKELY(front + red == mMaxFrames)) {
         if (CC_UNLIKELY((count -= red) > front)) {
             count = front;
         }
         if (CC_LIKELY(count > 0)) {
-            memcpy((char *) buffer + (red * mFrameSize), mPipe.mBuffer, count * mFrameSize);
+            memcpy((char *) buffer + (red * mFrameSize), mBuffer, count * mFrameSize);
             red += count;
         }
     }
@@ -92,4 +96,74 @@ ssize_t PipeReader::read(void *buffer, size_t count, int64_t readPTS __unused)
     return red;
 }
 
+ssize_t PipeReader::readVia(readVia_t via, size_t total, void *user,
+                            int64_t readPTS, size_t block)
+{
+    mPeeked = 0;
+    ssize_t avail = availableToRead();
+    if (CC_UNLIKELY(avail <= 0)) {
+        return avail;
+    }
+    if (CC_LIKELY(total > (size_t) avail)) {
+        total = avail;
+    }
+    if (block == 0) {
+        block = total;
+    }
+    size_t accumulator = 0;
+    while (accumulator < total) {
+        size_t front = mFront & (mMaxFrames - 1);
+        size_t count = mMaxFrames - front;
+        if (count > total - accumulator) {
+            count = total - accumulator;
+        }
+        if (count > block) {
+            count = block;
+        }
+        ssize_t ret = via(user, (const char *) mBuffer + (front * mFrameSize), count, readPTS);
+        if (ret <= 0) {
+            return accumulator > 0 ? (ssize_t) accumulator : ret;
+        }
+        ALOG_ASSERT((size_t) ret <= count);
+        mFront += ret;
+        mFramesRead += ret;
+        accumulator += ret;
+    }
+    return accumulator;
+}
+
+ssize_t PipeReader::peek(Region regions[2], size_t count)
+{
+    mPeeked = 0;
+    ssize_t avail = availableToRead();
+    if (CC_UNLIKELY(avail <= 0)) {
+        regions[0].mData = regions[1].mData = NULL;
+        regions[0].mFrameCount = regions[1].mFrameCount = 0;
+        return avail;
+    }
+    if (CC_LIKELY(count > (size_t) avail)) {
+        count = avail;
+    }
+    size_t front = mFront & (mMaxFrames - 1);
+    size_t part1 = mMaxFrames - front;
+    if (CC_LIKELY(part1 > count)) {
+        part1 = count;
+    }
+    regions[0].mData = (const char *) mBuffer + (front * mFrameSize);
+    regions[0].mFrameCount = part1;
+    regions[1].mData = count > part1 ? mBuffer : NULL;
+    regions[1].mFrameCount = count - part1;
+    mPeeked = count;
+    return count;
+}
+
+void PipeReader::advance(size_t count)
+{
+    LOG_ALWAYS_FATAL_IF(count > mPeeked, "advance(%zu) past the %zu frames peeked",
+            count, mPeeked);
+    mPeeked -= count;
+    mFront += count;
+    mFramesRead += count;
+}
+
 }   // namespace android
@@ -0,0 +1,35 @@
+# Build the benchmarks.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := pipe_benchmark
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	pipe_benchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libnbaio \
+	libcutils \
+	libutils \
+	liblog
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := nblog_benchmark
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+	nblog_benchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libnbaio \
+	libcutils \
+	libutils \
+	liblog
+
+include $(BUILD_EXECUTABLE)
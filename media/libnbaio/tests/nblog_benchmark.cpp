@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <media/nbaio/NBLog.h>
+
+/* Measures the cost of NBLog::Writer::logb() and logf() and checks the binary records.
+ *
+ * Several threads log concurrently, each through its own Writer and shared memory as the
+ * AudioFlinger threads do. Each thread logs the same binary records with logb() and then
+ * with logf(), and the Reader of each Writer checks that every record dumps correctly.
+ * A last run logs twice the capacity of a small Writer, and checks that the Reader drops the
+ * overwritten records but dumps the recent ones intact.
+ *
+ * One line is printed per thread with the nanoseconds per logb() and per logf() call.
+ */
+
+using namespace android;
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-t threads] [-r records] [-s bytes]\n", name);
+    fprintf(stderr, "    -t    number of logging threads (default 4)\n");
+    fprintf(stderr, "    -r    records per thread and per log function (default 2000)\n");
+    fprintf(stderr, "    -s    log size of each Writer in bytes (default 262144)\n");
+}
+
+static const char kFormat[] = "thread %d record %d: %lld %.2f";
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct LogThread {
+    int mIndex;
+    int mRecords;
+    sp<NBLog::Writer> mWriter;
+    int64_t mLogbNs;
+    int64_t mLogfNs;
+    int mFormatId;
+};
+
+static void *logThread(void *arg) {
+    LogThread *thread = (LogThread *) arg;
+    thread->mFormatId = thread->mWriter->registerFormat(kFormat);
+    int64_t start = nowNs();
+    for (int i = 0; i < thread->mRecords; ++i) {
+        thread->mWriter->logb(thread->mFormatId, thread->mIndex, i, (long long) i << 32, i * 0.5);
+    }
+    int64_t end = nowNs();
+    thread->mLogbNs = end - start;
+    for (int i = 0; i < thread->mRecords; ++i) {
+        thread->mWriter->logf(kFormat, thread->mIndex, i, (long long) i << 32, i * 0.5);
+    }
+    thread->mLogfNs = nowNs() - end;
+    return NULL;
+}
+
+// Returns the body of a dumped line, after the timestamp which is empty until the Reader has
+// seen a timestamp or a binary record.
+static const char *lineBody(const char *line) {
+    const char *end = strstr(line, "] ");
+    return end != NULL ? end + 2 : line + 1;
+}
+
+// Dumps the log and checks that it holds the records logged by logThread(), twice.
+// Returns the number of errors.
+static int checkDump(NBLog::Reader *reader, int index, int records) {
+    FILE *file = tmpfile();
+    if (file == NULL) {
+        fprintf(stderr, "tmpfile failed\n");
+        return 1;
+    }
+    reader->dump(fileno(file));
+    rewind(file);
+    int errors = 0;
+    int expected = 0;
+    int passes = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strstr(line, "warning: lost") != NULL) {
+            continue;
+        }
+        int t, r;
+        long long value;
+        double half;
+        char end;
+        if (sscanf(lineBody(line), "thread %d record %d: %lld %lf%c", &t, &r, &value, &half,
+                &end) != 5 || end != '\n') {
+            fprintf(stderr, "thread %d: unexpected line %s", index, line);
+            ++errors;
+            continue;
+        }
+        if (t != index || r != expected || value != (long long) r << 32 || half != r * 0.5) {
+            fprintf(stderr, "thread %d: expected record %d, got %s", index, expected, line);
+            ++errors;
+        }
+        if (++expected == records) {
+            expected = 0;
+            ++passes;
+        }
+    }
+    if (passes != 2 || expected != 0) {
+        fprintf(stderr, "thread %d: %d complete passes, %d records in the last one\n",
+                index, passes, expected);
+        ++errors;
+    }
+    fclose(file);
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    int threads = 4;
+    int records = 2000;
+    size_t size = 256 * 1024;
+    int ch;
+    while ((ch = getopt(argc, argv, "t:r:s:")) != -1) {
+        switch (ch) {
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'r':
+            records = atoi(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (threads <= 0 || records <= 0 || size < 1024) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int errors = 0;
+    LogThread *logThreads = new LogThread[threads];
+    void **shared = new void *[threads];
+    pthread_t *tids = new pthread_t[threads];
+    for (int i = 0; i < threads; ++i) {
+        shared[i] = calloc(1, NBLog::Timeline::sharedSize(size));
+        logThreads[i].mIndex = i;
+        logThreads[i].mRecords = records;
+        logThreads[i].mWriter = new NBLog::Writer(size, shared[i]);
+        pthread_create(&tids[i], NULL, logThread, &logThreads[i]);
+    }
+    printf("%8s %10s %10s\n", "thread", "logb ns", "logf ns");
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+        if (logThreads[i].mFormatId < 0) {
+            fprintf(stderr, "registerFormat failed: %d\n", logThreads[i].mFormatId);
+            return EXIT_FAILURE;
+        }
+        printf("%8d %10.1f %10.1f\n", i, (double) logThreads[i].mLogbNs / records,
+                (double) logThreads[i].mLogfNs / records);
+        sp<NBLog::Reader> reader = new NBLog::Reader(size, shared[i]);
+        errors += checkDump(reader.get(), i, records);
+        logThreads[i].mWriter.clear();
+        free(shared[i]);
+    }
+
+    // log twice what fits in a small Writer: only the most recent records are dumped
+    const size_t smallSize = 4096;
+    void *smallShared = calloc(1, NBLog::Timeline::sharedSize(smallSize));
+    LogThread small;
+    small.mIndex = 0;
+    small.mRecords = 200;   // about 8 KB of binary records, then 8 KB of strings
+    small.mWriter = new NBLog::Writer(smallSize, smallShared);
+    logThread(&small);
+    FILE *file = tmpfile();
+    sp<NBLog::Reader> reader = new NBLog::Reader(smallSize, smallShared);
+    reader->dump(fileno(file));
+    rewind(file);
+    char line[256];
+    int lines = 0;
+    int lastRecord = -1;
+    bool lost = false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        int r;
+        if (strstr(line, "warning: lost") != NULL) {
+            lost = true;
+        } else if (sscanf(lineBody(line), "thread 0 record %d:", &r) != 1 ||
+                (lastRecord != -1 && r != lastRecord + 1)) {
+            fprintf(stderr, "small log: unexpected line %s", line);
+            ++errors;
+        } else {
+            lastRecord = r;
+            ++lines;
+        }
+    }
+    fclose(file);
+    if (!lost || lines == 0 || lastRecord != small.mRecords - 1) {
+        fprintf(stderr, "small log: lost %d, %d lines, last record %d\n", lost, lines,
+                lastRecord);
+        ++errors;
+    }
+    small.mWriter.clear();
+    free(smallShared);
+
+    delete[] tids;
+    delete[] shared;
+    delete[] logThreads;
+    if (errors != 0) {
+        fprintf(stderr, "%d errors\n", errors);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <cutils/atomic.h>
+#include <media/AudioBufferProvider.h>
+#include <media/nbaio/Pipe.h>
+#include <media/nbaio/PipeReader.h>
+
+/* Measures the throughput of a Pipe with one writer thread and 1 to 8 reader threads,
+ * for each of the three ways of reading: read() into a buffer of the reader, readVia() and
+ * peek()/advance() directly from the pipe buffer.
+ *
+ * The writer writes stereo 16-bit frames holding their own index, and each reader checks every
+ * frame it reads, so that the data is touched as a real client would and any corruption is
+ * reported. The Pipe itself has no flow control: the writer waits for the slowest reader,
+ * so that a run never overruns.
+ *
+ * One line is printed per configuration with the total frames per second read by all readers.
+ */
+
+using namespace android;
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n pipe-frames] [-f frames] [-r readers] [-d frames-per-run]\n",
+            name);
+    fprintf(stderr, "    -n    pipe size in frames, rounded up to a power of 2 (default 4096)\n");
+    fprintf(stderr, "    -f    frames per write and per read (default 256)\n");
+    fprintf(stderr, "    -r    maximum number of readers (default 8)\n");
+    fprintf(stderr, "    -d    frames written per configuration (default 16777216)\n");
+}
+
+static const int kMaxReaders = 8;
+static const size_t kChannels = 2;
+
+enum ReadMode {
+    READ_COPY,
+    READ_VIA,
+    READ_PEEK,
+};
+
+static const char * const kReadModeNames[] = { "read", "readVia", "peek" };
+
+struct Reader {
+    PipeReader      *mPipeReader;
+    ReadMode        mMode;
+    size_t          mFrameCount;    // frames per read
+    size_t          mTotalFrames;
+    int16_t         *mBuffer;       // for READ_COPY
+    int16_t         mNextFrame;     // expected value of the next frame, wraps like the writer's
+    size_t          mErrors;
+    volatile int32_t mConsumed;     // frames read, for the flow control of the writer
+    // each Reader is used by its own thread
+    char            mPad[Pipe::kCacheLineSize];
+};
+
+static inline void checkFrames(Reader *reader, const int16_t *frames, size_t count) {
+    int16_t next = reader->mNextFrame;
+    size_t errors = 0;
+    for (size_t i = 0; i < count; ++i, ++next) {
+        errors += (frames[i * kChannels] != next) + (frames[i * kChannels + 1] != next);
+    }
+    reader->mNextFrame = next;
+    reader->mErrors += errors;
+}
+
+static ssize_t checkVia(void *user, const void *buffer, size_t count, int64_t readPTS __unused) {
+    checkFrames((Reader *) user, (const int16_t *) buffer, count);
+    return count;
+}
+
+static void *readerLoop(void *arg) {
+    Reader *reader = (Reader *) arg;
+    size_t consumed = 0;
+    while (consumed < reader->mTotalFrames) {
+        ssize_t ret;
+        switch (reader->mMode) {
+        case READ_COPY:
+            ret = reader->mPipeReader->read(reader->mBuffer, reader->mFrameCount,
+                    AudioBufferProvider::kInvalidPTS);
+            if (ret > 0) {
+                checkFrames(reader, reader->mBuffer, ret);
+            }
+            break;
+        case READ_VIA:
+            ret = reader->mPipeReader->readVia(checkVia, reader->mFrameCount, reader,
+                    AudioBufferProvider::kInvalidPTS);
+            break;
+        case READ_PEEK: {
+            PipeReader::Region regions[2];
+            ret = reader->mPipeReader->peek(regions, reader->mFrameCount);
+            for (int i = 0; i < 2 && ret > 0; i++) {
+                checkFrames(reader, (const int16_t *) regions[i].mData, regions[i].mFrameCount);
+            }
+            if (ret > 0) {
+                reader->mPipeReader->advance(ret);
+            }
+            } break;
+        default:
+            ret = 0;
+            break;
+        }
+        if (ret > 0) {
+            consumed += ret;
+            android_atomic_release_store(consumed, &reader->mConsumed);
+        } else if (ret == 0) {
+            sched_yield();
+        } else {
+            // an overrun is not expected with the flow control of the writer
+            fprintf(stderr, "read error %zd\n", ret);
+            reader->mErrors++;
+            break;
+        }
+    }
+    return NULL;
+}
+
+static double run(size_t pipeFrames, size_t frameCount, int numReaders, ReadMode mode,
+        size_t totalFrames, size_t *errors) {
+    const NBAIO_Format format = Format_from_SR_C(48000, kChannels, AUDIO_FORMAT_PCM_16_BIT);
+    const NBAIO_Format offers[1] = {format};
+    size_t numCounterOffers = 0;
+    Pipe *pipe = new Pipe(pipeFrames, format);
+    pipe->negotiate(offers, 1, NULL, numCounterOffers);
+    // the Pipe rounds its size up to a power of 2
+    pipeFrames = pipe->availableToWrite();
+
+    Reader *readers[kMaxReaders];
+    for (int i = 0; i < numReaders; i++) {
+        Reader *reader = new Reader;
+        reader->mPipeReader = new PipeReader(*pipe);
+        numCounterOffers = 0;
+        reader->mPipeReader->negotiate(offers, 1, NULL, numCounterOffers);
+        reader->mMode = mode;
+        reader->mFrameCount = frameCount;
+        reader->mTotalFrames = totalFrames;
+        reader->mBuffer = new int16_t[frameCount * kChannels];
+        reader->mNextFrame = 0;
+        reader->mErrors = 0;
+        reader->mConsumed = 0;
+        readers[i] = reader;
+    }
+
+    int16_t *buffer = new int16_t[frameCount * kChannels];
+    int16_t nextFrame = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t threads[kMaxReaders];
+    for (int i = 0; i < numReaders; i++) {
+        pthread_create(&threads[i], NULL, readerLoop, readers[i]);
+    }
+    size_t written = 0;
+    while (written < totalFrames) {
+        size_t count = totalFrames - written;
+        if (count > frameCount) {
+            count = frameCount;
+        }
+        // wait until the slowest reader leaves room for the next write
+        for (int i = 0; i < numReaders; i++) {
+            while (written + count -
+                    (size_t) android_atomic_acquire_load(&readers[i]->mConsumed) > pipeFrames) {
+                sched_yield();
+            }
+        }
+        for (size_t j = 0; j < count; j++, nextFrame++) {
+            buffer[j * kChannels] = buffer[j * kChannels + 1] = nextFrame;
+        }
+        written += pipe->write(buffer, count);
+    }
+    for (int i = 0; i < numReaders; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *errors = 0;
+    for (int i = 0; i < numReaders; i++) {
+        *errors += readers[i]->mErrors;
+        delete[] readers[i]->mBuffer;
+        delete readers[i]->mPipeReader;
+        delete readers[i];
+    }
+    delete[] buffer;
+    delete pipe;
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    return (double) totalFrames * numReaders / seconds;
+}
+
+int main(int argc, char* argv[]) {
+    const char* const progname = argv[0];
+    size_t pipeFrames = 4096;
+    size_t frameCount = 256;
+    int maxReaders = kMaxReaders;
+    size_t totalFrames = 1 << 24;
+    int ch;
+    while ((ch = getopt(argc, argv, "n:f:r:d:")) != -1) {
+        switch (ch) {
+        case 'n':
+            pipeFrames = atoi(optarg);
+            break;
+        case 'f':
+            frameCount = atoi(optarg);
+            break;
+        case 'r':
+            maxReaders = atoi(optarg);
+            break;
+        case 'd':
+            totalFrames = atoi(optarg);
+            break;
+        default:
+            usage(progname);
+            return EXIT_FAILURE;
+        }
+    }
+    if (pipeFrames < 2 || frameCount == 0 || frameCount > pipeFrames
+            || maxReaders < 1 || maxReaders > kMaxReaders || totalFrames == 0) {
+        usage(progname);
+        return EXIT_FAILURE;
+    }
+
+    printf("pipe %zu frames, %zu frames per transfer, %zu frames per run\n",
+            pipeFrames, frameCount, totalFrames);
+    int status = EXIT_SUCCESS;
+    for (int mode = READ_COPY; mode <= READ_PEEK; mode++) {
+        for (int readers = 1; readers <= maxReaders; readers++) {
+            size_t errors;
+            double framesPerSecond = run(pipeFrames, frameCount, readers, (ReadMode) mode,
+                    totalFrames, &errors);
+            printf("%-8s %d readers: %8.2f Mframes/s%s\n", kReadModeNames[mode], readers,
+                    framesPerSecond * 1e-6, errors ? "  DATA ERRORS" : "");
+            if (errors) {
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    return status;
+}
@@ -149,6 +149,10 @@ MediaCodec::MediaCodec(const sp<ALooper> &looper)
       mDequeueInputReplyID(0),
       mDequeueOutputTimeoutGeneration(0),
       mDequeueOutputReplyID(0),
+      mDequeueInputBatch(NULL),
+      mDequeueInputBatchSize(0),
+      mDequeueOutputBatch(NULL),
+      mDequeueOutputBatchSize(0),
       mHaveInputSurface(false) {
 }
 
@@ -241,9 +245,10 @@ status_t MediaCodec::init(const AString &name, bool nameIsType, bool encoder) {
     return PostAndAwaitResponse(msg, &response);
 }
 
-status_t MediaCodec::setCallback(const sp<AMessage> &callback) {
+status_t MediaCodec::setCallback(const sp<AMessage> &callback, bool coalesceBuffers) {
     sp<AMessage> msg = new AMessage(kWhatSetCallback, id());
     msg->setMessage("callback", callback);
+    msg->setInt32("coalesceBuffers", coalesceBuffers);
 
     sp<AMessage> response;
     return PostAndAwaitResponse(msg, &response);
@@ -485,6 +490,92 @@ status_t MediaCodec::releaseOutputBuffer(size_t index) {
     return PostAndAwaitResponse(msg, &response);
 }
 
+status_t MediaCodec::queueInputBuffers(
+        const BufferDescriptor *buffers, size_t numBuffers, size_t *count,
+        AString *errorDetailMsg) {
+    *count = 0;
+    if (errorDetailMsg != NULL) {
+        errorDetailMsg->clear();
+    }
+
+    sp<AMessage> msg = new AMessage(kWhatQueueInputBuffers, id());
+    msg->setPointer("buffers", (void *)buffers);
+    msg->setSize("numBuffers", numBuffers);
+    msg->setPointer("errorDetailMsg", errorDetailMsg);
+
+    sp<AMessage> response;
+    status_t err = PostAndAwaitResponse(msg, &response);
+
+    if (response != NULL) {
+        response->findSize("count", count);
+    }
+    return err;
+}
+
+status_t MediaCodec::dequeueInputBuffers(
+        size_t *indices, size_t maxCount, size_t *count, int64_t timeoutUs) {
+    *count = 0;
+    if (maxCount == 0) {
+        return -EINVAL;
+    }
+
+    sp<AMessage> msg = new AMessage(kWhatDequeueInputBuffers, id());
+    msg->setPointer("indices", indices);
+    msg->setSize("maxCount", maxCount);
+    msg->setInt64("timeoutUs", timeoutUs);
+
+    sp<AMessage> response;
+    status_t err;
+    if ((err = PostAndAwaitResponse(msg, &response)) != OK) {
+        return err;
+    }
+
+    CHECK(response->findSize("count", count));
+
+    return OK;
+}
+
+status_t MediaCodec::dequeueOutputBuffers(
+        BufferDescriptor *buffers, size_t maxCount, size_t *count, int64_t timeoutUs) {
+    *count = 0;
+    if (maxCount == 0) {
+        return -EINVAL;
+    }
+
+    sp<AMessage> msg = new AMessage(kWhatDequeueOutputBuffers, id());
+    msg->setPointer("buffers", buffers);
+    msg->setSize("maxCount", maxCount);
+    msg->setInt64("timeoutUs", timeoutUs);
+
+    sp<AMessage> response;
+    status_t err;
+    if ((err = PostAndAwaitResponse(msg, &response)) != OK) {
+        return err;
+    }
+
+    CHECK(response->findSize("count", count));
+
+    return OK;
+}
+
+status_t MediaCodec::releaseOutputBuffers(
+        const size_t *indices, size_t numIndices, bool render, size_t *count) {
+    *count = 0;
+
+    sp<AMessage> msg = new AMessage(kWhatReleaseOutputBuffers, id());
+    msg->setPointer("indices", (void *)indices);
+    msg->setSize("numIndices", numIndices);
+    msg->setInt32("render", render);
+
+    sp<AMessage> response;
+    status_t err = PostAndAwaitResponse(msg, &response);
+
+    if (response != NULL) {
+        response->findSize("count", count);
+    }
+    return err;
+}
+
 status_t MediaCodec::signalEndOfInputStream() {
     sp<AMessage> msg = new AMessage(kWhatSignalEndOfInputStream, id());
 
@@ -659,6 +750,17 @@ bool MediaCodec::handleDequeueInputBuffer(uint32_t replyID, bool newRequest) {
 
     sp<AMessage> response = new AMessage;
     response->setSize("index", index);
+
+    if (mDequeueInputBatch != NULL) {
+        size_t count = 0;
+        mDequeueInputBatch[count++] = index;
+        while (count < mDequeueInputBatchSize
+                && (index = dequeuePortBuffer(kPortIndexInput)) >= 0) {
+            mDequeueInputBatch[count++] = index;
+        }
+        response->setSize("count", count);
+    }
+
     response->postReply(replyID);
 
     return true;
@@ -686,33 +788,24 @@ bool MediaCodec::handleDequeueOutputBuffer(uint32_t replyID, bool newRequest) {
             return false;
         }
 
-        const sp<ABuffer> &buffer =
-            mPortBuffers[kPortIndexOutput].itemAt(index).mData;
-
-        response->setSize("index", index);
-        response->setSize("offset", buffer->offset());
-        response->setSize("size", buffer->size());
-
-        int64_t timeUs;
-        CHECK(buffer->meta()->findInt64("timeUs", &timeUs));
-
-        response->setInt64("timeUs", timeUs);
-
-        int32_t omxFlags;
-        CHECK(buffer->meta()->findInt32("omxFlags", &omxFlags));
-
-        uint32_t flags = 0;
-        if (omxFlags & OMX_BUFFERFLAG_SYNCFRAME) {
-            flags |= BUFFER_FLAG_SYNCFRAME;
-        }
-        if (omxFlags & OMX_BUFFERFLAG_CODECCONFIG) {
-            flags |= BUFFER_FLAG_CODECCONFIG;
-        }
-        if (omxFlags & OMX_BUFFERFLAG_EOS) {
-            flags |= BUFFER_FLAG_EOS;
+        if (mDequeueOutputBatch != NULL) {
+            size_t count = 0;
+            describeOutputBuffer(index, &mDequeueOutputBatch[count++]);
+            while (count < mDequeueOutputBatchSize
+                    && (index = dequeuePortBuffer(kPortIndexOutput)) >= 0) {
+                describeOutputBuffer(index, &mDequeueOutputBatch[count++]);
+            }
+            response->setSize("count", count);
+        } else {
+            BufferDescriptor desc;
+            describeOutputBuffer(index, &desc);
+
+            response->setSize("index", desc.mIndex);
+            response->setSize("offset", desc.mOffset);
+            response->setSize("size", desc.mSize);
+            response->setInt64("timeUs", desc.mPresentationTimeUs);
+            response->setInt32("flags", desc.mFlags);
         }
-
-        response->setInt32("flags", flags);
     }
 
     response->postReply(replyID);
@@ -1011,6 +1104,10 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
                         // format as necessary.
                         mFlags |= kFlagGatherCodecSpecificData;
                     } else if (mFlags & kFlagIsAsync) {
+                        if (mFlags & kFlagCoalesceCallbacks) {
+                            // buffers in the previous format come first
+                            postOutputBuffersAvailable();
+                        }
                         onOutputFormatChanged();
                     } else {
                         mFlags |= kFlagOutputFormatChanged;
@@ -1084,6 +1181,14 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
 
                 case CodecBase::kWhatDrainThisBuffer:
                 {
+                    if ((mFlags & kFlagCoalesceCallbacks)
+                            && (mFlags & kFlagGatherCodecSpecificData)
+                            && mState == STARTED) {
+                        // this buffer follows a format change, the buffers in the
+                        // previous format must be announced before it
+                        postOutputBuffersAvailable();
+                    }
+
                     /* size_t index = */updateBuffers(kPortIndexOutput, msg);
 
                     if (mState == FLUSHING
@@ -1242,11 +1347,19 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
 
             mCallback = callback;
 
+            int32_t coalesceBuffers;
+            CHECK(msg->findInt32("coalesceBuffers", &coalesceBuffers));
+
             if (mCallback != NULL) {
                 ALOGI("MediaCodec will operate in async mode");
                 mFlags |= kFlagIsAsync;
+                if (coalesceBuffers) {
+                    mFlags |= kFlagCoalesceCallbacks;
+                } else {
+                    mFlags &= ~kFlagCoalesceCallbacks;
+                }
             } else {
-                mFlags &= ~kFlagIsAsync;
+                mFlags &= ~(kFlagIsAsync | kFlagCoalesceCallbacks);
             }
 
             sp<AMessage> response = new AMessage;
@@ -1402,6 +1515,7 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
         }
 
         case kWhatDequeueInputBuffer:
+        case kWhatDequeueInputBuffers:
         {
             uint32_t replyID;
             CHECK(msg->senderAwaitsResponse(&replyID));
@@ -1418,6 +1532,16 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
                 break;
             }
 
+            if (!(mFlags & kFlagDequeueInputPending)) {
+                // the caller's array stays valid until the request is replied to
+                mDequeueInputBatch = NULL;
+                mDequeueInputBatchSize = 0;
+                if (msg->what() == kWhatDequeueInputBuffers) {
+                    CHECK(msg->findPointer("indices", (void **)&mDequeueInputBatch));
+                    CHECK(msg->findSize("maxCount", &mDequeueInputBatchSize));
+                }
+            }
+
             if (handleDequeueInputBuffer(replyID, true /* new request */)) {
                 break;
             }
@@ -1482,6 +1606,7 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
         }
 
         case kWhatDequeueOutputBuffer:
+        case kWhatDequeueOutputBuffers:
         {
             uint32_t replyID;
             CHECK(msg->senderAwaitsResponse(&replyID));
@@ -1492,6 +1617,16 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
                 break;
             }
 
+            if (!(mFlags & kFlagDequeueOutputPending)) {
+                // the caller's array stays valid until the request is replied to
+                mDequeueOutputBatch = NULL;
+                mDequeueOutputBatchSize = 0;
+                if (msg->what() == kWhatDequeueOutputBuffers) {
+                    CHECK(msg->findPointer("buffers", (void **)&mDequeueOutputBatch));
+                    CHECK(msg->findSize("maxCount", &mDequeueOutputBatchSize));
+                }
+            }
+
             if (handleDequeueOutputBuffer(replyID, true /* new request */)) {
                 break;
             }
@@ -1555,6 +1690,117 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatQueueInputBuffers:
+        {
+            uint32_t replyID;
+            CHECK(msg->senderAwaitsResponse(&replyID));
+
+            if (!isExecuting()) {
+                PostReplyWithError(replyID, INVALID_OPERATION);
+                break;
+            } else if (mFlags & kFlagStickyError) {
+                PostReplyWithError(replyID, getStickyError());
+                break;
+            }
+
+            const BufferDescriptor *buffers;
+            size_t numBuffers;
+            AString *errorDetailMsg;
+            CHECK(msg->findPointer("buffers", (void **)&buffers));
+            CHECK(msg->findSize("numBuffers", &numBuffers));
+            CHECK(msg->findPointer("errorDetailMsg", (void **)&errorDetailMsg));
+
+            // the items of the request are overwritten for each buffer. mCrypto->decrypt()
+            // always needs a detail message, the caller's one is optional.
+            AString detailMsg;
+            sp<AMessage> request = new AMessage;
+            request->setPointer("errorDetailMsg", &detailMsg);
+
+            status_t err = OK;
+            size_t count = 0;
+            for (; count < numBuffers; ++count) {
+                const BufferDescriptor &buffer = buffers[count];
+                request->setSize("index", buffer.mIndex);
+                request->setSize("offset", buffer.mOffset);
+                request->setSize("size", buffer.mSize);
+                request->setInt64("timeUs", buffer.mPresentationTimeUs);
+                request->setInt32("flags", buffer.mFlags);
+
+                err = onQueueInputBuffer(request);
+                if (err != OK) {
+                    if (errorDetailMsg != NULL) {
+                        *errorDetailMsg = detailMsg;
+                    }
+                    break;
+                }
+            }
+
+            sp<AMessage> response = new AMessage;
+            response->setInt32("err", err);
+            response->setSize("count", count);
+            response->postReply(replyID);
+            break;
+        }
+
+        case kWhatReleaseOutputBuffers:
+        {
+            uint32_t replyID;
+            CHECK(msg->senderAwaitsResponse(&replyID));
+
+            if (!isExecuting()) {
+                PostReplyWithError(replyID, INVALID_OPERATION);
+                break;
+            } else if (mFlags & kFlagStickyError) {
+                PostReplyWithError(replyID, getStickyError());
+                break;
+            }
+
+            const size_t *indices;
+            size_t numIndices;
+            int32_t render;
+            CHECK(msg->findPointer("indices", (void **)&indices));
+            CHECK(msg->findSize("numIndices", &numIndices));
+            CHECK(msg->findInt32("render", &render));
+
+            sp<AMessage> request = new AMessage;
+            request->setInt32("render", render);
+
+            status_t err = OK;
+            size_t count = 0;
+            for (; count < numIndices; ++count) {
+                request->setSize("index", indices[count]);
+
+                err = onReleaseOutputBuffer(request);
+                if (err != OK) {
+                    break;
+                }
+            }
+
+            sp<AMessage> response = new AMessage;
+            response->setInt32("err", err);
+            response->setSize("count", count);
+            response->postReply(replyID);
+            break;
+        }
+
+        case kWhatPostCoalescedCallbacks:
+        {
+            mFlags &= ~kFlagCoalescedCallbacksPending;
+
+            if (!(mFlags & kFlagCoalesceCallbacks)
+                    || mState == FLUSHING
+                    || mState == STOPPING
+                    || mState == RELEASING) {
+                break;
+            }
+
+            if (!mHaveInputSurface) {
+                postInputBuffersAvailable();
+            }
+            postOutputBuffersAvailable();
+            break;
+        }
+
         case kWhatSignalEndOfInputStream:
         {
             uint32_t replyID;
@@ -1769,6 +2015,8 @@ void MediaCodec::setState(State newState) {
         mFlags &= ~kFlagIsEncoder;
         mFlags &= ~kFlagGatherCodecSpecificData;
         mFlags &= ~kFlagIsAsync;
+        mFlags &= ~kFlagCoalesceCallbacks;
+        mFlags &= ~kFlagCoalescedCallbacksPending;
         mStickyError = OK;
 
         mActivityNotify.clear();
@@ -2098,6 +2346,16 @@ status_t MediaCodec::setNativeWindow(
 }
 
 void MediaCodec::onInputBufferAvailable() {
+    if (mFlags & kFlagCoalesceCallbacks) {
+        // the buffers that become available until this message is handled are announced
+        // together
+        if (!(mFlags & kFlagCoalescedCallbacksPending)) {
+            mFlags |= kFlagCoalescedCallbacksPending;
+            (new AMessage(kWhatPostCoalescedCallbacks, id()))->post();
+        }
+        return;
+    }
+
     int32_t index;
     while ((index = dequeuePortBuffer(kPortIndexInput)) >= 0) {
         sp<AMessage> msg = mCallback->dup();
@@ -2108,39 +2366,97 @@ void MediaCodec::onInputBufferAvailable() {
 }
 
 void MediaCodec::onOutputBufferAvailable() {
+    if (mFlags & kFlagCoalesceCallbacks) {
+        if (!(mFlags & kFlagCoalescedCallbacksPending)) {
+            mFlags |= kFlagCoalescedCallbacksPending;
+            (new AMessage(kWhatPostCoalescedCallbacks, id()))->post();
+        }
+        return;
+    }
+
     int32_t index;
     while ((index = dequeuePortBuffer(kPortIndexOutput)) >= 0) {
-        const sp<ABuffer> &buffer =
-            mPortBuffers[kPortIndexOutput].itemAt(index).mData;
+        BufferDescriptor desc;
+        describeOutputBuffer(index, &desc);
+
         sp<AMessage> msg = mCallback->dup();
         msg->setInt32("callbackID", CB_OUTPUT_AVAILABLE);
         msg->setInt32("index", index);
-        msg->setSize("offset", buffer->offset());
-        msg->setSize("size", buffer->size());
+        msg->setSize("offset", desc.mOffset);
+        msg->setSize("size", desc.mSize);
+        msg->setInt64("timeUs", desc.mPresentationTimeUs);
+        msg->setInt32("flags", desc.mFlags);
 
-        int64_t timeUs;
-        CHECK(buffer->meta()->findInt64("timeUs", &timeUs));
+        msg->post();
+    }
+}
 
-        msg->setInt64("timeUs", timeUs);
+void MediaCodec::describeOutputBuffer(size_t index, BufferDescriptor *desc) {
+    const sp<ABuffer> &buffer =
+        mPortBuffers[kPortIndexOutput].itemAt(index).mData;
 
-        int32_t omxFlags;
-        CHECK(buffer->meta()->findInt32("omxFlags", &omxFlags));
+    desc->mIndex = index;
+    desc->mOffset = buffer->offset();
+    desc->mSize = buffer->size();
 
-        uint32_t flags = 0;
-        if (omxFlags & OMX_BUFFERFLAG_SYNCFRAME) {
-            flags |= BUFFER_FLAG_SYNCFRAME;
-        }
-        if (omxFlags & OMX_BUFFERFLAG_CODECCONFIG) {
-            flags |= BUFFER_FLAG_CODECCONFIG;
-        }
-        if (omxFlags & OMX_BUFFERFLAG_EOS) {
-            flags |= BUFFER_FLAG_EOS;
-        }
+    CHECK(buffer->meta()->findInt64("timeUs", &desc->mPresentationTimeUs));
 
-        msg->setInt32("flags", flags);
+    int32_t omxFlags;
+    CHECK(buffer->meta()->findInt32("omxFlags", &omxFlags));
 
-        msg->post();
+    uint32_t flags = 0;
+    if (omxFlags & OMX_BUFFERFLAG_SYNCFRAME) {
+        flags |= BUFFER_FLAG_SYNCFRAME;
+    }
+    if (omxFlags & OMX_BUFFERFLAG_CODECCONFIG) {
+        flags |= BUFFER_FLAG_CODECCONFIG;
+    }
+    if (omxFlags & OMX_BUFFERFLAG_EOS) {
+        flags |= BUFFER_FLAG_EOS;
     }
+    desc->mFlags = flags;
+}
+
+void MediaCodec::postInputBuffersAvailable() {
+    List<size_t> *availBuffers = &mAvailPortBuffers[kPortIndexInput];
+    if (availBuffers->empty() || mCallback == NULL) {
+        return;
+    }
+
+    sp<ABuffer> indices = new ABuffer(availBuffers->size() * sizeof(int32_t));
+    int32_t *data = (int32_t *)indices->data();
+    int32_t count = 0;
+    ssize_t index;
+    while ((index = dequeuePortBuffer(kPortIndexInput)) >= 0) {
+        data[count++] = index;
+    }
+
+    sp<AMessage> msg = mCallback->dup();
+    msg->setInt32("callbackID", CB_INPUT_BUFFERS_AVAILABLE);
+    msg->setInt32("count", count);
+    msg->setBuffer("indices", indices);
+    msg->post();
+}
+
+void MediaCodec::postOutputBuffersAvailable() {
+    List<size_t> *availBuffers = &mAvailPortBuffers[kPortIndexOutput];
+    if (availBuffers->empty() || mCallback == NULL) {
+        return;
+    }
+
+    sp<ABuffer> buffers = new ABuffer(availBuffers->size() * sizeof(BufferDescriptor));
+    BufferDescriptor *data = (BufferDescriptor *)buffers->data();
+    int32_t count = 0;
+    ssize_t index;
+    while ((index = dequeuePortBuffer(kPortIndexOutput)) >= 0) {
+        describeOutputBuffer(index, &data[count++]);
+    }
+
+    sp<AMessage> msg = mCallback->dup();
+    msg->setInt32("callbackID", CB_OUTPUT_BUFFERS_AVAILABLE);
+    msg->setInt32("count", count);
+    msg->setBuffer("buffers", buffers);
+    msg->post();
 }
 
 void MediaCodec::onError(status_t err, int32_t actionCode, const char *detail) {
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <string.h>
 #include <sys/types.h>
 
 #include "AAtomizer.h"
@@ -25,42 +26,81 @@ AAtomizer AAtomizer::gAtomizer;
 
 // static
 const char *AAtomizer::Atomize(const char *name) {
-    return gAtomizer.atomize(name);
+    size_t length;
+    uint32_t hash = Hash(name, &length);
+    return gAtomizer.atomize(name, length, hash);
+}
+
+// static
+const char *AAtomizer::Atomize(const char *name, size_t length, uint32_t hash) {
+    return gAtomizer.atomize(name, length, hash);
+}
+
+// static
+const char *AAtomizer::Lookup(const char *name, size_t length, uint32_t hash) {
+    const Atom *atom = Find(
+            atomic_load_explicit(&gAtomizer.mBuckets[hash % kNumBuckets], memory_order_acquire),
+            name, length, hash);
+    return atom != NULL ? atom->mName.c_str() : NULL;
 }
 
 AAtomizer::AAtomizer() {
-    for (size_t i = 0; i < 128; ++i) {
-        mAtoms.push(List<AString>());
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        atomic_init(&mBuckets[i], (uintptr_t)0);
+    }
+}
+
+// static
+const AAtomizer::Atom *AAtomizer::Find(
+        uintptr_t head, const char *name, size_t length, uint32_t hash) {
+    for (const Atom *atom = (const Atom *)head; atom != NULL; atom = atom->mNext) {
+        if (atom->mHash == hash && atom->mName.size() == length
+                && !memcmp(atom->mName.c_str(), name, length)) {
+            return atom;
+        }
     }
+    return NULL;
 }
 
-const char *AAtomizer::atomize(const char *name) {
+const char *AAtomizer::atomize(const char *name, size_t length, uint32_t hash) {
+    atomic_uintptr_t *bucket = &mBuckets[hash % kNumBuckets];
+
+    const Atom *atom = Find(
+            atomic_load_explicit(bucket, memory_order_acquire), name, length, hash);
+    if (atom != NULL) {
+        return atom->mName.c_str();
+    }
+
     Mutex::Autolock autoLock(mLock);
 
-    const size_t n = mAtoms.size();
-    size_t index = AAtomizer::Hash(name) % n;
-    List<AString> &entry = mAtoms.editItemAt(index);
-    List<AString>::iterator it = entry.begin();
-    while (it != entry.end()) {
-        if ((*it) == name) {
-            return (*it).c_str();
-        }
-        ++it;
+    // another thread may have added it since
+    uintptr_t head = atomic_load_explicit(bucket, memory_order_relaxed);
+    atom = Find(head, name, length, hash);
+    if (atom != NULL) {
+        return atom->mName.c_str();
     }
 
-    entry.push_back(AString(name));
+    Atom *newAtom = new Atom;
+    newAtom->mNext = (Atom *)head;
+    newAtom->mHash = hash;
+    newAtom->mName.setTo(name, length);
+    atomic_store_explicit(bucket, (uintptr_t)newAtom, memory_order_release);
 
-    return (*--entry.end()).c_str();
+    return newAtom->mName.c_str();
 }
 
 // static
-uint32_t AAtomizer::Hash(const char *s) {
+uint32_t AAtomizer::Hash(const char *s, size_t *length) {
+    const char *start = s;
     uint32_t sum = 0;
     while (*s != '\0') {
         sum = (sum * 31) + *s;
         ++s;
     }
 
+    if (length != NULL) {
+        *length = s - start;
+    }
     return sum;
 }
 
@@ -67,7 +67,8 @@ int64_t ALooper::GetNowUs() {
 }
 
 ALooper::ALooper()
-    : mRunningLocally(false) {
+    : mNextSequence(0),
+      mRunningLocally(false) {
     // clean up stale AHandlers. Doing it here instead of in the destructor avoids
     // the side effect of objects being deleted from the unregister function recursively.
     gLooperRoster.unregisterStaleHandlers();
@@ -159,8 +160,6 @@ status_t ALooper::stop() {
 }
 
 void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
-    Mutex::Autolock autoLock(mLock);
-
     int64_t whenUs;
     if (delayUs > 0) {
         whenUs = GetNowUs() + delayUs;
@@ -168,20 +167,78 @@ void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
         whenUs = GetNowUs();
     }
 
-    List<Event>::iterator it = mEventQueue.begin();
-    while (it != mEventQueue.end() && (*it).mWhenUs <= whenUs) {
-        ++it;
-    }
+    postAt(msg, whenUs);
+}
+
+void ALooper::postAt(const sp<AMessage> &msg, int64_t whenUs) {
+    Mutex::Autolock autoLock(mLock);
 
     Event event;
     event.mWhenUs = whenUs;
+    event.mSequence = mNextSequence++;
     event.mMessage = msg;
 
-    if (it == mEventQueue.begin()) {
+    if (mEventQueue.isEmpty() || whenUs < mEventQueue[0].mWhenUs) {
         mQueueChangedCondition.signal();
     }
 
-    mEventQueue.insert(it, event);
+    pushEvent_l(event);
+}
+
+// Events due at the same time are delivered in the order they were posted.
+static inline bool isBefore(int64_t whenUs, uint64_t sequence,
+        int64_t otherWhenUs, uint64_t otherSequence) {
+    return whenUs < otherWhenUs || (whenUs == otherWhenUs && sequence < otherSequence);
+}
+
+void ALooper::pushEvent_l(const Event &event) {
+    mEventQueue.push();
+    Event *events = mEventQueue.editArray();
+
+    // move the parents down until the hole is where the event belongs
+    size_t index = mEventQueue.size() - 1;
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!isBefore(event.mWhenUs, event.mSequence,
+                events[parent].mWhenUs, events[parent].mSequence)) {
+            break;
+        }
+        events[index] = events[parent];
+        index = parent;
+    }
+    events[index] = event;
+}
+
+void ALooper::popEvent_l(Event *event) {
+    *event = mEventQueue[0];
+
+    size_t size = mEventQueue.size() - 1;
+    Event last = mEventQueue[size];
+    mEventQueue.pop();
+    if (size == 0) {
+        return;
+    }
+    Event *events = mEventQueue.editArray();
+
+    // move the earlier children up until the hole is where the last event belongs
+    size_t index = 0;
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && isBefore(events[child + 1].mWhenUs, events[child + 1].mSequence,
+                events[child].mWhenUs, events[child].mSequence)) {
+            ++child;
+        }
+        if (!isBefore(events[child].mWhenUs, events[child].mSequence,
+                last.mWhenUs, last.mSequence)) {
+            break;
+        }
+        events[index] = events[child];
+        index = child;
+    }
+    events[index] = last;
 }
 
 bool ALooper::loop() {
@@ -192,11 +249,11 @@ bool ALooper::loop() {
         if (mThread == NULL && !mRunningLocally) {
             return false;
         }
-        if (mEventQueue.empty()) {
+        if (mEventQueue.isEmpty()) {
             mQueueChangedCondition.wait(mLock);
             return true;
         }
-        int64_t whenUs = (*mEventQueue.begin()).mWhenUs;
+        int64_t whenUs = mEventQueue[0].mWhenUs;
         int64_t nowUs = GetNowUs();
 
         if (whenUs > nowUs) {
@@ -206,8 +263,7 @@ bool ALooper::loop() {
             return true;
         }
 
-        event = *mEventQueue.begin();
-        mEventQueue.erase(mEventQueue.begin());
+        popEvent_l(&event);
     }
 
     gLooperRoster.deliverMessage(event.mMessage);
@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "ALooperRoster"
 #include <utils/Log.h>
+#include <cutils/atomic.h>
 
 #include "ALooperRoster.h"
 
@@ -33,8 +34,6 @@ ALooperRoster::ALooperRoster()
 
 ALooper::handler_id ALooperRoster::registerHandler(
         const sp<ALooper> looper, const sp<AHandler> &handler) {
-    Mutex::Autolock autoLock(mLock);
-
     if (handler->id() != 0) {
         CHECK(!"A handler must only be registered once.");
         return INVALID_OPERATION;
@@ -43,8 +42,11 @@ ALooper::handler_id ALooperRoster::registerHandler(
     HandlerInfo info;
     info.mLooper = looper;
     info.mHandler = handler;
-    ALooper::handler_id handlerID = mNextHandlerID++;
-    mHandlers.add(handlerID, info);
+    ALooper::handler_id handlerID = android_atomic_inc(&mNextHandlerID);
+
+    Shard &shard = shardFor(handlerID);
+    Mutex::Autolock autoLock(shard.mLock);
+    shard.mHandlers.add(handlerID, info);
 
     handler->setID(handlerID);
 
@@ -52,15 +54,16 @@ ALooper::handler_id ALooperRoster::registerHandler(
 }
 
 void ALooperRoster::unregisterHandler(ALooper::handler_id handlerID) {
-    Mutex::Autolock autoLock(mLock);
+    Shard &shard = shardFor(handlerID);
+    Mutex::Autolock autoLock(shard.mLock);
 
-    ssize_t index = mHandlers.indexOfKey(handlerID);
+    ssize_t index = shard.mHandlers.indexOfKey(handlerID);
 
     if (index < 0) {
         return;
     }
 
-    const HandlerInfo &info = mHandlers.valueAt(index);
+    const HandlerInfo &info = shard.mHandlers.valueAt(index);
 
     sp<AHandler> handler = info.mHandler.promote();
 
@@ -68,22 +71,23 @@ void ALooperRoster::unregisterHandler(ALooper::handler_id handlerID) {
         handler->setID(0);
     }
 
-    mHandlers.removeItemsAt(index);
+    shard.mHandlers.removeItemsAt(index);
 }
 
 void ALooperRoster::unregisterStaleHandlers() {
 
     Vector<sp<ALooper> > activeLoopers;
-    {
-        Mutex::Autolock autoLock(mLock);
+    for (size_t s = 0; s < kNumShards; ++s) {
+        Shard &shard = mShards[s];
+        Mutex::Autolock autoLock(shard.mLock);
 
-        for (size_t i = mHandlers.size(); i-- > 0;) {
-            const HandlerInfo &info = mHandlers.valueAt(i);
+        for (size_t i = shard.mHandlers.size(); i-- > 0;) {
+            const HandlerInfo &info = shard.mHandlers.valueAt(i);
 
             sp<ALooper> looper = info.mLooper.promote();
             if (looper == NULL) {
-                ALOGV("Unregistering stale handler %d", mHandlers.keyAt(i));
-                mHandlers.removeItemsAt(i);
+                ALOGV("Unregistering stale handler %d", shard.mHandlers.keyAt(i));
+                shard.mHandlers.removeItemsAt(i);
             } else {
                 // At this point 'looper' might be the only sp<> keeping
                 // the object alive. To prevent it from going out of scope
@@ -113,16 +117,17 @@ void ALooperRoster::deliverMessage(const sp<AMessage> &msg) {
     sp<AHandler> handler;
 
     {
-        Mutex::Autolock autoLock(mLock);
+        Shard &shard = shardFor(msg->target());
+        Mutex::Autolock autoLock(shard.mLock);
 
-        ssize_t index = mHandlers.indexOfKey(msg->target());
+        ssize_t index = shard.mHandlers.indexOfKey(msg->target());
 
         if (index < 0) {
             ALOGW("failed to deliver message. Target handler not registered.");
             return;
         }
 
-        const HandlerInfo &info = mHandlers.valueAt(index);
+        const HandlerInfo &info = shard.mHandlers.valueAt(index);
         handler = info.mHandler.promote();
 
         if (handler == NULL) {
@@ -130,7 +135,7 @@ void ALooperRoster::deliverMessage(const sp<AMessage> &msg) {
                  "Target handler %d registered, but object gone.",
                  msg->target());
 
-            mHandlers.removeItemsAt(index);
+            shard.mHandlers.removeItemsAt(index);
             return;
         }
     }
@@ -139,18 +144,19 @@ void ALooperRoster::deliverMessage(const sp<AMessage> &msg) {
 }
 
 sp<ALooper> ALooperRoster::findLooper(ALooper::handler_id handlerID) {
-    Mutex::Autolock autoLock(mLock);
+    Shard &shard = shardFor(handlerID);
+    Mutex::Autolock autoLock(shard.mLock);
 
-    ssize_t index = mHandlers.indexOfKey(handlerID);
+    ssize_t index = shard.mHandlers.indexOfKey(handlerID);
 
     if (index < 0) {
         return NULL;
     }
 
-    sp<ALooper> looper = mHandlers.valueAt(index).mLooper.promote();
+    sp<ALooper> looper = shard.mHandlers.valueAt(index).mLooper.promote();
 
     if (looper == NULL) {
-        mHandlers.removeItemsAt(index);
+        shard.mHandlers.removeItemsAt(index);
         return NULL;
     }
 
@@ -65,8 +65,7 @@ ALooper::handler_id AMessage::target() const {
 void AMessage::clear() {
     for (size_t i = 0; i < mNumItems; ++i) {
         Item *item = &mItems[i];
-        delete[] item->mName;
-        item->mName = NULL;
+        item->freeName();
         freeItemValue(item);
     }
     mNumItems = 0;
@@ -125,19 +124,19 @@ static void reportStats() {
 }
 #endif
 
-inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
+inline size_t AMessage::findItemIndex(const char *name, size_t len, uint32_t hash) const {
 #ifdef DUMP_STATS
     size_t memchecks = 0;
 #endif
     size_t i = 0;
     for (; i < mNumItems; i++) {
-        if (len != mItems[i].mNameLength) {
+        if (hash != mItems[i].mNameHash || len != mItems[i].mNameLength) {
             continue;
         }
 #ifdef DUMP_STATS
         ++memchecks;
 #endif
-        if (!memcmp(mItems[i].mName, name, len)) {
+        if (mItems[i].mName == name || !memcmp(mItems[i].mName, name, len)) {
             break;
         }
     }
@@ -155,15 +154,31 @@ inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
 }
 
 // assumes item's name was uninitialized or NULL
-void AMessage::Item::setName(const char *name, size_t len) {
+// Shares the name with AAtomizer if it is already an atom, and copies it otherwise. Names
+// are never atomized here: atoms are never freed, and names can come from untrusted input
+// such as a Parcel, a playlist attribute or an NDK client.
+void AMessage::Item::setName(const char *name, size_t len, uint32_t hash) {
     mNameLength = len;
-    mName = new char[len + 1];
-    memcpy((void*)mName, name, len + 1);
+    mNameHash = hash;
+    mName = AAtomizer::Lookup(name, len, hash);
+    mNameIsAtom = mName != NULL;
+    if (!mNameIsAtom) {
+        mName = new char[len + 1];
+        memcpy((void*)mName, name, len + 1);
+    }
+}
+
+void AMessage::Item::freeName() {
+    if (!mNameIsAtom) {
+        delete[] mName;
+    }
+    mName = NULL;
 }
 
 AMessage::Item *AMessage::allocateItem(const char *name) {
-    size_t len = strlen(name);
-    size_t i = findItemIndex(name, len);
+    size_t len;
+    uint32_t hash = AAtomizer::Hash(name, &len);
+    size_t i = findItemIndex(name, len, hash);
     Item *item;
 
     if (i < mNumItems) {
@@ -173,7 +188,7 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
         CHECK(mNumItems < kMaxNumItems);
         i = mNumItems++;
         item = &mItems[i];
-        item->setName(name, len);
+        item->setName(name, len, hash);
     }
 
     return item;
@@ -181,7 +196,9 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
 
 const AMessage::Item *AMessage::findItem(
         const char *name, Type type) const {
-    size_t i = findItemIndex(name, strlen(name));
+    size_t len;
+    uint32_t hash = AAtomizer::Hash(name, &len);
+    size_t i = findItemIndex(name, len, hash);
     if (i < mNumItems) {
         const Item *item = &mItems[i];
         return item->mType == type ? item : NULL;
@@ -191,7 +208,9 @@ const AMessage::Item *AMessage::findItem(
 }
 
 bool AMessage::contains(const char *name) const {
-    size_t i = findItemIndex(name, strlen(name));
+    size_t len;
+    uint32_t hash = AAtomizer::Hash(name, &len);
+    size_t i = findItemIndex(name, len, hash);
     return i < mNumItems;
 }
 
@@ -364,7 +383,14 @@ sp<AMessage> AMessage::dup() const {
         const Item *from = &mItems[i];
         Item *to = &msg->mItems[i];
 
-        to->setName(from->mName, from->mNameLength);
+        if (from->mNameIsAtom) {
+            to->mName = from->mName;
+            to->mNameLength = from->mNameLength;
+            to->mNameHash = from->mNameHash;
+            to->mNameIsAtom = true;
+        } else {
+            to->setName(from->mName, from->mNameLength, from->mNameHash);
+        }
         to->mType = from->mType;
 
         switch (from->mType) {
@@ -539,7 +565,9 @@ sp<AMessage> AMessage::FromParcel(const Parcel &parcel) {
         Item *item = &msg->mItems[i];
 
         const char *name = parcel.readCString();
-        item->setName(name, strlen(name));
+        size_t len;
+        uint32_t hash = AAtomizer::Hash(name, &len);
+        item->setName(name, len, hash);
         item->mType = static_cast<Type>(parcel.readInt32());
 
         switch (item->mType) {
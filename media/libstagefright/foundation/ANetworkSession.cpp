@@ -27,6 +27,7 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 
@@ -52,6 +53,11 @@ static uint64_t U64_AT(const uint8_t *ptr) {
 static const size_t kMaxUDPSize = 1500;
 static const int32_t kMaxUDPRetries = 200;
 
+// epoll events handled per wakeup
+static const int kMaxEpollEvents = 64;
+// epoll data of the interrupt pipe, session IDs start at 1
+static const uint32_t kPipeEpollID = 0;
+
 struct ANetworkSession::NetworkThread : public Thread {
     NetworkThread(ANetworkSession *session);
 
@@ -99,6 +105,10 @@ struct ANetworkSession::Session : public RefBase {
     status_t readMore();
     status_t writeMore();
 
+    // whether the last readMore() or writeMore() failed with an error it
+    // will retry, clears the flag
+    bool takeRetryPending();
+
     status_t sendRequest(
             const void *data, ssize_t size, bool timeValid, int64_t timeUs);
 
@@ -126,6 +136,7 @@ private:
     sp<AMessage> mNotify;
     bool mSawReceiveFailure, mSawSendFailure;
     int32_t mUDPRetries;
+    bool mRetryPending;
 
     List<Fragment> mOutFragments;
 
@@ -170,6 +181,7 @@ ANetworkSession::Session::Session(
       mSawReceiveFailure(false),
       mSawSendFailure(false),
       mUDPRetries(kMaxUDPRetries),
+      mRetryPending(false),
       mLastStallReportUs(-1ll) {
     if (mState == CONNECTED) {
         struct sockaddr_in localAddr;
@@ -265,6 +277,12 @@ bool ANetworkSession::Session::wantsToWrite() {
             || (mState == DATAGRAM && !mOutFragments.empty()));
 }
 
+bool ANetworkSession::Session::takeRetryPending() {
+    bool retryPending = mRetryPending;
+    mRetryPending = false;
+    return retryPending;
+}
+
 status_t ANetworkSession::Session::readMore() {
     if (mState == DATAGRAM) {
         CHECK_EQ(mMode, MODE_DATAGRAM);
@@ -327,6 +345,7 @@ status_t ANetworkSession::Session::readMore() {
                 mUDPRetries--;
                 ALOGE("Recvfrom failed, %d/%d retries left",
                         mUDPRetries, kMaxUDPRetries);
+                mRetryPending = true;
                 err = OK;
             }
         } else {
@@ -336,23 +355,30 @@ status_t ANetworkSession::Session::readMore() {
         return err;
     }
 
+    // The socket is edge-triggered, read everything that is available.
     char tmp[512];
     ssize_t n;
     do {
-        n = recv(mSocket, tmp, sizeof(tmp), 0);
-    } while (n < 0 && errno == EINTR);
-
-    status_t err = OK;
+        do {
+            n = recv(mSocket, tmp, sizeof(tmp), 0);
+        } while (n < 0 && errno == EINTR);
 
-    if (n > 0) {
-        mInBuffer.append(tmp, n);
+        if (n > 0) {
+            mInBuffer.append(tmp, n);
 
 #if 0
-        ALOGI("in:");
-        hexdump(tmp, n);
+            ALOGI("in:");
+            hexdump(tmp, n);
 #endif
-    } else if (n < 0) {
-        err = -errno;
+        }
+    } while (n > 0);
+
+    status_t err = OK;
+
+    if (n < 0) {
+        if (errno != EAGAIN) {
+            err = -errno;
+        }
     } else {
         err = -ECONNRESET;
     }
@@ -592,6 +618,7 @@ status_t ANetworkSession::Session::writeMore() {
                 mUDPRetries--;
                 ALOGE("Send datagram failed, %d/%d retries left",
                         mUDPRetries, kMaxUDPRetries);
+                mRetryPending = true;
                 err = OK;
             }
         } else {
@@ -651,8 +678,11 @@ status_t ANetworkSession::Session::writeMore() {
 
     status_t err = OK;
 
+    // a full socket is not an error, EPOLLOUT reports when it drained
     if (n < 0) {
-        err = -errno;
+        if (errno != EAGAIN) {
+            err = -errno;
+        }
     } else if (n == 0) {
         err = -ECONNRESET;
     }
@@ -800,10 +830,21 @@ void ANetworkSession::Session::notify(NotificationReason reason) {
 ANetworkSession::ANetworkSession()
     : mNextSessionID(1) {
     mPipeFd[0] = mPipeFd[1] = -1;
+
+    // created here so that sessions can be added before start()
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        ALOGE("epoll_create1 failed w/ error %d (%s)", errno, strerror(errno));
+    }
 }
 
 ANetworkSession::~ANetworkSession() {
     stop();
+
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
 }
 
 status_t ANetworkSession::start() {
@@ -811,12 +852,32 @@ status_t ANetworkSession::start() {
         return INVALID_OPERATION;
     }
 
+    if (mEpollFd < 0) {
+        return NO_INIT;
+    }
+
     int res = pipe(mPipeFd);
     if (res != 0) {
         mPipeFd[0] = mPipeFd[1] = -1;
         return -errno;
     }
 
+    // level-triggered, the thread reads as many bytes as it can per wakeup
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = kPipeEpollID;
+    res = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mPipeFd[0], &event);
+    if (res != 0) {
+        status_t err = -errno;
+
+        close(mPipeFd[0]);
+        close(mPipeFd[1]);
+        mPipeFd[0] = mPipeFd[1] = -1;
+
+        return err;
+    }
+
     mThread = new NetworkThread(this);
 
     status_t err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
@@ -937,9 +998,14 @@ status_t ANetworkSession::destroySession(int32_t sessionID) {
         return -ENOENT;
     }
 
-    mSessions.removeItemsAt(index);
+    // the socket is closed once the last reference to the session is gone,
+    // it must not report events until then
+    int s = mSessions.valueAt(index)->socket();
+    if (s >= 0) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, s, NULL);
+    }
 
-    interrupt();
+    mSessions.removeItemsAt(index);
 
     return OK;
 }
@@ -1148,9 +1214,11 @@ status_t ANetworkSession::createClientOrServer(
         session->setMode(Session::MODE_RTSP);
     }
 
-    mSessions.add(session->sessionID(), session);
-
-    interrupt();
+    // the session now owns the socket
+    err = addSession_l(session);
+    if (err != OK) {
+        goto bail;
+    }
 
     *sessionID = session->sessionID();
 
@@ -1215,9 +1283,16 @@ status_t ANetworkSession::sendRequest(
 
     const sp<Session> session = mSessions.valueAt(index);
 
+    bool wasWriting = session->wantsToWrite();
+
     status_t err = session->sendRequest(data, size, timeValid, timeUs);
 
-    interrupt();
+    // Once the output queue is not empty the thread writes it until the
+    // socket is full, and EPOLLOUT reports when it can write again.
+    if (!wasWriting && session->wantsToWrite()) {
+        mSessionsToWrite.push(sessionID);
+        interrupt();
+    }
 
     return err;
 }
@@ -1248,163 +1323,207 @@ void ANetworkSession::interrupt() {
     }
 }
 
-void ANetworkSession::threadLoop() {
-    fd_set rs, ws;
-    FD_ZERO(&rs);
-    FD_ZERO(&ws);
+status_t ANetworkSession::addSession_l(const sp<Session> &session) {
+    // Edge-triggered: the sessions read and write until their socket would
+    // block, so the events are only reported again once the socket changes.
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.u32 = session->sessionID();
 
-    FD_SET(mPipeFd[0], &rs);
-    int maxFd = mPipeFd[0];
+    int res = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, session->socket(), &event);
+    if (res != 0) {
+        status_t err = -errno;
+        ALOGE("Unable to watch socket %d, failed w/ error %d (%s)",
+              session->socket(), err, strerror(-err));
+        return err;
+    }
 
-    {
-        Mutex::Autolock autoLock(mLock);
+    mSessions.add(session->sessionID(), session);
 
-        for (size_t i = 0; i < mSessions.size(); ++i) {
-            const sp<Session> &session = mSessions.valueAt(i);
+    return OK;
+}
 
-            int s = session->socket();
+void ANetworkSession::acceptClients_l(const sp<Session> &session) {
+    for (;;) {
+        struct sockaddr_in remoteAddr;
+        socklen_t remoteAddrLen = sizeof(remoteAddr);
 
-            if (s < 0) {
+        int clientSocket = accept(
+                session->socket(), (struct sockaddr *)&remoteAddr, &remoteAddrLen);
+
+        if (clientSocket < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-
-            if (session->wantsToRead()) {
-                FD_SET(s, &rs);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
+            if (errno != EAGAIN) {
+                ALOGE("accept returned error %d (%s)",
+                      errno, strerror(errno));
             }
+            break;
+        }
 
-            if (session->wantsToWrite()) {
-                FD_SET(s, &ws);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
+        status_t err = MakeSocketNonBlocking(clientSocket);
+
+        if (err != OK) {
+            ALOGE("Unable to make client socket non blocking, "
+                  "failed w/ error %d (%s)",
+                  err, strerror(-err));
+
+            close(clientSocket);
+            clientSocket = -1;
+            continue;
         }
+
+        in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
+
+        ALOGI("incoming connection from %d.%d.%d.%d:%d "
+              "(socket %d)",
+              (addr >> 24),
+              (addr >> 16) & 0xff,
+              (addr >> 8) & 0xff,
+              addr & 0xff,
+              ntohs(remoteAddr.sin_port),
+              clientSocket);
+
+        sp<Session> clientSession =
+            new Session(
+                    mNextSessionID++,
+                    Session::CONNECTED,
+                    clientSocket,
+                    session->getNotificationMessage());
+
+        clientSession->setMode(
+                session->isRTSPServer()
+                    ? Session::MODE_RTSP
+                    : Session::MODE_DATAGRAM);
+
+        if (addSession_l(clientSession) == OK) {
+            ALOGI("added clientSession %d", clientSession->sessionID());
+        }
+    }
+}
+
+void ANetworkSession::readMore_l(const sp<Session> &session) {
+    status_t err = session->readMore();
+    if (err != OK) {
+        ALOGE("readMore on socket %d failed w/ error %d (%s)",
+              session->socket(), err, strerror(-err));
     }
 
-    int res = select(maxFd + 1, &rs, &ws, NULL, NULL /* tv */);
+    if (session->takeRetryPending()) {
+        mSessionsToRetryRead.add(session->sessionID());
+    }
+}
 
-    if (res == 0) {
-        return;
+void ANetworkSession::writeMore_l(const sp<Session> &session) {
+    status_t err = session->writeMore();
+    if (err != OK) {
+        ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+              session->socket(), err, strerror(-err));
+    }
+
+    if (session->takeRetryPending()) {
+        mSessionsToRetryWrite.add(session->sessionID());
     }
+}
+
+void ANetworkSession::threadLoop() {
+    struct epoll_event events[kMaxEpollEvents];
+
+    int res = epoll_wait(mEpollFd, events, kMaxEpollEvents, -1 /* timeout */);
 
     if (res < 0) {
         if (errno == EINTR) {
             return;
         }
 
-        ALOGE("select failed w/ error %d (%s)", errno, strerror(errno));
+        ALOGE("epoll_wait failed w/ error %d (%s)", errno, strerror(errno));
         return;
     }
 
-    if (FD_ISSET(mPipeFd[0], &rs)) {
-        char c;
-        ssize_t n;
-        do {
-            n = read(mPipeFd[0], &c, 1);
-        } while (n < 0 && errno == EINTR);
+    Mutex::Autolock autoLock(mLock);
+
+    // A failed UDP read or write did not run the socket dry, so its edge
+    // may never be reported again: retry it now rather than wait for one.
+    SortedVector<int32_t> sessionsToRetryWrite = mSessionsToRetryWrite;
+    mSessionsToRetryWrite.clear();
 
-        if (n < 0) {
-            ALOGW("Error reading from pipe (%s)", strerror(errno));
+    for (size_t i = 0; i < sessionsToRetryWrite.size(); ++i) {
+        ssize_t index = mSessions.indexOfKey(sessionsToRetryWrite.itemAt(i));
+        if (index >= 0 && mSessions.valueAt(index)->wantsToWrite()) {
+            writeMore_l(mSessions.valueAt(index));
         }
+    }
+
+    SortedVector<int32_t> sessionsToRetryRead = mSessionsToRetryRead;
+    mSessionsToRetryRead.clear();
 
-        --res;
+    for (size_t i = 0; i < sessionsToRetryRead.size(); ++i) {
+        ssize_t index = mSessions.indexOfKey(sessionsToRetryRead.itemAt(i));
+        if (index >= 0 && mSessions.valueAt(index)->wantsToRead()) {
+            readMore_l(mSessions.valueAt(index));
+        }
     }
 
-    {
-        Mutex::Autolock autoLock(mLock);
+    for (int i = 0; i < res; ++i) {
+        if (events[i].data.u32 == kPipeEpollID) {
+            char tmp[64];
+            ssize_t n;
+            do {
+                n = read(mPipeFd[0], tmp, sizeof(tmp));
+            } while (n < 0 && errno == EINTR);
 
-        List<sp<Session> > sessionsToAdd;
+            if (n < 0) {
+                ALOGW("Error reading from pipe (%s)", strerror(errno));
+            }
+            continue;
+        }
 
-        for (size_t i = mSessions.size(); res > 0 && i-- > 0;) {
-            const sp<Session> &session = mSessions.valueAt(i);
+        // the session may have been destroyed since epoll_wait returned
+        ssize_t index = mSessions.indexOfKey(events[i].data.u32);
+        if (index < 0) {
+            continue;
+        }
 
-            int s = session->socket();
+        sp<Session> session = mSessions.valueAt(index);
 
-            if (s < 0) {
-                continue;
-            }
+        // Errors are reported to the side that is in use. Writes come first
+        // so that a completed connection is also read from.
+        uint32_t ev = events[i].events;
 
-            if (FD_ISSET(s, &rs) || FD_ISSET(s, &ws)) {
-                --res;
-            }
+        if ((ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && session->wantsToWrite()) {
+            writeMore_l(session);
+        }
 
-            if (FD_ISSET(s, &rs)) {
-                if (session->isRTSPServer() || session->isTCPDatagramServer()) {
-                    struct sockaddr_in remoteAddr;
-                    socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-                    int clientSocket = accept(
-                            s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
-
-                    if (clientSocket >= 0) {
-                        status_t err = MakeSocketNonBlocking(clientSocket);
-
-                        if (err != OK) {
-                            ALOGE("Unable to make client socket non blocking, "
-                                  "failed w/ error %d (%s)",
-                                  err, strerror(-err));
-
-                            close(clientSocket);
-                            clientSocket = -1;
-                        } else {
-                            in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
-
-                            ALOGI("incoming connection from %d.%d.%d.%d:%d "
-                                  "(socket %d)",
-                                  (addr >> 24),
-                                  (addr >> 16) & 0xff,
-                                  (addr >> 8) & 0xff,
-                                  addr & 0xff,
-                                  ntohs(remoteAddr.sin_port),
-                                  clientSocket);
-
-                            sp<Session> clientSession =
-                                new Session(
-                                        mNextSessionID++,
-                                        Session::CONNECTED,
-                                        clientSocket,
-                                        session->getNotificationMessage());
-
-                            clientSession->setMode(
-                                    session->isRTSPServer()
-                                        ? Session::MODE_RTSP
-                                        : Session::MODE_DATAGRAM);
-
-                            sessionsToAdd.push_back(clientSession);
-                        }
-                    } else {
-                        ALOGE("accept returned error %d (%s)",
-                              errno, strerror(errno));
-                    }
-                } else {
-                    status_t err = session->readMore();
-                    if (err != OK) {
-                        ALOGE("readMore on socket %d failed w/ error %d (%s)",
-                              s, err, strerror(-err));
-                    }
-                }
+        if ((ev & (EPOLLIN | EPOLLERR | EPOLLHUP)) && session->wantsToRead()) {
+            if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+                acceptClients_l(session);
+            } else {
+                readMore_l(session);
             }
+        }
+    }
 
-            if (FD_ISSET(s, &ws)) {
-                status_t err = session->writeMore();
-                if (err != OK) {
-                    ALOGE("writeMore on socket %d failed w/ error %d (%s)",
-                          s, err, strerror(-err));
-                }
-            }
+    for (size_t i = 0; i < mSessionsToWrite.size(); ++i) {
+        ssize_t index = mSessions.indexOfKey(mSessionsToWrite.itemAt(i));
+        if (index < 0) {
+            continue;
         }
 
-        while (!sessionsToAdd.empty()) {
-            sp<Session> session = *sessionsToAdd.begin();
-            sessionsToAdd.erase(sessionsToAdd.begin());
+        sp<Session> session = mSessions.valueAt(index);
+        if (!session->wantsToWrite()) {
+            continue;
+        }
 
-            mSessions.add(session->sessionID(), session);
+        writeMore_l(session);
+    }
+    mSessionsToWrite.clear();
 
-            ALOGI("added clientSession %d", session->sessionID());
-        }
+    // Each retry uses up one of the session's kMaxUDPRetries, after which it
+    // reports the error and stops reading or writing, so this cannot spin.
+    if (!mSessionsToRetryRead.empty() || !mSessionsToRetryWrite.empty()) {
+        interrupt();
     }
 }
 
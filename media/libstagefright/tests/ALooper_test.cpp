@@ -0,0 +1,169 @@
+/*
+ * Copyright 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ALooper_test"
+
+#include <gtest/gtest.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+namespace android {
+
+// Records the index of each message in the order they are delivered.
+struct OrderHandler : public AHandler {
+    OrderHandler(size_t expected)
+        : mExpected(expected) {
+    }
+
+    // Waits until all the expected messages were delivered, or 10 seconds.
+    bool waitForAll() {
+        Mutex::Autolock autoLock(mLock);
+        while (mIndices.size() < mExpected) {
+            if (mCondition.waitRelative(mLock, 10000000000ll) != OK) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Vector<int32_t> indices() {
+        Mutex::Autolock autoLock(mLock);
+        return mIndices;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        int32_t index;
+        CHECK(msg->findInt32("index", &index));
+        Mutex::Autolock autoLock(mLock);
+        mIndices.push(index);
+        if (mIndices.size() == mExpected) {
+            mCondition.signal();
+        }
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    const size_t mExpected;
+    Vector<int32_t> mIndices;
+};
+
+struct ALooperTest : public ::testing::Test {
+protected:
+    // ALooper::post() takes a delay from the current time, so messages posted one after the
+    // other are never due at the same time; post at an absolute time instead.
+    static void postAt(const sp<ALooper> &looper, const sp<AMessage> &msg, int64_t whenUs) {
+        looper->postAt(msg, whenUs);
+    }
+};
+
+// Messages due at the same time are delivered in the order they were posted, among messages
+// due earlier and later that are posted in between.
+TEST_F(ALooperTest, FifoForEqualTimes) {
+    static const size_t kMessages = 3000;
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("ALooper_test");
+    sp<OrderHandler> handler = new OrderHandler(kMessages);
+    looper->registerHandler(handler);
+
+    // Post everything before the looper runs so that the whole set is in the queue at once.
+    // Message i is due at whenUs[i]: one time shared by a third of the messages, and a few
+    // earlier and later times, each also shared by several messages.
+    const int64_t baseUs = ALooper::GetNowUs() + 50000ll;
+    Vector<int64_t> whenUs;
+    for (size_t i = 0; i < kMessages; ++i) {
+        int64_t offsetUs;
+        switch (i % 3) {
+        case 0:
+            offsetUs = 0;
+            break;
+        case 1:
+            offsetUs = -1000ll * (int64_t) (1 + (i * 7) % 5);
+            break;
+        default:
+            offsetUs = 1000ll * (int64_t) (1 + (i * 11) % 5);
+            break;
+        }
+        whenUs.push(baseUs + offsetUs);
+
+        sp<AMessage> msg = new AMessage(0, handler->id());
+        msg->setInt32("index", i);
+        postAt(looper, msg, whenUs[i]);
+    }
+
+    ASSERT_EQ(OK, looper->start());
+    ASSERT_TRUE(handler->waitForAll());
+    looper->stop();
+    looper->unregisterHandler(handler->id());
+
+    // Each message must come after every message due earlier, and after the messages due at
+    // the same time that were posted before it.
+    Vector<int32_t> indices = handler->indices();
+    ASSERT_EQ(kMessages, indices.size());
+    for (size_t i = 1; i < indices.size(); ++i) {
+        int32_t previous = indices[i - 1];
+        int32_t current = indices[i];
+        EXPECT_TRUE(whenUs[previous] < whenUs[current]
+                || (whenUs[previous] == whenUs[current] && previous < current))
+                << "message " << current << " due at " << whenUs[current]
+                << " delivered after message " << previous << " due at " << whenUs[previous];
+    }
+}
+
+// Messages posted without delay are delivered in posting order, while delayed messages are
+// pending.
+TEST_F(ALooperTest, FifoForImmediatePosts) {
+    static const size_t kMessages = 1000;
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("ALooper_test");
+    sp<OrderHandler> handler = new OrderHandler(kMessages);
+    looper->registerHandler(handler);
+    ASSERT_EQ(OK, looper->start());
+
+    // these are never delivered
+    for (size_t i = 0; i < 100; ++i) {
+        sp<AMessage> msg = new AMessage(0, handler->id());
+        msg->setInt32("index", -1);
+        msg->post(3600ll * 1000000ll + i);
+    }
+
+    for (size_t i = 0; i < kMessages; ++i) {
+        sp<AMessage> msg = new AMessage(0, handler->id());
+        msg->setInt32("index", i);
+        msg->post();
+    }
+
+    ASSERT_TRUE(handler->waitForAll());
+    looper->stop();
+    looper->unregisterHandler(handler->id());
+
+    Vector<int32_t> indices = handler->indices();
+    ASSERT_EQ(kMessages, indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        EXPECT_EQ((int32_t) i, indices[i]);
+    }
+}
+
+} // namespace android
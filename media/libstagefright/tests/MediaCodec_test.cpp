@@ -0,0 +1,341 @@
+/*
+ * Copyright 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MediaCodec_test"
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <binder/ProcessState.h>
+#include <media/ICrypto.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaCodec.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/List.h>
+#include <utils/threads.h>
+
+namespace android {
+
+static const int32_t kChannelCount = 2;
+static const int32_t kSampleRate = 44100;
+static const size_t kFrameSize = kChannelCount * sizeof(int16_t);
+static const size_t kBufferFrames = 256;
+static const size_t kNumBuffers = 64;  // queued before the end of stream
+static const size_t kMaxBatch = 8;
+static const int64_t kTimeoutUs = 10000ll;
+
+static int64_t bufferTimeUs(size_t i) {
+    return (int64_t) i * kBufferFrames * 1000000ll / kSampleRate;
+}
+
+// Records the callbacks of an asynchronous codec.
+struct CallbackRecorder : public AHandler {
+    // returns the next callback, or NULL after one second without any
+    sp<AMessage> next() {
+        Mutex::Autolock autoLock(mLock);
+        if (mCallbacks.empty()) {
+            mCondition.waitRelative(mLock, 1000000000ll);
+            if (mCallbacks.empty()) {
+                return NULL;
+            }
+        }
+        sp<AMessage> msg = *mCallbacks.begin();
+        mCallbacks.erase(mCallbacks.begin());
+        return msg;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        Mutex::Autolock autoLock(mLock);
+        mCallbacks.push_back(msg);
+        mCondition.signal();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    List<sp<AMessage> > mCallbacks;
+};
+
+// Fails every decryption with a vendor error and its detail message, as a DRM plugin would.
+struct FailingCrypto : public BnCrypto {
+    virtual status_t initCheck() const { return OK; }
+    virtual bool isCryptoSchemeSupported(const uint8_t uuid[16] __unused) { return true; }
+    virtual status_t createPlugin(
+            const uint8_t uuid[16] __unused, const void *data __unused,
+            size_t size __unused) {
+        return OK;
+    }
+    virtual status_t destroyPlugin() { return OK; }
+    virtual bool requiresSecureDecoderComponent(const char *mime __unused) const {
+        return false;
+    }
+    virtual void notifyResolution(uint32_t width __unused, uint32_t height __unused) { }
+
+    virtual ssize_t decrypt(
+            bool secure __unused,
+            const uint8_t key[16] __unused,
+            const uint8_t iv[16] __unused,
+            CryptoPlugin::Mode mode __unused,
+            const void *srcPtr __unused,
+            const CryptoPlugin::SubSample *subSamples __unused,
+            size_t numSubSamples __unused,
+            void *dstPtr __unused,
+            AString *errorDetailMsg) {
+        errorDetailMsg->setTo("vendor error");
+        return ERROR_DRM_VENDOR_MIN;
+    }
+};
+
+class MediaCodecTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        ProcessState::self()->startThreadPool();
+
+        mLooper = new ALooper;
+        mLooper->setName("MediaCodec_test");
+        mLooper->start();
+
+        mCodec = MediaCodec::CreateByType(mLooper, MEDIA_MIMETYPE_AUDIO_RAW, false /* encoder */);
+        ASSERT_TRUE(mCodec != NULL);
+
+        mFormat = new AMessage;
+        mFormat->setString("mime", MEDIA_MIMETYPE_AUDIO_RAW);
+        mFormat->setInt32("channel-count", kChannelCount);
+        mFormat->setInt32("sample-rate", kSampleRate);
+    }
+
+    virtual void TearDown() {
+        if (mCodec != NULL) {
+            mCodec->release();
+            mCodec.clear();
+        }
+        mLooper->stop();
+    }
+
+    // describes and fills input buffer |index| as the buffer |*queued| of the stream
+    void fillInputBuffer(size_t index, size_t *queued, MediaCodec::BufferDescriptor *desc) {
+        sp<ABuffer> buffer;
+        ASSERT_EQ(OK, mCodec->getInputBuffer(index, &buffer));
+        desc->mIndex = index;
+        desc->mOffset = 0;
+        desc->mPresentationTimeUs = bufferTimeUs(*queued);
+        if (*queued == kNumBuffers) {
+            desc->mSize = 0;
+            desc->mFlags = MediaCodec::BUFFER_FLAG_EOS;
+        } else {
+            desc->mSize = kBufferFrames * kFrameSize;
+            desc->mFlags = 0;
+            ASSERT_LE(desc->mSize, buffer->capacity());
+            memset(buffer->base(), *queued & 0xff, desc->mSize);
+        }
+        ++*queued;
+    }
+
+    sp<ALooper> mLooper;
+    sp<MediaCodec> mCodec;
+    sp<AMessage> mFormat;
+};
+
+// The batched calls carry a stream through the codec in order, many buffers per call.
+TEST_F(MediaCodecTest, BatchedBufferCalls) {
+    ASSERT_EQ(OK, mCodec->configure(mFormat, NULL, NULL, 0));
+    ASSERT_EQ(OK, mCodec->start());
+
+    size_t queued = 0;
+    size_t outputBytes = 0;
+    int64_t lastTimeUs = -1;
+    bool eos = false;
+    while (!eos) {
+        size_t count;
+        if (queued <= kNumBuffers) {
+            size_t indices[kMaxBatch];
+            status_t err = mCodec->dequeueInputBuffers(indices, kMaxBatch, &count, kTimeoutUs);
+            if (err == OK) {
+                ASSERT_GT(count, 0u);
+                MediaCodec::BufferDescriptor buffers[kMaxBatch];
+                size_t i = 0;
+                for (; i < count && queued <= kNumBuffers; ++i) {
+                    fillInputBuffer(indices[i], &queued, &buffers[i]);
+                }
+                size_t queuedCount;
+                ASSERT_EQ(OK, mCodec->queueInputBuffers(buffers, i, &queuedCount));
+                ASSERT_EQ(i, queuedCount);
+            } else {
+                ASSERT_EQ(-EAGAIN, err);
+            }
+        }
+
+        MediaCodec::BufferDescriptor buffers[kMaxBatch];
+        status_t err = mCodec->dequeueOutputBuffers(buffers, kMaxBatch, &count, kTimeoutUs);
+        if (err == INFO_FORMAT_CHANGED || err == INFO_OUTPUT_BUFFERS_CHANGED || err == -EAGAIN) {
+            continue;
+        }
+        ASSERT_EQ(OK, err);
+        ASSERT_GT(count, 0u);
+        ASSERT_LE(count, kMaxBatch);
+
+        size_t indices[kMaxBatch];
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_GE(buffers[i].mPresentationTimeUs, lastTimeUs);
+            lastTimeUs = buffers[i].mPresentationTimeUs;
+            outputBytes += buffers[i].mSize;
+            if (buffers[i].mFlags & MediaCodec::BUFFER_FLAG_EOS) {
+                eos = true;
+            }
+            indices[i] = buffers[i].mIndex;
+        }
+        size_t released;
+        ASSERT_EQ(OK, mCodec->releaseOutputBuffers(indices, count, false /* render */, &released));
+        ASSERT_EQ(count, released);
+    }
+    ASSERT_EQ(kNumBuffers * kBufferFrames * kFrameSize, outputBytes);
+
+    ASSERT_EQ(OK, mCodec->stop());
+}
+
+// A decryption error stops a batched queue at its buffer, and reports its detail message.
+TEST_F(MediaCodecTest, BatchedQueueDecryptError) {
+    ASSERT_EQ(OK, mCodec->configure(mFormat, NULL, new FailingCrypto, 0));
+    ASSERT_EQ(OK, mCodec->start());
+
+    size_t indices[kMaxBatch];
+    size_t count;
+    ASSERT_EQ(OK, mCodec->dequeueInputBuffers(indices, kMaxBatch, &count, 1000000ll));
+    ASSERT_GT(count, 0u);
+
+    size_t queued = 0;
+    MediaCodec::BufferDescriptor buffer;
+    fillInputBuffer(indices[0], &queued, &buffer);
+
+    size_t queuedCount;
+    AString errorDetailMsg;
+    ASSERT_EQ(ERROR_DRM_VENDOR_MIN,
+            mCodec->queueInputBuffers(&buffer, 1, &queuedCount, &errorDetailMsg));
+    ASSERT_EQ(0u, queuedCount);
+    ASSERT_STREQ("vendor error", errorDetailMsg.c_str());
+
+    // the detail message is optional
+    ASSERT_EQ(ERROR_DRM_VENDOR_MIN, mCodec->queueInputBuffers(&buffer, 1, &queuedCount));
+    ASSERT_EQ(0u, queuedCount);
+
+    ASSERT_EQ(OK, mCodec->stop());
+}
+
+// With coalesced callbacks, all the buffers are announced in batches, the output buffers in
+// order, and after the output format that applies to them.
+TEST_F(MediaCodecTest, CoalescedCallbacks) {
+    sp<ALooper> callbackLooper = new ALooper;
+    callbackLooper->setName("MediaCodec_test callbacks");
+    callbackLooper->start();
+    sp<CallbackRecorder> recorder = new CallbackRecorder;
+    callbackLooper->registerHandler(recorder);
+
+    ASSERT_EQ(OK, mCodec->setCallback(new AMessage(0, recorder->id()), true /* coalesce */));
+    ASSERT_EQ(OK, mCodec->configure(mFormat, NULL, NULL, 0));
+    ASSERT_EQ(OK, mCodec->start());
+
+    size_t queued = 0;
+    size_t outputBytes = 0;
+    int64_t lastTimeUs = -1;
+    bool sawFormat = false;
+    bool eos = false;
+    while (!eos) {
+        sp<AMessage> msg = recorder->next();
+        ASSERT_TRUE(msg != NULL);
+
+        int32_t callbackID;
+        ASSERT_TRUE(msg->findInt32("callbackID", &callbackID));
+        switch (callbackID) {
+            case MediaCodec::CB_INPUT_BUFFERS_AVAILABLE:
+            {
+                int32_t count;
+                sp<ABuffer> indices;
+                ASSERT_TRUE(msg->findInt32("count", &count));
+                ASSERT_TRUE(msg->findBuffer("indices", &indices));
+                ASSERT_GT(count, 0);
+                ASSERT_EQ(count * sizeof(int32_t), indices->size());
+
+                Vector<MediaCodec::BufferDescriptor> buffers;
+                for (int32_t i = 0; i < count && queued <= kNumBuffers; ++i) {
+                    MediaCodec::BufferDescriptor buffer;
+                    fillInputBuffer(((int32_t *)indices->data())[i], &queued, &buffer);
+                    buffers.push(buffer);
+                }
+                if (!buffers.isEmpty()) {
+                    size_t queuedCount;
+                    ASSERT_EQ(OK, mCodec->queueInputBuffers(
+                            buffers.array(), buffers.size(), &queuedCount));
+                    ASSERT_EQ(buffers.size(), queuedCount);
+                }
+                break;
+            }
+
+            case MediaCodec::CB_OUTPUT_FORMAT_CHANGED:
+            {
+                sawFormat = true;
+                break;
+            }
+
+            case MediaCodec::CB_OUTPUT_BUFFERS_AVAILABLE:
+            {
+                ASSERT_TRUE(sawFormat);
+
+                int32_t count;
+                sp<ABuffer> data;
+                ASSERT_TRUE(msg->findInt32("count", &count));
+                ASSERT_TRUE(msg->findBuffer("buffers", &data));
+                ASSERT_GT(count, 0);
+                ASSERT_EQ(count * sizeof(MediaCodec::BufferDescriptor), data->size());
+
+                const MediaCodec::BufferDescriptor *buffers =
+                        (const MediaCodec::BufferDescriptor *)data->data();
+                Vector<size_t> indices;
+                for (int32_t i = 0; i < count; ++i) {
+                    ASSERT_GE(buffers[i].mPresentationTimeUs, lastTimeUs);
+                    lastTimeUs = buffers[i].mPresentationTimeUs;
+                    outputBytes += buffers[i].mSize;
+                    if (buffers[i].mFlags & MediaCodec::BUFFER_FLAG_EOS) {
+                        eos = true;
+                    }
+                    indices.push(buffers[i].mIndex);
+                }
+                size_t released;
+                ASSERT_EQ(OK, mCodec->releaseOutputBuffers(
+                        indices.array(), indices.size(), false /* render */, &released));
+                ASSERT_EQ(indices.size(), released);
+                break;
+            }
+
+            default:
+                // neither the single buffer callbacks nor errors are expected
+                FAIL() << "unexpected callback " << callbackID;
+        }
+    }
+    ASSERT_EQ(kNumBuffers * kBufferFrames * kFrameSize, outputBytes);
+
+    ASSERT_EQ(OK, mCodec->stop());
+    callbackLooper->stop();
+}
+
+} // namespace android
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <utils/threads.h>
+
+/* Measures the ALooper event queue with 10, 1000 and 100000 pending delayed messages.
+ *
+ * For each queue size, the looper is first filled with messages due in one to two hours,
+ * which are never delivered. Then two rates are printed:
+ *  - delayed posts: messages posted per second with random delays in the same range, so that
+ *    each one is inserted among the pending messages,
+ *  - immediate messages: messages posted without delay and delivered to the handler per second,
+ *    from the first post until the handler has received the last one.
+ */
+
+using namespace android;
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-m messages]\n", name);
+    fprintf(stderr, "    -m    messages posted per measurement (default 10000)\n");
+}
+
+static const size_t kPendingCounts[] = { 10, 1000, 100000 };
+static const int64_t kMinDelayUs = 3600ll * 1000000ll;
+
+struct CountingHandler : public AHandler {
+    CountingHandler()
+        : mReceived(0),
+          mExpected(0) {
+    }
+
+    void expect(size_t count) {
+        Mutex::Autolock autoLock(mLock);
+        mReceived = 0;
+        mExpected = count;
+    }
+
+    void waitForAll() {
+        Mutex::Autolock autoLock(mLock);
+        while (mReceived < mExpected) {
+            mCondition.wait(mLock);
+        }
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg __unused) {
+        Mutex::Autolock autoLock(mLock);
+        if (++mReceived == mExpected) {
+            mCondition.signal();
+        }
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    size_t mReceived;
+    size_t mExpected;
+};
+
+static int64_t randomDelayUs() {
+    return kMinDelayUs + (int64_t)(drand48() * kMinDelayUs);
+}
+
+static double rate(size_t count, int64_t durationUs) {
+    return durationUs > 0 ? count * 1000000.0 / durationUs : 0.0;
+}
+
+int main(int argc, char **argv) {
+    size_t messages = 10000;
+    int ch;
+    while ((ch = getopt(argc, argv, "m:")) != -1) {
+        switch (ch) {
+        case 'm':
+            messages = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (messages == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    srand48(0);
+    printf("%10s %20s %24s\n", "pending", "delayed posts/s", "immediate messages/s");
+    for (size_t i = 0; i < sizeof(kPendingCounts) / sizeof(kPendingCounts[0]); ++i) {
+        sp<ALooper> looper = new ALooper;
+        looper->setName("looper_benchmark");
+        sp<CountingHandler> handler = new CountingHandler;
+        looper->registerHandler(handler);
+        looper->start();
+
+        for (size_t j = 0; j < kPendingCounts[i]; ++j) {
+            (new AMessage(0, handler->id()))->post(randomDelayUs());
+        }
+
+        int64_t startUs = ALooper::GetNowUs();
+        for (size_t j = 0; j < messages; ++j) {
+            (new AMessage(0, handler->id()))->post(randomDelayUs());
+        }
+        double delayedRate = rate(messages, ALooper::GetNowUs() - startUs);
+
+        handler->expect(messages);
+        startUs = ALooper::GetNowUs();
+        for (size_t j = 0; j < messages; ++j) {
+            (new AMessage(1, handler->id()))->post();
+        }
+        handler->waitForAll();
+        double immediateRate = rate(messages, ALooper::GetNowUs() - startUs);
+
+        printf("%10zu %20.0f %24.0f\n", kPendingCounts[i], delayedRate, immediateRate);
+
+        looper->stop();
+        looper->unregisterHandler(handler->id());
+    }
+    return EXIT_SUCCESS;
+}
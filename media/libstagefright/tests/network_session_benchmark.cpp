@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/ANetworkSession.h>
+#include <utils/threads.h>
+
+/* Measures the UDP datagram throughput of one ANetworkSession with 1 to 256 pairs of sessions
+ * on the loopback interface.
+ *
+ * For each number of pairs, the datagrams are sent round robin on the sending sessions, and
+ * the run ends when all of them were notified to the receiving handler, or when none arrived
+ * for one second. One line is printed per number of pairs with the datagrams received per
+ * second, measured up to the arrival of the last datagram so that the wait for lost ones is
+ * not counted; datagrams dropped by the sockets are counted as lost.
+ */
+
+using namespace android;
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-s pairs] [-d datagrams] [-b bytes] [-p port]\n", name);
+    fprintf(stderr, "    -s    maximum number of session pairs (default 256)\n");
+    fprintf(stderr, "    -d    datagrams sent per configuration (default 100000)\n");
+    fprintf(stderr, "    -b    bytes per datagram (default 1316)\n");
+    fprintf(stderr, "    -p    first local port (default 30000)\n");
+}
+
+static const int64_t kStallTimeoutNs = 1000000000ll;
+
+struct DatagramCounter : public AHandler {
+    DatagramCounter()
+        : mReceived(0),
+          mErrors(0),
+          mLastArrivalUs(-1ll) {
+    }
+
+    void reset() {
+        Mutex::Autolock autoLock(mLock);
+        mReceived = 0;
+        mErrors = 0;
+        mLastArrivalUs = -1ll;
+    }
+
+    // Waits until |count| datagrams were received or none arrived for a while, returns the
+    // number received and the arrival time of the last one.
+    size_t waitFor(size_t count, int64_t *lastArrivalUs) {
+        Mutex::Autolock autoLock(mLock);
+        while (mReceived < count) {
+            size_t received = mReceived;
+            mCondition.waitRelative(mLock, kStallTimeoutNs);
+            if (mReceived == received) {
+                break;
+            }
+        }
+        *lastArrivalUs = mLastArrivalUs;
+        return mReceived;
+    }
+
+    size_t errors() {
+        Mutex::Autolock autoLock(mLock);
+        return mErrors;
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        int32_t reason;
+        if (!msg->findInt32("reason", &reason)) {
+            return;
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        if (reason == ANetworkSession::kWhatDatagram) {
+            sp<ABuffer> data;
+            int64_t arrivalUs;
+            if (msg->findBuffer("data", &data)
+                    && data->meta()->findInt64("arrivalTimeUs", &arrivalUs)) {
+                mLastArrivalUs = arrivalUs;
+            }
+            ++mReceived;
+            mCondition.signal();
+        } else if (reason == ANetworkSession::kWhatError) {
+            ++mErrors;
+        }
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    size_t mReceived;
+    size_t mErrors;
+    int64_t mLastArrivalUs;
+};
+
+int main(int argc, char **argv) {
+    size_t maxPairs = 256;
+    size_t datagrams = 100000;
+    size_t datagramSize = 1316;
+    unsigned basePort = 30000;
+    int ch;
+    while ((ch = getopt(argc, argv, "s:d:b:p:")) != -1) {
+        switch (ch) {
+        case 's':
+            maxPairs = atoi(optarg);
+            break;
+        case 'd':
+            datagrams = atoi(optarg);
+            break;
+        case 'b':
+            datagramSize = atoi(optarg);
+            break;
+        case 'p':
+            basePort = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (maxPairs == 0 || datagrams == 0 || datagramSize == 0 || datagramSize > 1500
+            || basePort + 2 * maxPairs > 65536) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("network_session_benchmark");
+    sp<DatagramCounter> counter = new DatagramCounter;
+    looper->registerHandler(counter);
+    looper->start();
+
+    sp<ANetworkSession> netSession = new ANetworkSession;
+    status_t err = netSession->start();
+    if (err != OK) {
+        fprintf(stderr, "ANetworkSession::start failed: %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    sp<AMessage> notify = new AMessage(0, counter->id());
+    char *payload = (char *)calloc(datagramSize, 1);
+
+    printf("%8s %16s %10s\n", "pairs", "datagrams/s", "lost");
+    for (size_t pairs = 1; pairs <= maxPairs; pairs *= 4) {
+        Vector<int32_t> sessions;
+        bool ok = true;
+        for (size_t i = 0; i < pairs && ok; ++i) {
+            unsigned port = basePort + 2 * i;
+            int32_t receiverID, senderID;
+            ok = netSession->createUDPSession(port + 1, notify, &receiverID) == OK;
+            if (ok) {
+                sessions.push(receiverID);
+                ok = netSession->createUDPSession(
+                        port, "127.0.0.1", port + 1, notify, &senderID) == OK;
+            }
+            if (ok) {
+                sessions.push(senderID);
+            }
+        }
+
+        if (ok) {
+            counter->reset();
+            int64_t startUs = ALooper::GetNowUs();
+            for (size_t i = 0; i < datagrams; ++i) {
+                netSession->sendRequest(
+                        sessions.itemAt(2 * (i % pairs) + 1), payload, datagramSize);
+            }
+            int64_t lastArrivalUs;
+            size_t received = counter->waitFor(datagrams, &lastArrivalUs);
+            int64_t durationUs = lastArrivalUs - startUs;
+
+            printf("%8zu %16.0f %10zu\n", pairs,
+                    durationUs > 0 ? received * 1000000.0 / durationUs : 0.0,
+                    datagrams - received);
+            if (counter->errors() != 0) {
+                fprintf(stderr, "%zu session errors\n", counter->errors());
+            }
+        } else {
+            fprintf(stderr, "unable to create %zu session pairs\n", pairs);
+        }
+
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            netSession->destroySession(sessions.itemAt(i));
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    free(payload);
+    netSession->stop();
+    looper->stop();
+    return EXIT_SUCCESS;
+}
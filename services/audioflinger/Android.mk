@@ -35,7 +35,8 @@ LOCAL_SRC_FILES:=               \
     Tracks.cpp                  \
     Effects.cpp                 \
     AudioMixer.cpp.arm          \
-    PatchPanel.cpp
+    PatchPanel.cpp              \
+    ResamplerStage.cpp
 
 LOCAL_SRC_FILES += StateQueue.cpp
 
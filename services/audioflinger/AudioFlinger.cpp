@@ -210,6 +210,9 @@ AudioFlinger::AudioFlinger()
         mTeeSinkTrackEnabled = true;
     }
 #endif
+
+    // measure the resampler costs once, before any mixer thread creates an adaptive resampler
+    AudioResampler::calibrate();
 }
 
 void AudioFlinger::onFirstRef()
@@ -421,6 +424,11 @@ status_t AudioFlinger::dump(int fd, const Vector<String16>& args)
             mRecordThreads.valueAt(i)->dump(fd, args);
         }
 
+        // dump the direct patches, which have no thread of their own above
+        if (mPatchPanel != 0) {
+            mPatchPanel->dump(fd);
+        }
+
         // dump orphan effect chains
         if (mOrphanEffectChains.size() != 0) {
             write(fd, "  Orphan Effect Chains\n", strlen("  Orphan Effect Chains\n"));
@@ -756,6 +764,8 @@ status_t AudioFlinger::setMasterVolume(float value)
     // support master volume will simply ignore the setting.
     for (size_t i = 0; i < mPlaybackThreads.size(); i++)
         mPlaybackThreads.valueAt(i)->setMasterVolume(value);
+    // and in the direct patches, which have no playback thread
+    mPatchPanel->setMasterVolume_l(value);
 
     return NO_ERROR;
 }
@@ -868,6 +878,8 @@ status_t AudioFlinger::setMasterMute(bool muted)
     // mute will simply ignore the setting.
     for (size_t i = 0; i < mPlaybackThreads.size(); i++)
         mPlaybackThreads.valueAt(i)->setMasterMute(muted);
+    // and in the direct patches, which have no playback thread
+    mPatchPanel->setMasterMute_l(muted);
 
     return NO_ERROR;
 }
@@ -1072,6 +1084,10 @@ status_t AudioFlinger::setParameters(audio_io_handle_t ioHandle, const String8&
         thread = checkPlaybackThread_l(ioHandle);
         if (thread == 0) {
             thread = checkRecordThread_l(ioHandle);
+            if (thread == 0) {
+                // the streams of the direct patches have no thread
+                return mPatchPanel->setParameters_l(ioHandle, keyValuePairs);
+            }
         } else if (thread == primaryPlaybackThread_l()) {
             // indicate output device change to all input threads for pre processing
             AudioParameter param = AudioParameter(keyValuePairs);
@@ -2811,7 +2827,7 @@ bool AudioFlinger::updateOrphanEffectChains(const sp<AudioFlinger::EffectModule>
 
 
 struct Entry {
-#define MAX_NAME 32     // %Y%m%d%H%M%S_%d.wav
+#define MAX_NAME 32     // %Y%m%d%H%M%S_%d.wav or %Y%m%d%H%M%S_%d.hist
     char mName[MAX_NAME];
 };
 
@@ -2820,62 +2836,71 @@ int comparEntry(const void *p1, const void *p2)
     return strcmp(((const Entry *) p1)->mName, ((const Entry *) p2)->mName);
 }
 
+void AudioFlinger::rotateDumpFiles(int fd, const char *suffix)
+{
+    // There is a benign race condition if 2 threads call this simultaneously.
+    // They would both traverse the directory, but the result would simply be
+    // failures at unlink() which are ignored.  It's also unlikely since
+    // normally dumpsys is only done by bugreport or from the command line.
+    char path[32+256];
+    strcpy(path, "/data/misc/media");
+    size_t pathLen = strlen(path);
+    DIR *dir = opendir(path);
+    path[pathLen++] = '/';
+    if (dir != NULL) {
+#define MAX_SORT 20 // number of entries to sort
+#define MAX_KEEP 10 // number of entries to keep
+        struct Entry entries[MAX_SORT];
+        size_t entryCount = 0;
+        size_t suffixLen = strlen(suffix);
+        while (entryCount < MAX_SORT) {
+            struct dirent de;
+            struct dirent *result = NULL;
+            int rc = readdir_r(dir, &de, &result);
+            if (rc != 0) {
+                ALOGW("readdir_r failed %d", rc);
+                break;
+            }
+            if (result == NULL) {
+                break;
+            }
+            if (result != &de) {
+                ALOGW("readdir_r returned unexpected result %p != %p", result, &de);
+                break;
+            }
+            // ignore entries without the suffix
+            size_t nameLen = strlen(de.d_name);
+            if (nameLen <= suffixLen || nameLen >= MAX_NAME ||
+                    strcmp(&de.d_name[nameLen - suffixLen], suffix)) {
+                continue;
+            }
+            strcpy(entries[entryCount++].mName, de.d_name);
+        }
+        (void) closedir(dir);
+        if (entryCount > MAX_KEEP) {
+            qsort(entries, entryCount, sizeof(Entry), comparEntry);
+            for (size_t i = 0; i < entryCount - MAX_KEEP; ++i) {
+                strcpy(&path[pathLen], entries[i].mName);
+                (void) unlink(path);
+            }
+        }
+    } else {
+        if (fd >= 0) {
+            dprintf(fd, "unable to rotate %s files in %s: %s\n", suffix, path, strerror(errno));
+        }
+    }
+}
+
 #ifdef TEE_SINK
 void AudioFlinger::dumpTee(int fd, const sp<NBAIO_Source>& source, audio_io_handle_t id)
 {
     NBAIO_Source *teeSource = source.get();
     if (teeSource != NULL) {
         // .wav rotation
-        // There is a benign race condition if 2 threads call this simultaneously.
-        // They would both traverse the directory, but the result would simply be
-        // failures at unlink() which are ignored.  It's also unlikely since
-        // normally dumpsys is only done by bugreport or from the command line.
         char teePath[32+256];
-        strcpy(teePath, "/data/misc/media");
+        strcpy(teePath, "/data/misc/media/");
         size_t teePathLen = strlen(teePath);
-        DIR *dir = opendir(teePath);
-        teePath[teePathLen++] = '/';
-        if (dir != NULL) {
-#define MAX_SORT 20 // number of entries to sort
-#define MAX_KEEP 10 // number of entries to keep
-            struct Entry entries[MAX_SORT];
-            size_t entryCount = 0;
-            while (entryCount < MAX_SORT) {
-                struct dirent de;
-                struct dirent *result = NULL;
-                int rc = readdir_r(dir, &de, &result);
-                if (rc != 0) {
-                    ALOGW("readdir_r failed %d", rc);
-                    break;
-                }
-                if (result == NULL) {
-                    break;
-                }
-                if (result != &de) {
-                    ALOGW("readdir_r returned unexpected result %p != %p", result, &de);
-                    break;
-                }
-                // ignore non .wav file entries
-                size_t nameLen = strlen(de.d_name);
-                if (nameLen <= 4 || nameLen >= MAX_NAME ||
-                        strcmp(&de.d_name[nameLen - 4], ".wav")) {
-                    continue;
-                }
-                strcpy(entries[entryCount++].mName, de.d_name);
-            }
-            (void) closedir(dir);
-            if (entryCount > MAX_KEEP) {
-                qsort(entries, entryCount, sizeof(Entry), comparEntry);
-                for (size_t i = 0; i < entryCount - MAX_KEEP; ++i) {
-                    strcpy(&teePath[teePathLen], entries[i].mName);
-                    (void) unlink(teePath);
-                }
-            }
-        } else {
-            if (fd >= 0) {
-                dprintf(fd, "unable to rotate tees in %s: %s\n", teePath, strerror(errno));
-            }
-        }
+        rotateDumpFiles(fd, ".wav");
         char teeTime[16];
         struct timeval tv;
         gettimeofday(&tv, NULL);
@@ -56,6 +56,7 @@
 #include <media/nbaio/NBAIO.h>
 #include "AudioWatchdog.h"
 #include "AudioMixer.h"
+#include "ResamplerStage.h"
 
 #include <powermanager/IPowerManager.h>
 
@@ -262,7 +263,7 @@ public:
     sp<NBLog::Writer>   newWriter_l(size_t size, const char *name);
     void                unregisterWriter(const sp<NBLog::Writer>& writer);
 private:
-    static const size_t kLogMemorySize = 40 * 1024;
+    static const size_t kLogMemorySize = 48 * 1024;
     sp<MemoryDealer>    mLogMemoryDealer;   // == 0 when NBLog is disabled
     // When a log writer is unregistered, it is done lazily so that media.log can continue to see it
     // for as long as possible.  The memory is only freed when it is needed for another log writer.
@@ -359,6 +360,16 @@ private:
     // Set kEnableExtendedPrecision to true to use extended precision in MixerThread
     static const bool kEnableExtendedPrecision = true;
 
+    // Sample type of the effect chain buffers and of the track main buffers attached to them,
+    // see FLOAT_EFFECT_CHAIN in Configuration.h
+#ifdef FLOAT_EFFECT_CHAIN
+#define EFFECT_BUFFER_FORMAT AUDIO_FORMAT_PCM_FLOAT
+    typedef float effect_buffer_t;
+#else
+#define EFFECT_BUFFER_FORMAT AUDIO_FORMAT_PCM_16_BIT
+    typedef int16_t effect_buffer_t;
+#endif
+
     // Returns true if format is permitted for the PCM sink in the MixerThread
     static inline bool isValidPcmSinkFormat(audio_format_t format) {
         switch (format) {
@@ -755,6 +766,10 @@ private:
 
 public:
 
+    // removes the oldest files with the given suffix from /data/misc/media, so that the dumps
+    // written there by dumpsys do not accumulate
+    static void rotateDumpFiles(int fd, const char *suffix);
+
 #ifdef TEE_SINK
     // tee sink, if enabled by property, allows dumpsys to write most recent audio to .wav file
     static void dumpTee(int fd, const sp<NBAIO_Source>& source, audio_io_handle_t id = 0);
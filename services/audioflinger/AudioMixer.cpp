@@ -43,6 +43,7 @@
 #include <audio_effects/effect_downmix.h>
 
 #include "AudioMixerOps.h"
+#include "AudioMixerOpsSse.h"
 #include "AudioMixer.h"
 
 // The FCC_2 macro refers to the Fixed Channel Count of 2 for the legacy integer mixer.
@@ -78,6 +79,22 @@ static const bool kUseNewMixer = false;
 // because of downmix/upmix support.
 static const bool kUseFloat = true;
 
+// Set kFloatInPlace to true to let the 16 bit mixer engine read float tracks which are
+// not resampled directly from the track buffer, converting while it mixes, instead of
+// reformatting them to 16 bit through a copy buffer first.
+static const bool kFloatInPlace = true;
+
+// Set kUseSimd to true to allow the x86 SSE2/AVX2 kernels to be selected at runtime
+// for the legacy 16 bit stereo track hooks. The kernels are bit-exact with the C code.
+static const bool kUseSimd = true;
+
+// Parallel mixing costs a wakeup of the workers and a wait for the slowest of them on each
+// process() call, tens of microseconds, so it is only selected when there are at least
+// kParallelMinTracks enabled tracks and at least kParallelMinTrackFrames frames to mix
+// over all of them. Below that the serial hooks are faster.
+static const uint32_t kParallelMinTracks = 4;
+static const size_t kParallelMinTrackFrames = 4096;
+
 // Set to default copy buffer size in frames for input processing.
 static const size_t kCopyBufferFrameCount = 256;
 
@@ -397,7 +414,7 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     mState.outputTemp   = NULL;
     mState.resampleTemp = NULL;
     mState.mLog         = &mDummyLog;
-    // mState.reserved
+    mState.workerPool   = NULL;
 
     // FIXME Most of the following initialization is probably redundant since
     // tracks[i] should only be referenced if (mTrackNames & (1 << i)) != 0
@@ -423,6 +440,7 @@ AudioMixer::~AudioMixer()
     }
     delete [] mState.outputTemp;
     delete [] mState.resampleTemp;
+    delete mState.workerPool;
 }
 
 void AudioMixer::setLog(NBLog::Writer *log)
@@ -430,6 +448,129 @@ void AudioMixer::setLog(NBLog::Writer *log)
     mState.mLog = log;
 }
 
+void AudioMixer::setWorkerCount(uint32_t workerCount)
+{
+    if (workerCount > MAX_NUM_WORKERS) {
+        workerCount = MAX_NUM_WORKERS;
+    }
+    if (workerCount <= 1) {
+        workerCount = 0;
+    }
+    const uint32_t currentCount =
+            mState.workerPool != NULL ? mState.workerPool->workerCount() : 0;
+    if (workerCount == currentCount) {
+        return;
+    }
+    delete mState.workerPool;
+    mState.workerPool = workerCount > 0 ? new WorkerPool(workerCount, mState.frameCount) : NULL;
+    ALOGV("setWorkerCount(%u)", workerCount);
+    // reselect the process hook
+    invalidateState(mState.enabledTracks);
+}
+
+size_t AudioMixer::getWorkerTids(pid_t* tids, size_t maxTids) const
+{
+    size_t count = 0;
+    if (mState.workerPool != NULL) {
+        // worker 0 is the caller of process()
+        for (uint32_t i = 1; i < mState.workerPool->workerCount() && count < maxTids; i++) {
+            tids[count++] = mState.workerPool->workerTid(i);
+        }
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+
+AudioMixer::WorkerPool::WorkerPool(uint32_t workerCount, size_t frameCount)
+    :   mWorkerCount(workerCount),
+        mGeneration(0), mPending(0),
+        mState(NULL), mTracks(NULL), mSampleCount(0), mPts(0)
+{
+    for (uint32_t i = 0; i < mWorkerCount; i++) {
+        mOutputTemp[i] = new int32_t[MAX_NUM_CHANNELS * frameCount];
+        mResampleTemp[i] = new int32_t[MAX_NUM_CHANNELS * frameCount];
+    }
+    // worker 0 is the thread calling process()
+    for (uint32_t i = 1; i < mWorkerCount; i++) {
+        mWorkers[i] = new Worker(*this, i);
+        mWorkers[i]->run("AudioMixerWorker", ANDROID_PRIORITY_URGENT_AUDIO);
+    }
+}
+
+AudioMixer::WorkerPool::~WorkerPool()
+{
+    for (uint32_t i = 1; i < mWorkerCount; i++) {
+        mWorkers[i]->requestExit();
+    }
+    {
+        Mutex::Autolock _l(mLock);
+        mWorkCond.broadcast();
+    }
+    for (uint32_t i = 1; i < mWorkerCount; i++) {
+        mWorkers[i]->requestExitAndWait();
+        mWorkers[i].clear();
+    }
+    for (uint32_t i = 0; i < mWorkerCount; i++) {
+        delete [] mOutputTemp[i];
+        delete [] mResampleTemp[i];
+    }
+}
+
+void AudioMixer::WorkerPool::mix(state_t* state, const uint32_t* tracks,
+        size_t sampleCount, int64_t pts)
+{
+    {
+        Mutex::Autolock _l(mLock);
+        mState = state;
+        mTracks = tracks;
+        mSampleCount = sampleCount;
+        mPts = pts;
+        mPending = mWorkerCount - 1;
+        mGeneration++;
+        mWorkCond.broadcast();
+    }
+    mixWorker(0);
+    Mutex::Autolock _l(mLock);
+    while (mPending > 0) {
+        mDoneCond.wait(mLock);
+    }
+}
+
+void AudioMixer::WorkerPool::mixWorker(uint32_t index)
+{
+    int32_t* const outTemp = mOutputTemp[index];
+    memset(outTemp, 0, sizeof(*outTemp) * mSampleCount);
+    if (mTracks[index] != 0) {
+        mixTracks(mState, mTracks[index], outTemp, mResampleTemp[index], mPts);
+    }
+}
+
+AudioMixer::WorkerPool::Worker::Worker(WorkerPool& pool, uint32_t index)
+    :   Thread(false /*canCallJava*/), mPool(pool), mIndex(index), mGeneration(0)
+{
+}
+
+bool AudioMixer::WorkerPool::Worker::threadLoop()
+{
+    {
+        Mutex::Autolock _l(mPool.mLock);
+        while (mGeneration == mPool.mGeneration) {
+            if (exitPending()) {
+                return false;
+            }
+            mPool.mWorkCond.wait(mPool.mLock);
+        }
+        mGeneration = mPool.mGeneration;
+    }
+    mPool.mixWorker(mIndex);
+    Mutex::Autolock _l(mPool.mLock);
+    if (--mPool.mPending == 0) {
+        mPool.mDoneCond.signal();
+    }
+    return true;
+}
+
 int AudioMixer::getTrackName(audio_channel_mask_t channelMask,
         audio_format_t format, int sessionId)
 {
@@ -496,6 +637,8 @@ int AudioMixer::getTrackName(audio_channel_mask_t channelMask,
         t->mFormat = format;
         t->mMixerInFormat = kUseFloat && kUseNewMixer
                 ? AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT;
+        t->mHookInFormat = t->mMixerInFormat;
+        selectHookInFormat(t);
         t->mMixerChannelMask = audio_channel_mask_from_representation_and_bits(
                 AUDIO_CHANNEL_REPRESENTATION_POSITION, AUDIO_CHANNEL_OUT_STEREO);
         t->mMixerChannelCount = audio_channel_count_from_out_mask(t->mMixerChannelMask);
@@ -552,15 +695,17 @@ bool AudioMixer::setChannelMasks(int name,
     // channel masks have changed, does this track need a downmixer?
     // update to try using our desired format (if we aren't already using it)
     const audio_format_t prevMixerInFormat = track.mMixerInFormat;
+    const audio_format_t prevHookInFormat = track.mHookInFormat;
     track.mMixerInFormat = kUseFloat && kUseNewMixer
             ? AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT;
+    selectHookInFormat(&track);
     const status_t status = initTrackDownmix(&mState.tracks[name], name);
     ALOGE_IF(status != OK,
             "initTrackDownmix error %d, track channel mask %#x, mixer channel mask %#x",
             status, track.channelMask, track.mMixerChannelMask);
 
     const bool mixerInFormatChanged = prevMixerInFormat != track.mMixerInFormat;
-    if (mixerInFormatChanged) {
+    if (mixerInFormatChanged || prevHookInFormat != track.mHookInFormat) {
         prepareTrackForReformat(&track, name); // because of downmixer, track format may change!
     }
 
@@ -611,23 +756,36 @@ status_t AudioMixer::prepareTrackForDownmix(track_t* pTrack, int trackName)
     // discard the previous downmixer if there was one
     unprepareTrackForDownmix(pTrack, trackName);
     if (DownmixerBufferProvider::isMultichannelCapable()) {
-        DownmixerBufferProvider* pDbp = new DownmixerBufferProvider(pTrack->channelMask,
-                pTrack->mMixerChannelMask,
-                AUDIO_FORMAT_PCM_16_BIT /* TODO: use pTrack->mMixerInFormat, now only PCM 16 */,
-                pTrack->sampleRate, pTrack->sessionId, kCopyBufferFrameCount);
-
-        if (pDbp->isValid()) { // if constructor completed properly
-            pTrack->mMixerInFormat = AUDIO_FORMAT_PCM_16_BIT; // PCM 16 bit required for downmix
-            pTrack->downmixerBufferProvider = pDbp;
-            reconfigureBufferProviders(pTrack);
-            return NO_ERROR;
+        // Prefer the format read by the track hooks, but not all downmix effects accept float,
+        // so fall back to PCM 16 bit which they must all support.
+        audio_format_t format = pTrack->mHookInFormat;
+        for (;;) {
+            DownmixerBufferProvider* pDbp = new DownmixerBufferProvider(pTrack->channelMask,
+                    pTrack->mMixerChannelMask, format,
+                    pTrack->sampleRate, pTrack->sessionId, kCopyBufferFrameCount);
+
+            if (pDbp->isValid()) { // if constructor completed properly
+                // a 16 bit downmixer also requires a 16 bit mix, whereas a float downmixer
+                // may feed a 16 bit mix in place.
+                if (format == AUDIO_FORMAT_PCM_16_BIT) {
+                    pTrack->mMixerInFormat = format;
+                }
+                pTrack->mHookInFormat = format;
+                pTrack->downmixerBufferProvider = pDbp;
+                reconfigureBufferProviders(pTrack);
+                return NO_ERROR;
+            }
+            delete pDbp;
+            if (format == AUDIO_FORMAT_PCM_16_BIT) {
+                break;
+            }
+            format = AUDIO_FORMAT_PCM_16_BIT;
         }
-        delete pDbp;
     }
 
     // Effect downmixer does not accept the channel conversion.  Let's use our remixer.
     RemixBufferProvider* pRbp = new RemixBufferProvider(pTrack->channelMask,
-            pTrack->mMixerChannelMask, pTrack->mMixerInFormat, kCopyBufferFrameCount);
+            pTrack->mMixerChannelMask, pTrack->mHookInFormat, kCopyBufferFrameCount);
     // Remix always finds a conversion whereas Downmixer effect above may fail.
     pTrack->downmixerBufferProvider = pRbp;
     reconfigureBufferProviders(pTrack);
@@ -649,16 +807,44 @@ status_t AudioMixer::prepareTrackForReformat(track_t* pTrack, int trackName)
     // discard the previous reformatter if there was one
     unprepareTrackForReformat(pTrack, trackName);
     // only configure reformatter if needed
-    if (pTrack->mFormat != pTrack->mMixerInFormat) {
+    if (pTrack->mFormat != pTrack->mHookInFormat) {
         pTrack->mReformatBufferProvider = new ReformatBufferProvider(
                 audio_channel_count_from_out_mask(pTrack->channelMask),
-                pTrack->mFormat, pTrack->mMixerInFormat,
+                pTrack->mFormat, pTrack->mHookInFormat,
                 kCopyBufferFrameCount);
         reconfigureBufferProviders(pTrack);
     }
     return NO_ERROR;
 }
 
+bool AudioMixer::selectHookInFormat(track_t* pTrack)
+{
+    // The resampler reads the mix internal format, as do the 16 bit track hooks.
+    // A float track which is not resampled is read in place by the float input track hooks,
+    // which accumulate into the 16 bit (Q4.27) mix: this saves the reformat copy, and the
+    // precision lost by rounding the input to 16 bit.
+    const audio_format_t format = kFloatInPlace
+            && pTrack->mFormat == AUDIO_FORMAT_PCM_FLOAT
+            && pTrack->mMixerInFormat == AUDIO_FORMAT_PCM_16_BIT
+            && !pTrack->doesResample()
+            ? AUDIO_FORMAT_PCM_FLOAT : pTrack->mMixerInFormat;
+    if (format == pTrack->mHookInFormat) {
+        return false;
+    }
+    ALOGV("AudioMixer::selectHookInFormat() %#x -> %#x", pTrack->mHookInFormat, format);
+    pTrack->mHookInFormat = format;
+    return true;
+}
+
+void AudioMixer::prepareTrackForHookInFormat(track_t* pTrack, int trackName)
+{
+    // a downmixer reads and writes the format read by the track hooks
+    if (pTrack->downmixerBufferProvider != NULL) {
+        initTrackDownmix(pTrack, trackName);
+    }
+    prepareTrackForReformat(pTrack, trackName);
+}
+
 void AudioMixer::reconfigureBufferProviders(track_t* pTrack)
 {
     pTrack->bufferProvider = pTrack->mInputBufferProvider;
@@ -828,7 +1014,11 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
                 ALOG_ASSERT(audio_is_linear_pcm(format), "Invalid format %#x", format);
                 track.mFormat = format;
                 ALOGV("setParameter(TRACK, FORMAT, %#x)", format);
-                prepareTrackForReformat(&track, name);
+                if (selectHookInFormat(&track)) {
+                    prepareTrackForHookInFormat(&track, name);
+                } else {
+                    prepareTrackForReformat(&track, name);
+                }
                 invalidateState(1 << name);
             }
             } break;
@@ -863,6 +1053,10 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
             if (track.setResampler(uint32_t(valueInt), mSampleRate)) {
                 ALOGV("setParameter(RESAMPLE, SAMPLE_RATE, %u)",
                         uint32_t(valueInt));
+                // a new resampler reads the mix internal format, not float in place
+                if (selectHookInFormat(&track)) {
+                    prepareTrackForHookInFormat(&track, name);
+                }
                 invalidateState(1 << name);
             }
             break;
@@ -874,6 +1068,9 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
             delete track.resampler;
             track.resampler = NULL;
             track.sampleRate = mSampleRate;
+            if (selectHookInFormat(&track)) {
+                prepareTrackForHookInFormat(&track, name);
+            }
             invalidateState(1 << name);
             break;
         default:
@@ -1021,6 +1218,29 @@ size_t AudioMixer::getUnreleasedFrames(int name) const
     return 0;
 }
 
+bool AudioMixer::stepResamplerQuality(int step)
+{
+    // change the tracks furthest from the target quality first, so that they converge
+    const int first = step < 0 ? AudioResampler::DYN_HIGH_QUALITY
+            : AudioResampler::DYN_LOW_QUALITY;
+    for (int quality = first; quality + step >= AudioResampler::DYN_LOW_QUALITY
+            && quality + step <= AudioResampler::DYN_HIGH_QUALITY; quality += step) {
+        uint32_t en = mState.enabledTracks;
+        while (en) {
+            const int i = 31 - __builtin_clz(en);
+            en &= ~(1 << i);
+            AudioResampler* resampler = mState.tracks[i].resampler;
+            if (resampler != NULL && resampler->isAdaptive()
+                    && resampler->getQuality() == quality
+                    && resampler->setQuality(
+                            static_cast<AudioResampler::src_quality>(quality + step))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 void AudioMixer::setBufferProvider(int name, AudioBufferProvider* bufferProvider)
 {
     name -= TRACK0;
@@ -1108,7 +1328,7 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
                 all16BitsStereoNoResample = false;
                 resampling = true;
                 t.hook = getTrackHook(TRACKTYPE_RESAMPLE, t.mMixerChannelCount,
-                        t.mMixerInFormat, t.mMixerFormat);
+                        t.mMixerInFormat, t.mMixerFormat, t.mHookInFormat);
                 ALOGV_IF((n & NEEDS_CHANNEL_COUNT__MASK) > NEEDS_CHANNEL_2,
                         "Track %d needs downmix + resample", i);
             } else {
@@ -1117,12 +1337,12 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
                             t.mMixerChannelCount == 2 // TODO: MONO_HACK.
                                 ? TRACKTYPE_NORESAMPLEMONO : TRACKTYPE_NORESAMPLE,
                             t.mMixerChannelCount,
-                            t.mMixerInFormat, t.mMixerFormat);
+                            t.mMixerInFormat, t.mMixerFormat, t.mHookInFormat);
                     all16BitsStereoNoResample = false;
                 }
                 if ((n & NEEDS_CHANNEL_COUNT__MASK) >= NEEDS_CHANNEL_2){
                     t.hook = getTrackHook(TRACKTYPE_NORESAMPLE, t.mMixerChannelCount,
-                            t.mMixerInFormat, t.mMixerFormat);
+                            t.mMixerInFormat, t.mMixerFormat, t.mHookInFormat);
                     ALOGV_IF((n & NEEDS_CHANNEL_COUNT__MASK) > NEEDS_CHANNEL_2,
                             "Track %d needs downmix", i);
                 }
@@ -1161,14 +1381,21 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
                         // This is dangerous if the track is MONO as that requires
                         // special case handling due to implicit channel duplication.
                         // Stereo or Multichannel should actually be fine here.
+                        // the single track is written directly in the output format
                         state->hook = getProcessHook(PROCESSTYPE_NORESAMPLEONETRACK,
-                                t.mMixerChannelCount, t.mMixerInFormat, t.mMixerFormat);
+                                t.mMixerChannelCount, t.mHookInFormat, t.mMixerFormat);
                     }
                 }
             }
         }
     }
 
+    // parallel mixing replaces the generic hooks when there is enough work to share
+    if (state->workerPool != NULL && (uint32_t) countActiveTracks >= kParallelMinTracks
+            && countActiveTracks * state->frameCount >= kParallelMinTrackFrames) {
+        state->hook = process__genericParallel;
+    }
+
     ALOGV("mixer configuration change: %d activeTracks (%08x) "
         "all16BitsStereoNoResample=%d, resampling=%d, volumeRamp=%d",
         countActiveTracks, state->enabledTracks,
@@ -1200,7 +1427,7 @@ void AudioMixer::process__validate(state_t* state, int64_t pts)
                 track_t& t = state->tracks[i];
                 // Muted single tracks handled by allMuted above.
                 state->hook = getProcessHook(PROCESSTYPE_NORESAMPLEONETRACK,
-                        t.mMixerChannelCount, t.mMixerInFormat, t.mMixerFormat);
+                        t.mMixerChannelCount, t.mHookInFormat, t.mMixerFormat);
             }
         }
     }
@@ -1680,46 +1907,122 @@ void AudioMixer::process__genericResampling(state_t* state, int64_t pts)
         e0 &= ~(e1);
         int32_t *out = t1.mainBuffer;
         memset(outTemp, 0, sizeof(*outTemp) * t1.mMixerChannelCount * state->frameCount);
-        while (e1) {
-            const int i = 31 - __builtin_clz(e1);
-            e1 &= ~(1<<i);
-            track_t& t = state->tracks[i];
-            int32_t *aux = NULL;
-            if (CC_UNLIKELY(t.needs & NEEDS_AUX)) {
-                aux = t.auxBuffer;
-            }
+        mixTracks(state, e1, outTemp, state->resampleTemp, pts);
+        convertMixerFormat(out, t1.mMixerFormat,
+                outTemp, t1.mMixerInFormat, numFrames * t1.mMixerChannelCount);
+    }
+}
 
-            // this is a little goofy, on the resampling case we don't
-            // acquire/release the buffers because it's done by
-            // the resampler.
-            if (t.needs & NEEDS_RESAMPLE) {
-                t.resampler->setPTS(pts);
-                t.hook(&t, outTemp, numFrames, state->resampleTemp, aux);
-            } else {
+void AudioMixer::mixTracks(state_t* state, uint32_t tracks, int32_t* outTemp,
+        int32_t* resampleTemp, int64_t pts)
+{
+    const size_t numFrames = state->frameCount;
+    while (tracks) {
+        const int i = 31 - __builtin_clz(tracks);
+        tracks &= ~(1<<i);
+        track_t& t = state->tracks[i];
+        int32_t *aux = NULL;
+        if (CC_UNLIKELY(t.needs & NEEDS_AUX)) {
+            aux = t.auxBuffer;
+        }
+
+        // this is a little goofy, on the resampling case we don't
+        // acquire/release the buffers because it's done by
+        // the resampler.
+        if (t.needs & NEEDS_RESAMPLE) {
+            t.resampler->setPTS(pts);
+            t.hook(&t, outTemp, numFrames, resampleTemp, aux);
+        } else {
 
-                size_t outFrames = 0;
+            size_t outFrames = 0;
 
-                while (outFrames < numFrames) {
-                    t.buffer.frameCount = numFrames - outFrames;
-                    int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
-                    t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
-                    t.in = t.buffer.raw;
-                    // t.in == NULL can happen if the track was flushed just after having
-                    // been enabled for mixing.
-                    if (t.in == NULL) break;
+            while (outFrames < numFrames) {
+                t.buffer.frameCount = numFrames - outFrames;
+                int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
+                t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
+                t.in = t.buffer.raw;
+                // t.in == NULL can happen if the track was flushed just after having
+                // been enabled for mixing.
+                if (t.in == NULL) break;
 
-                    if (CC_UNLIKELY(aux != NULL)) {
-                        aux += outFrames;
-                    }
-                    t.hook(&t, outTemp + outFrames * t.mMixerChannelCount, t.buffer.frameCount,
-                            state->resampleTemp, aux);
-                    outFrames += t.buffer.frameCount;
-                    t.bufferProvider->releaseBuffer(&t.buffer);
+                if (CC_UNLIKELY(aux != NULL)) {
+                    aux += outFrames;
                 }
+                t.hook(&t, outTemp + outFrames * t.mMixerChannelCount, t.buffer.frameCount,
+                        resampleTemp, aux);
+                outFrames += t.buffer.frameCount;
+                t.bufferProvider->releaseBuffer(&t.buffer);
             }
         }
-        convertMixerFormat(out, t1.mMixerFormat,
-                outTemp, t1.mMixerInFormat, numFrames * t1.mMixerChannelCount);
+    }
+}
+
+// generic code with parallel mixing, with or without resampling
+void AudioMixer::process__genericParallel(state_t* state, int64_t pts)
+{
+    ALOGVV("process__genericParallel\n");
+    WorkerPool* const pool = state->workerPool;
+    const uint32_t workerCount = pool->workerCount();
+    const size_t numFrames = state->frameCount;
+
+    uint32_t e0 = state->enabledTracks;
+    while (e0) {
+        // process by group of tracks with same output buffer
+        uint32_t e1 = e0, e2 = e0;
+        int j = 31 - __builtin_clz(e1);
+        track_t& t1 = state->tracks[j];
+        e2 &= ~(1<<j);
+        while (e2) {
+            j = 31 - __builtin_clz(e2);
+            e2 &= ~(1<<j);
+            track_t& t2 = state->tracks[j];
+            if (CC_UNLIKELY(t2.mainBuffer != t1.mainBuffer)) {
+                e1 &= ~(1<<j);
+            }
+        }
+        e0 &= ~(e1);
+
+        // Deal the tracks round-robin in track name order.
+        // Tracks with an aux send all stay on worker 0, as aux buffers may be shared.
+        uint32_t tracks[MAX_NUM_WORKERS] = {};
+        uint32_t next = 0;
+        e2 = e1;
+        while (e2) {
+            j = 31 - __builtin_clz(e2);
+            e2 &= ~(1<<j);
+            if (state->tracks[j].needs & NEEDS_AUX) {
+                tracks[0] |= 1<<j;
+            } else {
+                tracks[next] |= 1<<j;
+                if (++next == workerCount) {
+                    next = 0;
+                }
+            }
+        }
+        const size_t sampleCount = numFrames * t1.mMixerChannelCount;
+        pool->mix(state, tracks, sampleCount, pts);
+
+        // deterministic reduction in worker order
+        int32_t* const outTemp = pool->outputTemp(0);
+        for (uint32_t w = 1; w < workerCount; w++) {
+            if (tracks[w] == 0) {
+                continue;
+            }
+            const int32_t* const workerTemp = pool->outputTemp(w);
+            if (t1.mMixerInFormat == AUDIO_FORMAT_PCM_FLOAT) {
+                float* const fout = reinterpret_cast<float*>(outTemp);
+                const float* const fin = reinterpret_cast<const float*>(workerTemp);
+                for (size_t k = 0; k < sampleCount; k++) {
+                    fout[k] += fin[k];
+                }
+            } else {
+                for (size_t k = 0; k < sampleCount; k++) {
+                    outTemp[k] += workerTemp[k];
+                }
+            }
+        }
+        convertMixerFormat(t1.mainBuffer, t1.mMixerFormat,
+                outTemp, t1.mMixerInFormat, sampleCount);
     }
 }
 
@@ -1821,6 +2124,7 @@ int64_t AudioMixer::calculateOutputPTS(const track_t& t, int64_t basePTS,
 
 /*static*/ uint64_t AudioMixer::sLocalTimeFreq;
 /*static*/ pthread_once_t AudioMixer::sOnceControl = PTHREAD_ONCE_INIT;
+/*static*/ int AudioMixer::sSimdType = AudioMixer::SIMDTYPE_NONE;
 
 /*static*/ void AudioMixer::sInitRoutine()
 {
@@ -1828,8 +2132,113 @@ int64_t AudioMixer::calculateOutputPTS(const track_t& t, int64_t basePTS,
     sLocalTimeFreq = lc.getLocalFreq(); // for the resampler
 
     DownmixerBufferProvider::init(); // for the downmixer
+
+    // select the track hook kernel family supported by this cpu
+#if USE_SSE2
+    if (kUseSimd) {
+        sSimdType = SIMDTYPE_SSE2;
+#if USE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            sSimdType = SIMDTYPE_AVX2;
+        }
+#endif
+    }
+#endif
+    ALOGV("mixer simd type: %d", sSimdType);
 }
 
+#if USE_SSE2
+/* x86 version of track__16BitsStereo. The aux send path is uncommon and
+ * remains in C, see AudioMixerOpsSse.h for the kernels.
+ *
+ * SIMDTYPE    SIMDTYPE_SSE2 or SIMDTYPE_AVX2
+ */
+template <int SIMDTYPE>
+void AudioMixer::track__16BitsStereoSimd(track_t* t, int32_t* out, size_t frameCount,
+        int32_t* temp, int32_t* aux)
+{
+    ALOGVV("track__16BitsStereoSimd<%d>\n", SIMDTYPE);
+    if (CC_UNLIKELY(aux != NULL)) {
+        track__16BitsStereo(t, out, frameCount, temp, aux);
+        return;
+    }
+    const int16_t *in = static_cast<const int16_t *>(t->in);
+
+    // ramp gain
+    if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1])) {
+#if USE_AVX2
+        if (SIMDTYPE == SIMDTYPE_AVX2) {
+            rampStereo16_avx2(out, in, frameCount, &t->prevVolume[0], &t->prevVolume[1],
+                    t->volumeInc[0], t->volumeInc[1]);
+        } else
+#endif
+        {
+            rampStereo16_sse2(out, in, frameCount, &t->prevVolume[0], &t->prevVolume[1],
+                    t->volumeInc[0], t->volumeInc[1]);
+        }
+        t->adjustVolumeRamp(false);
+    }
+
+    // constant gain
+    else {
+#if USE_AVX2
+        if (SIMDTYPE == SIMDTYPE_AVX2) {
+            mixStereo16_avx2(out, in, frameCount, t->volume[0], t->volume[1]);
+        } else
+#endif
+        {
+            mixStereo16_sse2(out, in, frameCount, t->volume[0], t->volume[1]);
+        }
+    }
+    t->in = in + frameCount * FCC_2;
+}
+
+/* x86 version of track__16BitsMono.
+ *
+ * SIMDTYPE    SIMDTYPE_SSE2 or SIMDTYPE_AVX2
+ */
+template <int SIMDTYPE>
+void AudioMixer::track__16BitsMonoSimd(track_t* t, int32_t* out, size_t frameCount,
+        int32_t* temp, int32_t* aux)
+{
+    ALOGVV("track__16BitsMonoSimd<%d>\n", SIMDTYPE);
+    if (CC_UNLIKELY(aux != NULL)) {
+        track__16BitsMono(t, out, frameCount, temp, aux);
+        return;
+    }
+    const int16_t *in = static_cast<const int16_t *>(t->in);
+
+    // ramp gain
+    if (CC_UNLIKELY(t->volumeInc[0]|t->volumeInc[1])) {
+#if USE_AVX2
+        if (SIMDTYPE == SIMDTYPE_AVX2) {
+            rampMono16_avx2(out, in, frameCount, &t->prevVolume[0], &t->prevVolume[1],
+                    t->volumeInc[0], t->volumeInc[1]);
+        } else
+#endif
+        {
+            rampMono16_sse2(out, in, frameCount, &t->prevVolume[0], &t->prevVolume[1],
+                    t->volumeInc[0], t->volumeInc[1]);
+        }
+        t->adjustVolumeRamp(false);
+    }
+
+    // constant gain
+    else {
+#if USE_AVX2
+        if (SIMDTYPE == SIMDTYPE_AVX2) {
+            mixMono16_avx2(out, in, frameCount, t->volume[0], t->volume[1]);
+        } else
+#endif
+        {
+            mixMono16_sse2(out, in, frameCount, t->volume[0], t->volume[1]);
+        }
+    }
+    t->in = in + frameCount;
+}
+#endif // USE_SSE2
+
 /* TODO: consider whether this level of optimization is necessary.
  * Perhaps just stick with a single for loop.
  */
@@ -2116,8 +2525,30 @@ void AudioMixer::convertMixerFormat(void *out, audio_format_t mixerOutFormat,
 /* Returns the proper track hook to use for mixing the track into the output buffer.
  */
 AudioMixer::hook_t AudioMixer::getTrackHook(int trackType, uint32_t channelCount,
-        audio_format_t mixerInFormat, audio_format_t mixerOutFormat __unused)
+        audio_format_t mixerInFormat, audio_format_t mixerOutFormat __unused,
+        audio_format_t hookInFormat)
 {
+    if (hookInFormat != mixerInFormat) {
+        // float mixed in place into the 16 bit mix, see selectHookInFormat()
+        LOG_ALWAYS_FATAL_IF(hookInFormat != AUDIO_FORMAT_PCM_FLOAT
+                || mixerInFormat != AUDIO_FORMAT_PCM_16_BIT
+                || channelCount > MAX_NUM_CHANNELS,
+                "bad hookInFormat %#x for mixerInFormat %#x", hookInFormat, mixerInFormat);
+        switch (trackType) {
+        case TRACKTYPE_NOP:
+            return track__nop;
+        case TRACKTYPE_NORESAMPLEMONO:
+            return (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MONOEXPAND, int32_t, float, int32_t>;
+        case TRACKTYPE_NORESAMPLE:
+            return (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MULTI, int32_t, float, int32_t>;
+        default:
+            LOG_ALWAYS_FATAL("bad trackType: %d", trackType);
+            break;
+        }
+        return NULL;
+    }
     if (!kUseNewMixer && channelCount == FCC_2 && mixerInFormat == AUDIO_FORMAT_PCM_16_BIT) {
         switch (trackType) {
         case TRACKTYPE_NOP:
@@ -2125,8 +2556,24 @@ AudioMixer::hook_t AudioMixer::getTrackHook(int trackType, uint32_t channelCount
         case TRACKTYPE_RESAMPLE:
             return track__genericResample;
         case TRACKTYPE_NORESAMPLEMONO:
+#if USE_SSE2
+            switch (sSimdType) {
+            case SIMDTYPE_SSE2:
+                return track__16BitsMonoSimd<SIMDTYPE_SSE2>;
+            case SIMDTYPE_AVX2:
+                return track__16BitsMonoSimd<SIMDTYPE_AVX2>;
+            }
+#endif
             return track__16BitsMono;
         case TRACKTYPE_NORESAMPLE:
+#if USE_SSE2
+            switch (sSimdType) {
+            case SIMDTYPE_SSE2:
+                return track__16BitsStereoSimd<SIMDTYPE_SSE2>;
+            case SIMDTYPE_AVX2:
+                return track__16BitsStereoSimd<SIMDTYPE_AVX2>;
+            }
+#endif
             return track__16BitsStereo;
         default:
             LOG_ALWAYS_FATAL("bad trackType: %d", trackType);
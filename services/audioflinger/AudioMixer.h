@@ -57,6 +57,9 @@ public:
     // maximum number of channels supported for the content
     static const uint32_t MAX_NUM_CHANNELS_TO_DOWNMIX = AUDIO_CHANNEL_COUNT_MAX;
 
+    // maximum number of threads (including the caller of process()) used for parallel mixing
+    static const uint32_t MAX_NUM_WORKERS = 4;
+
     static const uint16_t UNITY_GAIN_INT = 0x1000;
     static const float    UNITY_GAIN_FLOAT = 1.0f;
 
@@ -126,6 +129,26 @@ public:
 
     size_t      getUnreleasedFrames(int name) const;
 
+    // Lower or raise by one step the quality of one adaptive resampler of the enabled tracks,
+    // starting with the highest quality when lowering, and the lowest when raising.
+    // Return false if no resampler quality could be changed.
+    bool        lowerResamplerQuality() { return stepResamplerQuality(-1); }
+    bool        raiseResamplerQuality() { return stepResamplerQuality(1); }
+
+    // Opt-in parallel mixing. When workerCount > 1, process() partitions the enabled
+    // tracks across workerCount threads, one of them being the caller of process().
+    // Each worker mixes its tracks into a private buffer, and the buffers are summed
+    // in worker order so that the output does not depend on thread scheduling.
+    // workerCount <= 1 restores serial mixing; values above MAX_NUM_WORKERS are clamped.
+    // Parallel mixing is only used when there are enough enabled tracks and frames to
+    // amortize the synchronization with the workers.
+    void        setWorkerCount(uint32_t workerCount);
+
+    // Stores the thread ids of the worker threads owned by the mixer in tids, and returns
+    // their number, at most maxTids. The caller of process() waits for these threads, so
+    // they should be given a real-time priority as well.
+    size_t      getWorkerTids(pid_t* tids, size_t maxTids) const;
+
     static inline bool isValidPcmTrackFormat(audio_format_t format) {
         return format == AUDIO_FORMAT_PCM_16_BIT ||
                 format == AUDIO_FORMAT_PCM_24_BIT_PACKED ||
@@ -134,6 +157,7 @@ public:
     }
 
 private:
+    friend class MixerOpsTest; // compares the SIMD track hooks with the C ones
 
     enum {
         // FIXME this representation permits up to 8 channels
@@ -154,6 +178,7 @@ private:
     struct state_t;
     struct track_t;
     class CopyBufferProvider;
+    class WorkerPool;
 
     typedef void (*hook_t)(track_t* t, int32_t* output, size_t numOutFrames, int32_t* temp,
                            int32_t* aux);
@@ -216,6 +241,8 @@ private:
         audio_format_t mFormat;          // input track format
         audio_format_t mMixerInFormat;   // mix internal format AUDIO_FORMAT_PCM_(FLOAT|16_BIT)
                                          // each track must be converted to this format.
+        audio_format_t mHookInFormat;    // format read by the track hooks, mMixerInFormat
+                                         // unless float is mixed in place, see kFloatInPlace.
 
         float          mVolume[MAX_NUM_VOLUMES];     // floating point set volume
         float          mPrevVolume[MAX_NUM_VOLUMES]; // floating point previous volume
@@ -249,7 +276,7 @@ private:
         int32_t         *outputTemp;
         int32_t         *resampleTemp;
         NBLog::Writer*  mLog;
-        int32_t         reserved[1];
+        WorkerPool*     workerPool; // non-NULL if parallel mixing is enabled
         // FIXME allocate dynamically to save some memory when maxNumTracks < MAX_NUM_TRACKS
         track_t         tracks[MAX_NUM_TRACKS] __attribute__((aligned(32)));
     };
@@ -360,6 +387,53 @@ private:
         const audio_format_t mOutputFormat;
     };
 
+    // WorkerPool runs the parallel mixing of process__genericParallel.
+    // Worker 0 is the thread calling AudioMixer::process(), the other workers are
+    // threads owned by the pool. Each worker has private output and resample buffers.
+    class WorkerPool {
+    public:
+        WorkerPool(uint32_t workerCount, size_t frameCount);
+        ~WorkerPool();
+
+        uint32_t workerCount() const { return mWorkerCount; }
+        int32_t* outputTemp(uint32_t index) const { return mOutputTemp[index]; }
+        pid_t    workerTid(uint32_t index) const { return mWorkers[index]->getTid(); }
+
+        // Clears sampleCount samples of each worker output buffer, then mixes
+        // tracks[i] into the output buffer of worker i. Returns when all workers are done.
+        void mix(state_t* state, const uint32_t* tracks, size_t sampleCount, int64_t pts);
+
+    private:
+        class Worker : public Thread {
+        public:
+            Worker(WorkerPool& pool, uint32_t index);
+        private:
+            virtual bool threadLoop();
+            WorkerPool&     mPool;
+            const uint32_t  mIndex;
+            uint32_t        mGeneration; // last generation mixed by this worker
+        };
+
+        void mixWorker(uint32_t index);
+
+        const uint32_t  mWorkerCount;
+        Mutex           mLock;
+        Condition       mWorkCond;   // signaled when mGeneration changes
+        Condition       mDoneCond;   // signaled when mPending reaches 0
+        uint32_t        mGeneration; // incremented for each call to mix()
+        uint32_t        mPending;    // number of pool threads still mixing
+
+        // parameters of the current call to mix(), protected by mLock
+        state_t*        mState;
+        const uint32_t* mTracks;
+        size_t          mSampleCount;
+        int64_t         mPts;
+
+        sp<Worker>      mWorkers[MAX_NUM_WORKERS]; // mWorkers[0] is unused
+        int32_t*        mOutputTemp[MAX_NUM_WORKERS];
+        int32_t*        mResampleTemp[MAX_NUM_WORKERS];
+    };
+
     // bitmask of allocated track names, where bit 0 corresponds to TRACK0 etc.
     uint32_t        mTrackNames;
 
@@ -382,12 +456,19 @@ private:
     bool setChannelMasks(int name,
             audio_channel_mask_t trackChannelMask, audio_channel_mask_t mixerChannelMask);
 
+    // step is -1 to lower, or +1 to raise, the quality of one adaptive resampler
+    bool stepResamplerQuality(int step);
+
     // TODO: remove unused trackName/trackNum from functions below.
     static status_t initTrackDownmix(track_t* pTrack, int trackName);
     static status_t prepareTrackForDownmix(track_t* pTrack, int trackNum);
     static void unprepareTrackForDownmix(track_t* pTrack, int trackName);
     static status_t prepareTrackForReformat(track_t* pTrack, int trackNum);
     static void unprepareTrackForReformat(track_t* pTrack, int trackName);
+    // selects mHookInFormat, and returns true if it changed
+    static bool selectHookInFormat(track_t* pTrack);
+    // reconfigures the downmixer and reformatter after mHookInFormat changed
+    static void prepareTrackForHookInFormat(track_t* pTrack, int trackName);
     static void reconfigureBufferProviders(track_t* pTrack);
 
     static void track__genericResample(track_t* t, int32_t* out, size_t numFrames, int32_t* temp,
@@ -408,6 +489,11 @@ private:
     static void process__genericResampling(state_t* state, int64_t pts);
     static void process__OneTrack16BitsStereoNoResampling(state_t* state,
                                                           int64_t pts);
+    static void process__genericParallel(state_t* state, int64_t pts);
+
+    // mixes the given tracks into outTemp, shared by the generic and parallel process hooks
+    static void mixTracks(state_t* state, uint32_t tracks, int32_t* outTemp,
+            int32_t* resampleTemp, int64_t pts);
 
     static int64_t calculateOutputPTS(const track_t& t, int64_t basePTS,
                                       int outputFrameIndex);
@@ -416,6 +502,22 @@ private:
     static pthread_once_t   sOnceControl;
     static void             sInitRoutine();
 
+    // kernel family used by the legacy 16 bit track hooks, selected at runtime
+    enum {
+        SIMDTYPE_NONE,
+        SIMDTYPE_SSE2,
+        SIMDTYPE_AVX2,
+    };
+    static int              sSimdType;
+
+    // x86 SIMD versions of track__16BitsStereo and track__16BitsMono (AudioMixerOpsSse.h)
+    template <int SIMDTYPE>
+    static void track__16BitsStereoSimd(track_t* t, int32_t* out, size_t numFrames,
+            int32_t* temp, int32_t* aux);
+    template <int SIMDTYPE>
+    static void track__16BitsMonoSimd(track_t* t, int32_t* out, size_t numFrames,
+            int32_t* temp, int32_t* aux);
+
     /* multi-format volume mixing function (calls template functions
      * in AudioMixerOps.h).  The template parameters are as follows:
      *
@@ -461,7 +563,8 @@ private:
     static process_hook_t getProcessHook(int processType, uint32_t channelCount,
             audio_format_t mixerInFormat, audio_format_t mixerOutFormat);
     static hook_t getTrackHook(int trackType, uint32_t channelCount,
-            audio_format_t mixerInFormat, audio_format_t mixerOutFormat);
+            audio_format_t mixerInFormat, audio_format_t mixerOutFormat,
+            audio_format_t hookInFormat);
 };
 
 // ----------------------------------------------------------------------------
@@ -41,7 +41,7 @@ struct is_same<T, T>  // partial specialization
  * O(utput) = I(nput) * V(olume)
  *
  * The output, input, and volume may have different types.
- * There are 27 variants, of which 14 are actually defined in an
+ * There are 27 variants, of which 15 are actually defined in an
  * explicitly templated class.
  *
  * The following type variables and the underlying meaning:
@@ -151,6 +151,25 @@ inline float MixMul<float, int16_t, float>(int16_t value, float volume) {
     return value * volume * float_from_q_15;
 }
 
+/* Used to mix float input in place into the Q4.27 mix of the 16 bit mixer engine.
+ * Unlike the unused variants below, this one is needed in execution.
+ * This clamps like clampq4_27_from_float(), but truncates instead of rounding,
+ * which lets the compiler vectorize the mixing loops.
+ */
+template <>
+inline int32_t MixMul<int32_t, float, float>(float value, float volume) {
+    static const float limpos = 16.f - 1.f / (1 << 20); // largest float below 16.
+    static const float limneg = -16.f;
+    float f = value * volume;
+    if (f < limneg) {
+        f = limneg;
+    }
+    if (f > limpos) {
+        f = limpos;
+    }
+    return f * (1 << 27);
+}
+
 template <>
 inline int32_t MixMul<int32_t, int32_t, float>(int32_t value, float volume) {
     LOG_ALWAYS_FATAL("MixMul<int32_t, int32_t, float> Runtime Should not be here");
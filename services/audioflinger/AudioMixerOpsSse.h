@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_MIXER_OPS_SSE_H
+#define ANDROID_AUDIO_MIXER_OPS_SSE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#if defined(__SSE2__)
+#define USE_SSE2 (true)
+#include <emmintrin.h>
+#else
+#define USE_SSE2 (false)
+#endif
+
+// AVX2 kernels are compiled with a function level target attribute so that a
+// baseline x86 build still contains them; they must only be called after the
+// caller has checked for AVX2 support at runtime (see AudioMixer::sInitRoutine).
+#if USE_SSE2 && (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#define USE_AVX2 (true)
+#include <immintrin.h>
+#define MIXER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define USE_AVX2 (false)
+#endif
+
+namespace android {
+
+/* x86 kernels for the legacy 16 bit stereo integer mixer hooks
+ * (AudioMixer::track__16BitsStereo and AudioMixer::track__16BitsMono).
+ *
+ * Each kernel handles the aux == NULL case only, and is bit-exact
+ * with the scalar C code:
+ *
+ *   constant gain:  out[c] += in[c] * volume[c]          (U4.12 volume)
+ *   volume ramp:    out[c] += in[c] * (vol[c] >> 16)     (U4.28 volume)
+ *                   vol[c] += volInc[c]                  (per frame)
+ *
+ * The input is int16_t (Q0.15), the output is an int32_t (Q4.27) accumulator
+ * with 2 interleaved channels. Ramped volumes are updated in place so the
+ * caller can store them back to the track.
+ */
+
+#if USE_SSE2
+
+// Multiplies 8 int16_t samples by 8 int16_t volumes and accumulates
+// the 8 exact int32_t products into out.
+static inline void mulAdd16x8_sse2(int32_t *out, __m128i samples, __m128i volumes)
+{
+    const __m128i lo = _mm_mullo_epi16(samples, volumes);
+    const __m128i hi = _mm_mulhi_epi16(samples, volumes);
+    __m128i *dst = reinterpret_cast<__m128i *>(out);
+    _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), _mm_unpacklo_epi16(lo, hi)));
+    _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), _mm_unpackhi_epi16(lo, hi)));
+}
+
+// Returns the int16_t volumes (vl >> 16, vr >> 16) for 4 consecutive frames,
+// interleaved as L0 R0 L1 R1 L2 R2 L3 R3.
+// The U4.28 ramp never exceeds U4.12 after the shift, so the saturating pack is exact.
+static inline __m128i rampVolumes16x8_sse2(__m128i vl, __m128i vr)
+{
+    const __m128i l = _mm_srai_epi32(vl, 16);
+    const __m128i r = _mm_srai_epi32(vr, 16);
+    return _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r));
+}
+
+static inline void mixStereo16_sse2(int32_t *out, const int16_t *in, size_t frameCount,
+        int16_t vl, int16_t vr)
+{
+    const __m128i volumes = _mm_set_epi16(vr, vl, vr, vl, vr, vl, vr, vl);
+    for (; frameCount >= 4; frameCount -= 4) {
+        mulAdd16x8_sse2(out, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)), volumes);
+        in += 8;
+        out += 8;
+    }
+    for (; frameCount > 0; --frameCount) {
+        out[0] += in[0] * vl;
+        out[1] += in[1] * vr;
+        in += 2;
+        out += 2;
+    }
+}
+
+static inline void mixMono16_sse2(int32_t *out, const int16_t *in, size_t frameCount,
+        int16_t vl, int16_t vr)
+{
+    const __m128i volumes = _mm_set_epi16(vr, vl, vr, vl, vr, vl, vr, vl);
+    for (; frameCount >= 8; frameCount -= 8) {
+        const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        mulAdd16x8_sse2(out, _mm_unpacklo_epi16(samples, samples), volumes);
+        mulAdd16x8_sse2(out + 8, _mm_unpackhi_epi16(samples, samples), volumes);
+        in += 8;
+        out += 16;
+    }
+    for (; frameCount > 0; --frameCount) {
+        const int32_t l = *in++;
+        out[0] += l * vl;
+        out[1] += l * vr;
+        out += 2;
+    }
+}
+
+static inline void rampStereo16_sse2(int32_t *out, const int16_t *in, size_t frameCount,
+        int32_t *pvl, int32_t *pvr, int32_t vlInc, int32_t vrInc)
+{
+    int32_t vl = *pvl;
+    int32_t vr = *pvr;
+    if (frameCount >= 4) {
+        __m128i vlv = _mm_add_epi32(_mm_set1_epi32(vl), _mm_set_epi32(3 * vlInc, 2 * vlInc, vlInc, 0));
+        __m128i vrv = _mm_add_epi32(_mm_set1_epi32(vr), _mm_set_epi32(3 * vrInc, 2 * vrInc, vrInc, 0));
+        const __m128i vlStep = _mm_set1_epi32(4 * vlInc);
+        const __m128i vrStep = _mm_set1_epi32(4 * vrInc);
+        for (; frameCount >= 4; frameCount -= 4) {
+            mulAdd16x8_sse2(out, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)),
+                    rampVolumes16x8_sse2(vlv, vrv));
+            vlv = _mm_add_epi32(vlv, vlStep);
+            vrv = _mm_add_epi32(vrv, vrStep);
+            vl += 4 * vlInc;
+            vr += 4 * vrInc;
+            in += 8;
+            out += 8;
+        }
+    }
+    for (; frameCount > 0; --frameCount) {
+        *out++ += (vl >> 16) * (int32_t) *in++;
+        *out++ += (vr >> 16) * (int32_t) *in++;
+        vl += vlInc;
+        vr += vrInc;
+    }
+    *pvl = vl;
+    *pvr = vr;
+}
+
+static inline void rampMono16_sse2(int32_t *out, const int16_t *in, size_t frameCount,
+        int32_t *pvl, int32_t *pvr, int32_t vlInc, int32_t vrInc)
+{
+    int32_t vl = *pvl;
+    int32_t vr = *pvr;
+    if (frameCount >= 4) {
+        __m128i vlv = _mm_add_epi32(_mm_set1_epi32(vl), _mm_set_epi32(3 * vlInc, 2 * vlInc, vlInc, 0));
+        __m128i vrv = _mm_add_epi32(_mm_set1_epi32(vr), _mm_set_epi32(3 * vrInc, 2 * vrInc, vrInc, 0));
+        const __m128i vlStep = _mm_set1_epi32(4 * vlInc);
+        const __m128i vrStep = _mm_set1_epi32(4 * vrInc);
+        for (; frameCount >= 4; frameCount -= 4) {
+            const __m128i samples = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+            mulAdd16x8_sse2(out, _mm_unpacklo_epi16(samples, samples),
+                    rampVolumes16x8_sse2(vlv, vrv));
+            vlv = _mm_add_epi32(vlv, vlStep);
+            vrv = _mm_add_epi32(vrv, vrStep);
+            vl += 4 * vlInc;
+            vr += 4 * vrInc;
+            in += 4;
+            out += 8;
+        }
+    }
+    for (; frameCount > 0; --frameCount) {
+        const int32_t l = *in++;
+        *out++ += (vl >> 16) * l;
+        *out++ += (vr >> 16) * l;
+        vl += vlInc;
+        vr += vrInc;
+    }
+    *pvl = vl;
+    *pvr = vr;
+}
+
+#endif // USE_SSE2
+
+#if USE_AVX2
+
+// Sign extends 8 int16_t samples, multiplies by 8 int32_t volumes
+// and accumulates the int32_t products into out.
+MIXER_TARGET_AVX2
+static inline void mulAdd16x8_avx2(int32_t *out, __m128i samples, __m256i volumes)
+{
+    __m256i *dst = reinterpret_cast<__m256i *>(out);
+    _mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst),
+            _mm256_mullo_epi32(_mm256_cvtepi16_epi32(samples), volumes)));
+}
+
+MIXER_TARGET_AVX2
+static inline void mixStereo16_avx2(int32_t *out, const int16_t *in, size_t frameCount,
+        int16_t vl, int16_t vr)
+{
+    const __m256i volumes = _mm256_setr_epi32(vl, vr, vl, vr, vl, vr, vl, vr);
+    for (; frameCount >= 4; frameCount -= 4) {
+        mulAdd16x8_avx2(out, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)), volumes);
+        in += 8;
+        out += 8;
+    }
+    for (; frameCount > 0; --frameCount) {
+        out[0] += in[0] * vl;
+        out[1] += in[1] * vr;
+        in += 2;
+        out += 2;
+    }
+}
+
+MIXER_TARGET_AVX2
+static inline void mixMono16_avx2(int32_t *out, const int16_t *in, size_t frameCount,
+        int16_t vl, int16_t vr)
+{
+    const __m256i volumes = _mm256_setr_epi32(vl, vr, vl, vr, vl, vr, vl, vr);
+    for (; frameCount >= 8; frameCount -= 8) {
+        const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+        mulAdd16x8_avx2(out, _mm_unpacklo_epi16(samples, samples), volumes);
+        mulAdd16x8_avx2(out + 8, _mm_unpackhi_epi16(samples, samples), volumes);
+        in += 8;
+        out += 16;
+    }
+    for (; frameCount > 0; --frameCount) {
+        const int32_t l = *in++;
+        out[0] += l * vl;
+        out[1] += l * vr;
+        out += 2;
+    }
+}
+
+MIXER_TARGET_AVX2
+static inline void rampStereo16_avx2(int32_t *out, const int16_t *in, size_t frameCount,
+        int32_t *pvl, int32_t *pvr, int32_t vlInc, int32_t vrInc)
+{
+    int32_t vl = *pvl;
+    int32_t vr = *pvr;
+    if (frameCount >= 4) {
+        __m256i v = _mm256_setr_epi32(vl, vr, vl + vlInc, vr + vrInc,
+                vl + 2 * vlInc, vr + 2 * vrInc, vl + 3 * vlInc, vr + 3 * vrInc);
+        const __m256i step = _mm256_setr_epi32(4 * vlInc, 4 * vrInc, 4 * vlInc, 4 * vrInc,
+                4 * vlInc, 4 * vrInc, 4 * vlInc, 4 * vrInc);
+        for (; frameCount >= 4; frameCount -= 4) {
+            mulAdd16x8_avx2(out, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)),
+                    _mm256_srai_epi32(v, 16));
+            v = _mm256_add_epi32(v, step);
+            vl += 4 * vlInc;
+            vr += 4 * vrInc;
+            in += 8;
+            out += 8;
+        }
+    }
+    for (; frameCount > 0; --frameCount) {
+        *out++ += (vl >> 16) * (int32_t) *in++;
+        *out++ += (vr >> 16) * (int32_t) *in++;
+        vl += vlInc;
+        vr += vrInc;
+    }
+    *pvl = vl;
+    *pvr = vr;
+}
+
+MIXER_TARGET_AVX2
+static inline void rampMono16_avx2(int32_t *out, const int16_t *in, size_t frameCount,
+        int32_t *pvl, int32_t *pvr, int32_t vlInc, int32_t vrInc)
+{
+    int32_t vl = *pvl;
+    int32_t vr = *pvr;
+    if (frameCount >= 4) {
+        __m256i v = _mm256_setr_epi32(vl, vr, vl + vlInc, vr + vrInc,
+                vl + 2 * vlInc, vr + 2 * vrInc, vl + 3 * vlInc, vr + 3 * vrInc);
+        const __m256i step = _mm256_setr_epi32(4 * vlInc, 4 * vrInc, 4 * vlInc, 4 * vrInc,
+                4 * vlInc, 4 * vrInc, 4 * vlInc, 4 * vrInc);
+        for (; frameCount >= 4; frameCount -= 4) {
+            const __m128i samples = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+            mulAdd16x8_avx2(out, _mm_unpacklo_epi16(samples, samples),
+                    _mm256_srai_epi32(v, 16));
+            v = _mm256_add_epi32(v, step);
+            vl += 4 * vlInc;
+            vr += 4 * vrInc;
+            in += 4;
+            out += 8;
+        }
+    }
+    for (; frameCount > 0; --frameCount) {
+        const int32_t l = *in++;
+        *out++ += (vl >> 16) * l;
+        *out++ += (vr >> 16) * l;
+        vl += vlInc;
+        vr += vrInc;
+    }
+    *pvl = vl;
+    *pvr = vr;
+}
+
+#endif // USE_AVX2
+
+}; // namespace android
+
+#endif /* ANDROID_AUDIO_MIXER_OPS_SSE_H */
@@ -17,8 +17,11 @@
 #define LOG_TAG "AudioResampler"
 //#define LOG_NDEBUG 0
 
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <sys/types.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
@@ -103,6 +106,7 @@ bool AudioResampler::qualityIsSupported(src_quality quality)
 
 static pthread_once_t once_control = PTHREAD_ONCE_INIT;
 static AudioResampler::src_quality defaultQuality = AudioResampler::DEFAULT_QUALITY;
+static bool adaptiveQuality = true;
 
 void AudioResampler::init_routine()
 {
@@ -118,10 +122,35 @@ void AudioResampler::init_routine()
             }
         }
     }
+    if (property_get("af.resampler.adaptive", value, NULL) > 0) {
+        adaptiveQuality = strcmp(value, "0") != 0 && strcmp(value, "false") != 0;
+    }
 }
 
-uint32_t AudioResampler::qualityMHz(src_quality quality)
+// The budget is for all resamplers of the process, the loads are per resampler.
+// Both are in MHz of a 1 GHz reference core, that is thousandths of a CPU core.
+static const uint32_t maxMHz = 130; // an arbitrary number that permits 3 VHQ, should be tunable
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t currentMHz = 0;
+
+// Measured load of a stereo resampler to 48 kHz, indexed by [is float][quality], for all
+// qualities once calibrate() has run, so that the budget never mixes measured and static
+// estimates. The legacy qualities only support 16 bit input.
+static bool calibrated = false;
+static uint32_t calibratedMHz[2][AudioResampler::DYN_HIGH_QUALITY + 1];
+
+// must be called with mutex held
+uint32_t AudioResampler::qualityMHz(src_quality quality, audio_format_t format,
+        int channelCount, int32_t sampleRate)
 {
+    if (calibrated && quality > DEFAULT_QUALITY && quality <= DYN_HIGH_QUALITY) {
+        const uint32_t mhz = calibratedMHz[format == AUDIO_FORMAT_PCM_FLOAT][quality];
+        if (mhz != 0) {
+            // the cost is proportional to the channels and to the output rate
+            const uint64_t scaled = ((uint64_t) mhz * channelCount * sampleRate + 95999) / 96000;
+            return scaled < 1 ? 1 : (uint32_t) scaled;
+        }
+    }
     switch (quality) {
     default:
     case DEFAULT_QUALITY:
@@ -142,14 +171,129 @@ uint32_t AudioResampler::qualityMHz(src_quality quality)
     }
 }
 
-static const uint32_t maxMHz = 130; // an arbitrary number that permits 3 VHQ, should be tunable
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-static uint32_t currentMHz = 0;
+// Provides an endless stereo signal to the resamplers measured by calibrate().
+class CalibrationBufferProvider : public AudioBufferProvider {
+public:
+    explicit CalibrationBufferProvider(audio_format_t format) : mFormat(format), mNextFrame(0) {
+        for (size_t i = 0; i < kFrameCount; ++i) {
+            const float left = sinf(2 * M_PI * i / kFrameCount) * 0.5f;
+            const float right = sinf(2 * M_PI * 3 * i / kFrameCount) * 0.5f;
+            mFloat[i * 2] = left;
+            mFloat[i * 2 + 1] = right;
+            mInt16[i * 2] = left * 32767;
+            mInt16[i * 2 + 1] = right * 32767;
+        }
+    }
+
+    virtual status_t getNextBuffer(Buffer* buffer, int64_t pts __unused) {
+        const size_t offset = mNextFrame % kFrameCount;
+        if (buffer->frameCount > kFrameCount - offset) {
+            buffer->frameCount = kFrameCount - offset;
+        }
+        if (mFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            buffer->raw = &mFloat[offset * 2];
+        } else {
+            buffer->raw = &mInt16[offset * 2];
+        }
+        return NO_ERROR;
+    }
+
+    virtual void releaseBuffer(Buffer* buffer) {
+        mNextFrame += buffer->frameCount;
+        buffer->frameCount = 0;
+        buffer->raw = NULL;
+    }
+
+private:
+    static const size_t kFrameCount = 441; // 10 ms at 44.1 kHz
+
+    const audio_format_t mFormat;
+    size_t mNextFrame;
+    float mFloat[kFrameCount * 2];
+    int16_t mInt16[kFrameCount * 2];
+};
+
+static int64_t threadCpuTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+double AudioResampler::measureCostNs(audio_format_t format, src_quality quality)
+{
+    static const size_t kOutFrameCount = 256;
+    static const int kBuffers = 16;
+    static const int kRuns = 3;
+
+    CalibrationBufferProvider provider(format);
+    int32_t out[kOutFrameCount * 2]; // also holds float samples
+    AudioResampler *resampler = create(format, 2 /*inChannelCount*/, 48000, quality);
+    resampler->setSampleRate(44100);
+    resampler->setVolume(UNITY_GAIN_FLOAT, UNITY_GAIN_FLOAT);
+    // the first buffer designs the filter, which is not part of the cost
+    memset(out, 0, sizeof(out));
+    resampler->resample(out, kOutFrameCount, &provider);
+
+    // the least time of several runs excludes most interference, such as page faults
+    int64_t bestNs = INT64_MAX;
+    for (int run = 0; run < kRuns; ++run) {
+        const int64_t startNs = threadCpuTimeNs();
+        for (int i = 0; i < kBuffers; ++i) {
+            resampler->resample(out, kOutFrameCount, &provider);
+        }
+        const int64_t runNs = threadCpuTimeNs() - startNs;
+        if (runNs < bestNs) {
+            bestNs = runNs;
+        }
+    }
+    delete resampler;
+    return (double) bestNs / (kBuffers * kOutFrameCount);
+}
+
+void AudioResampler::calibrate()
+{
+    static const audio_format_t kFormats[] = { AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_FLOAT };
+    uint32_t mhz[2][DYN_HIGH_QUALITY + 1];
+    memset(mhz, 0, sizeof(mhz));
+
+    // Measure a stereo 44.1 to 48 kHz resampler, which is the common case and the one the
+    // static estimates describe. The cost at other ratios is extrapolated from it, and the
+    // mixer adjusts adaptive resamplers on its measured load anyway.
+    for (size_t i = 0; i < 2; ++i) {
+        const int firstQuality =
+                kFormats[i] == AUDIO_FORMAT_PCM_FLOAT ? DYN_LOW_QUALITY : LOW_QUALITY;
+        for (int quality = firstQuality; quality <= DYN_HIGH_QUALITY; ++quality) {
+            const double costNs = measureCostNs(kFormats[i], (src_quality) quality);
+            // milliseconds of CPU per second of output, that is MHz of a 1 GHz core
+            const double load = ceil(costNs * 48000 / 1000000);
+            mhz[i][quality] = load < 1 ? 1 : (uint32_t) load;
+        }
+        ALOGI("resampler load for format %#x: LOW %u, MED %u, HIGH %u, VERY_HIGH %u, "
+                "DYN_LOW %u, DYN_MED %u, DYN_HIGH %u MHz", kFormats[i],
+                mhz[i][LOW_QUALITY], mhz[i][MED_QUALITY], mhz[i][HIGH_QUALITY],
+                mhz[i][VERY_HIGH_QUALITY], mhz[i][DYN_LOW_QUALITY], mhz[i][DYN_MED_QUALITY],
+                mhz[i][DYN_HIGH_QUALITY]);
+    }
+
+    pthread_mutex_lock(&mutex);
+    // the resamplers record the load they were charged: only switch to the measured loads
+    // while none is charged, so that the budget stays in one unit.
+    if (currentMHz == 0) {
+        memcpy(calibratedMHz, mhz, sizeof(calibratedMHz));
+        calibrated = true;
+    } else {
+        ALOGW("resampler load %u MHz before calibration, keeping the static estimates",
+                currentMHz);
+    }
+    pthread_mutex_unlock(&mutex);
+}
 
 AudioResampler* AudioResampler::create(audio_format_t format, int inChannelCount,
         int32_t sampleRate, src_quality quality) {
 
     bool atFinalQuality;
+    bool adaptive = false;
     if (quality == DEFAULT_QUALITY) {
         // read the resampler default quality property the first time it is needed
         int ok = pthread_once(&once_control, init_routine);
@@ -164,18 +308,21 @@ AudioResampler* AudioResampler::create(audio_format_t format, int inChannelCount
 
     /* if the caller requests DEFAULT_QUALITY and af.resampler.property
      * has not been set, the target resampler quality is set to DYN_MED_QUALITY,
+     * or DYN_HIGH_QUALITY once calibrate() has measured the actual CPU cost,
      * and allowed to "throttle" down to DYN_LOW_QUALITY if necessary
      * due to estimated CPU load of having too many active resamplers
      * (the code below the if).
      */
+    pthread_mutex_lock(&mutex);
     if (quality == DEFAULT_QUALITY) {
-        quality = DYN_MED_QUALITY;
+        quality = calibrated ? DYN_HIGH_QUALITY : DYN_MED_QUALITY;
+        adaptive = adaptiveQuality;
     }
 
     // naive implementation of CPU load throttling doesn't account for whether resampler is active
-    pthread_mutex_lock(&mutex);
+    uint32_t deltaMHz;
     for (;;) {
-        uint32_t deltaMHz = qualityMHz(quality);
+        deltaMHz = qualityMHz(quality, format, inChannelCount, sampleRate);
         uint32_t newMHz = currentMHz + deltaMHz;
         if ((qualityIsSupported(quality) && newMHz <= maxMHz) || atFinalQuality) {
             ALOGV("resampler load %u -> %u MHz due to delta +%u MHz from quality %d",
@@ -257,15 +404,46 @@ AudioResampler* AudioResampler::create(audio_format_t format, int inChannelCount
 
     // initialize resampler
     resampler->init();
+    resampler->mFormat = format;
+    resampler->mAdaptive = adaptive;
+    resampler->mMHz = deltaMHz;
     return resampler;
 }
 
+bool AudioResampler::setQuality(src_quality quality)
+{
+    if (quality == mQuality) {
+        return true;
+    }
+    if (!mAdaptive || !canSetQuality(quality)) {
+        return false;
+    }
+    pthread_mutex_lock(&mutex);
+    const uint32_t deltaMHz = qualityMHz(quality, mFormat, mChannelCount, mSampleRate);
+    const uint32_t newMHz = currentMHz - mMHz + deltaMHz;
+    if (deltaMHz > mMHz && newMHz > maxMHz) {
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+    ALOGV("resampler load %u -> %u MHz due to quality %d -> %d",
+            currentMHz, newMHz, mQuality, quality);
+    currentMHz = newMHz;
+    mMHz = deltaMHz;
+    pthread_mutex_unlock(&mutex);
+
+    const src_quality oldQuality = mQuality;
+    mQuality = quality;
+    onQualityChanged(oldQuality);
+    return true;
+}
+
 AudioResampler::AudioResampler(int inChannelCount,
         int32_t sampleRate, src_quality quality) :
         mChannelCount(inChannelCount),
         mSampleRate(sampleRate), mInSampleRate(sampleRate), mInputIndex(0),
         mPhaseFraction(0), mLocalTimeFreq(0),
-        mPTS(AudioBufferProvider::kInvalidPTS), mQuality(quality) {
+        mPTS(AudioBufferProvider::kInvalidPTS), mQuality(quality),
+        mFormat(AUDIO_FORMAT_PCM_16_BIT), mAdaptive(false), mMHz(0) {
 
     const int maxChannels = quality < DYN_LOW_QUALITY ? 2 : 8;
     if (inChannelCount < 1
@@ -285,7 +463,7 @@ AudioResampler::AudioResampler(int inChannelCount,
 AudioResampler::~AudioResampler() {
     pthread_mutex_lock(&mutex);
     src_quality quality = getQuality();
-    uint32_t deltaMHz = qualityMHz(quality);
+    uint32_t deltaMHz = mMHz;
     int32_t newMHz = currentMHz - deltaMHz;
     ALOGV("resampler load %u -> %d MHz due to delta -%u MHz from quality %d",
             currentMHz, newMHz, deltaMHz, quality);
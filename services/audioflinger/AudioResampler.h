@@ -49,9 +49,17 @@ public:
 
     static const float UNITY_GAIN_FLOAT = 1.0f;
 
+    // A resampler created with DEFAULT_QUALITY is adaptive, unless af.resampler.quality
+    // forces a quality: it starts at the best dynamic quality that fits in the CPU budget,
+    // and its quality may then be changed with setQuality().
     static AudioResampler* create(audio_format_t format, int inChannelCount,
             int32_t sampleRate, src_quality quality=DEFAULT_QUALITY);
 
+    // Measures the CPU cost of the dynamic qualities on this device, which then replaces the
+    // static estimates in the CPU budget of create() and setQuality().
+    // Takes a few milliseconds, so it should be called once at startup, off any audio thread.
+    static void calibrate();
+
     virtual ~AudioResampler();
 
     virtual void init() = 0;
@@ -79,6 +87,14 @@ public:
     // called from destructor, so must not be virtual
     src_quality getQuality() const { return mQuality; }
 
+    bool isAdaptive() const { return mAdaptive; }
+
+    // Changes the quality of an adaptive resampler. The resampler crossfades from the
+    // previous filter to the new one, so this can be called while playing.
+    // Returns false and keeps the current quality if the resampler cannot change to this
+    // quality, or if the CPU budget does not allow a higher quality.
+    bool setQuality(src_quality quality);
+
 protected:
     // number of bits for phase fraction - 30 bits allows nearly 2x downsampling
     static const int kNumPhaseBits = 30;
@@ -144,6 +160,12 @@ protected:
                 + (mSampleRate - 1))/mSampleRate;
     }
 
+    // Returns true if setQuality() can change the resampler to this quality.
+    virtual bool canSetQuality(src_quality quality __unused) const { return false; }
+
+    // Called by setQuality() after the quality is changed, to switch to the new filter.
+    virtual void onQualityChanged(src_quality oldQuality __unused) { }
+
     inline float clampFloatVol(float volume) {
         if (volume > UNITY_GAIN_FLOAT) {
             return UNITY_GAIN_FLOAT;
@@ -154,7 +176,10 @@ protected:
     }
 
 private:
-    const src_quality mQuality;
+    src_quality mQuality;
+    audio_format_t mFormat;
+    bool mAdaptive;
+    uint32_t mMHz;  // CPU load accounted for this resampler, in MHz
 
     // Return 'true' if the quality level is supported without explicit request
     static bool qualityIsSupported(src_quality quality);
@@ -164,7 +189,13 @@ private:
 
     // Return the estimated CPU load for specific resampler in MHz.
     // The absolute number is irrelevant, it's the relative values that matter.
-    static uint32_t qualityMHz(src_quality quality);
+    // Once calibrate() has run, all qualities return their measured load, in MHz of a 1 GHz
+    // reference core, that is thousandths of a CPU core, scaled to the output channels and rate.
+    static uint32_t qualityMHz(src_quality quality, audio_format_t format,
+            int channelCount, int32_t sampleRate);
+
+    // Return the measured cost of a quality in nanoseconds per stereo output frame.
+    static double measureCostNs(audio_format_t format, src_quality quality);
 };
 
 // ----------------------------------------------------------------------------
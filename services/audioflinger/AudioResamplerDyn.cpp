@@ -29,9 +29,10 @@
 #include <utils/Log.h>
 #include <audio_utils/primitives.h>
 
-#include "AudioResamplerFirOps.h" // USE_NEON and USE_INLINE_ASSEMBLY defined here
+#include "AudioResamplerFirOps.h" // USE_NEON, USE_SSE2 and USE_INLINE_ASSEMBLY defined here
 #include "AudioResamplerFirProcess.h"
 #include "AudioResamplerFirProcessNeon.h"
+#include "AudioResamplerFirProcessSse.h"
 #include "AudioResamplerFirGen.h" // requires math.h
 #include "AudioResamplerDyn.h"
 
@@ -99,7 +100,7 @@ void AudioResamplerDyn<TC, TI, TO>::InBuffer::resize(int CHANNELS, int halfNumCo
     // attempt to preserve state
     if (mState) {
         TI* srcLo = mImpulse - halfNumCoefs*CHANNELS;
-        TI* srcHi = mImpulse + halfNumCoefs*CHANNELS;
+        TI* srcHi = mImpulse + (halfNumCoefs + 1)*CHANNELS; // including the head
         TI* dst = state;
 
         if (srcLo < mState) {
@@ -120,6 +121,19 @@ void AudioResamplerDyn<TC, TI, TO>::InBuffer::resize(int CHANNELS, int halfNumCo
     mRingFull = state + mStateCount - halfNumCoefs*CHANNELS;
 }
 
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::InBuffer::resizeKeepHead(
+        int CHANNELS, int halfNumCoefs, int newHalfNumCoefs)
+{
+    if (newHalfNumCoefs == halfNumCoefs) {
+        return;
+    }
+    // resize() preserves the state around the impulse pointer, so move it first.
+    // A longer filter may start with zeros for its oldest samples, as after init().
+    mImpulse += (halfNumCoefs - newHalfNumCoefs)*CHANNELS;
+    resize(CHANNELS, newHalfNumCoefs);
+}
+
 // copy in the input data into the head (impulse+halfNumCoefs) of the buffer.
 template<typename TC, typename TI, typename TO>
 template<int CHANNELS>
@@ -167,7 +181,7 @@ AudioResamplerDyn<TC, TI, TO>::AudioResamplerDyn(
         int inChannelCount, int32_t sampleRate, src_quality quality)
     : AudioResampler(inChannelCount, sampleRate, quality),
       mResampleFunc(0), mFilterSampleRate(0), mFilterQuality(DEFAULT_QUALITY),
-    mCoefBuffer(NULL)
+    mCoefBuffer(NULL), mFadeResampleFunc(0), mFadeFrame(0), mFadeFrameCount(0)
 {
     mVolumeSimd[0] = mVolumeSimd[1] = 0;
     // The AudioResampler base class assumes we are always ready for 1:1 resampling.
@@ -180,7 +194,12 @@ AudioResamplerDyn<TC, TI, TO>::AudioResamplerDyn(
 template<typename TC, typename TI, typename TO>
 AudioResamplerDyn<TC, TI, TO>::~AudioResamplerDyn()
 {
-    free(mCoefBuffer);
+    if (mCoefBuffer != NULL) {
+        FilterCache::release(mCoefBuffer);
+    }
+    if (mFadeConstants.mFirCoefs != NULL) {
+        FilterCache::release(mFadeConstants.mFirCoefs);
+    }
 }
 
 template<typename TC, typename TI, typename TO>
@@ -188,6 +207,10 @@ void AudioResamplerDyn<TC, TI, TO>::init()
 {
     mFilterSampleRate = 0; // always trigger new filter generation
     mInBuffer.init();
+    if (mFadeConstants.mFirCoefs != NULL) { // the state is cleared, no crossfade is needed
+        FilterCache::release(mFadeConstants.mFirCoefs);
+        mFadeConstants.mFirCoefs = NULL;
+    }
 }
 
 template<typename TC, typename TI, typename TO>
@@ -209,32 +232,127 @@ template<typename T> T max(T a, T b) {return a > b ? a : b;}
 
 template<typename T> T absdiff(T a, T b) {return a > b ? a - b : b - a;}
 
+static const double kFirAtten = 0.9998;   // to avoid ripple overflow
+
+template<typename TC, typename TI, typename TO>
+Mutex AudioResamplerDyn<TC, TI, TO>::FilterCache::sLock;
+
+template<typename TC, typename TI, typename TO>
+Vector<typename AudioResamplerDyn<TC, TI, TO>::FilterCache::Entry>
+        AudioResamplerDyn<TC, TI, TO>::FilterCache::sEntries;
+
+// must be called with sLock held
+template<typename TC, typename TI, typename TO>
+ssize_t AudioResamplerDyn<TC, TI, TO>::FilterCache::find_l(
+        int L, int halfNumCoefs, double stopBandAtten, double fcr)
+{
+    for (size_t i = 0; i < sEntries.size(); ++i) {
+        const Entry& e(sEntries[i]);
+        // the design parameters are computed identically for identical rates and quality,
+        // so exact floating point comparison is intended.
+        if (e.mL == L && e.mHalfNumCoefs == halfNumCoefs
+                && e.mStopBandAtten == stopBandAtten && e.mFcr == fcr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template<typename TC, typename TI, typename TO>
+const TC* AudioResamplerDyn<TC, TI, TO>::FilterCache::acquire(
+        int L, int halfNumCoefs, double stopBandAtten, double fcr)
+{
+    {
+        Mutex::Autolock _l(sLock);
+        ssize_t index = find_l(L, halfNumCoefs, stopBandAtten, fcr);
+        if (index >= 0) {
+            Entry& e(sEntries.editItemAt(index));
+            ++e.mRefCount;
+            return e.mCoefs;
+        }
+    }
+
+    // design outside of the lock, it can take several milliseconds.
+    TC* buf = NULL;
+    (void)posix_memalign(reinterpret_cast<void**>(&buf), 32, (L+1)*halfNumCoefs*sizeof(TC));
+    firKaiserGen(buf, L, halfNumCoefs, stopBandAtten, fcr, kFirAtten);
+
+    Mutex::Autolock _l(sLock);
+    ssize_t index = find_l(L, halfNumCoefs, stopBandAtten, fcr);
+    if (index >= 0) { // designed concurrently by another resampler
+        free(buf);
+        Entry& e(sEntries.editItemAt(index));
+        ++e.mRefCount;
+        return e.mCoefs;
+    }
+    Entry e;
+    e.mL = L;
+    e.mHalfNumCoefs = halfNumCoefs;
+    e.mStopBandAtten = stopBandAtten;
+    e.mFcr = fcr;
+    e.mCoefs = buf;
+    e.mRefCount = 1;
+    sEntries.add(e);
+    return buf;
+}
+
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::FilterCache::release(const TC* coefs)
+{
+    Mutex::Autolock _l(sLock);
+    size_t unused = 0;
+    ssize_t index = -1;
+    for (size_t i = 0; i < sEntries.size(); ++i) {
+        if (sEntries[i].mCoefs == coefs) {
+            index = i;
+        } else if (sEntries[i].mRefCount == 0) {
+            ++unused;
+        }
+    }
+    LOG_ALWAYS_FATAL_IF(index < 0, "releasing unknown filter bank %p", coefs);
+    Entry e(sEntries[index]);
+    if (--e.mRefCount > 0) {
+        sEntries.editItemAt(index).mRefCount = e.mRefCount;
+        return;
+    }
+    // move to the back so that unreferenced entries are ordered by release time
+    sEntries.removeAt(index);
+    sEntries.add(e);
+    if (++unused <= kMaxUnusedEntries) {
+        return;
+    }
+    for (size_t i = 0; i < sEntries.size(); ++i) {
+        if (sEntries[i].mRefCount == 0) {
+            free(sEntries[i].mCoefs);
+            sEntries.removeAt(i);
+            break;
+        }
+    }
+}
+
 template<typename TC, typename TI, typename TO>
 void AudioResamplerDyn<TC, TI, TO>::createKaiserFir(Constants &c,
         double stopBandAtten, int inSampleRate, int outSampleRate, double tbwCheat)
 {
-    TC* buf = NULL;
-    static const double atten = 0.9998;   // to avoid ripple overflow
     double fcr;
     double tbw = firKaiserTbw(c.mHalfNumCoefs, stopBandAtten);
 
-    (void)posix_memalign(reinterpret_cast<void**>(&buf), 32, (c.mL+1)*c.mHalfNumCoefs*sizeof(TC));
     if (inSampleRate < outSampleRate) { // upsample
         fcr = max(0.5*tbwCheat - tbw/2, tbw/2);
     } else { // downsample
         fcr = max(0.5*tbwCheat*outSampleRate/inSampleRate - tbw/2, tbw/2);
     }
-    // create and set filter
-    firKaiserGen(buf, c.mL, c.mHalfNumCoefs, stopBandAtten, fcr, atten);
+    // get the filter from the cache, designing it if needed, then release the previous one
+    const TC* buf = FilterCache::acquire(c.mL, c.mHalfNumCoefs, stopBandAtten, fcr);
     c.mFirCoefs = buf;
-    if (mCoefBuffer) {
-        free(mCoefBuffer);
+    if (mCoefBuffer != NULL) {
+        FilterCache::release(mCoefBuffer);
     }
     mCoefBuffer = buf;
 #ifdef DEBUG_RESAMPLER
     // print basic filter stats
     printf("L:%d  hnc:%d  stopBandAtten:%lf  fcr:%lf  atten:%lf  tbw:%lf\n",
-            c.mL, c.mHalfNumCoefs, stopBandAtten, fcr, atten, tbw);
+            c.mL, c.mHalfNumCoefs, stopBandAtten, fcr, kFirAtten, tbw);
     // test the filter and report results
     double fp = (fcr - tbw/2)/c.mL;
     double fs = (fcr + tbw/2)/c.mL;
@@ -275,16 +393,118 @@ static bool isClose(int32_t newSampleRate, int32_t prevSampleRate,
     return pdiff < prevSampleRate>>4 && adiff < filterSampleRate>>3;
 }
 
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::createFilter(int32_t inSampleRate)
+{
+    mFilterSampleRate = inSampleRate;
+    mFilterQuality = getQuality();
+
+    // Begin Kaiser Filter computation
+    //
+    // The quantization floor for S16 is about 96db - 10*log_10(#length) + 3dB.
+    // Keep the stop band attenuation no greater than 84-85dB for 32 length S16 filters
+    //
+    // For s32 we keep the stop band attenuation at the same as 16b resolution, about
+    // 96-98dB
+    //
+
+    bool useS32 = false;
+    double stopBandAtten;
+    double tbwCheat = 1.; // how much we "cheat" into aliasing
+    int halfLength;
+    if (mFilterQuality == DYN_HIGH_QUALITY) {
+        // 32b coefficients, 64 length
+        useS32 = true;
+        stopBandAtten = 98.;
+        if (inSampleRate >= mSampleRate * 4) {
+            halfLength = 48;
+        } else if (inSampleRate >= mSampleRate * 2) {
+            halfLength = 40;
+        } else {
+            halfLength = 32;
+        }
+    } else if (mFilterQuality == DYN_LOW_QUALITY) {
+        // 16b coefficients, 16-32 length
+        useS32 = false;
+        stopBandAtten = 80.;
+        if (inSampleRate >= mSampleRate * 4) {
+            halfLength = 24;
+        } else if (inSampleRate >= mSampleRate * 2) {
+            halfLength = 16;
+        } else {
+            halfLength = 8;
+        }
+        if (inSampleRate <= mSampleRate) {
+            tbwCheat = 1.05;
+        } else {
+            tbwCheat = 1.03;
+        }
+    } else { // DYN_MED_QUALITY
+        // 16b coefficients, 32-64 length
+        // note: > 64 length filters with 16b coefs can have quantization noise problems
+        useS32 = false;
+        stopBandAtten = 84.;
+        if (inSampleRate >= mSampleRate * 4) {
+            halfLength = 32;
+        } else if (inSampleRate >= mSampleRate * 2) {
+            halfLength = 24;
+        } else {
+            halfLength = 16;
+        }
+        if (inSampleRate <= mSampleRate) {
+            tbwCheat = 1.03;
+        } else {
+            tbwCheat = 1.01;
+        }
+    }
+
+    // determine the number of polyphases in the filterbank.
+    // for 16b, it is desirable to have 2^(16/2) = 256 phases.
+    // https://ccrma.stanford.edu/~jos/resample/Relation_Interpolation_Error_Quantization.html
+    //
+    // We are a bit more lax on this.
+
+    int phases = mSampleRate / gcd(mSampleRate, inSampleRate);
+
+    // TODO: Once dynamic sample rate change is an option, the code below
+    // should be modified to execute only when dynamic sample rate change is enabled.
+    //
+    // as above, #phases less than 63 is too few phases for accurate linear interpolation.
+    // we increase the phases to compensate, but more phases means more memory per
+    // filter and more time to compute the filter.
+    //
+    // if we know that the filter will be used for dynamic sample rate changes,
+    // that would allow us skip this part for fixed sample rate resamplers.
+    //
+    while (phases<63) {
+        phases *= 2; // this code only needed to support dynamic rate changes
+    }
+
+    if (phases>=256) {  // too many phases, always interpolate
+        phases = 127;
+    }
+
+    // create the filter
+    mConstants.set(phases, halfLength, inSampleRate, mSampleRate);
+    createKaiserFir(mConstants, stopBandAtten,
+            inSampleRate, mSampleRate, tbwCheat);
+#ifdef DEBUG_RESAMPLER
+    printf("quality:%d  %s\n", mFilterQuality, useS32 ? "S32" : "S16");
+#endif
+}
+
 template<typename TC, typename TI, typename TO>
 void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
 {
     if (mInSampleRate == inSampleRate) {
         return;
     }
+    if (mFadeConstants.mFirCoefs != NULL) { // the new rate may need another filter
+        finishFade();
+    }
     int32_t oldSampleRate = mInSampleRate;
     int32_t oldHalfNumCoefs = mConstants.mHalfNumCoefs;
     uint32_t oldPhaseWrapLimit = mConstants.mL << mConstants.mShift;
-    bool useS32 = false;
 
     mInSampleRate = inSampleRate;
 
@@ -292,98 +512,15 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
 
     if (mFilterQuality != getQuality() ||
             !isClose(inSampleRate, oldSampleRate, mFilterSampleRate, mSampleRate)) {
-        mFilterSampleRate = inSampleRate;
-        mFilterQuality = getQuality();
-
-        // Begin Kaiser Filter computation
-        //
-        // The quantization floor for S16 is about 96db - 10*log_10(#length) + 3dB.
-        // Keep the stop band attenuation no greater than 84-85dB for 32 length S16 filters
-        //
-        // For s32 we keep the stop band attenuation at the same as 16b resolution, about
-        // 96-98dB
-        //
-
-        double stopBandAtten;
-        double tbwCheat = 1.; // how much we "cheat" into aliasing
-        int halfLength;
-        if (mFilterQuality == DYN_HIGH_QUALITY) {
-            // 32b coefficients, 64 length
-            useS32 = true;
-            stopBandAtten = 98.;
-            if (inSampleRate >= mSampleRate * 4) {
-                halfLength = 48;
-            } else if (inSampleRate >= mSampleRate * 2) {
-                halfLength = 40;
-            } else {
-                halfLength = 32;
-            }
-        } else if (mFilterQuality == DYN_LOW_QUALITY) {
-            // 16b coefficients, 16-32 length
-            useS32 = false;
-            stopBandAtten = 80.;
-            if (inSampleRate >= mSampleRate * 4) {
-                halfLength = 24;
-            } else if (inSampleRate >= mSampleRate * 2) {
-                halfLength = 16;
-            } else {
-                halfLength = 8;
-            }
-            if (inSampleRate <= mSampleRate) {
-                tbwCheat = 1.05;
-            } else {
-                tbwCheat = 1.03;
-            }
-        } else { // DYN_MED_QUALITY
-            // 16b coefficients, 32-64 length
-            // note: > 64 length filters with 16b coefs can have quantization noise problems
-            useS32 = false;
-            stopBandAtten = 84.;
-            if (inSampleRate >= mSampleRate * 4) {
-                halfLength = 32;
-            } else if (inSampleRate >= mSampleRate * 2) {
-                halfLength = 24;
-            } else {
-                halfLength = 16;
-            }
-            if (inSampleRate <= mSampleRate) {
-                tbwCheat = 1.03;
-            } else {
-                tbwCheat = 1.01;
-            }
-        }
-
-        // determine the number of polyphases in the filterbank.
-        // for 16b, it is desirable to have 2^(16/2) = 256 phases.
-        // https://ccrma.stanford.edu/~jos/resample/Relation_Interpolation_Error_Quantization.html
-        //
-        // We are a bit more lax on this.
-
-        int phases = mSampleRate / gcd(mSampleRate, inSampleRate);
-
-        // TODO: Once dynamic sample rate change is an option, the code below
-        // should be modified to execute only when dynamic sample rate change is enabled.
-        //
-        // as above, #phases less than 63 is too few phases for accurate linear interpolation.
-        // we increase the phases to compensate, but more phases means more memory per
-        // filter and more time to compute the filter.
-        //
-        // if we know that the filter will be used for dynamic sample rate changes,
-        // that would allow us skip this part for fixed sample rate resamplers.
-        //
-        while (phases<63) {
-            phases *= 2; // this code only needed to support dynamic rate changes
-        }
-
-        if (phases>=256) {  // too many phases, always interpolate
-            phases = 127;
-        }
+        createFilter(inSampleRate);
+    }
+    applyFilter(oldPhaseWrapLimit);
+}
 
-        // create the filter
-        mConstants.set(phases, halfLength, inSampleRate, mSampleRate);
-        createKaiserFir(mConstants, stopBandAtten,
-                inSampleRate, mSampleRate, tbwCheat);
-    } // End Kaiser filter
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::applyFilter(uint32_t oldPhaseWrapLimit)
+{
+    const int32_t inSampleRate = mInSampleRate;
 
     // update phase and state based on the new filter.
     const Constants& c(mConstants);
@@ -413,78 +550,213 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
     LOG_ALWAYS_FATAL_IF(stride < 16, "Resampler stride must be 16 or more");
     LOG_ALWAYS_FATAL_IF(mChannelCount < 1 || mChannelCount > 8,
             "Resampler channels(%d) must be between 1 to 8", mChannelCount);
-    // stride 16 (falls back to stride 2 for machines that do not support NEON)
+    // stride 16 (falls back to stride 2 for machines that do not support NEON or SSE2)
     if (locked) {
         switch (mChannelCount) {
         case 1:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<1, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<1, true, 16, false>;
             break;
         case 2:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<2, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<2, true, 16, false>;
             break;
         case 3:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<3, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<3, true, 16, false>;
             break;
         case 4:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<4, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<4, true, 16, false>;
             break;
         case 5:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<5, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<5, true, 16, false>;
             break;
         case 6:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<6, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<6, true, 16, false>;
             break;
         case 7:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<7, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<7, true, 16, false>;
             break;
         case 8:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<8, true, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<8, true, 16, false>;
             break;
         }
     } else {
         switch (mChannelCount) {
         case 1:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<1, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<1, false, 16, false>;
             break;
         case 2:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<2, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<2, false, 16, false>;
             break;
         case 3:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<3, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<3, false, 16, false>;
             break;
         case 4:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<4, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<4, false, 16, false>;
             break;
         case 5:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<5, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<5, false, 16, false>;
             break;
         case 6:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<6, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<6, false, 16, false>;
             break;
         case 7:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<7, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<7, false, 16, false>;
             break;
         case 8:
-            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<8, false, 16>;
+            mResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<8, false, 16, false>;
             break;
         }
     }
+    // the crossfade after a quality change always interpolates the phase:
+    // the result is the same for a locked phase, which has no fractional phase bits.
+    switch (mChannelCount) {
+    case 1:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<1, false, 16, true>;
+        break;
+    case 2:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<2, false, 16, true>;
+        break;
+    case 3:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<3, false, 16, true>;
+        break;
+    case 4:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<4, false, 16, true>;
+        break;
+    case 5:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<5, false, 16, true>;
+        break;
+    case 6:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<6, false, 16, true>;
+        break;
+    case 7:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<7, false, 16, true>;
+        break;
+    case 8:
+        mFadeResampleFunc = &AudioResamplerDyn<TC, TI, TO>::resample<8, false, 16, true>;
+        break;
+    }
 #ifdef DEBUG_RESAMPLER
-    printf("channels:%d  %s  stride:%d  %s  coef:%d  shift:%d\n",
+    printf("channels:%d  %s  stride:%d  coef:%d  shift:%d\n",
             mChannelCount, locked ? "locked" : "interpolated",
-            stride, useS32 ? "S32" : "S16", 2*c.mHalfNumCoefs, c.mShift);
+            stride, 2*c.mHalfNumCoefs, c.mShift);
 #endif
 }
 
+template<typename TC, typename TI, typename TO>
+bool AudioResamplerDyn<TC, TI, TO>::canSetQuality(src_quality quality) const
+{
+    // 16b coefficients are not precise enough for the high quality filter
+    return quality == DYN_LOW_QUALITY || quality == DYN_MED_QUALITY
+            || (quality == DYN_HIGH_QUALITY && !is_same<TC, int16_t>::value);
+}
+
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::onQualityChanged(src_quality oldQuality __unused)
+{
+    if (mInSampleRate == 0) {
+        return; // no filter yet, setSampleRate() will design it for the new quality
+    }
+    if (mFadeConstants.mFirCoefs != NULL) {
+        finishFade();
+    }
+
+    // keep the current filter for the crossfade, and design the new one for the rate of
+    // the current filter: setSampleRate() keeps a filter for close rates, whose phases
+    // may differ from a filter designed for mInSampleRate.
+    // The filters then only differ in length, so they share the phases and phase fraction.
+    mFadeConstants = mConstants;
+    mCoefBuffer = NULL;
+    createFilter(mFilterSampleRate);
+    const Constants& c(mConstants);
+    if (c.mL != mFadeConstants.mL || c.mShift != mFadeConstants.mShift) {
+        // not expected, but the phases cannot be shared: switch without a crossfade
+        ALOGW("Resampler filter phases changed with the quality, no crossfade");
+        const uint32_t oldPhaseWrapLimit = mFadeConstants.mL << mFadeConstants.mShift;
+        mInBuffer.resizeKeepHead(mChannelCount, mFadeConstants.mHalfNumCoefs, c.mHalfNumCoefs);
+        FilterCache::release(mFadeConstants.mFirCoefs);
+        mFadeConstants.mFirCoefs = NULL;
+        applyFilter(oldPhaseWrapLimit);
+        return;
+    }
+
+    // the input buffer holds the longer filter during the crossfade
+    if (c.mHalfNumCoefs > mFadeConstants.mHalfNumCoefs) {
+        mInBuffer.resizeKeepHead(mChannelCount,
+                mFadeConstants.mHalfNumCoefs, c.mHalfNumCoefs);
+    }
+    mFadeFrame = 0;
+    mFadeFrameCount = mSampleRate * kFadeTimeMs / 1000;
+}
+
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::finishFade()
+{
+    const Constants& c(mConstants);
+    if (mFadeConstants.mHalfNumCoefs > c.mHalfNumCoefs) {
+        mInBuffer.resizeKeepHead(mChannelCount, mFadeConstants.mHalfNumCoefs, c.mHalfNumCoefs);
+    }
+    FilterCache::release(mFadeConstants.mFirCoefs);
+    mFadeConstants.mFirCoefs = NULL;
+}
+
+// returns volume * frame / frameCount, for frame <= frameCount
+template<typename T>
+static inline T fadeVolume(T volume, uint32_t frame, uint32_t frameCount)
+{
+    // integer volumes are U4_28, so the product fits in 64 bits
+    return static_cast<T>(static_cast<int64_t>(volume) * frame / frameCount);
+}
+
+template<>
+inline float fadeVolume<float>(float volume, uint32_t frame, uint32_t frameCount)
+{
+    return volume * frame / frameCount;
+}
+
+template<typename TC, typename TI, typename TO>
+template<int CHANNELS, int STRIDE>
+void AudioResamplerDyn<TC, TI, TO>::fadeFir(TO* const out,
+        const uint32_t phase, const uint32_t phaseWrapLimit,
+        const int coefShift, const int halfNumCoefs, const TI* const impulse,
+        const TO* const volumeLR)
+{
+    // the volumes of the two filters sum to the track volume
+    TO __attribute__ ((aligned (8))) fadeInVolume[2];
+    TO __attribute__ ((aligned (8))) fadeOutVolume[2];
+    if (mFadeFrame < mFadeFrameCount) {
+        ++mFadeFrame;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fadeInVolume[i] = fadeVolume(volumeLR[i], mFadeFrame, mFadeFrameCount);
+        fadeOutVolume[i] = volumeLR[i] - fadeInVolume[i];
+    }
+
+    // the input buffer is sized for the longer filter: align both filters with its head
+    const Constants& fadeOut(mFadeConstants);
+    fir<CHANNELS, false, STRIDE>(out, phase, phaseWrapLimit, coefShift,
+            fadeOut.mHalfNumCoefs, fadeOut.mFirCoefs,
+            impulse + (halfNumCoefs - fadeOut.mHalfNumCoefs)*CHANNELS, fadeOutVolume);
+    const Constants& fadeIn(mConstants);
+    fir<CHANNELS, false, STRIDE>(out, phase, phaseWrapLimit, coefShift,
+            fadeIn.mHalfNumCoefs, fadeIn.mFirCoefs,
+            impulse + (halfNumCoefs - fadeIn.mHalfNumCoefs)*CHANNELS, fadeInVolume);
+}
+
 template<typename TC, typename TI, typename TO>
 void AudioResamplerDyn<TC, TI, TO>::resample(int32_t* out, size_t outFrameCount,
             AudioBufferProvider* provider)
 {
-    (this->*mResampleFunc)(reinterpret_cast<TO*>(out), outFrameCount, provider);
+    if (CC_LIKELY(mFadeConstants.mFirCoefs == NULL)) {
+        (this->*mResampleFunc)(reinterpret_cast<TO*>(out), outFrameCount, provider);
+        return;
+    }
+    (this->*mFadeResampleFunc)(reinterpret_cast<TO*>(out), outFrameCount, provider);
+    if (mFadeFrame >= mFadeFrameCount) {
+        finishFade();
+    }
 }
 
 template<typename TC, typename TI, typename TO>
-template<int CHANNELS, bool LOCKED, int STRIDE>
+template<int CHANNELS, bool LOCKED, int STRIDE, bool FADE>
 void AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
         AudioBufferProvider* provider)
 {
@@ -499,6 +771,9 @@ void AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
     size_t outputIndex = 0;
     size_t outputSampleCount = outFrameCount * OUTPUT_CHANNELS;
     const uint32_t phaseWrapLimit = c.mL << c.mShift;
+    // during a crossfade, the input buffer is sized for the longer of the two filters
+    const int bufferHalfNumCoefs = FADE
+            ? max(c.mHalfNumCoefs, mFadeConstants.mHalfNumCoefs) : c.mHalfNumCoefs;
     size_t inFrameCount = (phaseIncrement * (uint64_t)outFrameCount + phaseFraction)
             / phaseWrapLimit;
     // sanity check that inFrameCount is in signed 32 bit integer range.
@@ -535,7 +810,7 @@ void AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
             inFrameCount -= mBuffer.frameCount;
             if (phaseFraction >= phaseWrapLimit) { // read in data
                 mInBuffer.template readAdvance<CHANNELS>(
-                        impulse, c.mHalfNumCoefs,
+                        impulse, bufferHalfNumCoefs,
                         reinterpret_cast<TI*>(mBuffer.raw), inputIndex);
                 inputIndex++;
                 phaseFraction -= phaseWrapLimit;
@@ -546,7 +821,7 @@ void AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
                         break;
                     }
                     mInBuffer.template readAdvance<CHANNELS>(
-                            impulse, c.mHalfNumCoefs,
+                            impulse, bufferHalfNumCoefs,
                             reinterpret_cast<TI*>(mBuffer.raw), inputIndex);
                     inputIndex++;
                     phaseFraction -= phaseWrapLimit;
@@ -556,7 +831,7 @@ void AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
         const TI* const in = reinterpret_cast<const TI*>(mBuffer.raw);
         const size_t frameCount = mBuffer.frameCount;
         const int coefShift = c.mShift;
-        const int halfNumCoefs = c.mHalfNumCoefs;
+        const int halfNumCoefs = bufferHalfNumCoefs;
         const TO* const volumeSimd = mVolumeSimd;
 
         // main processing loop
@@ -571,11 +846,19 @@ void AudioResamplerDyn<TC, TI, TO>::resample(TO* out, size_t outFrameCount,
             //        "  phaseFraction:%u  phaseWrapLimit:%u",
             //        inFrameCount, outputIndex, outFrameCount, phaseFraction, phaseWrapLimit);
             ALOG_ASSERT(phaseFraction < phaseWrapLimit);
-            fir<CHANNELS, LOCKED, STRIDE>(
-                    &out[outputIndex],
-                    phaseFraction, phaseWrapLimit,
-                    coefShift, halfNumCoefs, coefs,
-                    impulse, volumeSimd);
+            if (FADE) {
+                fadeFir<CHANNELS, STRIDE>(
+                        &out[outputIndex],
+                        phaseFraction, phaseWrapLimit,
+                        coefShift, halfNumCoefs,
+                        impulse, volumeSimd);
+            } else {
+                fir<CHANNELS, LOCKED, STRIDE>(
+                        &out[outputIndex],
+                        phaseFraction, phaseWrapLimit,
+                        coefShift, halfNumCoefs, coefs,
+                        impulse, volumeSimd);
+            }
 
             outputIndex += OUTPUT_CHANNELS;
 
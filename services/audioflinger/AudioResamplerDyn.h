@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <cutils/log.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
 
 #include "AudioResampler.h"
 
@@ -55,6 +57,11 @@ public:
     virtual void resample(int32_t* out, size_t outFrameCount,
             AudioBufferProvider* provider);
 
+protected:
+    virtual bool canSetQuality(src_quality quality) const;
+
+    virtual void onQualityChanged(src_quality oldQuality);
+
 private:
 
     class Constants { // stores the filter constants.
@@ -79,6 +86,10 @@ private:
 
         void resize(int CHANNELS, int halfNumCoefs);
 
+        // resizes the state buffer for a new filter length, keeping the most recent
+        // input samples at the head (impulse+halfNumCoefs) of the buffer.
+        void resizeKeepHead(int CHANNELS, int halfNumCoefs, int newHalfNumCoefs);
+
         // used for direct management of the mImpulse pointer
         inline TI* getImpulse() {
             return mImpulse;
@@ -107,10 +118,58 @@ private:
         size_t mStateCount; // size of state in units of TI.
     };
 
+    // Process-wide cache of designed filter banks, shared by all resamplers with the
+    // coefficient type TC. A filter bank is immutable once designed and is reference counted;
+    // a few unreferenced filter banks are kept so a new track at a common rate starts quickly.
+    class FilterCache {
+    public:
+        // returns a filter bank of (L+1)*halfNumCoefs coefficients, designing it if needed.
+        static const TC* acquire(int L, int halfNumCoefs, double stopBandAtten, double fcr);
+        static void release(const TC* coefs);
+
+    private:
+        struct Entry {
+            int    mL;
+            int    mHalfNumCoefs;
+            double mStopBandAtten;
+            double mFcr;
+            TC*    mCoefs;
+            int    mRefCount;
+        };
+
+        // maximum number of unreferenced filter banks kept, oldest released evicted first.
+        static const size_t kMaxUnusedEntries = 4;
+
+        static ssize_t find_l(int L, int halfNumCoefs, double stopBandAtten, double fcr);
+
+        static Mutex         sLock;
+        static Vector<Entry> sEntries; // unreferenced entries are ordered by release time
+    };
+
     void createKaiserFir(Constants &c, double stopBandAtten,
             int inSampleRate, int outSampleRate, double tbwCheat);
 
-    template<int CHANNELS, bool LOCKED, int STRIDE>
+    // designs the filter for the current quality and this input sample rate.
+    void createFilter(int32_t inSampleRate);
+
+    // updates the phase, input buffer and resample functions for the current filter.
+    void applyFilter(uint32_t oldPhaseWrapLimit);
+
+    // ends the crossfade from the filter of the previous quality.
+    void finishFade();
+
+    // computes one output frame as the crossfade of the previous and current filters.
+    template<int CHANNELS, int STRIDE>
+    inline void fadeFir(TO* const out, const uint32_t phase, const uint32_t phaseWrapLimit,
+            const int coefShift, const int halfNumCoefs, const TI* const impulse,
+            const TO* const volumeLR);
+
+    // duration of the crossfade between the filters of two qualities
+    static const int kFadeTimeMs = 20;
+
+    // FADE processes the crossfade after a quality change, with the input buffer sized
+    // for the longer of the two filters.
+    template<int CHANNELS, bool LOCKED, int STRIDE, bool FADE>
     void resample(TO* out, size_t outFrameCount, AudioBufferProvider* provider);
 
     // define a pointer to member function type for resample
@@ -124,7 +183,14 @@ private:
      resample_ABP_t mResampleFunc;     // called function for resampling
             int32_t mFilterSampleRate; // designed filter sample rate.
         src_quality mFilterQuality;    // designed filter quality.
-              void* mCoefBuffer;       // if a filter is created, this is not null
+          const TC* mCoefBuffer;       // if a filter is acquired from the cache, not null
+
+    // crossfade from the filter of the previous quality, active if mFadeConstants.mFirCoefs
+    // is not null. The previous filter has the same phases as the current one.
+          Constants mFadeConstants;    // previous filter, acquired from the cache
+     resample_ABP_t mFadeResampleFunc; // called function for resampling during the crossfade
+           uint32_t mFadeFrame;        // output frames since the start of the crossfade
+           uint32_t mFadeFrameCount;   // duration of the crossfade in output frames
 };
 
 }; // namespace android
@@ -17,8 +17,6 @@
 #ifndef ANDROID_AUDIO_RESAMPLER_FIR_OPS_H
 #define ANDROID_AUDIO_RESAMPLER_FIR_OPS_H
 
-namespace android {
-
 #if defined(__arm__) && !defined(__thumb__)
 #define USE_INLINE_ASSEMBLY (true)
 #else
@@ -32,6 +30,15 @@ namespace android {
 #define USE_NEON (false)
 #endif
 
+#if !USE_NEON && defined(__SSE2__)
+#define USE_SSE2 (true)
+#include <emmintrin.h>
+#else
+#define USE_SSE2 (false)
+#endif
+
+namespace android {
+
 template<typename T, typename U>
 struct is_same
 {
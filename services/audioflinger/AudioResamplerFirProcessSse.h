@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_SSE_H
+#define ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_SSE_H
+
+namespace android {
+
+// depends on AudioResamplerFirOps.h, AudioResamplerFirProcess.h
+
+#if USE_SSE2
+//
+// SSE2 specializations are enabled for Process() and ProcessL()
+//
+// The integer variants are bit-exact with the C code in AudioResamplerFirProcess.h,
+// as all products are exact and the int32_t accumulation wraps identically in any order.
+// The float variants differ from the C code only by the order of summation.
+//
+// Not accelerated: interpolated Process() with int32_t coefficients,
+// whose 32x32 bit lerp multiply has no efficient SSE2 equivalent.
+
+// reverse the order of 8 int16_t
+static inline __m128i reverse16x8_sse2(__m128i v)
+{
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+// int16_t coefficient interpolation, identical to interpolate<int16_t, uint32_t>()
+static inline __m128i interpolate16x8_sse2(__m128i coef_0, __m128i coef_1, __m128i lerp)
+{
+    const __m128i delta = _mm_sub_epi16(coef_1, coef_0);
+    const __m128i hi = _mm_mulhi_epi16(lerp, delta);
+    const __m128i lo = _mm_mullo_epi16(lerp, delta);
+    // low 16 bits of (lerp * delta) >> 15
+    const __m128i value = _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15));
+    return _mm_add_epi16(value, coef_0);
+}
+
+// multiply 8 int16_t samples by 8 int16_t coefs, accumulate exact int32_t products
+static inline __m128i mulAcc16x8_sse2(__m128i accum, __m128i samples, __m128i coefs)
+{
+    const __m128i lo = _mm_mullo_epi16(samples, coefs);
+    const __m128i hi = _mm_mulhi_epi16(samples, coefs);
+    accum = _mm_add_epi32(accum, _mm_unpacklo_epi16(lo, hi));
+    return _mm_add_epi32(accum, _mm_unpackhi_epi16(lo, hi));
+}
+
+// ((int64_t)coefs * samples) >> 16 for 4 int32_t coefs, identical to mulAdd(int16_t, int32_t).
+// samples must be int16_t values zero extended into the int32_t lanes.
+static inline __m128i mulShr16x4_sse2(__m128i coefs, __m128i samples)
+{
+    // coef = hi * 65536 + lo, where hi is signed and lo unsigned 16 bits.
+    const __m128i hiProduct = _mm_madd_epi16(_mm_srai_epi32(coefs, 16), samples);
+    // (lo * sample) >> 16, correcting the signed multiply for lo >= 32768.
+    __m128i loProduct = _mm_add_epi16(_mm_mulhi_epi16(coefs, samples),
+            _mm_and_si128(_mm_srai_epi16(coefs, 15), samples));
+    loProduct = _mm_srai_epi32(_mm_slli_epi32(loProduct, 16), 16);
+    return _mm_add_epi32(hiProduct, loProduct);
+}
+
+static inline int32_t sum32x4_sse2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static inline float sumf4_sse2(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+// int16_t coefficients, int16_t samples, int32_t output
+template <int CHANNELS, bool LOCKED>
+static inline
+void ProcessSse2(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const __m128i lerp = _mm_set1_epi16(static_cast<int16_t>(lerpP));
+    __m128i accum = _mm_setzero_si128();
+
+    if (CHANNELS == 1) {
+        sP -= 7;
+        for (int i = 0; i < count; i += 8) {
+            __m128i cP = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsP));
+            __m128i cN = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsN));
+            if (!LOCKED) {
+                cP = interpolate16x8_sse2(cP, _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(coefsP + count)), lerp);
+                cN = interpolate16x8_sse2(_mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(coefsN + count)), cN, lerp);
+            }
+            // the positive half runs backwards through the samples
+            const __m128i xP = reverse16x8_sse2(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(sP)));
+            const __m128i xN = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sN));
+            accum = _mm_add_epi32(accum, _mm_madd_epi16(xP, cP));
+            accum = _mm_add_epi32(accum, _mm_madd_epi16(xN, cN));
+            coefsP += 8;
+            coefsN += 8;
+            sP -= 8;
+            sN += 8;
+        }
+        const int32_t l = sum32x4_sse2(accum);
+        out[0] += volumeAdjust(l, volumeLR[0]);
+        out[1] += volumeAdjust(l, volumeLR[1]);
+    } else { /* CHANNELS == 2 */
+        sP -= 6;
+        for (int i = 0; i < count; i += 4) {
+            __m128i cP = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coefsP));
+            __m128i cN = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coefsN));
+            if (!LOCKED) {
+                cP = interpolate16x8_sse2(cP, _mm_loadl_epi64(
+                        reinterpret_cast<const __m128i*>(coefsP + count)), lerp);
+                cN = interpolate16x8_sse2(_mm_loadl_epi64(
+                        reinterpret_cast<const __m128i*>(coefsN + count)), cN, lerp);
+            }
+            // positive half: frames 3, 2, 1, 0 in memory order, coefs c3 c3 c2 c2 c1 c1 c0 c0
+            cP = _mm_shufflelo_epi16(cP, _MM_SHUFFLE(0, 1, 2, 3));
+            accum = mulAcc16x8_sse2(accum,
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(sP)),
+                    _mm_unpacklo_epi16(cP, cP));
+            // negative half: frames 0, 1, 2, 3, coefs c0 c0 c1 c1 c2 c2 c3 c3
+            accum = mulAcc16x8_sse2(accum,
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(sN)),
+                    _mm_unpacklo_epi16(cN, cN));
+            coefsP += 4;
+            coefsN += 4;
+            sP -= 8;
+            sN += 8;
+        }
+        // accum is L R L R
+        accum = _mm_add_epi32(accum, _mm_shuffle_epi32(accum, _MM_SHUFFLE(1, 0, 3, 2)));
+        const int32_t l = _mm_cvtsi128_si32(accum);
+        const int32_t r = _mm_cvtsi128_si32(_mm_shuffle_epi32(accum, _MM_SHUFFLE(1, 1, 1, 1)));
+        out[0] += volumeAdjust(l, volumeLR[0]);
+        out[1] += volumeAdjust(r, volumeLR[1]);
+    }
+}
+
+// int32_t coefficients, int16_t samples, int32_t output, locked phase only
+template <int CHANNELS>
+static inline
+void ProcessLSse2(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i accum = _mm_setzero_si128();
+
+    if (CHANNELS == 1) {
+        sP -= 3;
+        for (int i = 0; i < count; i += 4) {
+            const __m128i cP = _mm_shuffle_epi32(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsP)),
+                    _MM_SHUFFLE(0, 1, 2, 3));
+            const __m128i cN = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsN));
+            const __m128i xP = _mm_unpacklo_epi16(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(sP)), zero);
+            const __m128i xN = _mm_unpacklo_epi16(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(sN)), zero);
+            accum = _mm_add_epi32(accum, mulShr16x4_sse2(cP, xP));
+            accum = _mm_add_epi32(accum, mulShr16x4_sse2(cN, xN));
+            coefsP += 4;
+            coefsN += 4;
+            sP -= 4;
+            sN += 4;
+        }
+        const int32_t l = sum32x4_sse2(accum);
+        out[0] += volumeAdjust(l, volumeLR[0]);
+        out[1] += volumeAdjust(l, volumeLR[1]);
+    } else { /* CHANNELS == 2 */
+        sP -= 6;
+        for (int i = 0; i < count; i += 4) {
+            const __m128i cP = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsP));
+            const __m128i cN = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefsN));
+            // positive half: frames 3, 2, 1, 0 in memory order
+            const __m128i xP = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sP));
+            accum = _mm_add_epi32(accum, mulShr16x4_sse2(
+                    _mm_shuffle_epi32(cP, _MM_SHUFFLE(2, 2, 3, 3)), _mm_unpacklo_epi16(xP, zero)));
+            accum = _mm_add_epi32(accum, mulShr16x4_sse2(
+                    _mm_shuffle_epi32(cP, _MM_SHUFFLE(0, 0, 1, 1)), _mm_unpackhi_epi16(xP, zero)));
+            // negative half: frames 0, 1, 2, 3
+            const __m128i xN = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sN));
+            accum = _mm_add_epi32(accum, mulShr16x4_sse2(
+                    _mm_shuffle_epi32(cN, _MM_SHUFFLE(1, 1, 0, 0)), _mm_unpacklo_epi16(xN, zero)));
+            accum = _mm_add_epi32(accum, mulShr16x4_sse2(
+                    _mm_shuffle_epi32(cN, _MM_SHUFFLE(3, 3, 2, 2)), _mm_unpackhi_epi16(xN, zero)));
+            coefsP += 4;
+            coefsN += 4;
+            sP -= 8;
+            sN += 8;
+        }
+        accum = _mm_add_epi32(accum, _mm_shuffle_epi32(accum, _MM_SHUFFLE(1, 0, 3, 2)));
+        const int32_t l = _mm_cvtsi128_si32(accum);
+        const int32_t r = _mm_cvtsi128_si32(_mm_shuffle_epi32(accum, _MM_SHUFFLE(1, 1, 1, 1)));
+        out[0] += volumeAdjust(l, volumeLR[0]);
+        out[1] += volumeAdjust(r, volumeLR[1]);
+    }
+}
+
+// float coefficients, float samples, float output
+template <int CHANNELS, bool LOCKED>
+static inline
+void ProcessSse2(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* const volumeLR)
+{
+    const __m128 lerp = _mm_set1_ps(lerpP);
+    __m128 accum = _mm_setzero_ps();
+
+    if (CHANNELS == 1) {
+        sP -= 3;
+        for (int i = 0; i < count; i += 4) {
+            __m128 cP = _mm_loadu_ps(coefsP);
+            __m128 cN = _mm_loadu_ps(coefsN);
+            if (!LOCKED) {
+                cP = _mm_add_ps(_mm_mul_ps(lerp, _mm_sub_ps(_mm_loadu_ps(coefsP + count), cP)),
+                        cP);
+                const __m128 cN1 = _mm_loadu_ps(coefsN + count);
+                cN = _mm_add_ps(_mm_mul_ps(lerp, _mm_sub_ps(cN, cN1)), cN1);
+            }
+            __m128 xP = _mm_loadu_ps(sP);
+            xP = _mm_shuffle_ps(xP, xP, _MM_SHUFFLE(0, 1, 2, 3));
+            accum = _mm_add_ps(accum, _mm_mul_ps(xP, cP));
+            accum = _mm_add_ps(accum, _mm_mul_ps(_mm_loadu_ps(sN), cN));
+            coefsP += 4;
+            coefsN += 4;
+            sP -= 4;
+            sN += 4;
+        }
+        const float l = sumf4_sse2(accum);
+        out[0] += volumeAdjust(l, volumeLR[0]);
+        out[1] += volumeAdjust(l, volumeLR[1]);
+    } else { /* CHANNELS == 2 */
+        for (int i = 0; i < count; i += 4) {
+            __m128 cP = _mm_loadu_ps(coefsP);
+            __m128 cN = _mm_loadu_ps(coefsN);
+            if (!LOCKED) {
+                cP = _mm_add_ps(_mm_mul_ps(lerp, _mm_sub_ps(_mm_loadu_ps(coefsP + count), cP)),
+                        cP);
+                const __m128 cN1 = _mm_loadu_ps(coefsN + count);
+                cN = _mm_add_ps(_mm_mul_ps(lerp, _mm_sub_ps(cN, cN1)), cN1);
+            }
+            // positive half: frames 1, 0 then 3, 2 in memory order
+            accum = _mm_add_ps(accum, _mm_mul_ps(_mm_loadu_ps(sP - 2),
+                    _mm_shuffle_ps(cP, cP, _MM_SHUFFLE(0, 0, 1, 1))));
+            accum = _mm_add_ps(accum, _mm_mul_ps(_mm_loadu_ps(sP - 6),
+                    _mm_shuffle_ps(cP, cP, _MM_SHUFFLE(2, 2, 3, 3))));
+            // negative half: frames 0, 1 then 2, 3
+            accum = _mm_add_ps(accum, _mm_mul_ps(_mm_loadu_ps(sN),
+                    _mm_shuffle_ps(cN, cN, _MM_SHUFFLE(1, 1, 0, 0))));
+            accum = _mm_add_ps(accum, _mm_mul_ps(_mm_loadu_ps(sN + 4),
+                    _mm_shuffle_ps(cN, cN, _MM_SHUFFLE(3, 3, 2, 2))));
+            coefsP += 4;
+            coefsN += 4;
+            sP -= 8;
+            sN += 8;
+        }
+        // accum is L R L R
+        accum = _mm_add_ps(accum, _mm_movehl_ps(accum, accum));
+        const float l = _mm_cvtss_f32(accum);
+        const float r = _mm_cvtss_f32(_mm_shuffle_ps(accum, accum, _MM_SHUFFLE(1, 1, 1, 1)));
+        out[0] += volumeAdjust(l, volumeLR[0]);
+        out[1] += volumeAdjust(r, volumeLR[1]);
+    }
+}
+
+template <>
+inline void ProcessL<1, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    ProcessSse2<1, true>(out, count, coefsP, coefsN, sP, sN, 0, volumeLR);
+}
+
+template <>
+inline void ProcessL<2, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    ProcessSse2<2, true>(out, count, coefsP, coefsN, sP, sN, 0, volumeLR);
+}
+
+template <>
+inline void Process<1, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* coefsP1 __unused,
+        const int16_t* coefsN1 __unused,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    ProcessSse2<1, false>(out, count, coefsP, coefsN, sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void Process<2, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* coefsP1 __unused,
+        const int16_t* coefsN1 __unused,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    ProcessSse2<2, false>(out, count, coefsP, coefsN, sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void ProcessL<1, 16>(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    ProcessLSse2<1>(out, count, coefsP, coefsN, sP, sN, volumeLR);
+}
+
+template <>
+inline void ProcessL<2, 16>(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    ProcessLSse2<2>(out, count, coefsP, coefsN, sP, sN, volumeLR);
+}
+
+template <>
+inline void ProcessL<1, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* sP,
+        const float* sN,
+        const float* const volumeLR)
+{
+    ProcessSse2<1, true>(out, count, coefsP, coefsN, sP, sN, 0.f, volumeLR);
+}
+
+template <>
+inline void ProcessL<2, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* sP,
+        const float* sN,
+        const float* const volumeLR)
+{
+    ProcessSse2<2, true>(out, count, coefsP, coefsN, sP, sN, 0.f, volumeLR);
+}
+
+template <>
+inline void Process<1, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* coefsP1 __unused,
+        const float* coefsN1 __unused,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* const volumeLR)
+{
+    ProcessSse2<1, false>(out, count, coefsP, coefsN, sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void Process<2, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* coefsP1 __unused,
+        const float* coefsN1 __unused,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* const volumeLR)
+{
+    ProcessSse2<2, false>(out, count, coefsP, coefsN, sP, sN, lerpP, volumeLR);
+}
+
+#endif //USE_SSE2
+
+}; // namespace android
+
+#endif /*ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_SSE_H*/
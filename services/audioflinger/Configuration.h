@@ -42,4 +42,9 @@
 // uncomment to log CPU statistics every n wall clock seconds
 //#define DEBUG_CPU_USAGE 10
 
+// uncomment to process effect chains in AUDIO_FORMAT_PCM_FLOAT rather than AUDIO_FORMAT_PCM_16_BIT.
+// Effect engines which do not accept float are run through 16 bit conversion buffers.
+// Requires AudioFlinger::kEnableExtendedPrecision.
+#define FLOAT_EFFECT_CHAIN
+
 #endif // ANDROID_AUDIOFLINGER_CONFIGURATION_H
@@ -63,7 +63,13 @@ AudioFlinger::EffectModule::EffectModule(ThreadBase *thread,
     : mPinned(sessionId > AUDIO_SESSION_OUTPUT_MIX),
       mThread(thread), mChain(chain), mId(id), mSessionId(sessionId),
       mDescriptor(*desc),
-      // mConfig is set by configure() and not used before then
+      // mConfig is cleared below and set by configure()
+      mInBuffer(NULL), mOutBuffer(NULL),
+#ifdef FLOAT_EFFECT_CHAIN
+      mSupportsFloat(false),
+      mInConversionBuffer(NULL), mOutConversionBuffer(NULL),
+      mInConversionSamples(0), mOutConversionSamples(0),
+#endif
       mEffectInterface(NULL),
       mStatus(NO_INIT), mState(IDLE),
       // mMaxDisableWaitCnt is set by configure() and not used before then
@@ -74,6 +80,8 @@ AudioFlinger::EffectModule::EffectModule(ThreadBase *thread,
     ALOGV("Constructor %p", this);
     int lStatus;
 
+    memset(&mConfig, 0, sizeof(mConfig));
+
     // create effect engine from effect factory
     mStatus = EffectCreate(&desc->uuid, sessionId, thread->id(), &mEffectInterface);
 
@@ -102,6 +110,10 @@ AudioFlinger::EffectModule::~EffectModule()
         // release effect engine
         EffectRelease(mEffectInterface);
     }
+#ifdef FLOAT_EFFECT_CHAIN
+    delete[] mInConversionBuffer;
+    delete[] mOutConversionBuffer;
+#endif
 }
 
 status_t AudioFlinger::EffectModule::addHandle(EffectHandle *handle)
@@ -269,44 +281,97 @@ void AudioFlinger::EffectModule::process()
     }
 
     if (isProcessEnabled()) {
+        const bool auxType =
+                (mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY;
+#ifdef FLOAT_EFFECT_CHAIN
+        if (auxType && mSupportsFloat) {
+            // do 32 bit to float conversion for auxiliary effect input buffer.
+            // The mixer accumulates 16 bit samples scaled by a U4.12 volume, i.e. Q4.27.
+            memcpy_to_float_from_q4_27(mConfig.inputCfg.buffer.f32,
+                                       mConfig.inputCfg.buffer.s32,
+                                       mConfig.inputCfg.buffer.frameCount);
+        } else
+#endif
         // do 32 bit to 16 bit conversion for auxiliary effect input buffer
-        if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
+        if (auxType) {
             ditherAndClamp(mConfig.inputCfg.buffer.s32,
                                         mConfig.inputCfg.buffer.s32,
                                         mConfig.inputCfg.buffer.frameCount/2);
         }
 
+#ifdef FLOAT_EFFECT_CHAIN
+        // the engine only accepts 16 bit: convert the float chain buffers on the way in,
+        // including the output buffer when the engine accumulates into it
+        if (!mSupportsFloat) {
+            if (!auxType) {
+                memcpy_to_i16_from_float(mInConversionBuffer, mInBuffer, mInConversionSamples);
+            }
+            if (mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
+                memcpy_to_i16_from_float(mOutConversionBuffer, mOutBuffer,
+                                         mOutConversionSamples);
+            }
+        }
+#endif
+
         // do the actual processing in the effect engine
         int ret = (*mEffectInterface)->process(mEffectInterface,
                                                &mConfig.inputCfg.buffer,
                                                &mConfig.outputCfg.buffer);
 
+#ifdef FLOAT_EFFECT_CHAIN
+        if (!mSupportsFloat) {
+            memcpy_to_float_from_i16(mOutBuffer, mConfig.outputCfg.buffer.s16,
+                                     mOutConversionSamples);
+        }
+#endif
+
         // force transition to IDLE state when engine is ready
         if (mState == STOPPED && ret == -ENODATA) {
             mDisableWaitCnt = 1;
         }
 
         // clear auxiliary effect input buffer for next accumulation
-        if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
+        if (auxType) {
             memset(mConfig.inputCfg.buffer.raw, 0,
                    mConfig.inputCfg.buffer.frameCount*sizeof(int32_t));
         }
     } else if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_INSERT &&
-                mConfig.inputCfg.buffer.raw != mConfig.outputCfg.buffer.raw) {
+                mInBuffer != mOutBuffer) {
         // If an insert effect is idle and input buffer is different from output buffer,
         // accumulate input onto output
         sp<EffectChain> chain = mChain.promote();
         if (chain != 0 && chain->activeTrackCnt() != 0) {
             size_t frameCnt = mConfig.inputCfg.buffer.frameCount * 2;  //always stereo here
-            int16_t *in = mConfig.inputCfg.buffer.s16;
-            int16_t *out = mConfig.outputCfg.buffer.s16;
+            const effect_buffer_t *in = mInBuffer;
+            effect_buffer_t *out = mOutBuffer;
             for (size_t i = 0; i < frameCnt; i++) {
+#ifdef FLOAT_EFFECT_CHAIN
+                out[i] += in[i];
+#else
                 out[i] = clamp16((int32_t)out[i] + (int32_t)in[i]);
+#endif
             }
         }
     }
 }
 
+#ifdef FLOAT_EFFECT_CHAIN
+// Must be called with EffectChain::mLock held
+void AudioFlinger::EffectModule::updateConversionBuffers_l(size_t inSamples, size_t outSamples)
+{
+    if (inSamples != mInConversionSamples) {
+        delete[] mInConversionBuffer;
+        mInConversionBuffer = new int16_t[inSamples];
+        mInConversionSamples = inSamples;
+    }
+    if (outSamples != mOutConversionSamples) {
+        delete[] mOutConversionBuffer;
+        mOutConversionBuffer = new int16_t[outSamples];
+        mOutConversionSamples = outSamples;
+    }
+}
+#endif
+
 void AudioFlinger::EffectModule::reset_l()
 {
     if (mStatus != NO_ERROR || mEffectInterface == NULL) {
@@ -342,8 +407,17 @@ status_t AudioFlinger::EffectModule::configure()
         mConfig.inputCfg.channels = channelMask;
     }
     mConfig.outputCfg.channels = channelMask;
-    mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
-    mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    // pre processing effects on record threads are not run through process()
+    // and keep the 16 bit configuration
+    if (thread->type() != ThreadBase::RECORD) {
+        mConfig.inputCfg.format = EFFECT_BUFFER_FORMAT;
+        mConfig.outputCfg.format = EFFECT_BUFFER_FORMAT;
+    } else {
+        mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+        mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    }
+    mConfig.inputCfg.buffer.raw = mInBuffer;
+    mConfig.outputCfg.buffer.raw = mOutBuffer;
     mConfig.inputCfg.samplingRate = thread->sampleRate();
     mConfig.outputCfg.samplingRate = mConfig.inputCfg.samplingRate;
     mConfig.inputCfg.bufferProvider.cookie = NULL;
@@ -362,7 +436,7 @@ status_t AudioFlinger::EffectModule::configure()
     // Auxiliary effect:
     //      accumulates in output buffer: input buffer != output buffer
     // Therefore: accumulate <=> input buffer != output buffer
-    if (mConfig.inputCfg.buffer.raw != mConfig.outputCfg.buffer.raw) {
+    if (mInBuffer != mOutBuffer) {
         mConfig.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_ACCUMULATE;
     } else {
         mConfig.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_WRITE;
@@ -387,6 +461,37 @@ status_t AudioFlinger::EffectModule::configure()
         status = cmdStatus;
     }
 
+#ifdef FLOAT_EFFECT_CHAIN
+    mSupportsFloat = (status == 0 && mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT);
+    if (status != 0 && mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+        // the engine rejected float: run it on 16 bit copies of the chain buffers.
+        // The input buffer of an auxiliary effect is converted in place by process().
+        ALOGV("configure() %s does not support float, using 16 bit conversion buffers",
+                mDescriptor.name);
+        const size_t frameCount = mConfig.inputCfg.buffer.frameCount;
+        updateConversionBuffers_l(
+                frameCount * audio_channel_count_from_out_mask(mConfig.inputCfg.channels),
+                frameCount * audio_channel_count_from_out_mask(mConfig.outputCfg.channels));
+        mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+        mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+        if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) != EFFECT_FLAG_TYPE_AUXILIARY) {
+            mConfig.inputCfg.buffer.s16 = mInConversionBuffer;
+        }
+        mConfig.outputCfg.buffer.s16 = mInBuffer == mOutBuffer ?
+                mInConversionBuffer : mOutConversionBuffer;
+        size = sizeof(int);
+        status = (*mEffectInterface)->command(mEffectInterface,
+                                                       EFFECT_CMD_SET_CONFIG,
+                                                       sizeof(effect_config_t),
+                                                       &mConfig,
+                                                       &size,
+                                                       &cmdStatus);
+        if (status == 0) {
+            status = cmdStatus;
+        }
+    }
+#endif
+
     if (status == 0 &&
             (memcmp(&mDescriptor.type, SL_IID_VISUALIZATION, sizeof(effect_uuid_t)) == 0)) {
         uint32_t buf32[sizeof(effect_param_t) / sizeof(uint32_t) + 2];
@@ -1349,7 +1454,7 @@ AudioFlinger::EffectChain::EffectChain(ThreadBase *thread,
 AudioFlinger::EffectChain::~EffectChain()
 {
     if (mOwnInBuffer) {
-        delete mInBuffer;
+        delete[] mInBuffer;
     }
 
 }
@@ -1410,12 +1515,10 @@ void AudioFlinger::EffectChain::clearInputBuffer()
 // Must be called with EffectChain::mLock locked
 void AudioFlinger::EffectChain::clearInputBuffer_l(sp<ThreadBase> thread)
 {
-    // TODO: This will change in the future, depending on multichannel
-    // and sample format changes for effects.
-    // Currently effects processing is only available for stereo, AUDIO_FORMAT_PCM_16_BIT
-    // (4 bytes frame size)
+    // TODO: This will change in the future, depending on multichannel changes for effects.
+    // Currently effects processing is only available for stereo, EFFECT_BUFFER_FORMAT
     const size_t frameSize =
-            audio_bytes_per_sample(AUDIO_FORMAT_PCM_16_BIT) * min(FCC_2, thread->channelCount());
+            audio_bytes_per_sample(EFFECT_BUFFER_FORMAT) * min(FCC_2, thread->channelCount());
     memset(mInBuffer, 0, thread->frameCount() * frameSize);
 }
 
@@ -1489,7 +1592,7 @@ status_t AudioFlinger::EffectChain::addEffect_l(const sp<EffectModule>& effect)
         size_t numSamples = thread->frameCount();
         int32_t *buffer = new int32_t[numSamples];
         memset(buffer, 0, numSamples * sizeof(int32_t));
-        effect->setInBuffer((int16_t *)buffer);
+        effect->setInBuffer((effect_buffer_t *)buffer);
         // auxiliary effects output samples to chain input buffer for further processing
         // by insert effects
         effect->setOutBuffer(mInBuffer);
@@ -1596,7 +1699,7 @@ size_t AudioFlinger::EffectChain::removeEffect_l(const sp<EffectModule>& effect)
                 mEffects[i]->stop();
             }
             if (type == EFFECT_FLAG_TYPE_AUXILIARY) {
-                delete[] effect->inBuffer();
+                delete[] reinterpret_cast<int32_t *>(effect->inBuffer());
             } else {
                 if (i == size - 1 && i != 0) {
                     mEffects[i - 1]->setOutBuffer(mOutBuffer);
@@ -84,10 +84,13 @@ public:
     bool isEnabled() const;
     bool isProcessEnabled() const;
 
-    void        setInBuffer(int16_t *buffer) { mConfig.inputCfg.buffer.s16 = buffer; }
-    int16_t     *inBuffer() { return mConfig.inputCfg.buffer.s16; }
-    void        setOutBuffer(int16_t *buffer) { mConfig.outputCfg.buffer.s16 = buffer; }
-    int16_t     *outBuffer() { return mConfig.outputCfg.buffer.s16; }
+    // The chain buffers are in EFFECT_BUFFER_FORMAT, except for the input buffer of an
+    // auxiliary effect which holds 32 bit samples accumulated by the mixer.
+    // configure() must be called after changing them.
+    void        setInBuffer(effect_buffer_t *buffer) { mInBuffer = buffer; }
+    effect_buffer_t *inBuffer() const { return mInBuffer; }
+    void        setOutBuffer(effect_buffer_t *buffer) { mOutBuffer = buffer; }
+    effect_buffer_t *outBuffer() const { return mOutBuffer; }
     void        setChain(const wp<EffectChain>& chain) { mChain = chain; }
     void        setThread(const wp<ThreadBase>& thread) { mThread = thread; }
     const wp<ThreadBase>& thread() { return mThread; }
@@ -136,6 +139,9 @@ protected:
     status_t start_l();
     status_t stop_l();
     status_t remove_effect_from_hal_l();
+#ifdef FLOAT_EFFECT_CHAIN
+    void     updateConversionBuffers_l(size_t inSamples, size_t outSamples);
+#endif
 
 mutable Mutex               mLock;      // mutex for process, commands and handles list protection
     wp<ThreadBase>      mThread;    // parent thread
@@ -144,6 +150,16 @@ mutable Mutex               mLock;      // mutex for process, commands and handl
     const int           mSessionId; // audio session ID
     const effect_descriptor_t mDescriptor;// effect descriptor received from effect engine
     effect_config_t     mConfig;    // input and output audio configuration
+    effect_buffer_t     *mInBuffer; // chain buffer read by the effect
+    effect_buffer_t     *mOutBuffer;// chain buffer written or accumulated to by the effect
+#ifdef FLOAT_EFFECT_CHAIN
+    bool                mSupportsFloat; // effect engine accepted AUDIO_FORMAT_PCM_FLOAT
+    // 16 bit copies of the chain buffers passed to engines which do not support float
+    int16_t             *mInConversionBuffer;
+    int16_t             *mOutConversionBuffer;
+    size_t              mInConversionSamples;
+    size_t              mOutConversionSamples;
+#endif
     effect_handle_t  mEffectInterface; // Effect module C API
     status_t            mStatus;    // initialization status
     effect_state        mState;     // current activation state
@@ -278,17 +294,17 @@ public:
     void setMode_l(audio_mode_t mode);
     void setAudioSource_l(audio_source_t source);
 
-    void setInBuffer(int16_t *buffer, bool ownsBuffer = false) {
+    void setInBuffer(effect_buffer_t *buffer, bool ownsBuffer = false) {
         mInBuffer = buffer;
         mOwnInBuffer = ownsBuffer;
     }
-    int16_t *inBuffer() const {
+    effect_buffer_t *inBuffer() const {
         return mInBuffer;
     }
-    void setOutBuffer(int16_t *buffer) {
+    void setOutBuffer(effect_buffer_t *buffer) {
         mOutBuffer = buffer;
     }
-    int16_t *outBuffer() const {
+    effect_buffer_t *outBuffer() const {
         return mOutBuffer;
     }
 
@@ -363,8 +379,8 @@ protected:
     Mutex mLock;                // mutex protecting effect list
     Vector< sp<EffectModule> > mEffects; // list of effect modules
     int mSessionId;             // audio session ID
-    int16_t *mInBuffer;         // chain input buffer
-    int16_t *mOutBuffer;        // chain output buffer
+    effect_buffer_t *mInBuffer;  // chain input buffer
+    effect_buffer_t *mOutBuffer; // chain output buffer
 
     // 'volatile' here means these are accessed with atomic operations instead of mutex
     volatile int32_t mActiveTrackCnt;    // number of active tracks connected
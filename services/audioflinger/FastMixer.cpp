@@ -26,7 +26,9 @@
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
 #include "Configuration.h"
+#include <errno.h>
 #include <time.h>
+#include <unistd.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 #include <system/audio.h>
@@ -64,6 +66,8 @@ FastMixer::FastMixer() : FastThread(),
     sampleRate(0),
     fastTracksGen(0),
     totalNativeFramesWritten(0),
+    // mUnderrunBurst
+    // mFirstFrameWait
     // timestamp
     nativeFramesWrittenButNotPresented(0)   // the = 0 is to silence the compiler
 {
@@ -80,6 +84,8 @@ FastMixer::FastMixer() : FastThread(),
     for (i = 0; i < FastMixerState::kMaxFastTracks; ++i) {
         fastTrackNames[i] = -1;
         generations[i] = 0;
+        mUnderrunBurst[i] = 0;
+        mFirstFrameWait[i] = 0;
     }
 #ifdef FAST_MIXER_STATISTICS
     oldLoad.tv_sec = 0;
@@ -271,6 +277,13 @@ void FastMixer::onStateChange()
                         (void *)(uintptr_t)mSinkChannelMask);
                 mixer->enable(name);
             }
+            // histograms describe the track now in this slot, except for time to first frame;
+            // a track that is only re-added because the mixer was reconfigured keeps them
+            if (fastTrack->mGeneration != generations[i]) {
+                dumpState->mTracks[i].mHistograms.resetTrack();
+                mUnderrunBurst[i] = 0;
+                mFirstFrameWait[i] = 1;
+            }
             generations[i] = fastTrack->mGeneration;
         }
 
@@ -282,7 +295,12 @@ void FastMixer::onStateChange()
             modifiedTracks &= ~(1 << i);
             const FastTrack* fastTrack = &current->mFastTracks[i];
             if (fastTrack->mGeneration != generations[i]) {
-                // this track was actually modified
+                // this track was actually modified; the generation only changes when a track
+                // is added or removed, so this is another track if the state queue skipped the
+                // state where the slot was empty, and the histograms must not carry over
+                dumpState->mTracks[i].mHistograms.resetTrack();
+                mUnderrunBurst[i] = 0;
+                mFirstFrameWait[i] = 1;
                 AudioBufferProvider *bufferProvider = fastTrack->mBufferProvider;
                 ALOG_ASSERT(bufferProvider != NULL);
                 if (mixer != NULL) {
@@ -375,24 +393,48 @@ void FastMixer::onWork()
             }
             FastTrackDump *ftDump = &dumpState->mTracks[i];
             FastTrackUnderruns underruns = ftDump->mUnderruns;
+            FastTrackHistograms *histograms = &ftDump->mHistograms;
             if (framesReady < frameCount) {
                 if (framesReady == 0) {
                     underruns.mBitFields.mEmpty++;
                     underruns.mBitFields.mMostRecent = UNDERRUN_EMPTY;
+                    histograms->mEmpty++;
                     mixer->disable(name);
                 } else {
                     // allow mixing partial buffer
                     underruns.mBitFields.mPartial++;
                     underruns.mBitFields.mMostRecent = UNDERRUN_PARTIAL;
+                    histograms->mPartial++;
                     mixer->enable(name);
                 }
             } else {
                 underruns.mBitFields.mFull++;
                 underruns.mBitFields.mMostRecent = UNDERRUN_FULL;
+                histograms->mFull++;
                 mixer->enable(name);
             }
             ftDump->mUnderruns = underruns;
             ftDump->mFramesReady = framesReady;
+            histograms->mFramesReady[
+                    FastTrackHistograms::framesReadyBucket(framesReady, frameCount)]++;
+            if (mFirstFrameWait[i] != 0) {
+                // the client has not yet provided any data, so this is startup and not underrun
+                if (framesReady > 0) {
+                    histograms->mFirstFrameCycles = mFirstFrameWait[i];
+                    histograms->mFirstFrame[FastTrackHistograms::log2Bucket(mFirstFrameWait[i],
+                            FastTrackHistograms::kFirstFrameBuckets)]++;
+                    mFirstFrameWait[i] = 0;
+                } else {
+                    mFirstFrameWait[i]++;
+                }
+            } else if (framesReady < frameCount) {
+                mUnderrunBurst[i]++;
+            } else if (mUnderrunBurst[i] > 0) {
+                // a burst is only counted once it has ended
+                histograms->mUnderrunBursts[FastTrackHistograms::log2Bucket(mUnderrunBurst[i],
+                        FastTrackHistograms::kUnderrunBurstBuckets)]++;
+                mUnderrunBurst[i] = 0;
+            }
         }
 
         int64_t pts;
@@ -672,6 +714,92 @@ void FastMixerDumpState::dump(int fd) const
                 (underruns.mBitFields.mEmpty) & UNDERRUN_MASK,
                 mostRecent, ftDump->mFramesReady);
     }
+
+    // Histograms are only shown for slots that have been used since the mixer was created.
+    // Frames ready is in fractions of the mix frame count; the other histograms are in mix cycles.
+    dprintf(fd, "  Fast track histograms (mix cycle %.2f ms):\n", mixPeriodSec * 1e3);
+    dprintf(fd, "    frames ready:        0   <1/4   <1/2   <3/4     <1     <2     <4    >=4\n"
+                "    underrun burst:      1      2    <=4    <=8   <=16   <=32   <=64    >64\n"
+                "    first frame:         1      2    <=4    <=8   <=16   <=32   <=64    >64\n");
+    for (uint32_t i = 0; i < FastMixerState::kMaxFastTracks; ++i) {
+        const FastTrackHistograms& h = mTracks[i].mHistograms;
+        uint32_t cycles = h.mFull + h.mPartial + h.mEmpty;
+        uint32_t firstFrames = 0;
+        for (uint32_t j = 0; j < FastTrackHistograms::kFirstFrameBuckets; ++j) {
+            firstFrames += h.mFirstFrame[j];
+        }
+        if (cycles == 0 && firstFrames == 0) {
+            continue;
+        }
+        dprintf(fd, "  %5u full=%u partial=%u empty=%u firstFrame=%.2f ms\n", i,
+                h.mFull, h.mPartial, h.mEmpty, h.mFirstFrameCycles * mixPeriodSec * 1e3);
+        dprintf(fd, "    frames ready:  ");
+        for (uint32_t j = 0; j < FastTrackHistograms::kFramesReadyBuckets; ++j) {
+            dprintf(fd, " %6u", h.mFramesReady[j]);
+        }
+        dprintf(fd, "\n    underrun burst:");
+        for (uint32_t j = 0; j < FastTrackHistograms::kUnderrunBurstBuckets; ++j) {
+            dprintf(fd, " %6u", h.mUnderrunBursts[j]);
+        }
+        dprintf(fd, "\n    first frame:   ");
+        for (uint32_t j = 0; j < FastTrackHistograms::kFirstFrameBuckets; ++j) {
+            dprintf(fd, " %6u", h.mFirstFrame[j]);
+        }
+        dprintf(fd, "\n");
+    }
+}
+
+// Binary layout written by dumpHistograms(), all fields in native byte order:
+//   FastMixerHistogramsHeader
+//   FastTrackHistograms[mMaxFastTracks], indexed by fast track slot
+// mVersion is incremented whenever the layout of either struct changes.
+struct FastMixerHistogramsHeader {
+    char     mMagic[4];         // "FMXH"
+    uint32_t mVersion;
+    uint32_t mHeaderSize;       // sizeof(FastMixerHistogramsHeader)
+    uint32_t mTrackSize;        // sizeof(FastTrackHistograms)
+    uint32_t mMaxFastTracks;
+    uint32_t mTrackMask;        // mask of active tracks
+    uint32_t mSampleRate;
+    uint32_t mFrameCount;
+};
+
+ssize_t FastMixerDumpState::dumpHistograms(int fd) const
+{
+    static const uint32_t kVersion = 1;
+    FastMixerHistogramsHeader header;
+    memcpy(header.mMagic, "FMXH", sizeof(header.mMagic));
+    header.mVersion = kVersion;
+    header.mHeaderSize = sizeof(FastMixerHistogramsHeader);
+    header.mTrackSize = sizeof(FastTrackHistograms);
+    header.mMaxFastTracks = FastMixerState::kMaxFastTracks;
+    header.mTrackMask = mTrackMask;
+    header.mSampleRate = mSampleRate;
+    header.mFrameCount = mFrameCount;
+    ssize_t total = write(fd, &header, sizeof(header));
+    if (total != (ssize_t) sizeof(header)) {
+        return total < 0 ? -errno : -EIO;
+    }
+    for (uint32_t i = 0; i < FastMixerState::kMaxFastTracks; ++i) {
+        ssize_t written = write(fd, &mTracks[i].mHistograms, sizeof(FastTrackHistograms));
+        if (written != (ssize_t) sizeof(FastTrackHistograms)) {
+            return written < 0 ? -errno : -EIO;
+        }
+        total += written;
+    }
+    return total;
+}
+
+uint32_t FastTrackHistograms::framesReadyBucket(size_t framesReady, size_t frameCount)
+{
+    if (framesReady == 0 || frameCount == 0) {
+        return 0;
+    }
+    if (framesReady < frameCount) {
+        return 1 + (framesReady * 4) / frameCount;  // 1 to 4, in quarters of a mix cycle
+    }
+    size_t cycles = framesReady / frameCount;
+    return cycles < 2 ? 5 : cycles < 4 ? 6 : 7;
 }
 
 }   // namespace android
@@ -78,6 +78,10 @@ private:
     int fastTracksGen;
     FastMixerDumpState dummyDumpState;
     uint32_t totalNativeFramesWritten;  // copied to dumpState->mFramesWritten
+    // per-track state for the dumpState->mTracks[i].mHistograms
+    uint32_t mUnderrunBurst[FastMixerState::kMaxFastTracks];    // consecutive non-full cycles
+    uint32_t mFirstFrameWait[FastMixerState::kMaxFastTracks];   // cycles since added, or 0 if
+                                                                // first frame was already seen
 
     // next 2 fields are valid only when timestampStatus == NO_ERROR
     AudioTimestamp timestamp;
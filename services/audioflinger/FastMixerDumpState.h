@@ -17,6 +17,7 @@
 #ifndef ANDROID_AUDIO_FAST_MIXER_DUMP_STATE_H
 #define ANDROID_AUDIO_FAST_MIXER_DUMP_STATE_H
 
+#include <string.h>
 #include "Configuration.h"
 
 namespace android {
@@ -48,12 +49,51 @@ private:
     uint32_t mAtomic;
 };
 
+// Long-term statistics for the fast track currently occupying a slot.
+// Unlike the underrun counters above, these are reset each time a new track is added to the slot,
+// but not when the mixer is reconfigured, and the counters are wide enough that they do not wrap
+// in practice.
+// Buckets are cumulative counts of mix cycles (or tracks, for time to first frame);
+// see FastMixerDumpState::dump() in FastMixer.cpp for the bucket boundaries.
+struct FastTrackHistograms {
+    static const uint32_t kFramesReadyBuckets = 8;      // in fractions of the mix frame count
+    static const uint32_t kUnderrunBurstBuckets = 8;    // consecutive cycles, powers of 2
+    static const uint32_t kFirstFrameBuckets = 8;       // cycles until first frame, powers of 2
+
+    uint32_t mFull;             // total cycles where framesReady() was full frame count
+    uint32_t mPartial;          // total cycles where framesReady() was non-zero but < frame count
+    uint32_t mEmpty;            // total cycles where framesReady() was zero
+    uint32_t mFirstFrameCycles; // cycles from track add until first non-empty framesReady(),
+                                // or 0 if no frames have been seen yet
+    uint32_t mFramesReady[kFramesReadyBuckets];
+    uint32_t mUnderrunBursts[kUnderrunBurstBuckets];
+    uint32_t mFirstFrame[kFirstFrameBuckets];   // accumulated across tracks using this slot
+
+    // Clears the statistics of the previous track in the slot, except for time to first frame
+    void resetTrack() {
+        mFull = 0;
+        mPartial = 0;
+        mEmpty = 0;
+        mFirstFrameCycles = 0;
+        memset(mFramesReady, 0, sizeof(mFramesReady));
+        memset(mUnderrunBursts, 0, sizeof(mUnderrunBursts));
+    }
+
+    // Returns the power of 2 bucket index for a count >= 1, clamped to buckets - 1
+    static uint32_t log2Bucket(uint32_t count, uint32_t buckets) {
+        uint32_t bucket = count <= 1 ? 0 : 32 - __builtin_clz(count - 1);
+        return bucket < buckets ? bucket : buckets - 1;
+    }
+    static uint32_t framesReadyBucket(size_t framesReady, size_t frameCount);
+};
+
 // Represents the dump state of a fast track
 struct FastTrackDump {
-    FastTrackDump() : mFramesReady(0) { }
+    FastTrackDump() : mFramesReady(0) { memset(&mHistograms, 0, sizeof(mHistograms)); }
     /*virtual*/ ~FastTrackDump() { }
     FastTrackUnderruns mUnderruns;
-    size_t mFramesReady;        // most recent value only; no long-term statistics kept
+    size_t mFramesReady;        // most recent value only
+    FastTrackHistograms mHistograms;
 };
 
 // The FastMixerDumpState keeps a cache of FastMixer statistics that can be logged by dumpsys.
@@ -72,6 +112,10 @@ struct FastMixerDumpState : FastThreadDumpState {
 
     void dump(int fd) const;    // should only be called on a stable copy, not the original
 
+    // Writes the per-track histograms in binary form for offline analysis,
+    // should only be called on a stable copy.  Returns number of bytes written or negative errno.
+    ssize_t dumpHistograms(int fd) const;
+
     uint32_t mWriteSequence;    // incremented before and after each write()
     uint32_t mFramesWritten;    // total number of frames written successfully
     uint32_t mNumTracks;        // total number of active fast tracks
@@ -61,6 +61,8 @@ FastThread::FastThread() : Thread(false /*canCallJava*/),
     warmupCycles(0),
     // dummyLogWriter
     logWriter(&dummyLogWriter),
+    underrunFormatId(-1),
+    overrunFormatId(-1),
     timestampStatus(INVALID_OPERATION),
 
     command(FastThreadState::INITIAL),
@@ -110,7 +112,16 @@ bool FastThread::threadLoop()
 
             // As soon as possible of learning of a new dump area, start using it
             dumpState = next->mDumpState != NULL ? next->mDumpState : mDummyDumpState;
-            logWriter = next->mNBLogWriter != NULL ? next->mNBLogWriter : &dummyLogWriter;
+            NBLog::Writer *newLogWriter =
+                    next->mNBLogWriter != NULL ? next->mNBLogWriter : &dummyLogWriter;
+            if (newLogWriter != logWriter) {
+                logWriter = newLogWriter;
+                // binary records, formatted by media.log rather than on this thread
+                underrunFormatId = logWriter->registerFormat(
+                        "underrun: time since last cycle %d.%03d sec");
+                overrunFormatId = logWriter->registerFormat(
+                        "overrun: time since last cycle %d.%03d sec");
+            }
             setLog(logWriter);
 
             // We want to always have a valid reference to the previous (non-idle) state.
@@ -243,18 +254,15 @@ bool FastThread::threadLoop()
                 if (isWarm) {
                     if (sec > 0 || nsec > underrunNs) {
                         ATRACE_NAME("underrun");
-                        // FIXME only log occasionally
-                        ALOGV("underrun: time since last cycle %d.%03ld sec",
-                                (int) sec, nsec / 1000000L);
+                        logWriter->logb(underrunFormatId, (int) sec, (int) (nsec / 1000000L));
                         dumpState->mUnderruns++;
                         ignoreNextOverrun = true;
                     } else if (nsec < overrunNs) {
                         if (ignoreNextOverrun) {
                             ignoreNextOverrun = false;
                         } else {
-                            // FIXME only log occasionally
-                            ALOGV("overrun: time since last cycle %d.%03ld sec",
-                                    (int) sec, nsec / 1000000L);
+                            logWriter->logb(overrunFormatId, (int) sec,
+                                    (int) (nsec / 1000000L));
                             dumpState->mOverruns++;
                         }
                         // This forces a minimum cycle time. It:
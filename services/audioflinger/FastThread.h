@@ -77,6 +77,8 @@ protected:
     uint32_t warmupCycles;  // counter of number of loop cycles required to warmup
     NBLog::Writer dummyLogWriter;
     NBLog::Writer *logWriter;
+    int underrunFormatId;   // binary record formats registered with logWriter,
+    int overrunFormatId;    // negative if unavailable
     status_t timestampStatus;
 
     FastThreadState::Command command;
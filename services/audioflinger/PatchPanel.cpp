@@ -25,6 +25,7 @@
 
 #include "AudioFlinger.h"
 #include "ServiceUtilities.h"
+#include "SchedulingPolicyService.h"
 #include <media/AudioParameter.h>
 
 // ----------------------------------------------------------------------------
@@ -44,6 +45,16 @@
 
 namespace android {
 
+// SCHED_FIFO priority of the direct patch threads, the same as the fast mixer
+static const int kPriorityDirectPatch = 3;
+
+// sleep time after a HAL read or write error, to avoid spinning
+static const uint32_t kDirectPatchErrorSleepUs = 5000;
+
+// a direct patch corrects the clock drift between its devices once the frames queued in the
+// output, averaged over one second of input buffers, deviate by more than this
+static const uint32_t kDirectPatchDriftToleranceMs = 1;
+
 /* List connected audio ports and their attributes */
 status_t AudioFlinger::listAudioPorts(unsigned int *num_ports,
                                 struct audio_port *ports)
@@ -168,6 +179,8 @@ status_t AudioFlinger::PatchPanel::createAudioPatch(const struct audio_patch *pa
                 halHandle = mPatches[index]->mHalHandle;
                 Patch *removedPatch = mPatches[index];
                 mPatches.removeAt(index);
+                // stops the direct thread or releases the thread pair of a software patch
+                clearPatchConnections(removedPatch);
                 delete removedPatch;
                 break;
             }
@@ -238,6 +251,15 @@ status_t AudioFlinger::PatchPanel::createAudioPatch(const struct audio_patch *pa
                         goto exit;
                     }
                 } else {
+                    // connect the device streams directly when no resampling or channel
+                    // conversion is needed
+                    status = createDirectPatch(newPatch, patch);
+                    if (status == NO_ERROR) {
+                        goto exit;
+                    }
+                    ALOGV("createAudioPatch() direct patch not possible, status %d", status);
+                    status = NO_ERROR;
+
                     audio_config_t config = AUDIO_CONFIG_INITIALIZER;
                     audio_devices_t device = patch->sinks[0].ext.device.type;
                     String8 address = String8(patch->sinks[0].ext.device.address);
@@ -508,6 +530,11 @@ void AudioFlinger::PatchPanel::clearPatchConnections(Patch *patch)
     ALOGV("clearPatchConnections() patch->mRecordPatchHandle %d patch->mPlaybackPatchHandle %d",
           patch->mRecordPatchHandle, patch->mPlaybackPatchHandle);
 
+    if (patch->mDirectThread != 0) {
+        patch->mDirectThread->close();
+        patch->mDirectThread.clear();
+    }
+
     if (patch->mPatchRecord != 0) {
         patch->mPatchRecord->stop();
     }
@@ -543,6 +570,564 @@ void AudioFlinger::PatchPanel::clearPatchConnections(Patch *patch)
     }
 }
 
+status_t AudioFlinger::PatchPanel::createDirectPatch(Patch *patch,
+                                                     const struct audio_patch *audioPatch)
+{
+    sp<AudioFlinger> audioflinger = mAudioFlinger.promote();
+    if (audioflinger == 0) {
+        return NO_INIT;
+    }
+
+    sp<DirectPatchThread> thread = new DirectPatchThread();
+    status_t status = thread->open(audioflinger, audioPatch);
+    if (status != NO_ERROR) {
+        thread->close();
+        return status;
+    }
+    thread->setMasterVolume(audioflinger->masterVolume_l());
+    thread->setMasterMute(audioflinger->masterMute_l());
+    status = thread->run("AudioPatch", PRIORITY_URGENT_AUDIO);
+    if (status != NO_ERROR) {
+        thread->close();
+        return status;
+    }
+    pid_t tid = thread->getTid();
+    int err = requestPriority(getpid_cached, tid, kPriorityDirectPatch);
+    if (err != 0) {
+        ALOGW("Policy SCHED_FIFO priority %d is unavailable for pid %d tid %d; error %d",
+                kPriorityDirectPatch, getpid_cached, tid, err);
+    }
+    patch->mDirectThread = thread;
+    return NO_ERROR;
+}
+
+void AudioFlinger::PatchPanel::setMasterVolume_l(float value)
+{
+    for (size_t i = 0; i < mPatches.size(); i++) {
+        if (mPatches[i]->mDirectThread != 0) {
+            mPatches[i]->mDirectThread->setMasterVolume(value);
+        }
+    }
+}
+
+void AudioFlinger::PatchPanel::setMasterMute_l(bool muted)
+{
+    for (size_t i = 0; i < mPatches.size(); i++) {
+        if (mPatches[i]->mDirectThread != 0) {
+            mPatches[i]->mDirectThread->setMasterMute(muted);
+        }
+    }
+}
+
+status_t AudioFlinger::PatchPanel::setParameters_l(audio_io_handle_t ioHandle,
+                                                   const String8& keyValuePairs)
+{
+    for (size_t i = 0; i < mPatches.size(); i++) {
+        if (mPatches[i]->mDirectThread != 0) {
+            status_t status = mPatches[i]->mDirectThread->setParameters(ioHandle, keyValuePairs);
+            if (status != BAD_VALUE) {
+                return status;
+            }
+        }
+    }
+    return BAD_VALUE;
+}
+
+void AudioFlinger::PatchPanel::dump(int fd)
+{
+    bool header = false;
+    for (size_t i = 0; i < mPatches.size(); i++) {
+        if (mPatches[i]->mDirectThread == 0) {
+            continue;
+        }
+        if (!header) {
+            dprintf(fd, "\nDirect patches:\n");
+            header = true;
+        }
+        dprintf(fd, " Patch %d:\n", mPatches[i]->mHandle);
+        mPatches[i]->mDirectThread->dump(fd);
+    }
+}
+
+AudioFlinger::PatchPanel::DirectPatchThread::DirectPatchThread()
+    :   Thread(false /*canCallJava*/),
+        mInput(NULL), mOutput(NULL),
+        mInputId(AUDIO_IO_HANDLE_NONE), mOutputId(AUDIO_IO_HANDLE_NONE),
+        mInputHalHandle(AUDIO_PATCH_HANDLE_NONE), mOutputHalHandle(AUDIO_PATCH_HANDLE_NONE),
+        mInputFormat(AUDIO_FORMAT_INVALID), mOutputFormat(AUDIO_FORMAT_INVALID),
+        mChannelCount(0), mInputFrameSize(0), mOutputFrameSize(0), mSampleRate(0),
+        mBufferSize(0), mOutputPeriodFrames(0), mPrimeFrames(0), mCorrectDrift(false),
+        mInputBuffer(NULL), mOutputBuffer(NULL), mSilence(NULL),
+        mDriftWindow(0), mWindowQueuedFrames(0), mWindowCount(0), mTargetQueuedFrames(-1),
+        mFramesWritten(0), mQueuedFrames(-1),
+        mDroppedFrames(0), mInsertedFrames(0),
+        mMasterVolume(1.0f), mMasterMute(false)
+{
+}
+
+AudioFlinger::PatchPanel::DirectPatchThread::~DirectPatchThread()
+{
+    ALOG_ASSERT(mInput == NULL && mOutput == NULL, "~DirectPatchThread() streams not closed");
+    free(mInputBuffer);
+    free(mOutputBuffer);
+    free(mSilence);
+}
+
+status_t AudioFlinger::PatchPanel::DirectPatchThread::open(const sp<AudioFlinger>& audioFlinger,
+                                                           const struct audio_patch *patch)
+{
+    // the output is opened first so that the input can be configured to match it,
+    // as for the RecordThread of a thread pair
+    status_t status = openOutput(audioFlinger, &patch->sinks[0]);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    status = openInput(audioFlinger, &patch->sources[0]);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    mBufferSize = mInput->stream->common.get_buffer_size(&mInput->stream->common);
+    if (mBufferSize == 0 || mBufferSize % mInputFrameSize != 0) {
+        ALOGW("DirectPatchThread::open() invalid input buffer size %zu", mBufferSize);
+        return BAD_VALUE;
+    }
+    mInputBuffer = malloc(mBufferSize);
+    if (mInputBuffer == NULL) {
+        return NO_MEMORY;
+    }
+    if (mInputFormat != mOutputFormat) {
+        mOutputBuffer = malloc(mBufferSize / mInputFrameSize * mOutputFrameSize);
+        if (mOutputBuffer == NULL) {
+            return NO_MEMORY;
+        }
+    }
+
+    // the smallest write the output takes without blocking is one HAL period
+    const size_t outputBufferSize =
+            mOutput->stream->common.get_buffer_size(&mOutput->stream->common);
+    mOutputPeriodFrames = outputBufferSize / mOutputFrameSize;
+    if (mOutputPeriodFrames == 0) {
+        ALOGW("DirectPatchThread::open() invalid output buffer size %zu", outputBufferSize);
+        return BAD_VALUE;
+    }
+    mSilence = calloc(mOutputPeriodFrames, mOutputFrameSize);
+    if (mSilence == NULL) {
+        return NO_MEMORY;
+    }
+    // the devices of a HW module are clocked by the same codec, so the output consumes
+    // exactly what the input produces and needs no headroom
+    mCorrectDrift = mInput->audioHwDev != mOutput->audioHwDev;
+    mPrimeFrames = mCorrectDrift ? mOutputPeriodFrames : 0;
+    mDriftWindow = mSampleRate * mInputFrameSize / mBufferSize;
+    if (mDriftWindow == 0) {
+        mDriftWindow = 1;
+    }
+
+    // the mix port configurations of the streams, for the routes on HAL 3.0 and later
+    struct audio_port_config inputMix = {};
+    inputMix.type = AUDIO_PORT_TYPE_MIX;
+    inputMix.role = AUDIO_PORT_ROLE_SINK;
+    inputMix.ext.mix.handle = mInputId;
+    inputMix.ext.mix.hw_module = mInput->audioHwDev->handle();
+    inputMix.ext.mix.usecase.source = AUDIO_SOURCE_MIC;
+    inputMix.sample_rate = mInput->stream->common.get_sample_rate(&mInput->stream->common);
+    inputMix.channel_mask = mInput->stream->common.get_channels(&mInput->stream->common);
+    inputMix.format = mInputFormat;
+    inputMix.config_mask = AUDIO_PORT_CONFIG_SAMPLE_RATE|AUDIO_PORT_CONFIG_CHANNEL_MASK|
+                            AUDIO_PORT_CONFIG_FORMAT;
+    status = createRoute(mInput->audioHwDev, &mInput->stream->common,
+                         &patch->sources[0], &inputMix, &mInputHalHandle);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    struct audio_port_config outputMix = {};
+    outputMix.type = AUDIO_PORT_TYPE_MIX;
+    outputMix.role = AUDIO_PORT_ROLE_SOURCE;
+    outputMix.ext.mix.handle = mOutputId;
+    outputMix.ext.mix.hw_module = mOutput->audioHwDev->handle();
+    outputMix.ext.mix.usecase.stream = AUDIO_STREAM_DEFAULT;
+    outputMix.sample_rate = mOutput->stream->common.get_sample_rate(&mOutput->stream->common);
+    outputMix.channel_mask = mOutput->stream->common.get_channels(&mOutput->stream->common);
+    outputMix.format = mOutputFormat;
+    outputMix.config_mask = inputMix.config_mask;
+    return createRoute(mOutput->audioHwDev, &mOutput->stream->common,
+                       &outputMix, &patch->sinks[0], &mOutputHalHandle);
+}
+
+status_t AudioFlinger::PatchPanel::DirectPatchThread::openOutput(
+        const sp<AudioFlinger>& audioFlinger, const struct audio_port_config *sink)
+{
+    AudioHwDevice *hwDev = audioFlinger->findSuitableHwDev_l(sink->ext.device.hw_module,
+                                                             sink->ext.device.type);
+    if (hwDev == NULL) {
+        return BAD_VALUE;
+    }
+    audio_hw_device_t *hwDevHal = hwDev->hwDevice();
+    audio_config_t config = AUDIO_CONFIG_INITIALIZER;
+    audio_stream_out_t *outStream = NULL;
+    audio_io_handle_t output = audioFlinger->nextUniqueId();
+    audioFlinger->mHardwareStatus = AUDIO_HW_OUTPUT_OPEN;
+    status_t status = hwDevHal->open_output_stream(hwDevHal,
+                                                   output,
+                                                   sink->ext.device.type,
+                                                   AUDIO_OUTPUT_FLAG_NONE,
+                                                   &config,
+                                                   &outStream,
+                                                   sink->ext.device.address);
+    audioFlinger->mHardwareStatus = AUDIO_HW_IDLE;
+    if (status != NO_ERROR || outStream == NULL) {
+        ALOGW("DirectPatchThread::openOutput() open_output_stream failed %d", status);
+        return status != NO_ERROR ? status : NO_INIT;
+    }
+    mOutput = new AudioStreamOut(hwDev, outStream, AUDIO_OUTPUT_FLAG_NONE);
+    mOutputId = output;
+    mOutputFormat = outStream->common.get_format(&outStream->common);
+    mSampleRate = outStream->common.get_sample_rate(&outStream->common);
+    mChannelCount = audio_channel_count_from_out_mask(
+            outStream->common.get_channels(&outStream->common));
+    mOutputFrameSize = audio_stream_out_frame_size(outStream);
+    if (!isSupportedOutputFormat(mOutputFormat)) {
+        return INVALID_OPERATION;
+    }
+    return NO_ERROR;
+}
+
+status_t AudioFlinger::PatchPanel::DirectPatchThread::openInput(
+        const sp<AudioFlinger>& audioFlinger, const struct audio_port_config *source)
+{
+    AudioHwDevice *hwDev = audioFlinger->findSuitableHwDev_l(source->ext.device.hw_module,
+                                                             source->ext.device.type);
+    if (hwDev == NULL) {
+        return BAD_VALUE;
+    }
+    audio_hw_device_t *hwDevHal = hwDev->hwDevice();
+    audio_config_t config = AUDIO_CONFIG_INITIALIZER;
+    config.sample_rate = mOutput->stream->common.get_sample_rate(&mOutput->stream->common);
+    config.channel_mask = audio_channel_in_mask_from_count(mChannelCount);
+    config.format = mOutputFormat;
+    audio_stream_in_t *inStream = NULL;
+    audio_io_handle_t input = audioFlinger->nextUniqueId();
+    status_t status = hwDevHal->open_input_stream(hwDevHal, input, source->ext.device.type,
+                                                  &config, &inStream, AUDIO_INPUT_FLAG_NONE,
+                                                  source->ext.device.address, AUDIO_SOURCE_MIC);
+    // a different sample format proposed by the HAL is converted by the thread
+    if (status == BAD_VALUE && isSupportedInputFormat(config.format) &&
+            config.sample_rate ==
+                    mOutput->stream->common.get_sample_rate(&mOutput->stream->common) &&
+            audio_channel_count_from_in_mask(config.channel_mask) == mChannelCount) {
+        inStream = NULL;
+        status = hwDevHal->open_input_stream(hwDevHal, input, source->ext.device.type,
+                                             &config, &inStream, AUDIO_INPUT_FLAG_NONE,
+                                             source->ext.device.address, AUDIO_SOURCE_MIC);
+    }
+    if (status != NO_ERROR || inStream == NULL) {
+        ALOGV("DirectPatchThread::openInput() open_input_stream failed %d", status);
+        return status != NO_ERROR ? status : NO_INIT;
+    }
+    mInput = new AudioStreamIn(hwDev, inStream);
+    mInputId = input;
+    mInputFormat = inStream->common.get_format(&inStream->common);
+    mInputFrameSize = audio_stream_in_frame_size(inStream);
+
+    if (inStream->common.get_sample_rate(&inStream->common) !=
+                mOutput->stream->common.get_sample_rate(&mOutput->stream->common) ||
+            audio_channel_count_from_in_mask(inStream->common.get_channels(&inStream->common))
+                    != mChannelCount ||
+            !isSupportedInputFormat(mInputFormat)) {
+        return INVALID_OPERATION;
+    }
+    return NO_ERROR;
+}
+
+status_t AudioFlinger::PatchPanel::DirectPatchThread::createRoute(AudioHwDevice *hwDevice,
+        audio_stream_t *stream, const struct audio_port_config *source,
+        const struct audio_port_config *sink, audio_patch_handle_t *halHandle)
+{
+    if (hwDevice->version() >= AUDIO_DEVICE_API_VERSION_3_0) {
+        audio_hw_device_t *hwDev = hwDevice->hwDevice();
+        return hwDev->create_audio_patch(hwDev, 1, source, 1, sink, halHandle);
+    }
+    // the device is the source for an input and the sink for an output
+    const struct audio_port_config *device =
+            source->type == AUDIO_PORT_TYPE_DEVICE ? source : sink;
+    char *address;
+    if (strcmp(device->ext.device.address, "") != 0) {
+        address = audio_device_address_to_parameter(device->ext.device.type,
+                                                    device->ext.device.address);
+    } else {
+        address = (char *)calloc(1, 1);
+    }
+    AudioParameter param = AudioParameter(String8(address));
+    free(address);
+    param.addInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), (int)device->ext.device.type);
+    if (device == source) {
+        param.addInt(String8(AUDIO_PARAMETER_STREAM_INPUT_SOURCE), (int)AUDIO_SOURCE_MIC);
+    }
+    ALOGV("DirectPatchThread::createRoute() setParameters %s", param.toString().string());
+    return stream->set_parameters(stream, param.toString().string());
+}
+
+void AudioFlinger::PatchPanel::DirectPatchThread::releaseRoute(AudioHwDevice *hwDevice,
+        audio_stream_t *stream, audio_patch_handle_t halHandle)
+{
+    if (hwDevice->version() >= AUDIO_DEVICE_API_VERSION_3_0) {
+        if (halHandle != AUDIO_PATCH_HANDLE_NONE) {
+            audio_hw_device_t *hwDev = hwDevice->hwDevice();
+            hwDev->release_audio_patch(hwDev, halHandle);
+        }
+    } else {
+        AudioParameter param;
+        param.addInt(String8(AUDIO_PARAMETER_STREAM_ROUTING), 0);
+        stream->set_parameters(stream, param.toString().string());
+    }
+}
+
+void AudioFlinger::PatchPanel::DirectPatchThread::close()
+{
+    // does nothing if the thread was not started
+    requestExitAndWait();
+
+    if (mInput != NULL) {
+        audio_stream_t *stream = &mInput->stream->common;
+        stream->standby(stream);
+        releaseRoute(mInput->audioHwDev, stream, mInputHalHandle);
+        mInput->hwDev()->close_input_stream(mInput->hwDev(), mInput->stream);
+        delete mInput;
+        mInput = NULL;
+    }
+    if (mOutput != NULL) {
+        audio_stream_t *stream = &mOutput->stream->common;
+        stream->standby(stream);
+        releaseRoute(mOutput->audioHwDev, stream, mOutputHalHandle);
+        mOutput->hwDev()->close_output_stream(mOutput->hwDev(), mOutput->stream);
+        delete mOutput;
+        mOutput = NULL;
+    }
+    mInputHalHandle = AUDIO_PATCH_HANDLE_NONE;
+    mOutputHalHandle = AUDIO_PATCH_HANDLE_NONE;
+}
+
+// static
+bool AudioFlinger::PatchPanel::DirectPatchThread::isSupportedInputFormat(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+    case AUDIO_FORMAT_PCM_FLOAT:
+    case AUDIO_FORMAT_PCM_24_BIT_PACKED:
+    case AUDIO_FORMAT_PCM_32_BIT:
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// static
+bool AudioFlinger::PatchPanel::DirectPatchThread::isSupportedOutputFormat(audio_format_t format)
+{
+    // the master volume is applied to 16-bit or float samples only
+    return format == AUDIO_FORMAT_PCM_16_BIT || format == AUDIO_FORMAT_PCM_FLOAT;
+}
+
+void AudioFlinger::PatchPanel::DirectPatchThread::setMasterVolume(float value)
+{
+    Mutex::Autolock _l(mLock);
+    // Don't apply master volume in SW if our HAL can do it for us.
+    if (mOutput->audioHwDev->canSetMasterVolume()) {
+        mMasterVolume = 1.0f;
+    } else {
+        mMasterVolume = value;
+    }
+}
+
+void AudioFlinger::PatchPanel::DirectPatchThread::setMasterMute(bool muted)
+{
+    Mutex::Autolock _l(mLock);
+    // Don't apply master mute in SW if our HAL can do it for us.
+    if (mOutput->audioHwDev->canSetMasterMute()) {
+        mMasterMute = false;
+    } else {
+        mMasterMute = muted;
+    }
+}
+
+status_t AudioFlinger::PatchPanel::DirectPatchThread::setParameters(audio_io_handle_t ioHandle,
+                                                                    const String8& keyValuePairs)
+{
+    audio_stream_t *stream;
+    if (ioHandle == mInputId) {
+        stream = &mInput->stream->common;
+    } else if (ioHandle == mOutputId) {
+        stream = &mOutput->stream->common;
+    } else {
+        return BAD_VALUE;
+    }
+    return stream->set_parameters(stream, keyValuePairs.string());
+}
+
+void AudioFlinger::PatchPanel::DirectPatchThread::dump(int fd)
+{
+    float volume;
+    bool muted;
+    {
+        Mutex::Autolock _l(mLock);
+        volume = mMasterVolume;
+        muted = mMasterMute;
+    }
+    const size_t frameCount = mBufferSize / mInputFrameSize;
+    const int64_t queuedFrames = mQueuedFrames;
+    uint32_t latencyMs;
+    if (queuedFrames >= 0) {
+        // one input buffer, and the frames queued in the output up to the speaker
+        latencyMs = (uint32_t)((frameCount + queuedFrames) * 1000 / mSampleRate);
+    } else {
+        // one input buffer, the priming, and the HAL latency
+        latencyMs = (frameCount + mPrimeFrames) * 1000 / mSampleRate +
+                mOutput->stream->get_latency(mOutput->stream);
+    }
+    dprintf(fd, "  input %d format %#x, output %d format %#x, %u channels at %u Hz\n",
+            mInputId, mInputFormat, mOutputId, mOutputFormat, mChannelCount, mSampleRate);
+    dprintf(fd, "  buffer %zu frames, output period %zu frames, primed %zu frames\n",
+            frameCount, mOutputPeriodFrames, mPrimeFrames);
+    dprintf(fd, "  latency %u ms (%s), drift correction %s, dropped %u frames, "
+            "inserted %u frames\n",
+            latencyMs, queuedFrames >= 0 ? "measured" : "estimated",
+            mCorrectDrift ? "on" : "off (shared clock)", mDroppedFrames, mInsertedFrames);
+    dprintf(fd, "  master volume %.3f%s\n", volume, muted ? " (muted)" : "");
+}
+
+void AudioFlinger::PatchPanel::DirectPatchThread::applyMasterVolume(void *buffer, size_t samples)
+{
+    float volume;
+    bool muted;
+    {
+        Mutex::Autolock _l(mLock);
+        volume = mMasterVolume;
+        muted = mMasterMute;
+    }
+    if (muted) {
+        memset(buffer, 0, samples * audio_bytes_per_sample(mOutputFormat));
+    } else if (volume != 1.0f) {
+        if (mOutputFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            float *samplesFloat = (float *)buffer;
+            for (size_t i = 0; i < samples; i++) {
+                samplesFloat[i] *= volume;
+            }
+        } else {
+            // U4.12 gain, as the track volumes of the mixer
+            const int32_t gain = (int32_t)(volume * (1 << 12) + 0.5f);
+            int16_t *samples16 = (int16_t *)buffer;
+            for (size_t i = 0; i < samples; i++) {
+                samples16[i] = clamp16((samples16[i] * gain) >> 12);
+            }
+        }
+    }
+}
+
+void AudioFlinger::PatchPanel::DirectPatchThread::writeOutput(const char *buffer, size_t bytes)
+{
+    size_t written = 0;
+    while (written < bytes && !exitPending()) {
+        ssize_t ret = mOutput->stream->write(mOutput->stream, buffer + written, bytes - written);
+        if (ret <= 0) {
+            ALOGW("DirectPatchThread write error %zd", ret);
+            usleep(kDirectPatchErrorSleepUs);
+            break;
+        }
+        written += ret;
+    }
+    mFramesWritten += written / mOutputFrameSize;
+}
+
+bool AudioFlinger::PatchPanel::DirectPatchThread::getQueuedFrames(int64_t *queuedFrames)
+{
+    if (mOutput->stream->get_presentation_position == NULL) {
+        return false;
+    }
+    uint64_t position;
+    struct timespec timestamp;
+    if (mOutput->stream->get_presentation_position(mOutput->stream, &position,
+                                                    &timestamp) != 0) {
+        return false;
+    }
+    // the position is extrapolated to now, as it only advances once per HAL period
+    const nsecs_t elapsedNs = systemTime(SYSTEM_TIME_MONOTONIC) -
+            (timestamp.tv_sec * 1000000000LL + timestamp.tv_nsec);
+    int64_t presentedFrames = (int64_t)position;
+    if (elapsedNs > 0) {
+        presentedFrames += elapsedNs * mSampleRate / 1000000000LL;
+    }
+    *queuedFrames = mFramesWritten - presentedFrames;
+    return true;
+}
+
+bool AudioFlinger::PatchPanel::DirectPatchThread::threadLoop()
+{
+    // the blocking HAL read paces the loop
+    ssize_t bytesRead = mInput->stream->read(mInput->stream, mInputBuffer, mBufferSize);
+    if (bytesRead <= 0) {
+        ALOGW("DirectPatchThread read error %zd", bytesRead);
+        usleep(kDirectPatchErrorSleepUs);
+        return true;
+    }
+    const size_t frames = bytesRead / mInputFrameSize;
+
+    if (mFramesWritten == 0 && mPrimeFrames != 0) {
+        // one output period of silence ahead of the first buffer, as headroom for the clock
+        // drift; it is written after the first read so that the output does not play it
+        // while the thread waits for the input
+        writeOutput((const char *)mSilence, mPrimeFrames * mOutputFrameSize);
+    }
+
+    // measured right after each read, and averaged so that a late wakeup is not taken for drift
+    size_t dropFrames = 0;
+    int64_t queuedFrames;
+    if (getQueuedFrames(&queuedFrames)) {
+        mWindowQueuedFrames += queuedFrames;
+        if (++mWindowCount == mDriftWindow) {
+            queuedFrames = mWindowQueuedFrames / (int64_t)mWindowCount;
+            mWindowQueuedFrames = 0;
+            mWindowCount = 0;
+            mQueuedFrames = queuedFrames;
+            const int64_t toleranceFrames = mSampleRate * kDirectPatchDriftToleranceMs / 1000;
+            if (!mCorrectDrift || mTargetQueuedFrames < 0) {
+                // the first average is the target; with a shared clock, the averages only
+                // report the latency
+                mTargetQueuedFrames = queuedFrames;
+            } else if (queuedFrames > mTargetQueuedFrames + toleranceFrames) {
+                // the output is slower: drop the excess rather than let the latency grow
+                // until the write blocks and the input overruns
+                dropFrames = queuedFrames - mTargetQueuedFrames < (int64_t)frames ?
+                        (size_t)(queuedFrames - mTargetQueuedFrames) : frames;
+                ALOGV("DirectPatchThread dropping %zu frames, %lld queued",
+                      dropFrames, (long long)queuedFrames);
+                mDroppedFrames += dropFrames;
+            } else if (queuedFrames < mTargetQueuedFrames - toleranceFrames) {
+                // the output is faster: refill the headroom before it underruns
+                const size_t insertFrames =
+                        mTargetQueuedFrames - queuedFrames < (int64_t)mOutputPeriodFrames ?
+                        (size_t)(mTargetQueuedFrames - queuedFrames) : mOutputPeriodFrames;
+                ALOGV("DirectPatchThread inserting %zu frames, %lld queued",
+                      insertFrames, (long long)queuedFrames);
+                writeOutput((const char *)mSilence, insertFrames * mOutputFrameSize);
+                mInsertedFrames += insertFrames;
+            }
+        }
+    }
+
+    char *buffer = (char *)mInputBuffer;
+    if (mOutputBuffer != NULL) {
+        memcpy_by_audio_format(mOutputBuffer, mOutputFormat, mInputBuffer, mInputFormat,
+                               frames * mChannelCount);
+        buffer = (char *)mOutputBuffer;
+    }
+    applyMasterVolume(buffer, frames * mChannelCount);
+    writeOutput(buffer + dropFrames * mOutputFrameSize, (frames - dropFrames) * mOutputFrameSize);
+    return true;
+}
+
 /* Disconnect a patch */
 status_t AudioFlinger::PatchPanel::releaseAudioPatch(audio_patch_handle_t handle)
 {
@@ -52,6 +52,115 @@ public:
                                     const struct audio_patch *audioPatch);
     void clearPatchConnections(Patch *patch);
 
+    /* Apply the master volume and mute to the direct patches, called with AudioFlinger::mLock
+     * held like the other master volume and mute updates of the playback threads */
+    void setMasterVolume_l(float value);
+    void setMasterMute_l(bool muted);
+
+    /* Set parameters on a HAL stream of a direct patch, returns BAD_VALUE if no direct
+     * patch has a stream with this handle */
+    status_t setParameters_l(audio_io_handle_t ioHandle, const String8& keyValuePairs);
+
+    void dump(int fd);
+
+    // Connects the HAL streams of the source and sink devices of a software patch with a
+    // single thread, which reads each input buffer and writes it to the output after an
+    // optional sample format conversion and the master volume. Compared to a RecordThread and
+    // PlaybackThread pair, this saves two thread cycles of latency and two copies.
+    // There is no resampler to absorb a clock drift between devices of different HW modules:
+    // the output is primed with one output period of silence, and the thread tracks the frames
+    // queued in the output with its presentation position. When they deviate from the first
+    // measurement, it drops input frames for a slower output and writes silence for a faster
+    // one, instead of letting the write block or the output underrun. The streams of a single
+    // HW module share a clock and are neither primed nor corrected.
+    class DirectPatchThread : public Thread {
+    public:
+        DirectPatchThread();
+        virtual ~DirectPatchThread();
+
+        // Opens and routes the HAL streams for the first source and sink devices of the patch.
+        // Returns INVALID_OPERATION if the devices need a sample rate, channel count or
+        // unsupported sample format conversion, in which case the patch must go through a
+        // thread pair.
+        status_t open(const sp<AudioFlinger>& audioFlinger, const struct audio_patch *patch);
+
+        // Stops the thread, then releases the routes and closes the HAL streams.
+        void close();
+
+        // The master volume and mute are applied by the thread unless the output HAL
+        // applies them, as in PlaybackThread.
+        void setMasterVolume(float value);
+        void setMasterMute(bool muted);
+
+        // returns BAD_VALUE if ioHandle is neither the input nor the output of the patch
+        status_t setParameters(audio_io_handle_t ioHandle, const String8& keyValuePairs);
+
+        void dump(int fd);
+
+    private:
+        virtual bool threadLoop();
+
+        // only these conversions are supported by memcpy_by_audio_format()
+        static bool isSupportedInputFormat(audio_format_t format);
+        static bool isSupportedOutputFormat(audio_format_t format);
+
+        void applyMasterVolume(void *buffer, size_t samples);
+        // writes the whole buffer unless there is a write error or the thread is exiting
+        void writeOutput(const char *buffer, size_t bytes);
+        // returns the frames written to the output and not presented yet, or false if the
+        // output does not report its presentation position
+        bool getQueuedFrames(int64_t *queuedFrames);
+
+        status_t openOutput(const sp<AudioFlinger>& audioFlinger,
+                            const struct audio_port_config *sink);
+        status_t openInput(const sp<AudioFlinger>& audioFlinger,
+                           const struct audio_port_config *source);
+
+        // routes a stream to a device of the same HW module
+        status_t createRoute(AudioHwDevice *hwDevice, audio_stream_t *stream,
+                             const struct audio_port_config *source,
+                             const struct audio_port_config *sink,
+                             audio_patch_handle_t *halHandle);
+        void releaseRoute(AudioHwDevice *hwDevice, audio_stream_t *stream,
+                          audio_patch_handle_t halHandle);
+
+        AudioStreamIn           *mInput;
+        AudioStreamOut          *mOutput;
+        audio_io_handle_t       mInputId;
+        audio_io_handle_t       mOutputId;
+        audio_patch_handle_t    mInputHalHandle;    // route of the input, HAL 3.0 and later
+        audio_patch_handle_t    mOutputHalHandle;   // route of the output, HAL 3.0 and later
+        audio_format_t          mInputFormat;
+        audio_format_t          mOutputFormat;
+        uint32_t                mChannelCount;
+        size_t                  mInputFrameSize;
+        size_t                  mOutputFrameSize;
+        uint32_t                mSampleRate;
+        size_t                  mBufferSize;        // input buffer size in bytes
+        size_t                  mOutputPeriodFrames;
+        size_t                  mPrimeFrames;       // 0 if the streams share a clock
+        bool                    mCorrectDrift;      // false if the streams share a clock
+        void                    *mInputBuffer;
+        void                    *mOutputBuffer;     // only if the formats differ
+        void                    *mSilence;          // one output period
+        size_t                  mDriftWindow;       // input buffers in about one second
+
+        int64_t                 mWindowQueuedFrames; // sum over the current window
+        size_t                  mWindowCount;
+        int64_t                 mTargetQueuedFrames; // first average, -1 until measured
+        // the following are written by the thread only, and read by dump() without a lock
+        int64_t                 mFramesWritten;
+        int64_t                 mQueuedFrames;      // last window average, -1 until measured
+        uint32_t                mDroppedFrames;
+        uint32_t                mInsertedFrames;
+
+        Mutex                   mLock;              // protects the master volume and mute
+        float                   mMasterVolume;
+        bool                    mMasterMute;
+    };
+
+    status_t createDirectPatch(Patch *patch, const struct audio_patch *audioPatch);
+
     class Patch {
     public:
         Patch(const struct audio_patch *patch) :
@@ -69,6 +178,8 @@ public:
         sp<RecordThread::PatchRecord>   mPatchRecord;
         audio_patch_handle_t            mRecordPatchHandle;
         audio_patch_handle_t            mPlaybackPatchHandle;
+        // replaces the thread pair above when the devices have compatible configurations
+        sp<DirectPatchThread>           mDirectThread;
 
     };
 
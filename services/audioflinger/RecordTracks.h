@@ -66,20 +66,14 @@ private:
 
     bool                mOverflow;  // overflow on most recent attempt to fill client buffer
 
-           // updated by RecordThread::readInputParameters_l()
-            AudioResampler                      *mResampler;
-
-            // interleaved stereo pairs of fixed-point Q4.27
-            int32_t                             *mRsmpOutBuffer;
-            // current allocated frame count for the above, which may be larger than needed
-            size_t                              mRsmpOutFrameCount;
-
-            size_t                              mRsmpInUnrel;   // unreleased frames remaining from
-                                                                // most recent getNextBuffer
-                                                                // for debug only
+            // converts the thread input to the track parameters, 0 if none is needed.
+            // Shared with the other tracks of the thread with the same parameters.
+            sp<ResamplerStage>                  mResamplerStage;
 
             // rolling counter that is never cleared
-            int32_t                             mRsmpInFront;   // next available frame
+            int32_t                             mRsmpInFront;   // next available frame, in the
+                                                                // thread input or the output of
+                                                                // mResamplerStage
 
             AudioBufferProvider::Buffer mSink;  // references client's buffer sink in shared memory
 
@@ -91,9 +85,6 @@ private:
             // when < 0, maximum frames to drop before starting capture even if sync event is
             // not received
             ssize_t                             mFramesToDrop;
-
-            // used by resampler to find source frames
-            ResamplerBufferProvider *mResamplerBufferProvider;
 };
 
 // playback track, used by PatchPanel
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ResamplerStage"
+//#define LOG_NDEBUG 0
+
+#include <math.h>
+#include <string.h>
+#include <audio_utils/primitives.h>
+#include <media/nbaio/roundup.h>
+#include <utils/Log.h>
+
+#include "ResamplerStage.h"
+
+#define FCC_2 2     // FCC_2 = Fixed Channel Count 2
+
+namespace android {
+
+// AudioBufferProvider interface
+status_t ResamplerStage::BufferProvider::getNextBuffer(
+        AudioBufferProvider::Buffer* buffer, int64_t pts __unused)
+{
+    ResamplerStage *stage = mStage;
+    int32_t rear = stage->mInRear;
+    int32_t front = stage->mRsmpInFront;
+    ssize_t filled = rear - front;
+    // FIXME should not be P2 (don't want to increase latency)
+    // FIXME if client not keeping up, discard
+    LOG_ALWAYS_FATAL_IF(!(0 <= filled && (size_t) filled <= stage->mInFrames));
+    // 'filled' may be non-contiguous, so return only the first contiguous chunk
+    front &= stage->mInFramesP2 - 1;
+    size_t part1 = stage->mInFramesP2 - front;
+    if (part1 > (size_t) filled) {
+        part1 = filled;
+    }
+    size_t ask = buffer->frameCount;
+    ALOG_ASSERT(ask > 0);
+    if (part1 > ask) {
+        part1 = ask;
+    }
+    if (part1 == 0) {
+        // Higher-level should keep the thread input full, and not call resampler if empty
+        LOG_ALWAYS_FATAL("RecordThread::getNextBuffer() starved");
+        buffer->raw = NULL;
+        buffer->frameCount = 0;
+        stage->mRsmpInUnrel = 0;
+        return NOT_ENOUGH_DATA;
+    }
+
+    buffer->raw = (void *) (stage->mInBuffer + front * stage->mInChannelCount);
+    buffer->frameCount = part1;
+    stage->mRsmpInUnrel = part1;
+    return NO_ERROR;
+}
+
+// AudioBufferProvider interface
+void ResamplerStage::BufferProvider::releaseBuffer(AudioBufferProvider::Buffer* buffer)
+{
+    ResamplerStage *stage = mStage;
+    size_t stepCount = buffer->frameCount;
+    if (stepCount == 0) {
+        return;
+    }
+    ALOG_ASSERT(stepCount <= stage->mRsmpInUnrel);
+    stage->mRsmpInUnrel -= stepCount;
+    stage->mRsmpInFront += stepCount;
+    buffer->raw = NULL;
+    buffer->frameCount = 0;
+}
+
+ResamplerStage::ResamplerStage(uint32_t inSampleRate, uint32_t inChannelCount, size_t inFrames,
+        uint32_t sampleRate, audio_channel_mask_t channelMask, audio_format_t format)
+    :   mInSampleRate(inSampleRate), mInChannelCount(inChannelCount), mInFrames(inFrames),
+        mInFramesP2(roundup(inFrames)),
+        mSampleRate(sampleRate), mChannelMask(channelMask), mFormat(format),
+        mChannelCount(audio_channel_count_from_in_mask(channelMask)),
+        mFrameSize(mChannelCount * audio_bytes_per_sample(format)),
+        mOutRear(0),
+        mBufferProvider(this), mRsmpOutBuffer(NULL), mRsmpOutFrameCount(0),
+        mInBuffer(NULL), mInRear(0),
+        // See real initialization of mRsmpInFront at reset()
+        mRsmpInUnrel(0), mRsmpInFront(0)
+{
+    // sink SR
+    mResampler = AudioResampler::create(AUDIO_FORMAT_PCM_16_BIT, inChannelCount, sampleRate);
+    // source SR
+    mResampler->setSampleRate(inSampleRate);
+    mResampler->setVolume(AudioResampler::UNITY_GAIN_FLOAT, AudioResampler::UNITY_GAIN_FLOAT);
+
+    // Hold the same duration as the thread input, so that a client sees the same overrun
+    // behavior whether or not it is resampled.
+    mOutFrames = ((uint64_t) inFrames * sampleRate + inSampleRate - 1) / inSampleRate;
+    mOutFramesP2 = roundup(mOutFrames);
+    mOutBuffer = new int16_t[mOutFramesP2 * mChannelCount];
+}
+
+ResamplerStage::~ResamplerStage()
+{
+    delete mResampler;
+    delete[] mRsmpOutBuffer;
+    delete[] mOutBuffer;
+}
+
+void ResamplerStage::reset(int32_t inRear)
+{
+    mRsmpInFront = inRear;
+    mRsmpInUnrel = 0;
+    // FIXME why reset?
+    mResampler->reset();
+}
+
+void ResamplerStage::process(const int16_t *inBuffer, int32_t inRear)
+{
+    mInBuffer = inBuffer;
+    mInRear = inRear;
+    ssize_t filled = inRear - mRsmpInFront;
+    size_t framesIn;
+
+    if (filled < 0) {
+        // should not happen, but treat like a massive overrun and re-sync
+        mResampler->reset();
+        mRsmpInFront = inRear;
+        mRsmpInUnrel = 0;
+        return;
+    } else if ((size_t) filled <= mInFrames) {
+        framesIn = (size_t) filled;
+    } else {
+        // the tracks of this stage fell behind the input, resume with the latest data.
+        // The resampler must not keep a buffer of the frames which are skipped.
+        mResampler->reset();
+        framesIn = mInFrames;
+        mRsmpInFront = inRear - framesIn;
+        mRsmpInUnrel = 0;
+    }
+
+    // Although we theoretically have framesIn in circular buffer, some of those are
+    // unreleased frames, and thus must be discounted for purpose of budgeting.
+    size_t unreleased = mRsmpInUnrel;
+    framesIn = framesIn > unreleased ? framesIn - unreleased : 0;
+
+    // FIXME framesInNeeded should really be part of resampler API, and should
+    //       depend on the SRC ratio
+    //       to keep the thread input full so resampler always has sufficient input
+    // Do not precompute in/out because floating point is not associative
+    // e.g. a*b/c != a*(b/c).
+    const double in(mInSampleRate);
+    const double out(mSampleRate);
+    size_t framesOut = framesIn > 0 ? floor((framesIn - 1) * out / in) : 0;
+    if (framesOut > mOutFrames) {
+        framesOut = mOutFrames;
+    }
+    if (framesOut == 0) {
+        return;
+    }
+    size_t framesInNeeded = ceil(framesOut * in / out) + 1;
+    ALOGV("have %zu frames in and need %zu in to produce %zu out given in/out ratio of %.4g",
+            framesIn, framesInNeeded, framesOut, in / out);
+    LOG_ALWAYS_FATAL_IF(framesIn < framesInNeeded);
+
+    // reallocate mRsmpOutBuffer as needed; we will grow but never shrink
+    if (mRsmpOutFrameCount < framesOut) {
+        delete[] mRsmpOutBuffer;
+        // resampler always outputs stereo
+        mRsmpOutBuffer = new int32_t[framesOut * FCC_2];
+        mRsmpOutFrameCount = framesOut;
+    }
+
+    // resampler accumulates, but we only have one source
+    memset(mRsmpOutBuffer, 0, framesOut * FCC_2 * sizeof(int32_t));
+    mResampler->resample(mRsmpOutBuffer, framesOut, &mBufferProvider);
+
+    // convert to the output format, in up to two parts as the output buffer is circular
+    int32_t *src = mRsmpOutBuffer;
+    while (framesOut > 0) {
+        size_t rearIndex = mOutRear & (mOutFramesP2 - 1);
+        size_t part1 = mOutFramesP2 - rearIndex;
+        if (part1 > framesOut) {
+            part1 = framesOut;
+        }
+        int16_t *dst = mOutBuffer + rearIndex * mChannelCount;
+        if (mChannelCount == 1) {
+            // temporarily type pun mRsmpOutBuffer from Q4.27 to int16_t
+            ditherAndClamp(src, src, part1);
+            // the resampler always outputs stereo samples:
+            // do post stereo to mono conversion
+            downmix_to_mono_i16_from_stereo_i16(dst, (const int16_t *)src, part1);
+        } else {
+            ditherAndClamp((int32_t *)dst, src, part1);
+        }
+        src += part1 * FCC_2;
+        mOutRear += part1;
+        framesOut -= part1;
+    }
+}
+
+}   // namespace android
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_STAGE_H
+#define ANDROID_AUDIO_RESAMPLER_STAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <system/audio.h>
+#include <utils/RefBase.h>
+#include <media/AudioBufferProvider.h>
+#include "AudioResampler.h"
+
+namespace android {
+
+// Converts the input of a RecordThread to the sample rate, channel mask and format of a client.
+// A stage is shared by all the record tracks with the same parameters: it resamples the input
+// once per thread loop into its own circular buffer, and each track then copies from that
+// buffer at its own position, as it would from the thread input.
+// The thread input is a circular buffer of 16-bit frames with a power-of-2 size, filled up to
+// a rolling rear counter. A stage is only valid for the input configuration it was created
+// with, see matches().
+// Only accessed by the thread loop, except for construction and the read-only parameters.
+class ResamplerStage : public RefBase
+{
+public:
+    ResamplerStage(uint32_t inSampleRate, uint32_t inChannelCount, size_t inFrames,
+            uint32_t sampleRate, audio_channel_mask_t channelMask, audio_format_t format);
+    virtual ~ResamplerStage();
+
+    // restart from the current thread input, as a new track discards all buffered data
+    void        reset(int32_t inRear);
+    // resample all the available thread input, up to inRear, to the output buffer
+    void        process(const int16_t *inBuffer, int32_t inRear);
+
+    bool        matches(uint32_t inSampleRate, uint32_t inChannelCount, size_t inFrames,
+                        uint32_t sampleRate, audio_channel_mask_t channelMask,
+                        audio_format_t format) const {
+                    return inSampleRate == mInSampleRate && inChannelCount == mInChannelCount &&
+                            inFrames == mInFrames && sampleRate == mSampleRate &&
+                            channelMask == mChannelMask && format == mFormat;
+                }
+
+    // thread input
+    const uint32_t                      mInSampleRate;
+    const uint32_t                      mInChannelCount;
+    const size_t                        mInFrames;      // frames kept in the input buffer
+    const size_t                        mInFramesP2;    // input buffer size, a power-of-2
+
+    // client parameters
+    const uint32_t                      mSampleRate;
+    const audio_channel_mask_t          mChannelMask;
+    const audio_format_t                mFormat;
+    const uint32_t                      mChannelCount;
+    const size_t                        mFrameSize;
+
+    // output in the client format, read by the tracks like the thread input
+    int16_t                             *mOutBuffer;
+    size_t                              mOutFrames;     // size of output in frames
+    size_t                              mOutFramesP2;   // size rounded up to a power-of-2
+    // rolling index that is never cleared
+    int32_t                             mOutRear;       // last filled frame + 1
+
+private:
+    class BufferProvider : public AudioBufferProvider
+                        // derives from AudioBufferProvider interface for use by resampler
+    {
+    public:
+        BufferProvider(ResamplerStage* stage) : mStage(stage) { }
+        virtual ~BufferProvider() { }
+        // AudioBufferProvider interface
+        virtual status_t    getNextBuffer(AudioBufferProvider::Buffer* buffer, int64_t pts);
+        virtual void        releaseBuffer(AudioBufferProvider::Buffer* buffer);
+    private:
+        ResamplerStage * const mStage;
+    };
+
+    AudioResampler                      *mResampler;
+    BufferProvider                      mBufferProvider;
+
+    // interleaved stereo pairs of fixed-point Q4.27
+    int32_t                             *mRsmpOutBuffer;
+    // current allocated frame count for the above, which may be larger than needed
+    size_t                              mRsmpOutFrameCount;
+
+    // the input of the current process() call
+    const int16_t                       *mInBuffer;
+    int32_t                             mInRear;
+
+    size_t                              mRsmpInUnrel;   // unreleased frames remaining from
+                                                        // most recent getNextBuffer
+    // rolling counter that is never cleared
+    int32_t                             mRsmpInFront;   // next available input frame
+
+    ResamplerStage(const ResamplerStage&);
+    ResamplerStage& operator = (const ResamplerStage&);
+};
+
+}   // namespace android
+
+#endif  // ANDROID_AUDIO_RESAMPLER_STAGE_H
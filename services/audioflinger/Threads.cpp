@@ -119,6 +119,16 @@ static const uint32_t kMaxNormalSinkBufferSizeMs = 24;
 // Offloaded output thread standby delay: allows track transition without going to standby
 static const nsecs_t kOffloadStandbyDelayNs = seconds(1);
 
+// mix load, as a fraction of the mix period, above which adaptive resamplers are lowered
+static const float kMixLoadHigh = 0.5f;
+// mix load below which adaptive resamplers are raised
+static const float kMixLoadLow = 0.25f;
+// weight of each mix in the smoothed mix load, about 8 mixes
+static const float kMixLoadSmoothing = 0.125f;
+// minimum time between adaptive resampler quality changes, when lowering and raising
+static const nsecs_t kResamplerQualityLowerNs = milliseconds(100);
+static const nsecs_t kResamplerQualityRaiseNs = seconds(2);
+
 // Whether to use fast mixer
 static const enum {
     FastMixer_Never,    // never initialize or use: for debugging only
@@ -147,6 +157,9 @@ static const enum {
 static const int kPriorityAudioApp = 2;
 static const int kPriorityFastMixer = 3;
 static const int kPriorityFastCapture = 3;
+// The normal mixer waits for its parallel mixing workers, so they get SCHED_FIFO as well,
+// below the fast mixer so that they never delay it.
+static const int kPriorityMixerWorker = 2;
 
 // IAudioFlinger::createTrack() reports back to client the total size of shared memory area
 // for the track.  The client then sub-divides this into smaller buffers for its use.
@@ -188,6 +201,42 @@ static void sFastTrackMultiplierInit()
     }
 }
 
+// Number of threads used by the normal mixer to mix tracks in parallel,
+// see AudioMixer::setWorkerCount(). 0 or 1 selects serial mixing.
+// Can be specified per-device via property af.mixer.workers.
+static uint32_t sMixerWorkerCount = 0;
+
+static pthread_once_t sMixerWorkerCountOnce = PTHREAD_ONCE_INIT;
+
+static void sMixerWorkerCountInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.workers", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0' && ul <= AudioMixer::MAX_NUM_WORKERS) {
+            sMixerWorkerCount = (uint32_t) ul;
+        }
+    }
+}
+
+// Enables the configured parallel mixing workers of a mixer, and requests SCHED_FIFO for
+// their threads.
+static void setMixerWorkers(AudioMixer* mixer, bool asynchronous)
+{
+    (void) pthread_once(&sMixerWorkerCountOnce, sMixerWorkerCountInit);
+    mixer->setWorkerCount(sMixerWorkerCount);
+    pid_t tids[AudioMixer::MAX_NUM_WORKERS];
+    size_t count = mixer->getWorkerTids(tids, AudioMixer::MAX_NUM_WORKERS);
+    for (size_t i = 0; i < count; i++) {
+        int err = requestPriority(getpid_cached, tids[i], kPriorityMixerWorker, asynchronous);
+        if (err != 0) {
+            ALOGW("Policy SCHED_FIFO priority %d is unavailable for pid %d tid %d; error %d",
+                    kPriorityMixerWorker, getpid_cached, tids[i], err);
+        }
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 #ifdef ADD_BATTERY_DATA
@@ -1927,7 +1976,7 @@ void AudioFlinger::PlaybackThread::readOutputParameters_l()
     free(mEffectBuffer);
     mEffectBuffer = NULL;
     if (mEffectBufferEnabled) {
-        mEffectBufferFormat = AUDIO_FORMAT_PCM_16_BIT; // Note: Effects support 16b only
+        mEffectBufferFormat = EFFECT_BUFFER_FORMAT;
         mEffectBufferSize = mNormalFrameCount * mChannelCount
                 * audio_bytes_per_sample(mEffectBufferFormat);
         (void)posix_memalign(&mEffectBuffer, 32, mEffectBufferSize);
@@ -2247,7 +2296,7 @@ void AudioFlinger::PlaybackThread::invalidateTracks(audio_stream_type_t streamTy
 status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& chain)
 {
     int session = chain->sessionId();
-    int16_t* buffer = reinterpret_cast<int16_t*>(mEffectBufferEnabled
+    effect_buffer_t *buffer = reinterpret_cast<effect_buffer_t *>(mEffectBufferEnabled
             ? mEffectBuffer : mSinkBuffer);
     bool ownsBuffer = false;
 
@@ -2257,8 +2306,8 @@ status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& c
         // the sink buffer as input
         if (mType != DIRECT) {
             size_t numSamples = mNormalFrameCount * mChannelCount;
-            buffer = new int16_t[numSamples];
-            memset(buffer, 0, numSamples * sizeof(int16_t));
+            buffer = new effect_buffer_t[numSamples];
+            memset(buffer, 0, numSamples * sizeof(effect_buffer_t));
             ALOGV("addEffectChain_l() creating new input buffer %p session %d", buffer, session);
             ownsBuffer = true;
         }
@@ -2288,7 +2337,7 @@ status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& c
     }
     chain->setThread(this);
     chain->setInBuffer(buffer, ownsBuffer);
-    chain->setOutBuffer(reinterpret_cast<int16_t*>(mEffectBufferEnabled
+    chain->setOutBuffer(reinterpret_cast<effect_buffer_t *>(mEffectBufferEnabled
             ? mEffectBuffer : mSinkBuffer));
     // Effect chain for session AUDIO_SESSION_OUTPUT_STAGE is inserted at end of effect
     // chains list in order to be processed last as it contains output stage effects
@@ -2339,7 +2388,7 @@ size_t AudioFlinger::PlaybackThread::removeEffectChain_l(const sp<EffectChain>&
             for (size_t i = 0; i < mTracks.size(); ++i) {
                 sp<Track> track = mTracks[i];
                 if (session == track->sessionId()) {
-                    track->setMainBuffer(reinterpret_cast<int16_t*>(mSinkBuffer));
+                    track->setMainBuffer(reinterpret_cast<effect_buffer_t *>(mSinkBuffer));
                     chain->decTrackCnt();
                 }
             }
@@ -2558,8 +2607,8 @@ bool AudioFlinger::PlaybackThread::threadLoop()
             // Merge mMixerBuffer data into mEffectBuffer (if any effects are valid)
             // or mSinkBuffer (if there are no effects).
             //
-            // This is done pre-effects computation; if effects change to
-            // support higher precision, this needs to move.
+            // This is done pre-effects computation; with FLOAT_EFFECT_CHAIN the mixer and
+            // effect buffers are both float and this is a plain copy.
             //
             // mMixerBufferValid is only set true by MixerThread::prepareTracks_l().
             // TODO use sleepTime == 0 as an additional condition.
@@ -2788,7 +2837,9 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
     :   PlaybackThread(audioFlinger, output, id, device, type),
         // mAudioMixer below
         // mFastMixer below
-        mFastMixerFutex(0)
+        mFastMixerFutex(0),
+        mMixLoad(0), mMixLoadPermille(0),
+        mResamplerQualityTime(0)
         // mOutputSink below
         // mPipeSink below
         // mNormalSink below
@@ -2799,6 +2850,7 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
             mSampleRate, mChannelMask, mChannelCount, mFormat, mFrameSize, mFrameCount,
             mNormalFrameCount);
     mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
+    setMixerWorkers(mAudioMixer, false /*asynchronous*/);
 
     // create an NBAIO sink for the HAL output stream, and negotiate
     mOutputSink = new AudioStreamOutSink(output->stream);
@@ -3118,7 +3170,9 @@ void AudioFlinger::MixerThread::threadLoop_mix()
     }
 
     // mix buffers...
+    const nsecs_t mixStartNs = systemTime();
     mAudioMixer->process(pts);
+    updateResamplerQuality(systemTime() - mixStartNs);
     mCurrentWriteLength = mSinkBufferSize;
     // increase sleep time progressively when application underrun condition clears.
     // Only increase sleep time if the mixer is ready for two consecutive times to avoid
@@ -3133,6 +3187,31 @@ void AudioFlinger::MixerThread::threadLoop_mix()
 
 }
 
+void AudioFlinger::MixerThread::updateResamplerQuality(nsecs_t mixNs)
+{
+    // The mix load is the fraction of the mix period spent in the mixer, which includes
+    // the resamplers. It is measured in wall time, so that other threads competing for
+    // the CPU count as load too. Adaptive resamplers are lowered one at a time while the
+    // load is high, and raised slowly while it is low, within the budget of AudioResampler.
+    const nsecs_t periodNs = ((nsecs_t) mNormalFrameCount * 1000000000) / mSampleRate;
+    mMixLoad += ((float) mixNs / periodNs - mMixLoad) * kMixLoadSmoothing;
+    android_atomic_release_store((int32_t) (mMixLoad * 1000), &mMixLoadPermille);
+    const nsecs_t now = systemTime();
+    if (mMixLoad > kMixLoadHigh) {
+        if (now - mResamplerQualityTime >= kResamplerQualityLowerNs
+                && mAudioMixer->lowerResamplerQuality()) {
+            ALOGV("mix load %.2f, lowered a resampler quality", mMixLoad);
+            mResamplerQualityTime = now;
+        }
+    } else if (mMixLoad < kMixLoadLow) {
+        if (now - mResamplerQualityTime >= kResamplerQualityRaiseNs
+                && mAudioMixer->raiseResamplerQuality()) {
+            ALOGV("mix load %.2f, raised a resampler quality", mMixLoad);
+            mResamplerQualityTime = now;
+        }
+    }
+}
+
 void AudioFlinger::MixerThread::threadLoop_sleepTime()
 {
     // If no tracks are ready, sleep once for the duration of an output
@@ -3569,10 +3648,13 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                 // TODO: override track->mainBuffer()?
                 mMixerBufferValid = true;
             } else {
+                // the main buffer is either a 16 bit sink buffer or an effect chain input buffer
+                const audio_format_t mainBufferFormat = track->mainBuffer() == mSinkBuffer
+                        ? AUDIO_FORMAT_PCM_16_BIT : EFFECT_BUFFER_FORMAT;
                 mAudioMixer->setParameter(
                         name,
                         AudioMixer::TRACK,
-                        AudioMixer::MIXER_FORMAT, (void *)AUDIO_FORMAT_PCM_16_BIT);
+                        AudioMixer::MIXER_FORMAT, (void *)mainBufferFormat);
                 mAudioMixer->setParameter(
                         name,
                         AudioMixer::TRACK,
@@ -3846,6 +3928,8 @@ bool AudioFlinger::MixerThread::checkForNewParameter_l(const String8& keyValuePa
             readOutputParameters_l();
             delete mAudioMixer;
             mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
+            // the thread lock is held, do not wait for the scheduling policy service
+            setMixerWorkers(mAudioMixer, true /*asynchronous*/);
             for (size_t i = 0; i < mTracks.size() ; i++) {
                 int name = getTrackName_l(mTracks[i]->mChannelMask,
                         mTracks[i]->mFormat, mTracks[i]->mSessionId);
@@ -3881,11 +3965,41 @@ void AudioFlinger::MixerThread::dumpInternals(int fd, const Vector<String16>& ar
     PlaybackThread::dumpInternals(fd, args);
 
     dprintf(fd, "  AudioMixer tracks: 0x%08x\n", mAudioMixer->trackNames());
+    dprintf(fd, "  Mix load: %.1f%% of the mix period\n",
+            android_atomic_acquire_load(&mMixLoadPermille) / 10.);
 
     // Make a non-atomic copy of fast mixer dump state so it won't change underneath us
     const FastMixerDumpState copy(mFastMixerDumpState);
     copy.dump(fd);
 
+    // "dumpsys media.audio_flinger --fast-histograms" also saves the per-track histograms
+    // in binary form for offline analysis, named like the tee sink dumps and rotated with them
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == String16("--fast-histograms")) {
+            AudioFlinger::rotateDumpFiles(fd, ".hist");
+            char histTime[16];
+            time_t now = time(NULL);
+            struct tm tm;
+            localtime_r(&now, &tm);
+            strftime(histTime, sizeof(histTime), "%Y%m%d%H%M%S", &tm);
+            char path[64];
+            snprintf(path, sizeof(path), "/data/misc/media/%s_%d.hist", histTime, mId);
+            int histFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+            if (histFd >= 0) {
+                ssize_t written = copy.dumpHistograms(histFd);
+                close(histFd);
+                if (written >= 0) {
+                    dprintf(fd, "  Fast track histograms copied to %s\n", path);
+                } else {
+                    dprintf(fd, "  Unable to write %s: %s\n", path, strerror(-written));
+                }
+            } else {
+                dprintf(fd, "  Unable to create %s: %s\n", path, strerror(errno));
+            }
+            break;
+        }
+    }
+
 #ifdef STATE_QUEUE_DUMP
     // Similar for state queue
     StateQueueObserverDump observerCopy = mStateQueueObserverDump;
@@ -5216,6 +5330,9 @@ reacquire_wakelock:
                     doBroadcast = true;
                     mStandby = false;
                     activeTrack->mState = TrackBase::ACTIVE;
+                    if (activeTrack->mResamplerStage != 0) {
+                        startResamplerStage_l(activeTrack);
+                    }
                     break;
 
                 case TrackBase::ACTIVE:
@@ -5361,6 +5478,20 @@ reacquire_wakelock:
         rear = mRsmpInRear += framesRead;
 
         size = activeTracks.size();
+
+        // resample the input once for all the tracks sharing each resampler stage
+        {
+            SortedVector< sp<ResamplerStage> > stages;
+            for (size_t i = 0; i < size; i++) {
+                if (activeTracks[i]->mResamplerStage != 0) {
+                    stages.add(activeTracks[i]->mResamplerStage);
+                }
+            }
+            for (size_t i = 0; i < stages.size(); i++) {
+                stages[i]->process(mRsmpInBuffer, rear);
+            }
+        }
+
         // loop over each active track
         for (size_t i = 0; i < size; i++) {
             activeTrack = activeTracks[i];
@@ -5370,6 +5501,28 @@ reacquire_wakelock:
                 continue;
             }
 
+            // the track reads either the thread input, or the output of its resampler stage
+            // which is already in the track channel count
+            const ResamplerStage *stage = activeTrack->mResamplerStage.get();
+            const int8_t *srcBuffer;
+            size_t srcFrames;
+            size_t srcFramesP2;
+            size_t srcFrameSize;
+            int32_t srcRear;
+            if (stage != NULL) {
+                srcBuffer = (const int8_t *)stage->mOutBuffer;
+                srcFrames = stage->mOutFrames;
+                srcFramesP2 = stage->mOutFramesP2;
+                srcFrameSize = stage->mFrameSize;
+                srcRear = stage->mOutRear;
+            } else {
+                srcBuffer = (const int8_t *)mRsmpInBuffer;
+                srcFrames = mRsmpInFrames;
+                srcFramesP2 = mRsmpInFramesP2;
+                srcFrameSize = mFrameSize;
+                srcRear = rear;
+            }
+
             enum {
                 OVERRUN_UNKNOWN,
                 OVERRUN_TRUE,
@@ -5385,20 +5538,20 @@ reacquire_wakelock:
                 LOG_ALWAYS_FATAL_IF((status == OK) != (framesOut > 0));
 
                 int32_t front = activeTrack->mRsmpInFront;
-                ssize_t filled = rear - front;
+                ssize_t filled = srcRear - front;
                 size_t framesIn;
 
                 if (filled < 0) {
                     // should not happen, but treat like a massive overrun and re-sync
                     framesIn = 0;
-                    activeTrack->mRsmpInFront = rear;
+                    activeTrack->mRsmpInFront = srcRear;
                     overrun = OVERRUN_TRUE;
-                } else if ((size_t) filled <= mRsmpInFrames) {
+                } else if ((size_t) filled <= srcFrames) {
                     framesIn = (size_t) filled;
                 } else {
                     // client is not keeping up with server, but give it latest data
-                    framesIn = mRsmpInFrames;
-                    activeTrack->mRsmpInFront = front = rear - framesIn;
+                    framesIn = srcFrames;
+                    activeTrack->mRsmpInFront = front = srcRear - framesIn;
                     overrun = OVERRUN_TRUE;
                 }
 
@@ -5406,109 +5559,33 @@ reacquire_wakelock:
                     break;
                 }
 
-                if (activeTrack->mResampler == NULL) {
-                    // no resampling
-                    if (framesIn > framesOut) {
-                        framesIn = framesOut;
-                    } else {
-                        framesOut = framesIn;
-                    }
-                    int8_t *dst = activeTrack->mSink.i8;
-                    while (framesIn > 0) {
-                        front &= mRsmpInFramesP2 - 1;
-                        size_t part1 = mRsmpInFramesP2 - front;
-                        if (part1 > framesIn) {
-                            part1 = framesIn;
-                        }
-                        int8_t *src = (int8_t *)mRsmpInBuffer + (front * mFrameSize);
-                        if (mChannelCount == activeTrack->mChannelCount) {
-                            memcpy(dst, src, part1 * mFrameSize);
-                        } else if (mChannelCount == 1) {
-                            upmix_to_stereo_i16_from_mono_i16((int16_t *)dst, (const int16_t *)src,
-                                    part1);
-                        } else {
-                            downmix_to_mono_i16_from_stereo_i16((int16_t *)dst, (const int16_t *)src,
-                                    part1);
-                        }
-                        dst += part1 * activeTrack->mFrameSize;
-                        front += part1;
-                        framesIn -= part1;
-                    }
-                    activeTrack->mRsmpInFront += framesOut;
-
+                if (framesIn > framesOut) {
+                    framesIn = framesOut;
                 } else {
-                    // resampling
-                    // FIXME framesInNeeded should really be part of resampler API, and should
-                    //       depend on the SRC ratio
-                    //       to keep mRsmpInBuffer full so resampler always has sufficient input
-                    size_t framesInNeeded;
-                    // FIXME only re-calculate when it changes, and optimize for common ratios
-                    // Do not precompute in/out because floating point is not associative
-                    // e.g. a*b/c != a*(b/c).
-                    const double in(mSampleRate);
-                    const double out(activeTrack->mSampleRate);
-                    framesInNeeded = ceil(framesOut * in / out) + 1;
-                    ALOGV("need %u frames in to produce %u out given in/out ratio of %.4g",
-                                framesInNeeded, framesOut, in / out);
-                    // Although we theoretically have framesIn in circular buffer, some of those are
-                    // unreleased frames, and thus must be discounted for purpose of budgeting.
-                    size_t unreleased = activeTrack->mRsmpInUnrel;
-                    framesIn = framesIn > unreleased ? framesIn - unreleased : 0;
-                    if (framesIn < framesInNeeded) {
-                        ALOGV("not enough to resample: have %u frames in but need %u in to "
-                                "produce %u out given in/out ratio of %.4g",
-                                framesIn, framesInNeeded, framesOut, in / out);
-                        size_t newFramesOut = framesIn > 0 ? floor((framesIn - 1) * out / in) : 0;
-                        LOG_ALWAYS_FATAL_IF(newFramesOut >= framesOut);
-                        if (newFramesOut == 0) {
-                            break;
-                        }
-                        framesInNeeded = ceil(newFramesOut * in / out) + 1;
-                        ALOGV("now need %u frames in to produce %u out given out/in ratio of %.4g",
-                                framesInNeeded, newFramesOut, out / in);
-                        LOG_ALWAYS_FATAL_IF(framesIn < framesInNeeded);
-                        ALOGV("success 2: have %u frames in and need %u in to produce %u out "
-                              "given in/out ratio of %.4g",
-                              framesIn, framesInNeeded, newFramesOut, in / out);
-                        framesOut = newFramesOut;
-                    } else {
-                        ALOGV("success 1: have %u in and need %u in to produce %u out "
-                            "given in/out ratio of %.4g",
-                            framesIn, framesInNeeded, framesOut, in / out);
-                    }
-
-                    // reallocate mRsmpOutBuffer as needed; we will grow but never shrink
-                    if (activeTrack->mRsmpOutFrameCount < framesOut) {
-                        // FIXME why does each track need it's own mRsmpOutBuffer? can't they share?
-                        delete[] activeTrack->mRsmpOutBuffer;
-                        // resampler always outputs stereo
-                        activeTrack->mRsmpOutBuffer = new int32_t[framesOut * FCC_2];
-                        activeTrack->mRsmpOutFrameCount = framesOut;
+                    framesOut = framesIn;
+                }
+                int8_t *dst = activeTrack->mSink.i8;
+                while (framesIn > 0) {
+                    front &= srcFramesP2 - 1;
+                    size_t part1 = srcFramesP2 - front;
+                    if (part1 > framesIn) {
+                        part1 = framesIn;
                     }
-
-                    // resampler accumulates, but we only have one source track
-                    memset(activeTrack->mRsmpOutBuffer, 0, framesOut * FCC_2 * sizeof(int32_t));
-                    activeTrack->mResampler->resample(activeTrack->mRsmpOutBuffer, framesOut,
-                            // FIXME how about having activeTrack implement this interface itself?
-                            activeTrack->mResamplerBufferProvider
-                            /*this*/ /* AudioBufferProvider* */);
-                    // ditherAndClamp() works as long as all buffers returned by
-                    // activeTrack->getNextBuffer() are 32 bit aligned which should be always true.
-                    if (activeTrack->mChannelCount == 1) {
-                        // temporarily type pun mRsmpOutBuffer from Q4.27 to int16_t
-                        ditherAndClamp(activeTrack->mRsmpOutBuffer, activeTrack->mRsmpOutBuffer,
-                                framesOut);
-                        // the resampler always outputs stereo samples:
-                        // do post stereo to mono conversion
-                        downmix_to_mono_i16_from_stereo_i16(activeTrack->mSink.i16,
-                                (const int16_t *)activeTrack->mRsmpOutBuffer, framesOut);
+                    const int8_t *src = srcBuffer + (front * srcFrameSize);
+                    if (stage != NULL || mChannelCount == activeTrack->mChannelCount) {
+                        memcpy(dst, src, part1 * srcFrameSize);
+                    } else if (mChannelCount == 1) {
+                        upmix_to_stereo_i16_from_mono_i16((int16_t *)dst, (const int16_t *)src,
+                                part1);
                     } else {
-                        ditherAndClamp((int32_t *)activeTrack->mSink.raw,
-                                activeTrack->mRsmpOutBuffer, framesOut);
+                        downmix_to_mono_i16_from_stereo_i16((int16_t *)dst, (const int16_t *)src,
+                                part1);
                     }
-                    // now done with mRsmpOutBuffer
-
+                    dst += part1 * activeTrack->mFrameSize;
+                    front += part1;
+                    framesIn -= part1;
                 }
+                activeTrack->mRsmpInFront += framesOut;
 
                 if (framesOut > 0 && (overrun == OVERRUN_UNKNOWN)) {
                     overrun = OVERRUN_FALSE;
@@ -5816,12 +5893,10 @@ status_t AudioFlinger::RecordThread::start(RecordThread::RecordTrack* recordTrac
         // was initialized to some value closer to the thread's mRsmpInFront, then the track could
         // see previously buffered data before it called start(), but with greater risk of overrun.
 
+        // A track with a resampler stage catches up with the stage output instead, once the
+        // thread loop makes it active, because the stage may be in use by the thread loop now.
+
         recordTrack->mRsmpInFront = mRsmpInRear;
-        recordTrack->mRsmpInUnrel = 0;
-        // FIXME why reset?
-        if (recordTrack->mResampler != NULL) {
-            recordTrack->mResampler->reset();
-        }
         recordTrack->mState = TrackBase::STARTING_2;
         // signal thread to start
         mWaitWorkCV.broadcast();
@@ -5946,6 +6021,17 @@ void AudioFlinger::RecordThread::dumpInternals(int fd, const Vector<String16>& a
     }
     dprintf(fd, "  Fast capture thread: %s\n", hasFastCapture() ? "yes" : "no");
     dprintf(fd, "  Fast track available: %s\n", mFastTrackAvail ? "yes" : "no");
+    {
+        Mutex::Autolock _l(mResamplerStagesLock);
+        for (size_t i = 0; i < mResamplerStages.size(); i++) {
+            sp<ResamplerStage> stage = mResamplerStages[i].promote();
+            if (stage != 0) {
+                dprintf(fd, "  Resampler stage: %u Hz, channel mask %#x, format %#x, %d tracks\n",
+                        stage->mSampleRate, stage->mChannelMask, stage->mFormat,
+                        stage->getStrongCount() - 1);
+            }
+        }
+    }
 
     dumpBase(fd, args);
 }
@@ -5995,64 +6081,53 @@ void AudioFlinger::RecordThread::dumpTracks(int fd, const Vector<String16>& args
     write(fd, result.string(), result.size());
 }
 
-// AudioBufferProvider interface
-status_t AudioFlinger::RecordThread::ResamplerBufferProvider::getNextBuffer(
-        AudioBufferProvider::Buffer* buffer, int64_t pts __unused)
-{
-    RecordTrack *activeTrack = mRecordTrack;
-    sp<ThreadBase> threadBase = activeTrack->mThread.promote();
-    if (threadBase == 0) {
-        buffer->frameCount = 0;
-        buffer->raw = NULL;
-        return NOT_ENOUGH_DATA;
-    }
-    RecordThread *recordThread = (RecordThread *) threadBase.get();
-    int32_t rear = recordThread->mRsmpInRear;
-    int32_t front = activeTrack->mRsmpInFront;
-    ssize_t filled = rear - front;
-    // FIXME should not be P2 (don't want to increase latency)
-    // FIXME if client not keeping up, discard
-    LOG_ALWAYS_FATAL_IF(!(0 <= filled && (size_t) filled <= recordThread->mRsmpInFrames));
-    // 'filled' may be non-contiguous, so return only the first contiguous chunk
-    front &= recordThread->mRsmpInFramesP2 - 1;
-    size_t part1 = recordThread->mRsmpInFramesP2 - front;
-    if (part1 > (size_t) filled) {
-        part1 = filled;
-    }
-    size_t ask = buffer->frameCount;
-    ALOG_ASSERT(ask > 0);
-    if (part1 > ask) {
-        part1 = ask;
-    }
-    if (part1 == 0) {
-        // Higher-level should keep mRsmpInBuffer full, and not call resampler if empty
-        LOG_ALWAYS_FATAL("RecordThread::getNextBuffer() starved");
-        buffer->raw = NULL;
-        buffer->frameCount = 0;
-        activeTrack->mRsmpInUnrel = 0;
-        return NOT_ENOUGH_DATA;
-    }
-
-    buffer->raw = recordThread->mRsmpInBuffer + front * recordThread->mChannelCount;
-    buffer->frameCount = part1;
-    activeTrack->mRsmpInUnrel = part1;
-    return NO_ERROR;
+sp<ResamplerStage> AudioFlinger::RecordThread::getResamplerStage(
+        uint32_t sampleRate, audio_channel_mask_t channelMask, audio_format_t format)
+{
+    // FIXME I don't understand either of the channel count checks
+    if (mSampleRate == sampleRate || mChannelCount > FCC_2 ||
+            audio_channel_count_from_in_mask(channelMask) > FCC_2) {
+        return 0;
+    }
+    Mutex::Autolock _l(mResamplerStagesLock);
+    for (size_t i = 0; i < mResamplerStages.size(); ) {
+        sp<ResamplerStage> stage = mResamplerStages[i].promote();
+        if (stage == 0) {
+            // all its tracks were destroyed
+            mResamplerStages.removeAt(i);
+            continue;
+        }
+        if (stage->matches(mSampleRate, mChannelCount, mRsmpInFrames,
+                           sampleRate, channelMask, format)) {
+            return stage;
+        }
+        i++;
+    }
+    sp<ResamplerStage> stage = new ResamplerStage(mSampleRate, mChannelCount, mRsmpInFrames,
+                                                  sampleRate, channelMask, format);
+    mResamplerStages.add(stage);
+    return stage;
 }
 
-// AudioBufferProvider interface
-void AudioFlinger::RecordThread::ResamplerBufferProvider::releaseBuffer(
-        AudioBufferProvider::Buffer* buffer)
+void AudioFlinger::RecordThread::startResamplerStage_l(const sp<RecordTrack>& recordTrack)
 {
-    RecordTrack *activeTrack = mRecordTrack;
-    size_t stepCount = buffer->frameCount;
-    if (stepCount == 0) {
-        return;
+    const sp<ResamplerStage>& stage = recordTrack->mResamplerStage;
+    // The stage was processed by the last thread loop if another of its tracks was active,
+    // in which case it must not skip any frames. Otherwise it restarts from the current input.
+    bool inUse = false;
+    for (size_t i = 0; i < mActiveTracks.size(); i++) {
+        const sp<RecordTrack>& track = mActiveTracks[i];
+        if (track != recordTrack && track->mResamplerStage == stage &&
+                (track->mState == TrackBase::ACTIVE || track->mState == TrackBase::PAUSING)) {
+            inUse = true;
+            break;
+        }
     }
-    ALOG_ASSERT(stepCount <= activeTrack->mRsmpInUnrel);
-    activeTrack->mRsmpInUnrel -= stepCount;
-    activeTrack->mRsmpInFront += stepCount;
-    buffer->raw = NULL;
-    buffer->frameCount = 0;
+    if (!inUse) {
+        stage->reset(mRsmpInRear);
+    }
+    // This is what makes a new client discard all buffered data, as in start()
+    recordTrack->mRsmpInFront = stage->mOutRear;
 }
 
 bool AudioFlinger::RecordThread::checkForNewParameter_l(const String8& keyValuePair,
@@ -6239,7 +6314,24 @@ void AudioFlinger::RecordThread::readInputParameters_l()
     mRsmpInBuffer = new int16_t[(mRsmpInFramesP2 + mFrameCount - 1) * mChannelCount];
 
     // AudioRecord mSampleRate and mChannelCount are constant due to AudioRecord API constraints.
-    // But if thread's mSampleRate or mChannelCount changes, how will that affect active tracks?
+    // The resampler stages are built for the input sample rate, channel count and mRsmpInFrames,
+    // so the tracks move to new stages, and all of them discard the data of the previous input.
+    // getResamplerStage() also checks these parameters, but the old stages are released now.
+    {
+        Mutex::Autolock _l(mResamplerStagesLock);
+        mResamplerStages.clear();
+    }
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        const sp<RecordTrack>& track = mTracks[i];
+        track->mResamplerStage = getResamplerStage(track->sampleRate(), track->channelMask(),
+                                                   track->format());
+        if (track->mResamplerStage != 0) {
+            track->mResamplerStage->reset(mRsmpInRear);
+            track->mRsmpInFront = track->mResamplerStage->mOutRear;
+        } else {
+            track->mRsmpInFront = mRsmpInRear;
+        }
+    }
 }
 
 uint32_t AudioFlinger::RecordThread::getInputFramesLost()
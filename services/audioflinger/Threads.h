@@ -649,7 +649,7 @@ protected:
     // Size of mEffectsBuffer in bytes: mNormalFrameCount * #channels * sampsize.
     size_t                          mEffectBufferSize;
 
-    // The audio format of mEffectsBuffer. Set to AUDIO_FORMAT_PCM_16_BIT only.
+    // The audio format of mEffectsBuffer. Set to EFFECT_BUFFER_FORMAT only.
     audio_format_t                  mEffectBufferFormat;
 
     // An internal flag set to true by MixerThread::prepareTracks_l()
@@ -880,6 +880,12 @@ private:
                 //          mFastMixer->sq()    // for mutating and pushing state
                 int32_t     mFastMixerFutex;    // for cold idle
 
+                // lowers or raises the quality of adaptive resamplers from the mix load
+                void        updateResamplerQuality(nsecs_t mixNs);
+                float       mMixLoad;               // smoothed mix time over mix period
+                volatile int32_t mMixLoadPermille;  // mMixLoad published for dumpInternals()
+                nsecs_t     mResamplerQualityTime;  // last change of a resampler quality
+
 public:
     virtual     bool        hasFastMixer() const { return mFastMixer != 0; }
     virtual     FastTrackUnderruns getFastTrackUnderruns(size_t fastIndex) const {
@@ -1033,18 +1039,6 @@ class RecordThread : public ThreadBase
 public:
 
     class RecordTrack;
-    class ResamplerBufferProvider : public AudioBufferProvider
-                        // derives from AudioBufferProvider interface for use by resampler
-    {
-    public:
-        ResamplerBufferProvider(RecordTrack* recordTrack) : mRecordTrack(recordTrack) { }
-        virtual ~ResamplerBufferProvider() { }
-        // AudioBufferProvider interface
-        virtual status_t    getNextBuffer(AudioBufferProvider::Buffer* buffer, int64_t pts);
-        virtual void        releaseBuffer(AudioBufferProvider::Buffer* buffer);
-    private:
-        RecordTrack * const mRecordTrack;
-    };
 
 #include "RecordTracks.h"
 
@@ -1119,6 +1113,12 @@ public:
             void        readInputParameters_l();
     virtual uint32_t    getInputFramesLost();
 
+            // returns the resampler stage shared by the tracks with these parameters,
+            // creating it if needed, or 0 if the thread input needs no resampling
+            sp<ResamplerStage> getResamplerStage(uint32_t sampleRate,
+                                                 audio_channel_mask_t channelMask,
+                                                 audio_format_t format);
+
     virtual status_t addEffectChain_l(const sp<EffectChain>& chain);
     virtual size_t removeEffectChain_l(const sp<EffectChain>& chain);
     virtual uint32_t hasAudioSession(int sessionId) const;
@@ -1141,6 +1141,9 @@ private:
             // Enter standby if not already in standby, and set mStandby flag
             void    standbyIfNotAlreadyInStandby();
 
+            // Catch up a track becoming active with the output of its resampler stage
+            void    startResamplerStage_l(const sp<RecordTrack>& recordTrack);
+
             // Call the HAL standby method unconditionally, and don't change mStandby flag
             void    inputStandBy();
 
@@ -1161,6 +1164,10 @@ private:
             // rolling index that is never cleared
             int32_t                             mRsmpInRear;    // last filled frame + 1
 
+            // resampler stages, each held by the tracks which use it
+            Mutex                               mResamplerStagesLock;
+            Vector< wp<ResamplerStage> >        mResamplerStages;
+
             // For dumpsys
             const sp<NBAIO_Sink>                mTeeSink;
 
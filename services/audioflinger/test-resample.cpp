@@ -36,13 +36,14 @@ using namespace android;
 static bool gVerbose = false;
 
 static int usage(const char* name) {
-    fprintf(stderr,"Usage: %s [-p] [-f] [-F] [-v] [-c channels]"
+    fprintf(stderr,"Usage: %s [-p] [-f] [-b] [-F] [-v] [-c channels]"
                    " [-q {dq|lq|mq|hq|vhq|dlq|dmq|dhq}]"
                    " [-i input-sample-rate] [-o output-sample-rate]"
                    " [-O csv] [-P csv] [<input-file>]"
                    " <output-file>\n", name);
     fprintf(stderr,"    -p    enable profiling\n");
     fprintf(stderr,"    -f    enable filter profiling\n");
+    fprintf(stderr,"    -b    benchmark ns/frame for every quality level (<output-file> optional)\n");
     fprintf(stderr,"    -F    enable floating point -q {dlq|dmq|dhq} only");
     fprintf(stderr,"    -v    verbose : log buffer provider calls\n");
     fprintf(stderr,"    -c    # channels (1-2 for lq|mq|hq; 1-8 for dlq|dmq|dhq)\n");
@@ -105,6 +106,7 @@ int main(int argc, char* argv[]) {
     const char* const progname = argv[0];
     bool profileResample = false;
     bool profileFilter = false;
+    bool benchmark = false;
     bool useFloat = false;
     int channels = 1;
     int input_freq = 0;
@@ -114,7 +116,7 @@ int main(int argc, char* argv[]) {
     Vector<int> Pvalues;
 
     int ch;
-    while ((ch = getopt(argc, argv, "pfFvc:q:i:o:O:P:")) != -1) {
+    while ((ch = getopt(argc, argv, "pfbFvc:q:i:o:O:P:")) != -1) {
         switch (ch) {
         case 'p':
             profileResample = true;
@@ -122,6 +124,9 @@ int main(int argc, char* argv[]) {
         case 'f':
             profileFilter = true;
             break;
+        case 'b':
+            benchmark = true;
+            break;
         case 'F':
             useFloat = true;
             break;
@@ -193,7 +198,15 @@ int main(int argc, char* argv[]) {
 
     const char* file_in = NULL;
     const char* file_out = NULL;
-    if (argc == 1) {
+    if (argc == 0 && benchmark) {
+        // no output file is written in benchmark mode
+        if (input_freq == 0) {
+            input_freq = 44100;
+        }
+        if (output_freq == 0) {
+            output_freq = 48000;
+        }
+    } else if (argc == 1) {
         file_out = argv[0];
     } else if (argc == 2) {
         file_in = argv[0];
@@ -335,6 +348,66 @@ int main(int argc, char* argv[]) {
     size_t output_frames = ((int64_t) input_frames * output_freq) / input_freq;
     size_t output_size = output_frames * output_framesize;
 
+    if (benchmark) {
+        // Report the cost of each quality level as ns per output frame,
+        // to compare resampler implementations (e.g. C vs NEON vs SSE).
+        static const struct {
+            AudioResampler::src_quality quality;
+            const char *name;
+        } qualities[] = {
+            { AudioResampler::LOW_QUALITY,       "lq" },
+            { AudioResampler::MED_QUALITY,       "mq" },
+            { AudioResampler::HIGH_QUALITY,      "hq" },
+            { AudioResampler::VERY_HIGH_QUALITY, "vhq" },
+            { AudioResampler::DYN_LOW_QUALITY,   "dlq" },
+            { AudioResampler::DYN_MED_QUALITY,   "dmq" },
+            { AudioResampler::DYN_HIGH_QUALITY,  "dhq" },
+        };
+        const int trials = 4;
+        const int looplimit = 4;
+        void* bench_vaddr = malloc(output_size);
+
+        printf("%d Hz -> %d Hz  channels: %d  format: %s\n",
+                input_freq, output_freq, channels, useFloat ? "float" : "int16");
+        for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); ++q) {
+            if (qualities[q].quality < AudioResampler::DYN_LOW_QUALITY
+                    && (useFloat || channels > 2)) {
+                continue; // not supported by the legacy resamplers
+            }
+            AudioResampler* resampler = AudioResampler::create(format, channels,
+                    output_freq, qualities[q].quality);
+            resampler->setSampleRate(input_freq);
+            resampler->setVolume(AudioResampler::UNITY_GAIN_FLOAT,
+                    AudioResampler::UNITY_GAIN_FLOAT);
+
+            int64_t time = 0;
+            for (int n = 0; n < trials; ++n) {
+                timespec start, end;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (int i = 0; i < looplimit; ++i) {
+                    resampler->resample((int*) bench_vaddr, output_frames, &provider);
+                    provider.reset();
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                int64_t start_ns = start.tv_sec * 1000000000LL + start.tv_nsec;
+                int64_t end_ns = end.tv_sec * 1000000000LL + end.tv_nsec;
+                int64_t diff_ns = end_ns - start_ns;
+                if (n == 0 || diff_ns < time) {
+                    time = diff_ns;   // save the best out of our trials.
+                }
+            }
+            printf("quality: %-4s  ns/frame: %8.2f  Mfrms/s: %.2lf\n", qualities[q].name,
+                    (double)time / (output_frames * looplimit),
+                    output_frames * looplimit / (time / 1e9) / 1e6);
+            resampler->reset();
+            delete resampler;
+        }
+        free(bench_vaddr);
+        if (file_out == NULL) {
+            return EXIT_SUCCESS;
+        }
+    }
+
     if (profileFilter) {
         // Check how fast sample rate changes are that require filter changes.
         // The delta sample rate changes must indicate a downsampling ratio,
@@ -16,6 +16,8 @@ echo "waiting for device"
 adb root && adb wait-for-device remount
 adb push $OUT/system/lib/libaudioresampler.so /system/lib
 adb push $OUT/system/bin/resampler_tests /system/bin
+adb push $OUT/system/bin/mixerops_tests /system/bin
+adb push $OUT/system/bin/resampler_stage_tests /system/bin
 
 sh $ANDROID_BUILD_TOP/frameworks/av/services/audioflinger/tests/run_all_unit_tests.sh
 
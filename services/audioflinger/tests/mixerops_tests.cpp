@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audioflinger_mixerops_tests"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+#include "AudioMixer.h"
+#include "AudioMixerOpsSse.h"
+
+namespace android {
+
+// Runs the x86 track hooks selected by AudioMixer::getTrackHook() against the C hooks
+// track__16BitsStereo() and track__16BitsMono(), which are selected when no SIMD type is
+// available, so that any drift between the two is caught.
+class MixerOpsTest : public ::testing::Test {
+protected:
+    typedef AudioMixer::hook_t hook_t;
+    typedef AudioMixer::track_t track_t;
+
+    static const int SIMDTYPE_NONE = AudioMixer::SIMDTYPE_NONE;
+    static const int SIMDTYPE_SSE2 = AudioMixer::SIMDTYPE_SSE2;
+    static const int SIMDTYPE_AVX2 = AudioMixer::SIMDTYPE_AVX2;
+
+    static void SetUpTestCase() {
+        pthread_once(&AudioMixer::sOnceControl, &AudioMixer::sInitRoutine);
+    }
+
+    // the SIMD type selected for this cpu by AudioMixer::sInitRoutine()
+    static int simdType() {
+        return AudioMixer::sSimdType;
+    }
+
+    // returns the hook the mixer would use for a 16 bit track with the given SIMD type
+    static hook_t getHook(int simdType, uint32_t channels) {
+        const int savedSimdType = AudioMixer::sSimdType;
+        AudioMixer::sSimdType = simdType;
+        hook_t hook = AudioMixer::getTrackHook(
+                channels == 2 ? AudioMixer::TRACKTYPE_NORESAMPLE
+                        : AudioMixer::TRACKTYPE_NORESAMPLEMONO,
+                FCC_2, AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_16_BIT,
+                AUDIO_FORMAT_PCM_16_BIT);
+        AudioMixer::sSimdType = savedSimdType;
+        return hook;
+    }
+
+    static void testHooks(int simdType, uint32_t channels);
+};
+
+static void fillRandom(std::vector<int16_t> &in, std::vector<int32_t> &out)
+{
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i] = (int16_t)(rand() & 0xffff);
+    }
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = (rand() & 0xffffff) - 0x800000;
+    }
+}
+
+void MixerOpsTest::testHooks(int simdType, uint32_t channels)
+{
+    hook_t refHook = getHook(SIMDTYPE_NONE, channels);
+    hook_t testHook = getHook(simdType, channels);
+    ASSERT_TRUE(refHook != testHook);
+
+    // odd frame counts exercise the scalar tails after the vector loops
+    static const size_t frameCounts[] = { 1, 3, 4, 7, 8, 15, 16, 17, 256, 1021 };
+    // U4.12 start and target volumes, and the ramp length in frames; a ramp length of 0 is
+    // constant gain at the target. Ramps shorter than the buffer end inside the hook.
+    static const int32_t volumes[][5] = {
+        { 0x1000, 0x1000, 0x1000, 0x1000, 0 },
+        { 0x0800, 0x0123, 0x0800, 0x0123, 0 },
+        { 0x7fff, 0x0000, 0x7fff, 0x0000, 0 },
+        { 0x0000, 0x1000, 0x1000, 0x0000, 2048 },
+        { 0x1000, 0x0000, 0x0000, 0x1000, 8 },
+        { 0x0123, 0x0765, 0x0432, 0x0321, 100 },
+    };
+    for (size_t i = 0; i < sizeof(frameCounts) / sizeof(frameCounts[0]); ++i) {
+        for (size_t j = 0; j < sizeof(volumes) / sizeof(volumes[0]); ++j) {
+            const size_t frames = frameCounts[i];
+            std::vector<int16_t> in(frames * channels);
+            std::vector<int32_t> ref(frames * 2);
+            fillRandom(in, ref);
+            std::vector<int32_t> test(ref);
+
+            track_t refTrack;
+            memset(&refTrack, 0, sizeof(refTrack));
+            for (uint32_t k = 0; k < AudioMixer::MAX_NUM_VOLUMES; ++k) {
+                const int32_t start = volumes[j][k];
+                const int32_t target = volumes[j][k + 2];
+                const int32_t rampFrames = volumes[j][4];
+                refTrack.volume[k] = target;
+                refTrack.mVolume[k] = target / (float) AudioMixer::UNITY_GAIN_INT;
+                if (rampFrames != 0) {
+                    refTrack.prevVolume[k] = start << 16;
+                    refTrack.volumeInc[k] = (target - start) * 65536 / rampFrames;
+                } else {
+                    refTrack.prevVolume[k] = target << 16;
+                }
+            }
+            refTrack.in = &in[0];
+            track_t testTrack = refTrack;
+
+            refHook(&refTrack, &ref[0], frames, NULL, NULL);
+            testHook(&testTrack, &test[0], frames, NULL, NULL);
+            ASSERT_EQ(0, memcmp(&ref[0], &test[0], ref.size() * sizeof(ref[0])))
+                    << "frames " << frames << " volumes " << j;
+
+            // the ramp state and the input position must also advance identically
+            ASSERT_EQ(refTrack.in, testTrack.in);
+            for (uint32_t k = 0; k < AudioMixer::MAX_NUM_VOLUMES; ++k) {
+                ASSERT_EQ(refTrack.prevVolume[k], testTrack.prevVolume[k]);
+                ASSERT_EQ(refTrack.volumeInc[k], testTrack.volumeInc[k]);
+                ASSERT_EQ(refTrack.mPrevVolume[k], testTrack.mPrevVolume[k]);
+            }
+        }
+    }
+}
+
+#if USE_SSE2
+TEST_F(MixerOpsTest, sse2_bitexact) {
+    if (simdType() < SIMDTYPE_SSE2) {
+        ALOGI("simd track hooks disabled, skipping");
+        return;
+    }
+    testHooks(SIMDTYPE_SSE2, 2);
+    testHooks(SIMDTYPE_SSE2, 1);
+}
+#endif
+
+#if USE_AVX2
+TEST_F(MixerOpsTest, avx2_bitexact) {
+    if (simdType() < SIMDTYPE_AVX2) {
+        ALOGI("avx2 not supported, skipping");
+        return;
+    }
+    testHooks(SIMDTYPE_AVX2, 2);
+    testHooks(SIMDTYPE_AVX2, 1);
+}
+#endif
+
+} // namespace android
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "audioflinger_resampler_stage_tests"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+#include <media/nbaio/roundup.h>
+#include "ResamplerStage.h"
+
+using namespace android;
+
+// The input of a RecordThread: a circular buffer of 16-bit frames holding mFrames frames,
+// filled one HAL buffer of a sine at a time, as readInputParameters_l() and threadLoop() do.
+struct TestInput {
+    TestInput(uint32_t sampleRate, uint32_t channelCount, size_t halFrames)
+        : mSampleRate(sampleRate), mChannelCount(channelCount), mHalFrames(halFrames),
+          mFrames(halFrames * 7), mFramesP2(roundup(mFrames)),
+          mBuffer((mFramesP2 + halFrames - 1) * channelCount), mPhase(0) { }
+
+    // reads one HAL buffer of a sine at frequency Hz, returns the new rear
+    int32_t read(int32_t rear, double frequency) {
+        for (size_t i = 0; i < mHalFrames; i++) {
+            size_t index = (rear + i) & (mFramesP2 - 1);
+            int16_t sample = (int16_t) (16384 * sin(mPhase));
+            mPhase += 2 * M_PI * frequency / mSampleRate;
+            for (uint32_t j = 0; j < mChannelCount; j++) {
+                mBuffer[index * mChannelCount + j] = sample;
+            }
+        }
+        return rear + mHalFrames;
+    }
+
+    const uint32_t mSampleRate;
+    const uint32_t mChannelCount;
+    const size_t mHalFrames;
+    const size_t mFrames;           // mRsmpInFrames
+    const size_t mFramesP2;         // mRsmpInFramesP2
+    std::vector<int16_t> mBuffer;   // mRsmpInBuffer
+    double mPhase;
+};
+
+// A mono record track reading the output of a stage at its own position.
+struct TestTrack {
+    TestTrack() : mFront(0) { }
+
+    void start(const sp<ResamplerStage>& stage) {
+        mStage = stage;
+        mFront = stage->mOutRear;
+    }
+
+    // copies all the available output of the stage
+    void read() {
+        ASSERT_EQ(1u, mStage->mChannelCount);
+        ssize_t filled = mStage->mOutRear - mFront;
+        ASSERT_GE(filled, 0);
+        ASSERT_LE((size_t) filled, mStage->mOutFrames);
+        for (ssize_t i = 0; i < filled; i++) {
+            mSamples.push_back(mStage->mOutBuffer[(mFront + i) & (mStage->mOutFramesP2 - 1)]);
+        }
+        mFront += filled;
+    }
+
+    sp<ResamplerStage> mStage;
+    int32_t mFront;
+    std::vector<int16_t> mSamples;
+};
+
+// Estimates the frequency of a sine from its zero crossings, skipping the first samples
+// where the resampler filter is not yet full.
+static double sineFrequency(const std::vector<int16_t>& samples, size_t begin,
+        uint32_t sampleRate) {
+    begin += 100;
+    size_t first = 0, last = 0, crossings = 0;
+    for (size_t i = begin + 1; i < samples.size(); i++) {
+        if ((samples[i - 1] < 0) != (samples[i] < 0)) {
+            if (crossings++ == 0) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (crossings < 2) {
+        return 0;
+    }
+    return (crossings - 1) * 0.5 * sampleRate / (last - first);
+}
+
+static const uint32_t kClientRate = 16000;
+static const double kSineFrequency = 1000;
+
+// Runs the thread loop for the given number of HAL buffers: one resampling per loop,
+// then each track reads the stage output.
+static int32_t runLoops(TestInput& input, int32_t rear, const sp<ResamplerStage>& stage,
+        TestTrack *tracks, size_t trackCount, int loops) {
+    for (int i = 0; i < loops; i++) {
+        rear = input.read(rear, kSineFrequency);
+        stage->process(&input.mBuffer[0], rear);
+        for (size_t j = 0; j < trackCount; j++) {
+            tracks[j].read();
+        }
+    }
+    return rear;
+}
+
+TEST(audioflinger_resampler_stage, sharedstage) {
+    TestInput input(48000, 2, 960);
+    sp<ResamplerStage> stage = new ResamplerStage(input.mSampleRate, input.mChannelCount,
+            input.mFrames, kClientRate, AUDIO_CHANNEL_IN_MONO, AUDIO_FORMAT_PCM_16_BIT);
+    ASSERT_TRUE(stage->matches(input.mSampleRate, input.mChannelCount, input.mFrames,
+            kClientRate, AUDIO_CHANNEL_IN_MONO, AUDIO_FORMAT_PCM_16_BIT));
+
+    int32_t rear = 0;
+    stage->reset(rear);
+    TestTrack tracks[2];
+    tracks[0].start(stage);
+    tracks[1].start(stage);
+    rear = runLoops(input, rear, stage, tracks, 2, 50);
+
+    // one second of input, less the resampler latency
+    EXPECT_NEAR(kClientRate, tracks[0].mSamples.size(), kClientRate / 50);
+    EXPECT_TRUE(tracks[0].mSamples == tracks[1].mSamples);
+    EXPECT_NEAR(kSineFrequency, sineFrequency(tracks[0].mSamples, 0, kClientRate),
+            kSineFrequency / 100);
+}
+
+// Reconfigures the input to another sample rate, channel count and buffer size while the
+// stage is shared by two tracks, as RecordThread::readInputParameters_l() does.
+TEST(audioflinger_resampler_stage, reconfigurewhileshared) {
+    TestInput *input = new TestInput(48000, 2, 960);
+    sp<ResamplerStage> stage = new ResamplerStage(input->mSampleRate, input->mChannelCount,
+            input->mFrames, kClientRate, AUDIO_CHANNEL_IN_MONO, AUDIO_FORMAT_PCM_16_BIT);
+    int32_t rear = 0;
+    stage->reset(rear);
+    TestTrack tracks[2];
+    tracks[0].start(stage);
+    tracks[1].start(stage);
+    rear = runLoops(*input, rear, stage, tracks, 2, 25);
+
+    // the rear counter keeps rolling across the reconfiguration
+    delete input;
+    input = new TestInput(44100, 1, 441);
+
+    // the stage of the previous input must not be reused for the new one
+    EXPECT_FALSE(stage->matches(input->mSampleRate, input->mChannelCount, input->mFrames,
+            kClientRate, AUDIO_CHANNEL_IN_MONO, AUDIO_FORMAT_PCM_16_BIT));
+    stage = new ResamplerStage(input->mSampleRate, input->mChannelCount, input->mFrames,
+            kClientRate, AUDIO_CHANNEL_IN_MONO, AUDIO_FORMAT_PCM_16_BIT);
+    stage->reset(rear);
+    size_t begin = tracks[0].mSamples.size();
+    tracks[0].start(stage);
+    tracks[1].start(stage);
+    rear = runLoops(*input, rear, stage, tracks, 2, 100);
+    delete input;
+
+    // one second of the new input, at the client rate and pitch
+    EXPECT_NEAR(kClientRate, tracks[0].mSamples.size() - begin, kClientRate / 50);
+    EXPECT_TRUE(tracks[0].mSamples == tracks[1].mSamples);
+    EXPECT_NEAR(kSineFrequency, sineFrequency(tracks[0].mSamples, begin, kClientRate),
+            kSineFrequency / 100);
+}
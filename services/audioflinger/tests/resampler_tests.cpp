@@ -409,3 +409,193 @@ TEST(audioflinger_resampler, stopbandresponse_float_multichannel) {
     }
 }
 
+
+/* Resamplers with identical parameters share filter banks from a process-wide cache.
+ * Check that a resampler is unaffected when another resampler sharing its filter bank
+ * changes rate or is destroyed.
+ */
+TEST(audioflinger_resampler, sharedfilterbank) {
+    static const enum android::AudioResampler::src_quality kQualityArray[] = {
+            android::AudioResampler::DYN_LOW_QUALITY,
+            android::AudioResampler::DYN_MED_QUALITY,
+            android::AudioResampler::DYN_HIGH_QUALITY,
+    };
+    static const unsigned kChannels = 2;
+    static const unsigned kInputFreq = 44100;
+    static const unsigned kOutputFreq = 48000;
+
+    for (size_t i = 0; i < ARRAY_SIZE(kQualityArray); ++i) {
+        SignalProvider provider;
+        provider.setChirp<int16_t>(kChannels,
+                0., kOutputFreq/2., kOutputFreq, kOutputFreq/2000.);
+        size_t outputFrames = ((int64_t) provider.getNumFrames() * kOutputFreq) / kInputFreq;
+        std::vector<size_t> outputIncr;
+        outputIncr.push_back(outputFrames);
+        std::vector<int32_t> reference(outputFrames * kChannels);
+        std::vector<int32_t> test(outputFrames * kChannels);
+
+        android::AudioResampler* resampler1 = android::AudioResampler::create(
+                AUDIO_FORMAT_PCM_16_BIT, kChannels, kOutputFreq, kQualityArray[i]);
+        resampler1->setSampleRate(kInputFreq);
+        resampler1->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+                android::AudioResampler::UNITY_GAIN_FLOAT);
+        resample(kChannels, &reference[0], outputFrames, outputIncr, &provider, resampler1);
+
+        android::AudioResampler* resampler2 = android::AudioResampler::create(
+                AUDIO_FORMAT_PCM_16_BIT, kChannels, kOutputFreq, kQualityArray[i]);
+        resampler2->setSampleRate(kInputFreq);
+        resampler2->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+                android::AudioResampler::UNITY_GAIN_FLOAT);
+
+        // the first resampler moves to other filter banks and releases the shared one
+        resampler1->setSampleRate(kInputFreq / 2);
+        resampler1->setSampleRate(kInputFreq * 2);
+        delete resampler1;
+
+        provider.reset();
+        resample(kChannels, &test[0], outputFrames, outputIncr, &provider, resampler2);
+        delete resampler2;
+        buffercmp(&reference[0], &test[0], kChannels * sizeof(int32_t), outputFrames);
+    }
+}
+
+// TI = resampler input type, int16_t or float
+// TO = resampler output type, int32_t or float
+template <typename TI, typename TO>
+void testQualityChange(enum android::AudioResampler::src_quality toQuality)
+{
+    static const unsigned kChannels = 2;
+    static const unsigned kInputFreq = 44100;
+    static const unsigned kOutputFreq = 48000;
+    static const size_t kChunkFrames = 256;
+    const audio_format_t format =
+            is_same<TI, int16_t>::value ? AUDIO_FORMAT_PCM_16_BIT : AUDIO_FORMAT_PCM_FLOAT;
+
+    SignalProvider provider;
+    provider.setSine<TI>(kChannels, 1000., kInputFreq, 0.5 /* time */);
+    const size_t outputFrames = ((int64_t) provider.getNumFrames() * kOutputFreq) / kInputFreq;
+    const size_t switchFrame = kChunkFrames * 32;
+    std::vector<size_t> outputIncr;
+    outputIncr.push_back(kChunkFrames);
+
+    // an adaptive resampler changes quality after switchFrame
+    android::AudioResampler* resampler = android::AudioResampler::create(
+            format, kChannels, kOutputFreq);
+    ASSERT_TRUE(resampler->isAdaptive());
+    const enum android::AudioResampler::src_quality fromQuality = resampler->getQuality();
+    resampler->setSampleRate(kInputFreq);
+    resampler->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+            android::AudioResampler::UNITY_GAIN_FLOAT);
+    std::vector<TO> test(outputFrames * kChannels);
+    resample(kChannels, &test[0], switchFrame, outputIncr, &provider, resampler);
+    ASSERT_TRUE(resampler->setQuality(toQuality));
+    resample(kChannels, &test[switchFrame * kChannels], outputFrames - switchFrame,
+            outputIncr, &provider, resampler);
+    delete resampler;
+
+    // reference resamplers keep each quality
+    std::vector<TO> reference[2];
+    const enum android::AudioResampler::src_quality qualities[2] = { fromQuality, toQuality };
+    for (size_t i = 0; i < 2; ++i) {
+        provider.reset();
+        resampler = android::AudioResampler::create(format, kChannels, kOutputFreq, qualities[i]);
+        resampler->setSampleRate(kInputFreq);
+        resampler->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+                android::AudioResampler::UNITY_GAIN_FLOAT);
+        reference[i].resize(outputFrames * kChannels);
+        resample(kChannels, &reference[i][0], outputFrames, outputIncr, &provider, resampler);
+        delete resampler;
+    }
+
+    // identical output before the change, and once the crossfade is over
+    const size_t fadeEndFrame = switchFrame + kOutputFreq / 10;
+    buffercmp(&reference[0][0], &test[0], kChannels * sizeof(TO), switchFrame);
+    buffercmp(&reference[1][fadeEndFrame * kChannels], &test[fadeEndFrame * kChannels],
+            kChannels * sizeof(TO), outputFrames - fadeEndFrame);
+
+    // the crossfade does not step more than the sine does
+    double maxStep = 0;
+    for (size_t i = kChannels; i < fadeEndFrame * kChannels; ++i) {
+        maxStep = std::max(maxStep, fabs((double) reference[0][i] - reference[0][i - kChannels]));
+    }
+    for (size_t i = switchFrame * kChannels; i < fadeEndFrame * kChannels; ++i) {
+        ASSERT_LT(fabs((double) test[i] - test[i - kChannels]), maxStep * 1.05);
+    }
+}
+
+/* Quality change test
+ *
+ * An adaptive resampler crossfades to the filter of its new quality: its output matches
+ * a resampler of the previous quality before the change, a resampler of the new quality
+ * after the crossfade, and has no discontinuity in between.
+ */
+TEST(audioflinger_resampler, qualitychange_integer) {
+    testQualityChange<int16_t, int32_t>(android::AudioResampler::DYN_LOW_QUALITY);
+
+    // 16b coefficients cannot be used for the high quality filter
+    android::AudioResampler* resampler = android::AudioResampler::create(
+            AUDIO_FORMAT_PCM_16_BIT, 2, 48000);
+    ASSERT_EQ(android::AudioResampler::DYN_MED_QUALITY, resampler->getQuality());
+    ASSERT_FALSE(resampler->setQuality(android::AudioResampler::DYN_HIGH_QUALITY));
+    ASSERT_EQ(android::AudioResampler::DYN_MED_QUALITY, resampler->getQuality());
+    delete resampler;
+}
+
+TEST(audioflinger_resampler, qualitychange_float) {
+    testQualityChange<float, float>(android::AudioResampler::DYN_HIGH_QUALITY);
+    testQualityChange<float, float>(android::AudioResampler::DYN_LOW_QUALITY);
+}
+
+/* Quality change after a rate change
+ *
+ * setSampleRate() keeps the filter when the new rate is close to the rate it was designed
+ * for. A quality change then designs the new filter for that same rate, so that the output
+ * after the crossfade matches a resampler of the new quality with the same rate changes.
+ */
+TEST(audioflinger_resampler, qualitychange_afterratechange) {
+    static const unsigned kChannels = 2;
+    static const unsigned kInputFreq = 44100;
+    static const unsigned kOutputFreq = 48000;
+    static const size_t kChunkFrames = 256;
+    static const size_t kRateChangeFrame = kChunkFrames * 16;
+    static const size_t kSwitchFrame = kChunkFrames * 32;
+
+    SignalProvider provider;
+    provider.setSine<float>(kChannels, 1000., kInputFreq, 1.0 /* time */);
+    const size_t outputFrames = kSwitchFrame + kOutputFreq / 2;
+    std::vector<size_t> outputIncr;
+    outputIncr.push_back(kChunkFrames);
+
+    android::AudioResampler* resampler = android::AudioResampler::create(
+            AUDIO_FORMAT_PCM_FLOAT, kChannels, kOutputFreq);
+    ASSERT_TRUE(resampler->isAdaptive());
+    resampler->setSampleRate(kInputFreq);
+    resampler->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+            android::AudioResampler::UNITY_GAIN_FLOAT);
+    std::vector<float> test(outputFrames * kChannels);
+    resample(kChannels, &test[0], kRateChangeFrame, outputIncr, &provider, resampler);
+    resampler->setSampleRate(kInputFreq / 2); // upsampling again, the filter is kept
+    resample(kChannels, &test[kRateChangeFrame * kChannels], kSwitchFrame - kRateChangeFrame,
+            outputIncr, &provider, resampler);
+    ASSERT_TRUE(resampler->setQuality(android::AudioResampler::DYN_LOW_QUALITY));
+    resample(kChannels, &test[kSwitchFrame * kChannels], outputFrames - kSwitchFrame,
+            outputIncr, &provider, resampler);
+    delete resampler;
+
+    provider.reset();
+    resampler = android::AudioResampler::create(AUDIO_FORMAT_PCM_FLOAT, kChannels, kOutputFreq,
+            android::AudioResampler::DYN_LOW_QUALITY);
+    resampler->setSampleRate(kInputFreq);
+    resampler->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+            android::AudioResampler::UNITY_GAIN_FLOAT);
+    std::vector<float> reference(outputFrames * kChannels);
+    resample(kChannels, &reference[0], kRateChangeFrame, outputIncr, &provider, resampler);
+    resampler->setSampleRate(kInputFreq / 2);
+    resample(kChannels, &reference[kRateChangeFrame * kChannels], outputFrames - kRateChangeFrame,
+            outputIncr, &provider, resampler);
+    delete resampler;
+
+    const size_t fadeEndFrame = kSwitchFrame + kOutputFreq / 10;
+    buffercmp(&reference[fadeEndFrame * kChannels], &test[fadeEndFrame * kChannels],
+            kChannels * sizeof(float), outputFrames - fadeEndFrame);
+}
@@ -9,3 +9,5 @@ echo "waiting for device"
 adb root && adb wait-for-device remount
 
 adb shell /system/bin/resampler_tests
+adb shell /system/bin/mixerops_tests
+adb shell /system/bin/resampler_stage_tests
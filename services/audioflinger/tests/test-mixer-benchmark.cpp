@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <audio_utils/primitives.h>
+#include <audio_utils/sndfile.h>
+#include <media/AudioBufferProvider.h>
+#include "AudioMixer.h"
+#include "test_utils.h"
+
+/* Benchmarks AudioMixer::process() over a matrix of track configurations:
+ * input channel count, input format, resampling and volume ramping.
+ * Each configuration mixes the same number of identical synthetic tracks.
+ *
+ * For every configuration one line is printed with the throughput in
+ * tracks x frames per second, the speed relative to real time, and a checksum
+ * of the mixer output over a fixed number of mix cycles.  The checksum depends
+ * only on the mixer code and the command line options (including -w), so the
+ * output of a known good build can be saved and passed back with -r to detect
+ * changes in the mixed output as well as in speed.
+ *
+ *   test-mixer-benchmark > baseline.txt
+ *   (change AudioMixer)
+ *   test-mixer-benchmark -r baseline.txt
+ *
+ * Float tracks which are not resampled are mixed in place from the track buffer.
+ * To measure the saving per track, compare the "float_native" and "i16_native"
+ * configurations, for example of 8 channel tracks into an 8 channel mix:
+ *
+ *   test-mixer-benchmark -c 8 -p 8ch_
+ */
+
+using namespace android;
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-m] [-t tracks] [-c channels] [-s sample-rate] [-f frames]"
+                    " [-w workers] [-d seconds] [-p pattern] [-r reference-file]\n", name);
+    fprintf(stderr, "    -m    enable floating point mixer output\n");
+    fprintf(stderr, "    -t    number of tracks per configuration (default 8)\n");
+    fprintf(stderr, "    -c    number of mixer output channels (default 2)\n");
+    fprintf(stderr, "    -s    mixer sample-rate (default 48000)\n");
+    fprintf(stderr, "    -f    mixer frame count (default 256)\n");
+    fprintf(stderr, "    -w    number of parallel mixer workers (0 for serial mixing)\n");
+    fprintf(stderr, "    -d    seconds of audio to mix per configuration (default 10)\n");
+    fprintf(stderr, "    -p    only run configurations whose name contains pattern\n");
+    fprintf(stderr, "    -r    compare checksums with the output of a previous run\n");
+}
+
+// Number of mix cycles covered by the checksum, independent of -d so that runs of
+// different lengths can be compared.
+static const size_t kChecksumCycles = 200;
+
+// Continuously provides the signal by rewinding at the end, so that tracks never underrun.
+class LoopingProvider : public SignalProvider {
+public:
+    virtual status_t getNextBuffer(Buffer* buffer, int64_t pts = kInvalidPTS)
+    {
+        if (mNextFrame >= mNumFrames) {
+            reset();
+        }
+        return SignalProvider::getNextBuffer(buffer, pts);
+    }
+};
+
+static const size_t kMaxNameLength = 32;
+
+struct Config {
+    uint32_t mChannels;
+    audio_format_t mFormat;
+    bool mResample;
+    bool mRamp;
+    char mName[kMaxNameLength];
+};
+
+struct Result {
+    uint64_t mChecksum;
+    double mTrackFramesPerSecond;
+    double mRealtime;
+};
+
+// 64-bit FNV-1a
+static uint64_t checksum(uint64_t hash, const void *buffer, size_t size)
+{
+    const uint8_t *p = (const uint8_t *) buffer;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static double monotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Result runConfig(const Config& config, uint32_t trackCount,
+        uint32_t outputChannels, uint32_t outputSampleRate, size_t frameCount,
+        audio_format_t mixerFormat, uint32_t workerCount, double seconds)
+{
+    // a rate that is not a simple ratio of the mixer rate, so that the resampler
+    // takes its general (polyphase interpolation) path
+    const uint32_t inputSampleRate = !config.mResample ? outputSampleRate
+            : outputSampleRate == 44100 ? 48000 : 44100;
+    const audio_channel_mask_t outputChannelMask =
+            audio_channel_out_mask_from_count(outputChannels);
+    const audio_channel_mask_t channelMask =
+            audio_channel_out_mask_from_count(config.mChannels);
+
+    std::vector<LoopingProvider> providers(trackCount);
+    for (uint32_t i = 0; i < trackCount; ++i) {
+        // distinct frequencies so that the tracks don't sum coherently
+        const double freq = 300. + 100. * i;
+        if (config.mFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            providers[i].setSine<float>(config.mChannels, freq, inputSampleRate, 1.);
+        } else {
+            providers[i].setSine<int16_t>(config.mChannels, freq, inputSampleRate, 1.);
+        }
+    }
+
+    const size_t outputSize = frameCount * outputChannels * audio_bytes_per_sample(mixerFormat);
+    void *outputAddr = NULL;
+    (void) posix_memalign(&outputAddr, 32, outputSize);
+    memset(outputAddr, 0, outputSize);
+
+    AudioMixer *mixer = new AudioMixer(frameCount, outputSampleRate);
+    mixer->setWorkerCount(workerCount);
+    std::vector<int> names;
+    float volume[2] = { AudioMixer::UNITY_GAIN_FLOAT / trackCount,
+            AudioMixer::UNITY_GAIN_FLOAT / (2 * trackCount) };
+    for (uint32_t i = 0; i < trackCount; ++i) {
+        int name = mixer->getTrackName(channelMask, config.mFormat, AUDIO_SESSION_OUTPUT_MIX);
+        ALOG_ASSERT(name >= 0);
+        names.push_back(name);
+        mixer->setBufferProvider(name, &providers[i]);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MAIN_BUFFER, outputAddr);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MIXER_FORMAT,
+                (void *)(uintptr_t)mixerFormat);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::FORMAT,
+                (void *)(uintptr_t)config.mFormat);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::MIXER_CHANNEL_MASK,
+                (void *)(uintptr_t)outputChannelMask);
+        mixer->setParameter(name, AudioMixer::TRACK, AudioMixer::CHANNEL_MASK,
+                (void *)(uintptr_t)channelMask);
+        mixer->setParameter(name, AudioMixer::RESAMPLE, AudioMixer::SAMPLE_RATE,
+                (void *)(uintptr_t)inputSampleRate);
+        mixer->setParameter(name, AudioMixer::VOLUME, AudioMixer::VOLUME0, &volume[0]);
+        mixer->setParameter(name, AudioMixer::VOLUME, AudioMixer::VOLUME1, &volume[0]);
+        mixer->enable(name);
+    }
+
+    // With ramping, the target volume alternates every cycle so that each
+    // process() call takes the volume ramp path for the full mix buffer.
+    size_t cycle = 0;
+    Result result;
+    result.mChecksum = 0xcbf29ce484222325ULL;
+    const size_t timedCycles = (size_t) (seconds * outputSampleRate / frameCount);
+    double start = 0.;
+    for (size_t end = kChecksumCycles + timedCycles; cycle < end; ++cycle) {
+        if (config.mRamp) {
+            float *target = &volume[cycle & 1];
+            for (size_t j = 0; j < names.size(); ++j) {
+                mixer->setParameter(names[j], AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME0,
+                        target);
+                mixer->setParameter(names[j], AudioMixer::RAMP_VOLUME, AudioMixer::VOLUME1,
+                        target);
+            }
+        }
+        mixer->process(AudioBufferProvider::kInvalidPTS);
+        if (cycle < kChecksumCycles) {
+            result.mChecksum = checksum(result.mChecksum, outputAddr, outputSize);
+            if (cycle == kChecksumCycles - 1) {
+                start = monotonicSeconds();
+            }
+        }
+    }
+    const double elapsed = monotonicSeconds() - start;
+    const double mixedSeconds = (double) timedCycles * frameCount / outputSampleRate;
+    result.mTrackFramesPerSecond = elapsed > 0. ?
+            (double) timedCycles * frameCount * trackCount / elapsed : 0.;
+    result.mRealtime = elapsed > 0. ? mixedSeconds / elapsed : 0.;
+
+    delete mixer;
+    free(outputAddr);
+    return result;
+}
+
+// Reads "name checksum ..." lines written by a previous run; lines starting with '#' are skipped.
+static bool readReference(const char *filename, const char *name, uint64_t *reference)
+{
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[256];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        char refName[kMaxNameLength];
+        uint64_t refChecksum;
+        if (line[0] != '#' && sscanf(line, "%31s %" SCNx64, refName, &refChecksum) == 2
+                && !strcmp(refName, name)) {
+            *reference = refChecksum;
+            found = true;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+int main(int argc, char* argv[]) {
+    const char* const progname = argv[0];
+    bool useMixerFloat = false;
+    uint32_t trackCount = 8;
+    uint32_t outputChannels = 2;
+    uint32_t outputSampleRate = 48000;
+    size_t frameCount = 256;
+    uint32_t workerCount = 0;
+    double seconds = 10.;
+    const char* pattern = NULL;
+    const char* referenceFilename = NULL;
+
+    for (int ch; (ch = getopt(argc, argv, "mt:c:s:f:w:d:p:r:")) != -1;) {
+        switch (ch) {
+        case 'm':
+            useMixerFloat = true;
+            break;
+        case 't':
+            trackCount = atoi(optarg);
+            break;
+        case 'c':
+            outputChannels = atoi(optarg);
+            break;
+        case 's':
+            outputSampleRate = atoi(optarg);
+            break;
+        case 'f':
+            frameCount = atoi(optarg);
+            break;
+        case 'w':
+            workerCount = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 'p':
+            pattern = optarg;
+            break;
+        case 'r':
+            referenceFilename = optarg;
+            break;
+        case '?':
+        default:
+            usage(progname);
+            return EXIT_FAILURE;
+        }
+    }
+    if (trackCount == 0 || trackCount > AudioMixer::MAX_NUM_TRACKS) {
+        fprintf(stderr, "tracks must be between 1 and %u\n", AudioMixer::MAX_NUM_TRACKS);
+        return EXIT_FAILURE;
+    }
+    if (outputChannels == 0 || outputChannels > AudioMixer::MAX_NUM_CHANNELS
+            || frameCount == 0 || outputSampleRate == 0 || seconds < 0.) {
+        usage(progname);
+        return EXIT_FAILURE;
+    }
+    const audio_format_t mixerFormat = useMixerFloat
+            ? AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT;
+
+    // the configuration matrix, in the order the configurations are run
+    static const uint32_t kChannels[] = { 1, 2, 6, 8 };
+    static const audio_format_t kFormats[] = { AUDIO_FORMAT_PCM_16_BIT, AUDIO_FORMAT_PCM_FLOAT };
+    std::vector<Config> configs;
+    for (size_t c = 0; c < sizeof(kChannels) / sizeof(kChannels[0]); ++c) {
+        for (size_t f = 0; f < sizeof(kFormats) / sizeof(kFormats[0]); ++f) {
+            for (int resample = 0; resample <= 1; ++resample) {
+                for (int ramp = 0; ramp <= 1; ++ramp) {
+                    Config config;
+                    config.mChannels = kChannels[c];
+                    config.mFormat = kFormats[f];
+                    config.mResample = resample;
+                    config.mRamp = ramp;
+                    snprintf(config.mName, sizeof(config.mName), "%uch_%s_%s_%s",
+                            config.mChannels,
+                            config.mFormat == AUDIO_FORMAT_PCM_FLOAT ? "float" : "i16",
+                            resample ? "resample" : "native",
+                            ramp ? "ramp" : "flat");
+                    if (pattern == NULL || strstr(config.mName, pattern) != NULL) {
+                        configs.push_back(config);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("# tracks=%u channels=%u sampleRate=%u frameCount=%zu mixer=%s workers=%u"
+            " seconds=%.1f checksumCycles=%zu\n",
+            trackCount, outputChannels, outputSampleRate, frameCount,
+            useMixerFloat ? "float" : "i16", workerCount, seconds, kChecksumCycles);
+    printf("# %-22s %16s %16s %9s\n", "config", "checksum", "Mtrackframes/s", "realtime");
+    int mismatches = 0;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        const Config& config = configs[i];
+        Result result = runConfig(config, trackCount, outputChannels, outputSampleRate,
+                frameCount, mixerFormat, workerCount, seconds);
+        printf("%-24s %016" PRIx64 " %16.2f %8.1fx", config.mName, result.mChecksum,
+                result.mTrackFramesPerSecond * 1e-6, result.mRealtime);
+        if (referenceFilename != NULL) {
+            uint64_t reference;
+            if (!readReference(referenceFilename, config.mName, &reference)) {
+                printf("  no reference");
+            } else if (reference != result.mChecksum) {
+                printf("  MISMATCH (expected %016" PRIx64 ")", reference);
+                ++mismatches;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    if (mismatches > 0) {
+        fprintf(stderr, "%d configuration(s) differ from %s\n", mismatches, referenceFilename);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
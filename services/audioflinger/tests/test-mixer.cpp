@@ -36,13 +36,14 @@
 using namespace android;
 
 static void usage(const char* name) {
-    fprintf(stderr, "Usage: %s [-f] [-m] [-c channels]"
+    fprintf(stderr, "Usage: %s [-f] [-m] [-c channels] [-w workers]"
                     " [-s sample-rate] [-o <output-file>] [-a <aux-buffer-file>] [-P csv]"
                     " (<input-file> | <command>)+\n", name);
     fprintf(stderr, "    -f    enable floating point input track\n");
     fprintf(stderr, "    -m    enable floating point mixer output\n");
     fprintf(stderr, "    -c    number of mixer output channels\n");
     fprintf(stderr, "    -s    mixer sample-rate\n");
+    fprintf(stderr, "    -w    number of parallel mixer workers (0 for serial mixing)\n");
     fprintf(stderr, "    -o    <output-file> WAV file, pcm16 (or float if -m specified)\n");
     fprintf(stderr, "    -a    <aux-buffer-file>\n");
     fprintf(stderr, "    -P    # frames provided per call to resample() in CSV format\n");
@@ -85,13 +86,14 @@ int main(int argc, char* argv[]) {
     bool useRamp = true;
     uint32_t outputSampleRate = 48000;
     uint32_t outputChannels = 2; // stereo for now
+    uint32_t workerCount = 0;
     std::vector<int> Pvalues;
     const char* outputFilename = NULL;
     const char* auxFilename = NULL;
     std::vector<int32_t> Names;
     std::vector<SignalProvider> Providers;
 
-    for (int ch; (ch = getopt(argc, argv, "fmc:s:o:a:P:")) != -1;) {
+    for (int ch; (ch = getopt(argc, argv, "fmc:s:w:o:a:P:")) != -1;) {
         switch (ch) {
         case 'f':
             useInputFloat = true;
@@ -105,6 +107,9 @@ int main(int argc, char* argv[]) {
         case 's':
             outputSampleRate = atoi(optarg);
             break;
+        case 'w':
+            workerCount = atoi(optarg);
+            break;
         case 'o':
             outputFilename = optarg;
             break;
@@ -213,6 +218,7 @@ int main(int argc, char* argv[]) {
     // create the mixer.
     const size_t mixerFrameCount = 320; // typical numbers may range from 240 or 960
     AudioMixer *mixer = new AudioMixer(mixerFrameCount, outputSampleRate);
+    mixer->setWorkerCount(workerCount);
     audio_format_t inputFormat = useInputFloat
             ? AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT;
     audio_format_t mixerFormat = useMixerFloat
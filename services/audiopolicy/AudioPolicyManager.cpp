@@ -251,12 +251,14 @@ status_t AudioPolicyManager::setDeviceConnectionStateInt(audio_devices_t device,
 
             // register new device as available
             index = mAvailableOutputDevices.add(devDesc);
+            invalidateRoutingCache();
             if (index >= 0) {
                 sp<HwModule> module = getModuleForDevice(device);
                 if (module == 0) {
                     ALOGD("setDeviceConnectionState() could not find HW module for device %08x",
                           device);
                     mAvailableOutputDevices.remove(devDesc);
+                    invalidateRoutingCache();
                     return INVALID_OPERATION;
                 }
                 mAvailableOutputDevices[index]->mId = nextUniqueId();
@@ -267,6 +269,7 @@ status_t AudioPolicyManager::setDeviceConnectionStateInt(audio_devices_t device,
 
             if (checkOutputsForDevice(devDesc, state, outputs, devDesc->mAddress) != NO_ERROR) {
                 mAvailableOutputDevices.remove(devDesc);
+                invalidateRoutingCache();
                 return INVALID_OPERATION;
             }
             // outputs should never be empty here
@@ -298,6 +301,7 @@ status_t AudioPolicyManager::setDeviceConnectionStateInt(audio_devices_t device,
 
             // remove device from available output devices
             mAvailableOutputDevices.remove(devDesc);
+            invalidateRoutingCache();
 
             checkOutputsForDevice(devDesc, state, outputs, devDesc->mAddress);
             } break;
@@ -376,6 +380,7 @@ status_t AudioPolicyManager::setDeviceConnectionStateInt(audio_devices_t device,
             }
 
             index = mAvailableInputDevices.add(devDesc);
+            invalidateRoutingCache();
             if (index >= 0) {
                 mAvailableInputDevices[index]->mId = nextUniqueId();
                 mAvailableInputDevices[index]->mModule = module;
@@ -406,6 +411,7 @@ status_t AudioPolicyManager::setDeviceConnectionStateInt(audio_devices_t device,
 
             checkInputsForDevice(device, state, inputs, devDesc->mAddress);
             mAvailableInputDevices.remove(devDesc);
+            invalidateRoutingCache();
 
         } break;
 
@@ -632,6 +638,7 @@ void AudioPolicyManager::setPhoneState(audio_mode_t state)
     // store previous phone state for management of sonification strategy below
     int oldState = mPhoneState;
     mPhoneState = state;
+    invalidateRoutingCache();
     bool force = false;
 
     // are we entering or starting a call
@@ -803,6 +810,7 @@ void AudioPolicyManager::setForceUse(audio_policy_force_use_t usage,
         ALOGW("setForceUse() invalid usage %d", usage);
         break;
     }
+    invalidateRoutingCache();
 
     // check for device and output changes triggered by new force usage
     checkA2dpSuspend();
@@ -1426,6 +1434,7 @@ void AudioPolicyManager::releaseOutput(audio_io_handle_t output,
         if (outputDesc->isActive()) {
             mpClientInterface->closeOutput(output);
             mOutputs.removeItem(output);
+            invalidateRoutingCache();
             mTestOutputs[testIndex] = 0;
         }
         return;
@@ -2174,6 +2183,7 @@ status_t AudioPolicyManager::registerPolicyMixes(Vector<AudioMix> mixes)
         sp<AudioPolicyMix> policyMix = new AudioPolicyMix();
         policyMix->mMix = mixes[i];
         mPolicyMixes.add(address, policyMix);
+        invalidateRoutingCache();
         if (mixes[i].mMixType == MIX_TYPE_PLAYERS) {
             setDeviceConnectionStateInt(AUDIO_DEVICE_IN_REMOTE_SUBMIX,
                                      AUDIO_POLICY_DEVICE_STATE_AVAILABLE,
@@ -2213,6 +2223,7 @@ status_t AudioPolicyManager::unregisterPolicyMixes(Vector<AudioMix> mixes)
         }
 
         mPolicyMixes.removeItemsAt(index);
+        invalidateRoutingCache();
 
         if (getDeviceConnectionState(AUDIO_DEVICE_IN_REMOTE_SUBMIX, address.string()) ==
                                              AUDIO_POLICY_DEVICE_STATE_AVAILABLE)
@@ -2263,6 +2274,9 @@ status_t AudioPolicyManager::dump(int fd)
     snprintf(buffer, SIZE, " Force use for hdmi system audio %d\n",
             mForceUse[AUDIO_POLICY_FORCE_FOR_HDMI_SYSTEM_AUDIO]);
     result.append(buffer);
+    snprintf(buffer, SIZE, " Routing cache: generation %u, hits %u, misses %u\n",
+            mRoutingGeneration, mRoutingCacheHits, mRoutingCacheMisses);
+    result.append(buffer);
 
     snprintf(buffer, SIZE, " Available output devices:\n");
     result.append(buffer);
@@ -3049,7 +3063,10 @@ AudioPolicyManager::AudioPolicyManager(AudioPolicyClientInterface *clientInterfa
 #endif //AUDIO_POLICY_TEST
     mPrimaryOutput((audio_io_handle_t)0),
     mPhoneState(AUDIO_MODE_NORMAL),
-    mLimitRingtoneVolume(false), mLastVoiceVolume(-1.0f),
+    mLimitRingtoneVolume(false),
+    mRoutingGeneration(1), mOutputsForDeviceGeneration(0),
+    mRoutingCacheHits(0), mRoutingCacheMisses(0),
+    mLastVoiceVolume(-1.0f),
     mTotalEffectsCpuLoad(0), mTotalEffectsMemory(0),
     mA2dpSuspended(false),
     mSpeakerDrcEnabled(false), mNextUniqueId(1),
@@ -3064,6 +3081,9 @@ AudioPolicyManager::AudioPolicyManager(AudioPolicyClientInterface *clientInterfa
     for (int i = 0; i < AUDIO_POLICY_FORCE_USE_CNT; i++) {
         mForceUse[i] = AUDIO_POLICY_FORCE_NONE;
     }
+    for (int i = 0; i < NUM_STRATEGIES; i++) {
+        mStrategyDeviceGeneration[i] = 0;
+    }
 
     mDefaultOutputDevice = new DeviceDescriptor(String8(""), AUDIO_DEVICE_OUT_SPEAKER);
     if (loadAudioPolicyConfig(AUDIO_POLICY_VENDOR_CONFIG_FILE) != NO_ERROR) {
@@ -3247,6 +3267,7 @@ AudioPolicyManager::AudioPolicyManager(AudioPolicyClientInterface *clientInterfa
         }
         i++;
     }
+    invalidateRoutingCache();
     // make sure default device is reachable
     if (mAvailableOutputDevices.indexOf(mDefaultOutputDevice) < 0) {
         ALOGE("Default device %08x is unreachable", mDefaultOutputDevice->mDeviceType);
@@ -3406,6 +3427,7 @@ bool AudioPolicyManager::threadLoop()
                 audio_module_handle_t moduleHandle = outputDesc->mModule->mHandle;
 
                 mOutputs.removeItem(mPrimaryOutput);
+                invalidateRoutingCache();
 
                 sp<AudioOutputDescriptor> outputDesc = new AudioOutputDescriptor(NULL);
                 outputDesc->mDevice = AUDIO_DEVICE_OUT_SPEAKER;
@@ -3468,6 +3490,7 @@ void AudioPolicyManager::addOutput(audio_io_handle_t output, sp<AudioOutputDescr
     outputDesc->mIoHandle = output;
     outputDesc->mId = nextUniqueId();
     mOutputs.add(output, outputDesc);
+    invalidateRoutingCache();
     nextAudioPortGeneration();
 }
 
@@ -3702,6 +3725,7 @@ status_t AudioPolicyManager::checkOutputsForDevice(const sp<DeviceDescriptor> de
                                     mPrimaryOutput, output);
                             mpClientInterface->closeOutput(output);
                             mOutputs.removeItem(output);
+                            invalidateRoutingCache();
                             nextAudioPortGeneration();
                             output = AUDIO_IO_HANDLE_NONE;
                         }
@@ -4014,6 +4038,7 @@ void AudioPolicyManager::closeOutput(audio_io_handle_t output)
 
             mpClientInterface->closeOutput(duplicatedOutput);
             mOutputs.removeItem(duplicatedOutput);
+            invalidateRoutingCache();
         }
     }
 
@@ -4033,6 +4058,7 @@ void AudioPolicyManager::closeOutput(audio_io_handle_t output)
 
     mpClientInterface->closeOutput(output);
     mOutputs.removeItem(output);
+    invalidateRoutingCache();
     mPreviousOutputs = mOutputs;
 }
 
@@ -4061,8 +4087,23 @@ void AudioPolicyManager::closeInput(audio_io_handle_t input)
 }
 
 SortedVector<audio_io_handle_t> AudioPolicyManager::getOutputsForDevice(audio_devices_t device,
-                        DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> > openOutputs)
+                const DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> >& openOutputs)
 {
+    // only the outputs currently opened are memoized, not mPreviousOutputs
+    const bool cacheable = &openOutputs == &mOutputs;
+    if (cacheable) {
+        if (mOutputsForDeviceGeneration != mRoutingGeneration) {
+            mOutputsForDevice.clear();
+            mOutputsForDeviceGeneration = mRoutingGeneration;
+        }
+        ssize_t index = mOutputsForDevice.indexOfKey(device);
+        if (index >= 0) {
+            mRoutingCacheHits++;
+            return mOutputsForDevice.valueAt(index);
+        }
+        mRoutingCacheMisses++;
+    }
+
     SortedVector<audio_io_handle_t> outputs;
 
     ALOGVV("getOutputsForDevice() device %04x", device);
@@ -4074,6 +4115,9 @@ SortedVector<audio_io_handle_t> AudioPolicyManager::getOutputsForDevice(audio_de
             outputs.add(openOutputs.keyAt(i));
         }
     }
+    if (cacheable) {
+        mOutputsForDevice.add(device, outputs);
+    }
     return outputs;
 }
 
@@ -4522,6 +4566,40 @@ audio_devices_t AudioPolicyManager::getDeviceForStrategy(routing_strategy strate
               strategy, mDeviceForStrategy[strategy]);
         return mDeviceForStrategy[strategy];
     }
+    if (!isRoutingCacheable(strategy)) {
+        return computeDeviceForStrategy(strategy);
+    }
+    if (mStrategyDeviceGeneration[strategy] == mRoutingGeneration) {
+        mRoutingCacheHits++;
+        return mStrategyDevice[strategy];
+    }
+    mRoutingCacheMisses++;
+    device = computeDeviceForStrategy(strategy);
+    mStrategyDevice[strategy] = device;
+    mStrategyDeviceGeneration[strategy] = mRoutingGeneration;
+    return device;
+}
+
+bool AudioPolicyManager::isRoutingCacheable(routing_strategy strategy)
+{
+    switch (strategy) {
+    case STRATEGY_SONIFICATION_RESPECTFUL:  // depends on recent music activity
+    case STRATEGY_ACCESSIBILITY:            // depends on active compressed outputs
+        return false;
+    default:
+        return true;
+    }
+}
+
+void AudioPolicyManager::invalidateRoutingCache()
+{
+    mRoutingGeneration++;
+}
+
+audio_devices_t AudioPolicyManager::computeDeviceForStrategy(routing_strategy strategy)
+{
+    uint32_t device = AUDIO_DEVICE_NONE;
+
     audio_devices_t availableOutputDeviceTypes = mAvailableOutputDevices.types();
     switch (strategy) {
 
@@ -4923,6 +5001,10 @@ uint32_t AudioPolicyManager::setOutputDevice(audio_io_handle_t output,
 
     if (device != AUDIO_DEVICE_NONE) {
         outputDesc->mDevice = device;
+        if (device != prevDevice) {
+            // the media strategy depends on the device of the A2DP output
+            invalidateRoutingCache();
+        }
     }
     muteWaitMs = checkDeviceMuteStrategies(outputDesc, prevDevice, delayMs);
 
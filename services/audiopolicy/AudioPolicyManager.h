@@ -596,6 +596,17 @@ protected:
         virtual audio_devices_t getDeviceForStrategy(routing_strategy strategy,
                                                      bool fromCache);
 
+        // determines the device for a strategy from the current state, see getDeviceForStrategy()
+        audio_devices_t computeDeviceForStrategy(routing_strategy strategy);
+
+        // The results of getDeviceForStrategy(strategy, false) and of
+        // getOutputsForDevice(device, mOutputs) are memoized until the routing state changes:
+        // available devices, forced usages, phone state, opened outputs and their devices,
+        // and policy mixes. Whatever changes any of these must call invalidateRoutingCache().
+        // Strategies which also depend on stream activity are never memoized.
+        void invalidateRoutingCache();
+        static bool isRoutingCacheable(routing_strategy strategy);
+
         // change the route of the specified output. Returns the number of ms we have slept to
         // allow new routing to take effect in certain cases.
         virtual uint32_t setOutputDevice(audio_io_handle_t output,
@@ -735,7 +746,7 @@ protected:
         static audio_devices_t getDeviceForVolume(audio_devices_t device);
 
         SortedVector<audio_io_handle_t> getOutputsForDevice(audio_devices_t device,
-                        DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> > openOutputs);
+                const DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> >& openOutputs);
         bool vectorsEqual(SortedVector<audio_io_handle_t>& outputs1,
                                            SortedVector<audio_io_handle_t>& outputs2);
 
@@ -817,6 +828,15 @@ protected:
         StreamDescriptor mStreams[AUDIO_STREAM_CNT];           // stream descriptors for volume control
         bool    mLimitRingtoneVolume;                                       // limit ringtone volume to music volume if headset connected
         audio_devices_t mDeviceForStrategy[NUM_STRATEGIES];
+        // routing cache, see invalidateRoutingCache()
+        uint32_t mRoutingGeneration;                        // incremented on each invalidation
+        audio_devices_t mStrategyDevice[NUM_STRATEGIES];    // getDeviceForStrategy(i, false)
+        uint32_t mStrategyDeviceGeneration[NUM_STRATEGIES]; // generation of mStrategyDevice[i]
+        // getOutputsForDevice(device, mOutputs), indexed by device
+        KeyedVector<audio_devices_t, SortedVector<audio_io_handle_t> > mOutputsForDevice;
+        uint32_t mOutputsForDeviceGeneration;               // generation of mOutputsForDevice
+        uint32_t mRoutingCacheHits;
+        uint32_t mRoutingCacheMisses;
         float   mLastVoiceVolume;                                           // last voice volume value sent to audio HAL
 
         // Maximum CPU load allocated to audio effects in 0.1 MIPS (ARMv5TE, 0 WS memory) units